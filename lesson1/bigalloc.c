@@ -0,0 +1,317 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * bigalloc.c
+ *
+ * Your program never sees physical memory addresses. Every address it uses
+ * is "virtual", and the CPU translates it, one page (usually 4 KiB) at a
+ * time, using a small cache of recent translations called the TLB. A 10 GB
+ * matrix is 2.6 million pages; a column-wise pass over it touches a new page
+ * on almost every element, and misses the TLB nearly every time.
+ *
+ * Huge pages (usually 2 MiB on x86) need 512 times fewer translations.
+ * They aren't always 2 MiB, though (x86 can be set up to use 1 GiB ones,
+ * and ARM with 64 KiB pages has 512 MiB ones), so we ask the kernel.
+ * Linux offers them in two ways:
+ *
+ *   1) MAP_HUGETLB: from a pool of huge pages that the administrator has set
+ *      aside (see /proc/sys/vm/nr_hugepages). Guaranteed huge, but the pool
+ *      is often empty.
+ *   2) Transparent huge pages: ordinary memory that the kernel backs with
+ *      huge pages where it can, if asked with madvise(MADV_HUGEPAGE) (or
+ *      always, depending on /sys/kernel/mm/transparent_hugepage/enabled).
+ *      For this to work the buffer has to be aligned to the huge page size.
+ *
+ * big_alloc() tries them in that order, falling back to plain aligned
+ * memory, and keeps count of what each allocation actually got. You can
+ * force a mode with the BIGALLOC environment variable (hugetlb, thp or
+ * malloc). Buffers smaller than a huge page always come from the heap.
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE   // for MAP_HUGETLB and MADV_HUGEPAGE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "bigalloc.h"
+
+#define  DEFAULT_HUGE_PAGE_SIZE  (2*1024*1024)   // if the kernel won't say
+
+/* We need to remember how each buffer was made, to free it the right way.
+   Big buffers are few, so a simple linked list (with a lock, since any
+   thread might allocate) does the job.
+*/
+struct big_block
+{
+    void *ptr;         // what we gave the caller
+    void *base;        // what we have to give back (mmap'd or malloc'd)
+    size_t length;     // of the mapping at base
+    size_t requested;
+    int mode;
+    struct big_block *next;
+};
+
+static struct big_block *blocks;
+static struct bigalloc_stats stats;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The huge page sizes for MAP_HUGETLB and for transparent huge pages
+static size_t hugetlb_size, thp_size;
+static pthread_once_t sizes_once = PTHREAD_ONCE_INIT;
+
+
+static void read_page_sizes()
+/* MAP_HUGETLB gets the default size of the huge page pool, which is the
+ * Hugepagesize line of /proc/meminfo. Transparent huge pages are the size
+ * that one page table entry can map, which the kernel gives in hpage_pmd_size.
+ * The two usually agree, but needn't.
+ */
+{
+    char line[256];
+    unsigned long n;
+    hugetlb_size = thp_size = DEFAULT_HUGE_PAGE_SIZE;
+
+    FILE *f = fopen( "/proc/meminfo", "r" );
+    if (f != NULL)
+    {
+        while (fgets( line, sizeof(line), f ) != NULL)
+            if (sscanf( line, "Hugepagesize: %lu kB", &n ) == 1 && n > 0)
+                hugetlb_size = n * 1024;
+        fclose( f );
+    }
+
+    f = fopen( "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r" );
+    if (f != NULL)
+    {
+        if (fscanf( f, "%lu", &n ) == 1 && n > 0)
+            thp_size = n;
+        fclose( f );
+    }
+}
+
+
+static int thp_enabled()
+/* Transparent huge pages can be switched off altogether, in which case
+ * madvise() still succeeds, but doesn't do anything.
+ */
+{
+    char line[256] = "";
+    FILE *f = fopen( "/sys/kernel/mm/transparent_hugepage/enabled", "r" );
+    if (f == NULL)
+        return 0;
+    if (fgets( line, sizeof(line), f ) == NULL)
+        line[0] = '\0';
+    fclose( f );
+    return strstr( line, "[never]" ) == NULL && line[0] != '\0';
+}
+
+
+static int forced_mode()
+/* Returns the mode named by the BIGALLOC environment variable, or -1 */
+{
+    const char *env = getenv( "BIGALLOC" );
+    if (env == NULL)                     return -1;
+    if (strcmp( env, "hugetlb" ) == 0)   return BIGALLOC_HUGETLB;
+    if (strcmp( env, "thp" ) == 0)       return BIGALLOC_THP;
+    if (strcmp( env, "malloc" ) == 0)    return BIGALLOC_MALLOC;
+    return -1;
+}
+
+
+static void *try_mmap( size_t bytes, size_t align, int mode, struct big_block *b )
+{
+#ifdef __linux__
+    if (mode == BIGALLOC_HUGETLB)
+    {
+        // Huge page mappings are always huge-page aligned
+        b->length = (bytes + hugetlb_size - 1) / hugetlb_size * hugetlb_size;
+        b->base = mmap( NULL, b->length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+        if (b->base == MAP_FAILED || align > hugetlb_size)
+        {
+            if (b->base != MAP_FAILED)
+                munmap( b->base, b->length );
+            return NULL;
+        }
+        return b->base;
+    }
+
+    if (mode == BIGALLOC_THP && thp_enabled())
+    {
+        /* mmap only promises page alignment, so ask for an extra huge page's
+           worth, and trim off the ends so that what's left is aligned.
+        */
+        if (align < thp_size)
+            align = thp_size;
+        size_t length = (bytes + align - 1) / align * align;
+        char *raw = mmap( NULL, length + align, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if (raw == MAP_FAILED)
+            return NULL;
+
+        char *start = (char *)(((uintptr_t)raw + align - 1) / align * align);
+        if (start > raw)
+            munmap( raw, start - raw );
+        if (start + length < raw + length + align)
+            munmap( start + length, (raw + length + align) - (start + length) );
+
+        if (madvise( start, length, MADV_HUGEPAGE ) != 0)
+        {
+            munmap( start, length );
+            return NULL;
+        }
+        b->base = start;
+        b->length = length;
+        return start;
+    }
+#else
+    (void)bytes; (void)align; (void)mode; (void)b;
+#endif
+    return NULL;
+}
+
+
+void *big_alloc( size_t bytes, size_t align )
+/* Allocate a buffer of the given size, aligned to (at least) align bytes,
+ * on huge pages if possible.
+ *
+ * Memory allocated with this function must be freed with big_free().
+ *
+ * Inputs:
+ *   size_t bytes = the number of bytes to allocate
+ *   size_t align = the alignment required (a power of 2); 0 means 64
+ * Returns:
+ *   void * = a pointer to the buffer, or NULL on failure
+ */
+{
+    struct big_block *b = calloc( 1, sizeof(struct big_block) );
+    if (b == NULL)
+        return NULL;
+    if (align < 64)
+        align = 64;
+    b->requested = bytes;
+    pthread_once( &sizes_once, read_page_sizes );
+
+    int forced = forced_mode();
+    long fallbacks = 0;
+    for (b->mode = (forced >= 0 ? forced : BIGALLOC_HUGETLB); b->mode > BIGALLOC_MALLOC; b->mode--)
+    {
+        // Don't round a buffer up to a (possibly 1 GiB) huge page it can't
+        // fill, or madvise() one that can never get a huge page, unless
+        // that's the mode BIGALLOC asked for
+        size_t page = (b->mode == BIGALLOC_HUGETLB ? hugetlb_size : thp_size);
+        if (b->mode != forced && bytes < page)
+            continue;
+        if ((b->ptr = try_mmap( bytes, align, b->mode, b )) != NULL)
+            break;
+        fallbacks++;
+    }
+
+    if (b->ptr == NULL)
+    {
+        b->mode = BIGALLOC_MALLOC;
+        size_t length = (bytes + align - 1) / align * align;
+        b->base = b->ptr = aligned_alloc( align, length > 0 ? length : align );
+        if (b->ptr == NULL)
+        {
+            free( b );
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock( &lock );
+    b->next = blocks;
+    blocks = b;
+    stats.count[b->mode]++;
+    stats.bytes[b->mode] += bytes;
+    stats.fallbacks += fallbacks;
+    pthread_mutex_unlock( &lock );
+
+    return b->ptr;
+}
+
+
+static struct big_block *unlink_block( void *ptr )
+/* Find (and remove) the record of the buffer at ptr. Call with the lock held */
+{
+    struct big_block **pb;
+    for (pb = &blocks; *pb != NULL; pb = &(*pb)->next)
+        if ((*pb)->ptr == ptr)
+        {
+            struct big_block *b = *pb;
+            *pb = b->next;
+            return b;
+        }
+    return NULL;
+}
+
+
+void big_free( void *ptr )
+/* Free a buffer allocated with big_alloc() */
+{
+    if (ptr == NULL)
+        return;
+
+    pthread_mutex_lock( &lock );
+    struct big_block *b = unlink_block( ptr );
+    pthread_mutex_unlock( &lock );
+
+    if (b == NULL)
+    {
+        fprintf( stderr, "error: big_free: %p was not allocated with big_alloc\n", ptr );
+        abort();
+    }
+
+#ifdef __linux__
+    if (b->mode != BIGALLOC_MALLOC)
+        munmap( b->base, b->length );
+    else
+#endif
+        free( b->base );
+    free( b );
+}
+
+
+int big_alloc_mode( void *ptr )
+/* Returns the BIGALLOC_* mode that the buffer at ptr got, or -1 if it isn't
+ * one of ours.
+ */
+{
+    int mode = -1;
+    pthread_mutex_lock( &lock );
+    for (struct big_block *b = blocks; b != NULL; b = b->next)
+        if (b->ptr == ptr)
+            mode = b->mode;
+    pthread_mutex_unlock( &lock );
+    return mode;
+}
+
+
+void bigalloc_get_stats( struct bigalloc_stats *s )
+{
+    pthread_mutex_lock( &lock );
+    *s = stats;
+    pthread_mutex_unlock( &lock );
+}
+
+
+void bigalloc_print_stats( FILE *f )
+{
+    static const char *names[BIGALLOC_NMODES] = { "malloc", "thp", "hugetlb" };
+    struct bigalloc_stats s;
+    bigalloc_get_stats( &s );
+
+    fprintf( f, "big_alloc:" );
+    for (int m = 0; m < BIGALLOC_NMODES; m++)
+        fprintf( f, " %s %ld (%.1f MiB)%s", names[m], s.count[m],
+                 s.bytes[m] / (1024.0*1024.0), m < BIGALLOC_NMODES - 1 ? "," : "" );
+    fprintf( f, "; %ld fallback(s)\n", s.fallbacks );
+}
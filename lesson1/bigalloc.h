@@ -0,0 +1,33 @@
+/*****************************************************************************
+ * bigalloc.h
+ *
+ * Allocating large buffers on huge pages. See bigalloc.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef BIGALLOC_H
+#define BIGALLOC_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// The ways an allocation can end up being made
+#define  BIGALLOC_MALLOC   0   // ordinary (aligned) heap memory
+#define  BIGALLOC_THP      1   // mmap + madvise(MADV_HUGEPAGE): transparent huge pages
+#define  BIGALLOC_HUGETLB  2   // mmap with MAP_HUGETLB: reserved huge pages
+#define  BIGALLOC_NMODES   3
+
+struct bigalloc_stats
+{
+    long   count[BIGALLOC_NMODES];   // allocations that got each mode
+    size_t bytes[BIGALLOC_NMODES];   // ... and how many bytes they asked for
+    long   fallbacks;                // times a mode was tried and failed
+};
+
+void *big_alloc( size_t, size_t );
+void big_free( void * );
+int big_alloc_mode( void * );
+void bigalloc_get_stats( struct bigalloc_stats * );
+void bigalloc_print_stats( FILE * );
+
+#endif
@@ -9,13 +9,19 @@
  * the C language and syntax a bit better.
  *
  * This program generates a 100x100 matrix, populates it with values,
- * and writes it out to two files: one in binary and one in ascii.
+ * and writes it out to two files: one in binary and one in ascii. (Plus a
+ * third, the binary one's "pyramid" of smaller copies, for looking at it
+ * quickly: see pyramid.c.)
  *
  *****************************************************************************/
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include "bigalloc.h"
+#include "matrix_codec.h"
+#include "pyramid.h"
+#include "ripples.h"
 
 /* Below are "preprocessor macros". The first stage of the compiler is the
    preprocessing stage, in which these macros are expanded in the rest of the
@@ -36,9 +42,8 @@ void usage();
 double **create_matrix( int, int );
 void destroy_matrix( double **, int );
 
-void make_ripples( double **, int, int );
-
-void write_matrix( FILE *, double **, int, int, int );
+void write_matrix( FILE *, double **, int, int, int, struct pyramid_builder * );
+void write_encoded( const char *, double **, int, int, const char * );
 
 
 int main( int argc, char *argv[] )
@@ -64,6 +69,7 @@ int main( int argc, char *argv[] )
 
     char binfile[MAX_STR_LENGTH];  // <-- Remember, MAX_STR_LENGTH is defined
     char txtfile[MAX_STR_LENGTH];  //     in the preprocessor macro as 1024
+    char pyrfile[MAX_STR_LENGTH];
 
     /* sprintf is like printf, but it writes the contents to the memory
        address pointed at by the first argument instead of printing it to
@@ -71,6 +77,7 @@ int main( int argc, char *argv[] )
     */
     sprintf( binfile, "%s.bin", argv[1] );
     sprintf( txtfile, "%s.txt", argv[1] );
+    sprintf( pyrfile, "%s.pyr", argv[1] );
 
     // Open two files for writing
     FILE *f_bin = fopen( binfile, "w" ); // FILE * is a type defined in stdio.h
@@ -79,23 +86,55 @@ int main( int argc, char *argv[] )
     // Allocate memory for a 100x100 matrix
     int rows = 100, cols = 100; /* <-- a way of combining multiple declarations
                                        and instantiations on one line */
+
+    // ... unless the user asked for a different size
+    if (argc >= 4)
+    {
+        rows = atoi( argv[2] );  // atoi ("ascii to int") is in stdlib.h
+        cols = atoi( argv[3] );
+    }
+
     double **M = create_matrix( rows, cols );
+    if (M == NULL)
+    {
+        fprintf( stderr, "error: could not allocate a %dx%d matrix\n", rows, cols );
+        exit(EXIT_FAILURE);
+    }
 
     // Populate the matrix array with some values, using my own function
-    // (see below for function definition)
+    // (see ripples.c for its definition)
     make_ripples( M, rows, cols );
 
-    // Write out the matrix to the two files
-    write_matrix( f_bin, M, rows, cols, BINARY );
-    write_matrix( f_txt, M, rows, cols, ASCII );
+    // Write out the matrix to the two files, building the pyramid from the
+    // binary one as it goes out (an empty matrix doesn't get one)
+    struct pyramid_builder *pyr = NULL;
+    if (rows > 0 && cols > 0 && (pyr = pyramid_create( pyrfile, rows, cols )) == NULL)
+    {
+        fprintf( stderr, "error: could not start writing %s\n", pyrfile );
+        exit(EXIT_FAILURE);
+    }
+    write_matrix( f_bin, M, rows, cols, BINARY, pyr );
+    write_matrix( f_txt, M, rows, cols, ASCII, NULL );
+    if (pyr != NULL && pyramid_finish( pyr ) != 0)
+    {
+        fprintf( stderr, "error: could not write %s\n", pyrfile );
+        exit(EXIT_FAILURE);
+    }
 
     // Close the files
     fclose( f_bin );
     fclose( f_txt );
 
+    // If asked, also write a smaller, encoded copy (see matrix_codec.c)
+    if (argc >= 5)
+        write_encoded( argv[1], M, rows, cols, argv[4] );
+
     // Free memory for matrix
     destroy_matrix( M, rows );
 
+    // Report what kind of memory the matrix got (see bigalloc.c)
+    bigalloc_print_stats( stdout );
+
     return EXIT_SUCCESS;
 }
 
@@ -108,10 +147,14 @@ void usage()
  * Returns: (NONE)
  */
 {
-    printf( "usage: fileio [basename]\n\n" );
+    printf( "usage: fileio [basename] [rows cols [encoding]]\n\n" );
     printf( "This program will write out matrix data to two files:\n" );
     printf( "  [basename].bin  and  [basename].txt,\n" );
-    printf( "in binary and ascii formats, respectively.\n" );
+    printf( "in binary and ascii formats, respectively, and smaller copies\n" );
+    printf( "of it for previews to [basename].pyr (see pyramid.c).\n" );
+    printf( "The matrix is 100x100, unless rows and cols are given.\n" );
+    printf( "If an encoding (f64, f32, f16, bf16, i16 or i8) is given, it\n" );
+    printf( "also writes [basename].[encoding], with fewer bytes per number.\n" );
 }
 
 double **create_matrix( int rows, int cols )
@@ -125,18 +168,38 @@ double **create_matrix( int rows, int cols )
  *   int rows  = the number of rows
  *   int cols  = the number of cols
  * Returns:
- *   double ** = a pointer to the newly allocated memory
+ *   double ** = a pointer to the newly allocated memory (or NULL if the
+ *               memory couldn't be allocated)
  */
 {
-    // Allocate memory for a matrix with the requested size
+    // Allocate memory for a matrix with the requested size (with at least one
+    // row pointer, even if there are no rows: see below)
     double **M;
-    M = (double **)malloc( rows * sizeof(double *) );
+    M = (double **)malloc( (rows > 0 ? rows : 1) * sizeof(double *) );
+    if (M == NULL)
+        return NULL;
+
+    /* We could allocate memory for each row separately (see example3() in
+       heap_memory.c), but big matrices are faster to work with if all their
+       elements are in one contiguous block, which big_alloc() can put on
+       "huge pages" (see bigalloc.c for why that helps). Each row pointer
+       then just points to the start of its row within the block.
+    */
+    double *data = (double *)big_alloc( (size_t)rows * cols * sizeof(double), 0 );
+    if (data == NULL)
+    {
+        free( M );
+        return NULL;
+    }
 
-    // Allocate memory for each row
+    /* M[0] is always the start of the block, which is how destroy_matrix()
+       finds it again, even for a matrix with no rows.
+    */
+    M[0] = data;
     int r;
     for (r = 0; r < rows; r++)
     {
-        M[r] = (double *)malloc( cols * sizeof(double) );
+        M[r] = data + (size_t)r * cols;
     }
 
     return M;
@@ -155,56 +218,19 @@ void destroy_matrix( double **M, int rows )
  *   (NONE)
  */
 {
-    // Free memory for each row
-    int r;
-    for (r = 0; r < rows; r++)
-    {
-        free( M[r] );
-    }
+    (void)rows; // <-- no longer needed, but this tells the compiler it's okay
+
+    // All the rows live in one block, which create_matrix() keeps in M[0]
+    // (whether or not there are any rows)
+    big_free( M[0] );
 
     // Free the top-level allocation
     free( M );
 }
 
 
-void make_ripples( double **M, int rows, int cols )
-/* This function will populate matrix element r,c with the values between 0.0
- * and 1.0 such that they form a pattern of concentric ripples spreading out
- * from the centre of the array.
- *
- * Inputs:
- *   double **M = the 2D array to be populated
- *   int rows   = the number of rows in M
- *   int cols   = the number of columns in M
- */
-{
-    // First, find the centre of the array
-    int xc = cols / 2; // <-- Integer division!!
-    int yc = rows / 2;
-
-    // Some variables to help calculate the ripples
-
-    double dist; // i.e. distance from centre
-
-    double ripple_size = (rows < cols ? rows / 6.0 : cols / 6.0);
-    /*                                ^            ^
-       C-style ternary operator! -----+------------+
-       (COND ? X : Y) is shorthand for
-       if (COND is true), use value X, otherwise use Y
-    */
-
-    // Now, iterate through the array elements
-    int r, c;    // to iterate through (r)ows and (c)olumns, respectively
-    for (r = 0; r < rows; r++)
-    for (c = 0; c < cols; c++)
-    {
-        // In the following, "hypot", "cos", and "M_PI" are all from math.h
-        dist = hypot( c-xc, r-yc );
-        M[r][c] = cos( 2.0 * M_PI * dist / ripple_size );
-    }
-}
-
-void write_matrix( FILE *f, double **M, int rows, int cols, int write_type )
+void write_matrix( FILE *f, double **M, int rows, int cols, int write_type,
+                   struct pyramid_builder *pyr )
 /* This function will write the contents of a 2D matrix to file.
  *
  * Inputs:
@@ -217,6 +243,8 @@ void write_matrix( FILE *f, double **M, int rows, int cols, int write_type )
  *                    elements of M are written out in binary format;
  *                    if ASCII, they are written out in ascii format.
  *                    Anything else will cause a failure.
+ *   struct pyramid_builder *pyr = if not NULL, each row also goes into
+ *                    this pyramid (see pyramid.c) as it's written out
  *
  * Returns: (NONE)
  */
@@ -226,7 +254,15 @@ void write_matrix( FILE *f, double **M, int rows, int cols, int write_type )
     {
         case BINARY:
             for (r = 0; r < rows; r++)
+            {
                 fwrite( M[r], sizeof(double), cols, f ); // see 'man fwrite'
+                if (pyr != NULL && pyramid_add_rows( pyr, &M[r], 1 ) != 0)
+                {
+                    fprintf( stderr, "error: write_matrix: could not add "
+                                     "row %d to the pyramid\n", r );
+                    exit(EXIT_FAILURE);
+                }
+            }
             break;
         case ASCII:
             for (r = 0; r < rows; r++)
@@ -243,3 +279,57 @@ void write_matrix( FILE *f, double **M, int rows, int cols, int write_type )
             exit(EXIT_FAILURE);
     }
 }
+
+void write_encoded( const char *basename, double **M, int rows, int cols, const char *encoding )
+/* This function writes M to the file [basename].[encoding], using one of
+ * the encodings in matrix_codec.c, then reads it back to see how much
+ * precision was lost.
+ *
+ * Inputs:
+ *   const char *basename = the start of the filename
+ *   double **M           = the matrix to write
+ *   int rows             = the number of rows in M
+ *   int cols             = the number of cols in M
+ *   const char *encoding = the name of the encoding, e.g. "f16"
+ */
+{
+    int enc = encoding_from_name( encoding );
+    if (enc < 0)
+    {
+        fprintf( stderr, "error: unknown encoding '%s'\n", encoding );
+        exit(EXIT_FAILURE);
+    }
+
+    char filename[MAX_STR_LENGTH];
+    sprintf( filename, "%s.%s", basename, encoding );
+
+    FILE *f = fopen( filename, "w" );
+    if (f == NULL || write_matrix_encoded( f, M, rows, cols, enc ) != 0)
+    {
+        fprintf( stderr, "error: could not write %s\n", filename );
+        exit(EXIT_FAILURE);
+    }
+    fclose( f );
+
+    // Read it back, as doubles, into a second matrix
+    struct matrix_header h;
+    double **N = create_matrix( rows, cols );
+    f = fopen( filename, "r" );
+    if (N == NULL || f == NULL || read_matrix_header( f, &h ) != 0 ||
+        read_matrix_decoded( f, &h, N ) != 0)
+    {
+        fprintf( stderr, "error: could not read back %s\n", filename );
+        exit(EXIT_FAILURE);
+    }
+    fclose( f );
+
+    double max_error = 0.0;
+    int r, c;
+    for (r = 0; r < rows; r++)
+        for (c = 0; c < cols; c++)
+            max_error = fmax( max_error, fabs( N[r][c] - M[r][c] ) );
+    destroy_matrix( N, rows );
+
+    printf( "%s: %zu bytes per number (instead of %zu), largest error %g\n",
+            filename, encoding_size( enc ), sizeof(double), max_error );
+}
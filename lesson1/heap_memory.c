@@ -12,9 +12,10 @@
  *
  *****************************************************************************/
 
-#include <stdlib.h> // <-- 'malloc', 'free', 'srand', 'rand' defined here
-#include <stdio.h>  // <-- 'printf', 'fprintf'               defined here
-#include <time.h>   // <-- 'time'                            defined here
+#include <stdlib.h> // <-- 'malloc', 'free'                defined here
+#include <stdio.h>  // <-- 'printf', 'fprintf'             defined here
+#include <time.h>   // <-- 'time'                          defined here
+#include "prng.h"   // <-- 'prng_fill_int'                 defined here
 
 void example1();
 void example2();
@@ -37,9 +38,6 @@ void example3();
 
 int main()
 {
-    // Seed the random number generator
-    srand( time( NULL ) );
-
     example1(); // Allocating a 1D array on the heap
 
     //example2(); // Allocating a contiguous 2D array on the heap
@@ -95,14 +93,23 @@ void example1()
         exit(1);
     }
 
-    // Now let's fill it with random values between 10 and 15 inclusive
-    int idx;
-    for (idx = 0; idx < arr_size; idx++)
-    {
-        arr[idx] = (rand() % 6) + 10; // Introducing '%' = "mod operator"
-    }
+    /* Now let's fill it with random values between 10 and 15 inclusive.
+       The classic way to do that is with rand() from stdlib.h:
+
+         for (idx = 0; idx < arr_size; idx++)
+             arr[idx] = (rand() % 6) + 10; // '%' = "mod operator"
+
+       but for big arrays rand() is slow, can't be shared fairly between
+       threads, and '%' makes some values very slightly more likely than
+       others. prng.c has a better way (see the comments there). The last
+       two arguments are the "seed" (we use the current time, so that each
+       run is different) and a "stream" number (for when several parts of
+       a program each want their own random numbers).
+    */
+    prng_fill_int( arr, arr_size, 10, 15, time( NULL ), 0 );
 
     // Print out the first few values
+    int idx;
     printf( "Some random integers, 10 <= x <= 15:\n  [ " );
     for (idx = 0; idx < 5; idx++)
     {
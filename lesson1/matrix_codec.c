@@ -0,0 +1,423 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * matrix_codec.c
+ *
+ * A double has about 16 significant digits. The ripples in fileio.c are
+ * between -1 and 1, and nobody is going to look at more than the first
+ * three or four of those digits. Storing fewer bytes per number makes the
+ * files smaller and quicker to write and read, in exchange for a (known,
+ * bounded) loss of precision:
+ *
+ *   encoding  bytes  precision
+ *   f64       8      ~16 digits (no loss)
+ *   f32       4      ~7 digits
+ *   f16       2      ~3 digits, and only up to +/-65504
+ *   bf16      2      ~2 digits, but the same range as a float
+ *   i16       2      range/65534: evenly spaced steps between min and max
+ *   i8        1      range/254
+ *
+ * For i16 and i8, each number x is stored as the integer nearest to
+ * (x - offset) / scale, where offset and scale are chosen from the smallest
+ * and biggest numbers in the matrix so that they just fit ("quantisation").
+ *
+ * An encoded file starts with a small header (struct matrix_header), so that
+ * the reader knows the size of the matrix, how it was encoded, and the scale
+ * and offset. It can then either turn the numbers back into doubles, or
+ * keep them as they are (e.g. to hand them to a GPU).
+ *
+ * The conversion loops are written so that the compiler can vectorise them
+ * (and this file is compiled with -O3). Half precision has its own
+ * instructions on newer x86 CPUs (F16C); compile with -mf16c (or
+ * -march=native) to use them.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "matrix_codec.h"
+
+static const char *names[ENC_COUNT] = { "f64", "f32", "f16", "bf16", "i16", "i8" };
+static const size_t sizes[ENC_COUNT] = { 8, 4, 2, 2, 2, 1 };
+
+
+const char *encoding_name( int enc )
+{
+    return (enc >= 0 && enc < ENC_COUNT ? names[enc] : "unknown");
+}
+
+int encoding_from_name( const char *name )
+/* e.g. "f16" -> ENC_F16. Returns -1 for names it doesn't know. */
+{
+    int enc;
+    for (enc = 0; enc < ENC_COUNT; enc++)
+        if (strcmp( name, names[enc] ) == 0)
+            return enc;
+    return -1;
+}
+
+size_t encoding_size( int enc )
+/* Bytes per number */
+{
+    return (enc >= 0 && enc < ENC_COUNT ? sizes[enc] : 0);
+}
+
+/*****************************************************************************
+ * Half precision and bfloat16, one number at a time
+ *****************************************************************************/
+
+static inline uint32_t float_bits( float f )
+{
+    uint32_t u;
+    memcpy( &u, &f, sizeof(u) );   // (the safe way to look at a float's bits)
+    return u;
+}
+
+static inline float bits_float( uint32_t u )
+{
+    float f;
+    memcpy( &f, &u, sizeof(f) );
+    return f;
+}
+
+
+static inline uint16_t float_to_half( float f )
+/* A float has 8 bits of exponent and 23 of mantissa; a half has 5 and 10.
+ * Re-bias the exponent, and round the mantissa to the nearest (ties to
+ * even), taking care of numbers too big (-> infinity) and too small (->
+ * "subnormal" halves, which have no implicit leading 1).
+ */
+{
+    uint32_t x = float_bits( f );
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t a = x & 0x7fffffff;
+
+    if (a >= 0x7f800000)                      // infinity or NaN
+        return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 : 0);
+    if (a >= 0x477ff000)                      // rounds to more than 65504
+        return sign | 0x7c00;
+    if (a < 0x38800000)                       // below 2^-14: subnormal (or zero)
+        return sign | (uint16_t)lrintf( bits_float( a ) * 16777216.0f );
+
+    a -= 0x38000000;                          // exponent bias 127 -> 15
+    a += 0x0fff + ((a >> 13) & 1);            // round to nearest, ties to even
+    return sign | (a >> 13);
+}
+
+
+static inline float half_to_float( uint16_t h )
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t e = (h >> 10) & 0x1f;
+    uint32_t m = h & 0x3ff;
+
+    if (e == 0)                               // subnormal (or zero)
+        return bits_float( sign | float_bits( m * (1.0f / 16777216.0f) ) );
+    if (e == 31)                              // infinity or NaN
+        return bits_float( sign | 0x7f800000 | (m << 13) );
+    return bits_float( sign | ((e + 112) << 23) | (m << 13) );
+}
+
+
+static inline uint16_t float_to_bf16( float f )
+/* Keep the top 16 bits, rounding to the nearest (ties to even) */
+{
+    uint32_t x = float_bits( f );
+    if ((x & 0x7fffffff) > 0x7f800000)        // NaN: don't round it into infinity
+        return (x >> 16) | 0x40;
+    return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+
+static inline float bf16_to_float( uint16_t b )
+{
+    return bits_float( (uint32_t)b << 16 );
+}
+
+/*****************************************************************************
+ * Whole arrays
+ *****************************************************************************/
+
+static inline double clamp( double v, double lo, double hi )
+{
+    return (v < lo ? lo : v > hi ? hi : v);
+}
+
+
+void encode_doubles( int enc, const double *src, void *dst, size_t n, double scale, double offset )
+/* Convert n doubles to the given encoding.
+ *
+ * Inputs:
+ *   int enc           = the encoding (ENC_...)
+ *   const double *src = the numbers
+ *   void *dst         = where to put them (n * encoding_size( enc ) bytes)
+ *   size_t n          = how many
+ *   double scale      = (for ENC_I16 and ENC_I8; see choose_quantization())
+ *   double offset     =               "
+ */
+{
+    size_t i;
+    double inv = (scale != 0.0 ? 1.0 / scale : 0.0);
+
+    switch (enc)
+    {
+        case ENC_F64:
+            memcpy( dst, src, n * sizeof(double) );
+            break;
+
+        case ENC_F32:
+        {
+            float *d = dst;
+            for (i = 0; i < n; i++)
+                d[i] = (float)src[i];
+            break;
+        }
+
+        case ENC_F16:
+        {
+            uint16_t *d = dst;
+            i = 0;
+#ifdef __F16C__
+            // Eight at a time, with the CPU's own instruction
+            for ( ; i + 8 <= n; i += 8)
+            {
+                __m256 f = _mm256_set_m128( _mm256_cvtpd_ps( _mm256_loadu_pd( src + i + 4 ) ),
+                                            _mm256_cvtpd_ps( _mm256_loadu_pd( src + i ) ) );
+                _mm_storeu_si128( (__m128i *)(d + i),
+                                  _mm256_cvtps_ph( f, _MM_FROUND_TO_NEAREST_INT ) );
+            }
+#endif
+            for ( ; i < n; i++)
+                d[i] = float_to_half( (float)src[i] );
+            break;
+        }
+
+        case ENC_BF16:
+        {
+            uint16_t *d = dst;
+            for (i = 0; i < n; i++)
+                d[i] = float_to_bf16( (float)src[i] );
+            break;
+        }
+
+        /* Rounding to the nearest integer by adding +/-0.5 and truncating
+           (rather than calling lround()) is what lets these vectorise */
+        case ENC_I16:
+        {
+            int16_t *d = dst;
+            for (i = 0; i < n; i++)
+            {
+                double v = clamp( (src[i] - offset) * inv, -32767.0, 32767.0 );
+                d[i] = (int16_t)(v + (v >= 0 ? 0.5 : -0.5));
+            }
+            break;
+        }
+
+        case ENC_I8:
+        {
+            int8_t *d = dst;
+            for (i = 0; i < n; i++)
+            {
+                double v = clamp( (src[i] - offset) * inv, -127.0, 127.0 );
+                d[i] = (int8_t)(v + (v >= 0 ? 0.5 : -0.5));
+            }
+            break;
+        }
+    }
+}
+
+
+void decode_doubles( int enc, const void *src, double *dst, size_t n, double scale, double offset )
+/* The reverse of encode_doubles() */
+{
+    size_t i;
+    switch (enc)
+    {
+        case ENC_F64:
+            memcpy( dst, src, n * sizeof(double) );
+            break;
+
+        case ENC_F32:
+        {
+            const float *s = src;
+            for (i = 0; i < n; i++)
+                dst[i] = s[i];
+            break;
+        }
+
+        case ENC_F16:
+        {
+            const uint16_t *s = src;
+            i = 0;
+#ifdef __F16C__
+            for ( ; i + 8 <= n; i += 8)
+            {
+                __m256 f = _mm256_cvtph_ps( _mm_loadu_si128( (const __m128i *)(s + i) ) );
+                _mm256_storeu_pd( dst + i,     _mm256_cvtps_pd( _mm256_castps256_ps128( f ) ) );
+                _mm256_storeu_pd( dst + i + 4, _mm256_cvtps_pd( _mm256_extractf128_ps( f, 1 ) ) );
+            }
+#endif
+            for ( ; i < n; i++)
+                dst[i] = half_to_float( s[i] );
+            break;
+        }
+
+        case ENC_BF16:
+        {
+            const uint16_t *s = src;
+            for (i = 0; i < n; i++)
+                dst[i] = bf16_to_float( s[i] );
+            break;
+        }
+
+        case ENC_I16:
+        {
+            const int16_t *s = src;
+            for (i = 0; i < n; i++)
+                dst[i] = offset + scale * s[i];
+            break;
+        }
+
+        case ENC_I8:
+        {
+            const int8_t *s = src;
+            for (i = 0; i < n; i++)
+                dst[i] = offset + scale * s[i];
+            break;
+        }
+    }
+}
+
+
+void choose_quantization( int enc, double **M, int rows, int cols, double *scale, double *offset )
+/* The scale and offset that map the smallest and biggest (finite) elements
+ * of M onto the ends of the integer range of enc. The worst error is then
+ * scale/2. (For the other encodings, scale = 1 and offset = 0.)
+ */
+{
+    *scale = 1.0;
+    *offset = 0.0;
+    if (enc != ENC_I16 && enc != ENC_I8)
+        return;
+
+    double lo = INFINITY, hi = -INFINITY;
+    int r, c;
+    for (r = 0; r < rows; r++)
+        for (c = 0; c < cols; c++)
+            if (isfinite( M[r][c] ))
+            {
+                lo = fmin( lo, M[r][c] );
+                hi = fmax( hi, M[r][c] );
+            }
+    if (lo > hi)   // (no finite elements at all)
+        return;
+
+    double steps = (enc == ENC_I16 ? 32767.0 : 127.0);
+    *offset = (lo + hi) / 2.0;
+    *scale = (hi > lo ? (hi - lo) / (2.0 * steps) : 1.0);
+}
+
+/*****************************************************************************
+ * Files
+ *****************************************************************************/
+
+int write_matrix_encoded( FILE *f, double **M, int rows, int cols, int enc )
+/* Write a header and then M, in the given encoding.
+ *
+ * Inputs:
+ *   FILE *f    = the file (already open for writing)
+ *   double **M = the matrix
+ *   int rows   = the number of rows in M
+ *   int cols   = the number of cols in M
+ *   int enc    = the encoding (ENC_...)
+ * Returns:
+ *   int = 0 on success, -1 on failure
+ */
+{
+    if (enc < 0 || enc >= ENC_COUNT)
+        return -1;
+
+    struct matrix_header h;
+    memset( &h, 0, sizeof(h) );
+    memcpy( h.magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC) );
+    h.encoding = enc;
+    h.rows = rows;
+    h.cols = cols;
+    choose_quantization( enc, M, rows, cols, &h.scale, &h.offset );
+    if (fwrite( &h, sizeof(h), 1, f ) != 1)
+        return -1;
+
+    // One row at a time, through a buffer of the encoded row
+    void *row = malloc( (cols > 0 ? cols : 1) * encoding_size( enc ) );
+    if (row == NULL)
+        return -1;
+    int r, failed = 0;
+    for (r = 0; r < rows && !failed; r++)
+    {
+        encode_doubles( enc, M[r], row, cols, h.scale, h.offset );
+        failed = (fwrite( row, encoding_size( enc ), cols, f ) != (size_t)cols);
+    }
+    free( row );
+    return (failed ? -1 : 0);
+}
+
+
+int read_matrix_header( FILE *f, struct matrix_header *h )
+/* Read and check the header of a file written by write_matrix_encoded().
+ * Returns 0 on success, -1 if it isn't one.
+ */
+{
+    if (fread( h, sizeof(*h), 1, f ) != 1 ||
+        memcmp( h->magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC) ) != 0 ||
+        h->encoding < 0 || h->encoding >= ENC_COUNT ||
+        h->rows < 0 || h->cols < 0)
+        return -1;
+    return 0;
+}
+
+
+int read_matrix_decoded( FILE *f, const struct matrix_header *h, double **M )
+/* After read_matrix_header(), read the numbers into M (already allocated,
+ * h->rows x h->cols), turning them back into doubles.
+ * Returns 0 on success, -1 on failure.
+ */
+{
+    size_t size = encoding_size( h->encoding );
+    void *row = malloc( (h->cols > 0 ? h->cols : 1) * size );
+    if (row == NULL)
+        return -1;
+    int r, failed = 0;
+    for (r = 0; r < h->rows && !failed; r++)
+    {
+        failed = (fread( row, size, h->cols, f ) != (size_t)h->cols);
+        if (!failed)
+            decode_doubles( h->encoding, row, M[r], h->cols, h->scale, h->offset );
+    }
+    free( row );
+    return (failed ? -1 : 0);
+}
+
+
+void *read_matrix_raw( FILE *f, const struct matrix_header *h )
+/* After read_matrix_header(), read the numbers as they are stored (e.g. as
+ * uint16_t halves for ENC_F16), into one new row-major block, which the
+ * caller should free(). Returns NULL on failure.
+ */
+{
+    size_t n = (size_t)h->rows * h->cols;
+    size_t size = encoding_size( h->encoding );
+    void *data = malloc( (n > 0 ? n : 1) * size );
+    if (data != NULL && fread( data, size, n, f ) != n)
+    {
+        free( data );
+        return NULL;
+    }
+    return data;
+}
@@ -0,0 +1,54 @@
+/*****************************************************************************
+ * matrix_codec.h
+ *
+ * Storing matrices with fewer bytes per number. See matrix_codec.c for
+ * details.
+ *
+ *****************************************************************************/
+
+#ifndef MATRIX_CODEC_H
+#define MATRIX_CODEC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// How each number is stored
+#define  ENC_F64   0   // double (8 bytes, as write_matrix( ..., BINARY ))
+#define  ENC_F32   1   // float (4 bytes)
+#define  ENC_F16   2   // IEEE half precision (2 bytes)
+#define  ENC_BF16  3   // "brain float": a float with the bottom 16 bits cut off
+#define  ENC_I16   4   // offset + scale * (a 16-bit integer)
+#define  ENC_I8    5   // offset + scale * (an 8-bit integer)
+#define  ENC_COUNT 6
+
+#define  MATRIX_MAGIC  "MATRIX1"
+
+/* The start of an encoded matrix file. The numbers follow straight after,
+   row by row, in the byte order of the machine that wrote them.
+*/
+struct matrix_header
+{
+    char    magic[8];
+    int32_t encoding;
+    int32_t rows;
+    int32_t cols;
+    int32_t reserved;
+    double  scale;      // for ENC_I16 and ENC_I8
+    double  offset;
+};
+
+const char *encoding_name( int );
+int    encoding_from_name( const char * );
+size_t encoding_size( int );
+
+void encode_doubles( int, const double *, void *, size_t, double, double );
+void decode_doubles( int, const void *, double *, size_t, double, double );
+void choose_quantization( int, double **, int, int, double *, double * );
+
+int   write_matrix_encoded( FILE *, double **, int, int, int );
+int   read_matrix_header( FILE *, struct matrix_header * );
+int   read_matrix_decoded( FILE *, const struct matrix_header *, double ** );
+void *read_matrix_raw( FILE *, const struct matrix_header * );
+
+#endif
@@ -0,0 +1,710 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * matrix_io.c
+ *
+ * fwrite() in fileio.c is "blocking": the program stops until the operating
+ * system has taken the data. With one request at a time, a fast disk (which
+ * can work on dozens of requests at once) sits mostly idle, and so does the
+ * program. Asynchronous I/O separates the two halves: "submit" a request,
+ * carry on working, and find out later that it has "completed".
+ *
+ * Linux's io_uring does this with two ring buffers shared between the
+ * program and the kernel (see "man io_uring"):
+ *
+ *   the submission queue (SQ), where we put requests ("write these bytes to
+ *   this file at this offset"), and
+ *   the completion queue (CQ), where the kernel puts the results.
+ *
+ * Putting a request in the SQ is just writing to memory; one system call,
+ * io_uring_enter(), tells the kernel about all the new ones at once, and can
+ * also wait for completions. We use the system calls directly, so there's
+ * no library to install.
+ *
+ * Buffers can also be "registered" in advance, which saves the kernel from
+ * looking up (and pinning) the pages of the buffer on every request. Any
+ * request that falls inside a registered buffer uses it automatically.
+ *
+ * Not every kernel has io_uring (it arrived in 5.1, and some systems switch
+ * it off), so if it can't be set up, the same functions use a pool of
+ * threads that each call pwrite()/pread(). Either way, completion callbacks
+ * are only ever called from mio_wait() (or mio_drain()), in the thread that
+ * called it, so they don't need any locking.
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "matrix_io.h"
+
+#define  MIO_MAX_BUFFERS  16
+#define  MIO_MAX_THREADS  16
+
+#define  OP_READ   0
+#define  OP_WRITE  1
+
+struct mio_request
+{
+    int op;
+    int fd;
+    char *buf;
+    size_t len;
+    off_t off;
+    size_t done;             // bytes transferred so far
+    long result;
+    int buf_index;           // registered buffer, or -1
+    mio_callback cb;
+    void *arg;
+    struct mio_request *next;
+};
+
+struct mio
+{
+    int backend;
+    int depth;
+    int inflight;
+    struct mio_request *requests;    // depth of them
+    struct mio_request *free_list;
+
+    // Registered buffers
+    int nbufs;
+    struct iovec bufs[MIO_MAX_BUFFERS];
+
+    // io_uring
+    int ring_fd;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *sqes;
+    void *cqes;
+    unsigned unsubmitted;
+
+    // Thread pool
+    int nthreads;
+    pthread_t threads[MIO_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    struct mio_request *queue, *queue_tail, *finished;
+    int stopping;
+};
+
+/*****************************************************************************
+ * io_uring
+ *****************************************************************************/
+
+#ifdef __NR_io_uring_setup
+
+static int ring_setup( struct mio *m )
+/* Create the rings and map them into our memory. Returns 0 or -1. */
+{
+    struct io_uring_params p;
+    memset( &p, 0, sizeof(p) );
+    m->ring_fd = syscall( __NR_io_uring_setup, m->depth, &p );
+    if (m->ring_fd < 0)
+        return -1;
+
+    m->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    // Newer kernels let both rings share one mapping
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m->cq_size > m->sq_size)
+            m->sq_size = m->cq_size;
+        m->cq_size = 0;
+    }
+
+    m->sq_ptr = mmap( NULL, m->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m->ring_fd, IORING_OFF_SQ_RING );
+    if (m->sq_ptr == MAP_FAILED)
+        goto fail;
+
+    if (m->cq_size == 0)
+        m->cq_ptr = m->sq_ptr;
+    else
+    {
+        m->cq_ptr = mmap( NULL, m->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          m->ring_fd, IORING_OFF_CQ_RING );
+        if (m->cq_ptr == MAP_FAILED)
+        {
+            munmap( m->sq_ptr, m->sq_size );
+            goto fail;
+        }
+    }
+
+    m->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m->sqes = mmap( NULL, m->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m->ring_fd, IORING_OFF_SQES );
+    if (m->sqes == MAP_FAILED)
+    {
+        munmap( m->sq_ptr, m->sq_size );
+        if (m->cq_size)
+            munmap( m->cq_ptr, m->cq_size );
+        goto fail;
+    }
+
+    char *sq = m->sq_ptr, *cq = m->cq_ptr;
+    m->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    m->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    m->sq_array = (unsigned *)(sq + p.sq_off.array);
+    m->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    m->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    m->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    m->cqes     = cq + p.cq_off.cqes;
+
+    // The kernel may round the queue up; we never have more than depth in flight
+    return 0;
+
+fail:
+    close( m->ring_fd );
+    m->ring_fd = -1;
+    return -1;
+}
+
+
+static void ring_teardown( struct mio *m )
+{
+    munmap( m->sqes, m->sqes_size );
+    if (m->cq_size)
+        munmap( m->cq_ptr, m->cq_size );
+    munmap( m->sq_ptr, m->sq_size );
+    close( m->ring_fd );
+}
+
+
+static void ring_queue( struct mio *m, struct mio_request *r )
+/* Put r (or what's left of it) in the submission queue. There's always room,
+ * since there are never more than depth requests in flight.
+ */
+{
+    unsigned tail = *m->sq_tail;
+    unsigned index = tail & *m->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)m->sqes + index;
+
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->fd = r->fd;
+    sqe->off = r->off + r->done;
+    sqe->addr = (unsigned long)(r->buf + r->done);
+    sqe->len = r->len - r->done;
+    sqe->user_data = (unsigned long)r;
+    if (r->buf_index >= 0)
+    {
+        sqe->opcode = (r->op == OP_WRITE ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED);
+        sqe->buf_index = r->buf_index;
+    }
+    else
+        sqe->opcode = (r->op == OP_WRITE ? IORING_OP_WRITE : IORING_OP_READ);
+
+    m->sq_array[index] = index;
+
+    // The kernel mustn't see the new tail before the request is filled in
+    __atomic_store_n( m->sq_tail, tail + 1, __ATOMIC_RELEASE );
+    m->unsubmitted++;
+}
+
+
+static int ring_enter( struct mio *m, unsigned min_complete )
+/* Tell the kernel about new requests, and (optionally) wait for completions */
+{
+    if (m->unsubmitted == 0 && min_complete == 0)
+        return 0;
+
+    int ret;
+    do
+        ret = syscall( __NR_io_uring_enter, m->ring_fd, m->unsubmitted, min_complete,
+                       min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+    while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return -1;
+    m->unsubmitted -= ret;
+    return 0;
+}
+
+
+static int ring_reap( struct mio *m, struct mio_request **finished )
+/* Move completions from the CQ to the finished list. A short transfer that
+ * hasn't failed is sent back for the rest. Returns the number finished.
+ */
+{
+    unsigned head = *m->cq_head;
+    unsigned tail = __atomic_load_n( m->cq_tail, __ATOMIC_ACQUIRE );
+    int count = 0;
+
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = (struct io_uring_cqe *)m->cqes + (head & *m->cq_mask);
+        struct mio_request *r = (struct mio_request *)(unsigned long)cqe->user_data;
+        head++;
+
+        if (cqe->res > 0 && r->done + cqe->res < r->len)
+        {
+            r->done += cqe->res;
+            ring_queue( m, r );
+            continue;
+        }
+        if (cqe->res < 0)
+            r->result = cqe->res;
+        else
+            r->result = r->done + cqe->res;   // (0 means end of file)
+
+        r->next = *finished;
+        *finished = r;
+        count++;
+    }
+
+    __atomic_store_n( m->cq_head, head, __ATOMIC_RELEASE );
+    return count;
+}
+
+#else
+
+static int  ring_setup( struct mio *m )  { (void)m; return -1; }
+static void ring_teardown( struct mio *m )  { (void)m; }
+static void ring_queue( struct mio *m, struct mio_request *r )  { (void)m; (void)r; }
+static int  ring_enter( struct mio *m, unsigned n )  { (void)m; (void)n; return -1; }
+static int  ring_reap( struct mio *m, struct mio_request **f )  { (void)m; (void)f; return 0; }
+
+#endif
+
+/*****************************************************************************
+ * Thread pool
+ *****************************************************************************/
+
+static void *worker( void *arg )
+{
+    struct mio *m = arg;
+    pthread_mutex_lock( &m->lock );
+    while (1)
+    {
+        while (m->queue == NULL && !m->stopping)
+            pthread_cond_wait( &m->work, &m->lock );
+        if (m->queue == NULL)
+            break;
+
+        struct mio_request *r = m->queue;
+        m->queue = r->next;
+        pthread_mutex_unlock( &m->lock );
+
+        // Keep going until it's all done (or fails)
+        while (r->done < r->len)
+        {
+            ssize_t n = (r->op == OP_WRITE
+                         ? pwrite( r->fd, r->buf + r->done, r->len - r->done, r->off + r->done )
+                         : pread( r->fd, r->buf + r->done, r->len - r->done, r->off + r->done ));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                if (n < 0)
+                    r->result = -errno;
+                break;
+            }
+            r->done += n;
+        }
+        if (r->result == 0)
+            r->result = r->done;
+
+        pthread_mutex_lock( &m->lock );
+        r->next = m->finished;
+        m->finished = r;
+        pthread_cond_signal( &m->done );
+    }
+    pthread_mutex_unlock( &m->lock );
+    return NULL;
+}
+
+/*****************************************************************************
+ * The interface
+ *****************************************************************************/
+
+struct mio *mio_create( int depth, int flags )
+/* Set up asynchronous I/O with up to depth requests in flight at once.
+ *
+ * Inputs:
+ *   int depth = the queue depth (e.g. 32; more helps fast disks)
+ *   int flags = 0, or MIO_FORCE_THREADS to use the thread pool
+ * Returns:
+ *   struct mio * = the new context (free with mio_destroy()), or NULL
+ */
+{
+    if (depth < 1)
+        depth = 1;
+
+    struct mio *m = calloc( 1, sizeof(struct mio) );
+    if (m == NULL)
+        return NULL;
+    m->depth = depth;
+    m->ring_fd = -1;
+
+    m->requests = calloc( depth, sizeof(struct mio_request) );
+    if (m->requests == NULL)
+    {
+        free( m );
+        return NULL;
+    }
+    int i;
+    for (i = 0; i < depth; i++)
+    {
+        m->requests[i].next = m->free_list;
+        m->free_list = &m->requests[i];
+    }
+
+    if (!(flags & MIO_FORCE_THREADS) && ring_setup( m ) == 0)
+    {
+        m->backend = MIO_URING;
+        return m;
+    }
+
+    // Fall back on threads: one per request in flight, up to a limit
+    m->backend = MIO_THREADS;
+    pthread_mutex_init( &m->lock, NULL );
+    pthread_cond_init( &m->work, NULL );
+    pthread_cond_init( &m->done, NULL );
+    int want = (depth < MIO_MAX_THREADS ? depth : MIO_MAX_THREADS);
+    for (m->nthreads = 0; m->nthreads < want; m->nthreads++)
+        if (pthread_create( &m->threads[m->nthreads], NULL, worker, m ) != 0)
+            break;
+    if (m->nthreads == 0)
+    {
+        mio_destroy( m );
+        return NULL;
+    }
+    return m;
+}
+
+
+void mio_destroy( struct mio *m )
+/* Wait for anything still in flight, then free everything */
+{
+    if (m == NULL)
+        return;
+    mio_drain( m );
+
+    if (m->backend == MIO_URING)
+        ring_teardown( m );
+    else
+    {
+        pthread_mutex_lock( &m->lock );
+        m->stopping = 1;
+        pthread_cond_broadcast( &m->work );
+        pthread_mutex_unlock( &m->lock );
+        int i;
+        for (i = 0; i < m->nthreads; i++)
+            pthread_join( m->threads[i], NULL );
+        pthread_mutex_destroy( &m->lock );
+        pthread_cond_destroy( &m->work );
+        pthread_cond_destroy( &m->done );
+    }
+    free( m->requests );
+    free( m );
+}
+
+
+int mio_backend( const struct mio *m )
+{
+    return m->backend;
+}
+
+const char *mio_backend_name( const struct mio *m )
+{
+    return (m->backend == MIO_URING ? "io_uring" : "threads");
+}
+
+
+int mio_register_buffer( struct mio *m, void *buf, size_t len )
+/* Register a buffer that many requests will read from or write to (e.g. the
+ * whole of a matrix). Only io_uring makes use of it.
+ *
+ * Registering replaces the kernel's list of buffers, so only do it while
+ * nothing is in flight. The kernel limits the size of each buffer (1 GiB)
+ * and how much memory may be locked in total (see "ulimit -l").
+ *
+ * Returns: 0 if registered, -1 if not (requests still work, just unregistered)
+ */
+{
+    if (m->backend != MIO_URING || m->nbufs == MIO_MAX_BUFFERS || m->inflight > 0)
+        return -1;
+
+#ifdef __NR_io_uring_register
+    if (m->nbufs > 0)
+        syscall( __NR_io_uring_register, m->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0 );
+
+    m->bufs[m->nbufs].iov_base = buf;
+    m->bufs[m->nbufs].iov_len = len;
+    if (syscall( __NR_io_uring_register, m->ring_fd, IORING_REGISTER_BUFFERS,
+                 m->bufs, m->nbufs + 1 ) == 0)
+    {
+        m->nbufs++;
+        return 0;
+    }
+
+    // Put back the ones we had
+    if (m->nbufs > 0 &&
+        syscall( __NR_io_uring_register, m->ring_fd, IORING_REGISTER_BUFFERS, m->bufs, m->nbufs ) != 0)
+        m->nbufs = 0;
+#else
+    (void)buf;
+    (void)len;
+#endif
+    return -1;
+}
+
+
+static int find_buffer( const struct mio *m, const void *buf, size_t len )
+/* The registered buffer that [buf, buf+len) is inside, or -1 */
+{
+    const char *p = buf;
+    int i;
+    for (i = 0; i < m->nbufs; i++)
+    {
+        const char *base = m->bufs[i].iov_base;
+        if (p >= base && p + len <= base + m->bufs[i].iov_len)
+            return i;
+    }
+    return -1;
+}
+
+
+static void complete( struct mio *m, struct mio_request *finished )
+/* Call the callbacks of the finished requests, and recycle them */
+{
+    while (finished != NULL)
+    {
+        struct mio_request *r = finished;
+        finished = r->next;
+        m->inflight--;
+        mio_callback cb = r->cb;
+        void *arg = r->arg;
+        long result = r->result;
+        r->next = m->free_list;
+        m->free_list = r;
+        if (cb != NULL)
+            cb( arg, result );
+    }
+}
+
+
+int mio_wait( struct mio *m, int min_complete )
+/* Wait until at least min_complete requests have finished (or nothing is in
+ * flight), and call their callbacks. With min_complete = 0, just collect
+ * whatever has finished already, without waiting.
+ *
+ * Returns: the number of requests that finished, or -1 on error
+ */
+{
+    if (min_complete > m->inflight)
+        min_complete = m->inflight;
+
+    int total = 0;
+    do
+    {
+        struct mio_request *finished = NULL;
+        int n;
+        if (m->backend == MIO_URING)
+        {
+            if (ring_enter( m, (total < min_complete ? 1 : 0) ) != 0)
+                return -1;
+            n = ring_reap( m, &finished );
+        }
+        else
+        {
+            pthread_mutex_lock( &m->lock );
+            while (m->finished == NULL && total < min_complete)
+                pthread_cond_wait( &m->done, &m->lock );
+            finished = m->finished;
+            m->finished = NULL;
+            pthread_mutex_unlock( &m->lock );
+
+            struct mio_request *r;
+            for (n = 0, r = finished; r != NULL; r = r->next)
+                n++;
+        }
+        complete( m, finished );
+        total += n;
+    }
+    while (total < min_complete);
+
+    return total;
+}
+
+
+int mio_drain( struct mio *m )
+/* Wait for everything in flight to finish. Returns 0, or -1 on error. */
+{
+    while (m->inflight > 0)
+        if (mio_wait( m, m->inflight ) < 0)
+            return -1;
+    return 0;
+}
+
+
+static int submit( struct mio *m, int op, int fd, void *buf, size_t len, off_t off,
+                   mio_callback cb, void *arg )
+{
+    // If the queue is full, wait for room
+    while (m->free_list == NULL)
+        if (mio_wait( m, 1 ) < 0)
+            return -1;
+
+    struct mio_request *r = m->free_list;
+    m->free_list = r->next;
+    memset( r, 0, sizeof(struct mio_request) );
+    r->op = op;
+    r->fd = fd;
+    r->buf = buf;
+    r->len = len;
+    r->off = off;
+    r->cb = cb;
+    r->arg = arg;
+    r->buf_index = find_buffer( m, buf, len );
+    m->inflight++;
+
+    if (m->backend == MIO_URING)
+    {
+        /* Requests are collected in the SQ and handed to the kernel in
+           batches, whenever we wait (or every depth/4 requests)
+        */
+        ring_queue( m, r );
+        if (m->unsubmitted >= (unsigned)(m->depth / 4 > 0 ? m->depth / 4 : 1))
+            return ring_enter( m, 0 );
+        return 0;
+    }
+
+    pthread_mutex_lock( &m->lock );
+    if (m->queue == NULL)
+        m->queue = r;
+    else
+        m->queue_tail->next = r;
+    m->queue_tail = r;
+    pthread_cond_signal( &m->work );
+    pthread_mutex_unlock( &m->lock );
+    return 0;
+}
+
+
+int mio_write( struct mio *m, int fd, const void *buf, size_t len, off_t off,
+               mio_callback cb, void *arg )
+/* Start writing len bytes from buf to file fd at offset off. buf must not be
+ * changed (or freed) until the callback has been called.
+ *
+ * Inputs:
+ *   struct mio *m   = the context
+ *   int fd          = an open file descriptor (see "man 2 open")
+ *   const void *buf = the data to write
+ *   size_t len      = how many bytes
+ *   off_t off       = where in the file
+ *   mio_callback cb = called with (arg, result) when it's done (or NULL)
+ *   void *arg       = passed to cb
+ * Returns:
+ *   int = 0 if it was submitted, -1 if not
+ */
+{
+    return submit( m, OP_WRITE, fd, (void *)buf, len, off, cb, arg );
+}
+
+
+int mio_read( struct mio *m, int fd, void *buf, size_t len, off_t off,
+              mio_callback cb, void *arg )
+/* Start reading len bytes from file fd at offset off into buf. As for
+ * mio_write(), but in the other direction.
+ */
+{
+    return submit( m, OP_READ, fd, buf, len, off, cb, arg );
+}
+
+/*****************************************************************************
+ * Whole matrices
+ *****************************************************************************/
+
+struct band
+{
+    long expected;
+    int *failed;
+};
+
+static void band_done( void *arg, long result )
+{
+    struct band *b = arg;
+    if (result != b->expected)
+        *b->failed = 1;
+}
+
+
+static int matrix_io( struct mio *m, int op, int fd, double **M, int rows, int cols,
+                      off_t offset, int band_rows )
+{
+    if (band_rows < 1)
+        band_rows = 1;
+
+    /* Rows are only next to each other in memory if the matrix was made
+       that way (like create_matrix() in fileio.c does). If not, each row
+       has to be its own request.
+    */
+    int r;
+    for (r = 1; r < rows; r++)
+        if (M[r] != M[r - 1] + cols)
+            band_rows = 1;
+
+    int nbands = (rows + band_rows - 1) / band_rows;
+    struct band *bands = malloc( (nbands > 0 ? nbands : 1) * sizeof(struct band) );
+    if (bands == NULL)
+        return -1;
+
+    int failed = 0, b;
+    size_t row_bytes = (size_t)cols * sizeof(double);
+    for (b = 0; b < nbands && !failed; b++)
+    {
+        int r0 = b * band_rows;
+        int nr = (rows - r0 < band_rows ? rows - r0 : band_rows);
+        size_t len = nr * row_bytes;
+        off_t where = offset + (off_t)r0 * row_bytes;
+
+        bands[b].expected = (long)len;
+        bands[b].failed = &failed;
+        if ((op == OP_WRITE ? mio_write( m, fd, M[r0], len, where, band_done, &bands[b] )
+                            : mio_read( m, fd, M[r0], len, where, band_done, &bands[b] )) != 0)
+            failed = 1;
+    }
+
+    if (mio_drain( m ) != 0)
+        failed = 1;
+    free( bands );
+    return (failed ? -1 : 0);
+}
+
+
+int mio_write_matrix( struct mio *m, int fd, double **M, int rows, int cols, off_t offset, int band_rows )
+/* Write a matrix to fd, starting at offset, in the same format as
+ * write_matrix( ..., BINARY ) in fileio.c, as bands of band_rows rows that
+ * are all in flight at once (up to the queue depth). Returns when it's all
+ * written.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+{
+    return matrix_io( m, OP_WRITE, fd, M, rows, cols, offset, band_rows );
+}
+
+
+int mio_read_matrix( struct mio *m, int fd, double **M, int rows, int cols, off_t offset, int band_rows )
+/* Read a matrix written by mio_write_matrix() (or write_matrix()) into M,
+ * which must already be allocated. Returns 0 on success, -1 on failure.
+ */
+{
+    return matrix_io( m, OP_READ, fd, M, rows, cols, offset, band_rows );
+}
@@ -0,0 +1,45 @@
+/*****************************************************************************
+ * matrix_io.h
+ *
+ * Asynchronous file I/O, with several reads and writes in flight at once,
+ * using io_uring where the kernel has it and a pool of threads where it
+ * doesn't. See matrix_io.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Which way the I/O is actually done
+#define  MIO_URING    1
+#define  MIO_THREADS  2
+
+// Flags for mio_create()
+#define  MIO_FORCE_THREADS  1   // don't even try io_uring
+
+/* Called (from inside mio_wait()) when a request finishes. result is the
+   number of bytes transferred, or minus the error number (e.g. -EIO).
+*/
+typedef void (*mio_callback)( void *arg, long result );
+
+struct mio;
+
+struct mio *mio_create( int, int );
+void mio_destroy( struct mio * );
+int  mio_backend( const struct mio * );
+const char *mio_backend_name( const struct mio * );
+
+int mio_register_buffer( struct mio *, void *, size_t );
+
+int mio_write( struct mio *, int, const void *, size_t, off_t, mio_callback, void * );
+int mio_read( struct mio *, int, void *, size_t, off_t, mio_callback, void * );
+int mio_wait( struct mio *, int );
+int mio_drain( struct mio * );
+
+int mio_write_matrix( struct mio *, int, double **, int, int, off_t, int );
+int mio_read_matrix( struct mio *, int, double **, int, int, off_t, int );
+
+#endif
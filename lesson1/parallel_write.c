@@ -0,0 +1,249 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * parallel_write.c
+ *
+ * write_matrix( ..., BINARY ) in fileio.c writes row after row from one
+ * thread, and every byte goes through the "page cache": the kernel copies
+ * it into its own memory first, and writes it to disk later. For a file of
+ * many gigabytes, that copying keeps one core busy, and the file pushes
+ * everything else out of the cache (memory that other programs were using).
+ *
+ * write_matrix_parallel() does three things differently:
+ *
+ *   1) It sets the size of the file first, and then cuts the file into as
+ *      many pieces as there are threads. Each thread writes its own piece
+ *      with pwrite(), which takes the position in the file as an argument,
+ *      so the threads don't need to take turns.
+ *
+ *   2) It opens the file with O_DIRECT, which sends data straight from our
+ *      memory to the disk, skipping the page cache. The catch: the memory
+ *      address, the position in the file and the number of bytes must all
+ *      be multiples of the disk's block size (PWRITE_ALIGN covers all the
+ *      usual ones). So the pieces are cut on multiples of PWRITE_ALIGN,
+ *      the data is written straight from the matrix if it is suitably
+ *      aligned (or else copied through an aligned buffer), and the last few
+ *      bytes (the "tail", less than one block) are written separately,
+ *      without O_DIRECT. Some filesystems (e.g. tmpfs) don't do O_DIRECT at
+ *      all; then we just don't use it.
+ *
+ *   3) It calls fsync() once, at the end, to make sure everything is on the
+ *      disk before it returns (a checkpoint isn't a checkpoint until then).
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE   // for O_DIRECT
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "parallel_write.h"
+
+#define  STAGE_SIZE  (4*1024*1024)   // the copying buffer (a multiple of PWRITE_ALIGN)
+#define  MAX_CHUNK   (1 << 30)       // the most to ask pwrite() for at once
+#define  MAX_THREADS 64
+
+struct piece
+{
+    int fd;
+    double **M;
+    int rows, cols;
+    int contiguous;      // the rows follow each other in memory...
+    int aligned;         // ... starting at a multiple of PWRITE_ALIGN
+    off_t start, end;    // the bytes of the file to write (multiples of PWRITE_ALIGN)
+    int failed;
+};
+
+
+static int write_all( int fd, const char *buf, size_t len, off_t off )
+/* pwrite() until it's all written. Returns 0, or -1 on failure. */
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite( fd, buf, (len < MAX_CHUNK ? len : MAX_CHUNK), off );
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+static void gather( const struct piece *p, char *dst, off_t off, size_t len )
+/* Copy bytes off .. off+len-1 of the matrix (as it will be in the file) */
+{
+    size_t row_bytes = (size_t)p->cols * sizeof(double);
+    while (len > 0)
+    {
+        int r = off / row_bytes;
+        size_t in_row = off % row_bytes;
+        size_t n = row_bytes - in_row;
+        n = (n < len ? n : len);
+        memcpy( dst, (const char *)p->M[r] + in_row, n );
+        dst += n;
+        off += n;
+        len -= n;
+    }
+}
+
+
+static void *write_piece( void *arg )
+{
+    struct piece *p = arg;
+
+    if (p->contiguous && p->aligned)
+    {
+        // The whole piece, straight from the matrix
+        if (write_all( p->fd, (const char *)p->M[0] + p->start, p->end - p->start, p->start ) != 0)
+            p->failed = 1;
+        return NULL;
+    }
+
+    char *stage = aligned_alloc( PWRITE_ALIGN, STAGE_SIZE );
+    if (stage == NULL)
+    {
+        p->failed = 1;
+        return NULL;
+    }
+    off_t off;
+    for (off = p->start; off < p->end && !p->failed; off += STAGE_SIZE)
+    {
+        size_t len = (p->end - off < STAGE_SIZE ? p->end - off : STAGE_SIZE);
+        gather( p, stage, off, len );
+        if (write_all( p->fd, stage, len, off ) != 0)
+            p->failed = 1;
+    }
+    free( stage );
+    return NULL;
+}
+
+
+static int run_pieces( int fd, double **M, int rows, int cols, off_t body, int nthreads )
+/* Write the first body bytes (a multiple of PWRITE_ALIGN) with nthreads threads */
+{
+    struct piece pieces[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+
+    int contiguous = 1, r;
+    for (r = 1; r < rows && contiguous; r++)
+        contiguous = (M[r] == M[r - 1] + cols);
+    int aligned = ((uintptr_t)M[0] % PWRITE_ALIGN == 0);
+
+    /* Share out the blocks as evenly as possible. This thread does the
+       first piece itself (and any piece whose thread couldn't be started).
+    */
+    off_t nblocks = body / PWRITE_ALIGN;
+    int created[MAX_THREADS];
+    int t, failed = 0;
+    for (t = 0; t < nthreads; t++)
+    {
+        struct piece *p = &pieces[t];
+        p->fd = fd;
+        p->M = M;
+        p->rows = rows;
+        p->cols = cols;
+        p->contiguous = contiguous;
+        p->aligned = aligned;
+        p->start = nblocks * t / nthreads * PWRITE_ALIGN;
+        p->end = nblocks * (t + 1) / nthreads * PWRITE_ALIGN;
+        p->failed = 0;
+        created[t] = (t > 0 && pthread_create( &threads[t], NULL, write_piece, p ) == 0);
+    }
+    for (t = 0; t < nthreads; t++)
+    {
+        if (created[t])
+            pthread_join( threads[t], NULL );
+        else
+            write_piece( &pieces[t] );
+        failed |= pieces[t].failed;
+    }
+    return (failed ? -1 : 0);
+}
+
+
+int write_matrix_parallel( const char *filename, double **M, int rows, int cols,
+                           int nthreads, int *used_direct )
+/* Write M to a file, in the same format as write_matrix( ..., BINARY ) in
+ * fileio.c, with several threads and (where possible) O_DIRECT.
+ *
+ * Inputs:
+ *   const char *filename = the file to (over)write
+ *   double **M           = the matrix
+ *   int rows             = the number of rows in M
+ *   int cols             = the number of cols in M
+ *   int nthreads         = how many threads to write with
+ *   int *used_direct     = (output, may be NULL) set to 1 if O_DIRECT was used
+ * Returns:
+ *   int = 0 on success, -1 on failure
+ */
+{
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    off_t total = (off_t)rows * cols * sizeof(double);
+    off_t body = total - total % PWRITE_ALIGN;   // the part O_DIRECT can do
+    int direct = 1;
+
+    int fd = open( filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644 );
+    if (fd < 0 && errno == EINVAL)
+    {
+        direct = 0;
+        fd = open( filename, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    }
+    if (fd < 0)
+        return -1;
+
+    /* Set the size first. Then no thread has to make the file grow (which
+       the filesystem has to do one thread at a time), and fallocate() lets
+       the filesystem find space for it all in one go, if it can.
+    */
+    if (ftruncate( fd, total ) != 0)
+    {
+        close( fd );
+        return -1;
+    }
+    if (total > 0)
+        posix_fallocate( fd, 0, total );   // (only a hint; fine if it fails)
+
+    int failed = run_pieces( fd, M, rows, cols, body, nthreads );
+    if (failed && direct)
+    {
+        // The filesystem took O_DIRECT at open() but not for the writes
+        direct = 0;
+        failed = (fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_DIRECT ) != 0 ||
+                  run_pieces( fd, M, rows, cols, body, nthreads ) != 0);
+    }
+
+    // The tail, through the page cache
+    if (!failed && total > body)
+    {
+        char tail[PWRITE_ALIGN];
+        struct piece p = { fd, M, rows, cols, 0, 0, body, total, 0 };
+        gather( &p, tail, body, total - body );
+        if (direct)
+            fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_DIRECT );
+        failed = (write_all( fd, tail, total - body, body ) != 0);
+    }
+
+    // Once, at the end: fsync() flushes the whole file, whoever wrote it
+    if (!failed)
+        failed = (fsync( fd ) != 0);
+    if (close( fd ) != 0)
+        failed = 1;
+
+    if (used_direct != NULL)
+        *used_direct = direct;
+    return (failed ? -1 : 0);
+}
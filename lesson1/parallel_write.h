@@ -0,0 +1,16 @@
+/*****************************************************************************
+ * parallel_write.h
+ *
+ * Writing a big binary matrix with several threads at once, bypassing the
+ * page cache where possible. See parallel_write.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef PARALLEL_WRITE_H
+#define PARALLEL_WRITE_H
+
+#define  PWRITE_ALIGN  4096   // what O_DIRECT needs (sizes, offsets, addresses)
+
+int write_matrix_parallel( const char *, double **, int, int, int, int * );
+
+#endif
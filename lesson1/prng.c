@@ -0,0 +1,320 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * prng.c
+ *
+ * rand() is fine for a tutorial, but it has three problems when the arrays
+ * get big:
+ *
+ *   1) It is slow, and often only gives 31 (or even 15) random bits.
+ *   2) It has one hidden, global state. Threads calling it at the same time
+ *      either queue up for it or trample on it.
+ *   3) rand() % 6 is not quite fair: 2^31 isn't a multiple of 6, so the
+ *      small values come up very slightly more often.
+ *
+ * This file has two generators that fix all three:
+ *
+ *   xoshiro256** keeps its state in a struct that you own, so each thread
+ *   can have its own. xoshiro_jump() skips 2^128 numbers ahead, which is
+ *   how we give each thread its own "stream" that will never overlap with
+ *   anyone else's.
+ *
+ *   Philox4x32-10 has no state at all: it scrambles a counter with a key.
+ *   The i-th number is just philox(key, i), so a thread can jump straight
+ *   to its part of an array. The bulk fills below use it, which means they
+ *   give the same array whether 1 or 64 threads made it.
+ *
+ * Both are from the literature (Blackman & Vigna 2018; Salmon et al. 2011,
+ * "Parallel random numbers: as easy as 1, 2, 3").
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "prng.h"
+
+/*****************************************************************************
+ * xoshiro256**
+ *****************************************************************************/
+
+static inline uint64_t rotl( uint64_t x, int k )
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+
+static uint64_t splitmix64( uint64_t *x )
+/* Used to turn one 64-bit seed into a well-mixed 256-bit state */
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+
+void xoshiro_seed( struct xoshiro256 *g, uint64_t seed )
+{
+    int i;
+    for (i = 0; i < 4; i++)
+        g->s[i] = splitmix64( &seed );
+}
+
+
+uint64_t xoshiro_next( struct xoshiro256 *g )
+{
+    uint64_t *s = g->s;
+    uint64_t result = rotl( s[1] * 5, 7 ) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl( s[3], 45 );
+
+    return result;
+}
+
+
+void xoshiro_jump( struct xoshiro256 *g )
+/* Move the generator 2^128 numbers ahead */
+{
+    static const uint64_t JUMP[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+                                     0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    int i, b, j;
+    for (i = 0; i < 4; i++)
+        for (b = 0; b < 64; b++)
+        {
+            if (JUMP[i] & ((uint64_t)1 << b))
+                for (j = 0; j < 4; j++)
+                    s[j] ^= g->s[j];
+            xoshiro_next( g );
+        }
+    for (j = 0; j < 4; j++)
+        g->s[j] = s[j];
+}
+
+
+void xoshiro_stream( struct xoshiro256 *g, uint64_t seed, unsigned int stream )
+/* Seed a generator for the given stream (e.g. thread number) of a seed.
+ * Different streams are 2^128 numbers apart, so they never overlap.
+ */
+{
+    xoshiro_seed( g, seed );
+    unsigned int i;
+    for (i = 0; i < stream; i++)
+        xoshiro_jump( g );
+}
+
+
+uint64_t xoshiro_bounded( struct xoshiro256 *g, uint64_t range )
+/* A random integer 0 <= x < range, with every value equally likely.
+ *
+ * Instead of x % range (slow, and biased), this uses Lemire's method: the
+ * top 64 bits of x * range are almost right, and the few values of x that
+ * would make it unfair are thrown away and drawn again.
+ */
+{
+    unsigned __int128 m = (unsigned __int128)xoshiro_next( g ) * range;
+    uint64_t l = (uint64_t)m;
+    if (l < range)
+    {
+        uint64_t threshold = -range % range;
+        while (l < threshold)
+        {
+            m = (unsigned __int128)xoshiro_next( g ) * range;
+            l = (uint64_t)m;
+        }
+    }
+    return m >> 64;
+}
+
+
+double xoshiro_double( struct xoshiro256 *g )
+/* A random double 0 <= x < 1 (using the top 53 bits) */
+{
+    return (xoshiro_next( g ) >> 11) * 0x1.0p-53;
+}
+
+/*****************************************************************************
+ * Philox4x32-10
+ *****************************************************************************/
+
+#define  PHILOX_M0  0xD2511F53
+#define  PHILOX_M1  0xCD9E8D57
+#define  PHILOX_W0  0x9E3779B9
+#define  PHILOX_W1  0xBB67AE85
+
+static inline void philox_block( uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3,
+                                 uint32_t k0, uint32_t k1, uint32_t out[4] )
+/* Ten rounds of multiplying, swapping and mixing in the key. Written with
+ * plain variables (no arrays, no branches) so that the compiler can do
+ * several blocks at once with SIMD instructions.
+ */
+{
+    int r;
+    for (r = 0; r < 10; r++)
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+
+void philox4x32( const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4] )
+{
+    philox_block( ctr[0], ctr[1], ctr[2], ctr[3], key[0], key[1], out );
+}
+
+/* Every fill below uses the counter (block, block >> 32, stream, round):
+   block b makes elements 4b..4b+3 (or 2b, 2b+1 for doubles), and "round"
+   is only ever more than 0 on the rare occasions an integer is redrawn.
+   Each thread takes a contiguous run of blocks.
+*/
+#define  KEY0( seed )  ((uint32_t)(seed))
+#define  KEY1( seed )  ((uint32_t)((seed) >> 32))
+
+
+void prng_fill_u32( uint32_t *arr, long n, uint64_t seed, uint32_t stream )
+/* Fill arr with n random 32-bit integers.
+ *
+ * Inputs:
+ *   uint32_t *arr   = the array to fill
+ *   long n          = the number of elements
+ *   uint64_t seed   = the seed
+ *   uint32_t stream = the stream: different streams of one seed are independent
+ */
+{
+    long nblocks = (n + 3) / 4;
+    long b;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (b = 0; b < nblocks; b++)
+    {
+        uint32_t r[4];
+        philox_block( b, b >> 32, stream, 0, KEY0(seed), KEY1(seed), r );
+        int k;
+        for (k = 0; k < 4 && 4*b + k < n; k++)
+            arr[4*b + k] = r[k];
+    }
+}
+
+
+static int redraw( uint32_t range, uint32_t threshold, long i, uint32_t stream, uint64_t seed )
+/* Element i's first draw was one of the unfair ones: keep trying with later
+ * rounds of its block until one is fair.
+ */
+{
+    uint32_t round, r[4];
+    for (round = 1; ; round++)
+    {
+        philox_block( i/4, (i/4) >> 32, stream, round, KEY0(seed), KEY1(seed), r );
+        uint64_t m = (uint64_t)r[i % 4] * range;
+        if ((uint32_t)m >= threshold)
+            return m >> 32;
+    }
+}
+
+
+void prng_fill_int( int *arr, long n, int lo, int hi, uint64_t seed, uint32_t stream )
+/* Fill arr with n random integers lo <= x <= hi, every value equally likely.
+ * (This is what "rand() % 6 + 10" was trying to be, with lo = 10, hi = 15.)
+ */
+{
+    uint32_t range = (uint32_t)((int64_t)hi - lo + 1);   // 0 means "all 2^32"
+    uint32_t threshold = (range == 0 ? 0 : -range % range);
+    long nblocks = (n + 3) / 4;
+    long b;
+
+    /* Lemire's method again (see xoshiro_bounded), but 32-bit. We do the
+       common case for everything first, without any "if" in the way, and
+       only then go back for any element whose draw was unfair. For small
+       ranges that happens about once in a billion.
+    */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (b = 0; b < nblocks; b++)
+    {
+        uint32_t r[4];
+        philox_block( b, b >> 32, stream, 0, KEY0(seed), KEY1(seed), r );
+        int k;
+        for (k = 0; k < 4 && 4*b + k < n; k++)
+        {
+            uint64_t m = (uint64_t)r[k] * range;
+            if (range == 0)
+                arr[4*b + k] = (int)r[k];
+            else if ((uint32_t)m >= threshold)
+                arr[4*b + k] = lo + (int)(m >> 32);
+            else
+                arr[4*b + k] = lo + redraw( range, threshold, 4*b + k, stream, seed );
+        }
+    }
+}
+
+
+void prng_fill_double( double *arr, long n, uint64_t seed, uint32_t stream )
+/* Fill arr with n random doubles 0 <= x < 1 */
+{
+    long nblocks = (n + 1) / 2;
+    long b;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (b = 0; b < nblocks; b++)
+    {
+        uint32_t r[4];
+        philox_block( b, b >> 32, stream, 0, KEY0(seed), KEY1(seed), r );
+        arr[2*b] = ((((uint64_t)r[0] << 32) | r[1]) >> 11) * 0x1.0p-53;
+        if (2*b + 1 < n)
+            arr[2*b + 1] = ((((uint64_t)r[2] << 32) | r[3]) >> 11) * 0x1.0p-53;
+    }
+}
+
+
+void prng_fill_normal( double *arr, long n, double mean, double sd, uint64_t seed, uint32_t stream )
+/* Fill arr with n random doubles from a normal distribution.
+ *
+ * The Box-Muller transform turns two uniform numbers u1, u2 into two
+ * independent normal ones: sqrt(-2 ln u1) times cos and sin of 2 pi u2.
+ */
+{
+    long nblocks = (n + 1) / 2;
+    long b;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (b = 0; b < nblocks; b++)
+    {
+        uint32_t r[4];
+        philox_block( b, b >> 32, stream, 0, KEY0(seed), KEY1(seed), r );
+
+        // u1 must not be 0 (log(0) = -infinity), so use 0 < u1 <= 1
+        double u1 = (((((uint64_t)r[0] << 32) | r[1]) >> 11) + 1) * 0x1.0p-53;
+        double u2 = ((((uint64_t)r[2] << 32) | r[3]) >> 11) * 0x1.0p-53;
+        double radius = sd * sqrt( -2.0 * log( u1 ) );
+        double angle = 2.0 * M_PI * u2;
+
+        arr[2*b] = mean + radius * cos( angle );
+        if (2*b + 1 < n)
+            arr[2*b + 1] = mean + radius * sin( angle );
+    }
+}
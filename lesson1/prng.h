@@ -0,0 +1,40 @@
+/*****************************************************************************
+ * prng.h
+ *
+ * Fast pseudo-random numbers, including in parallel. See prng.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stdint.h>
+
+/* xoshiro256**: a small, fast generator for one thread at a time */
+struct xoshiro256
+{
+    uint64_t s[4];
+};
+
+void     xoshiro_seed( struct xoshiro256 *, uint64_t );
+void     xoshiro_stream( struct xoshiro256 *, uint64_t, unsigned int );
+void     xoshiro_jump( struct xoshiro256 * );
+uint64_t xoshiro_next( struct xoshiro256 * );
+uint64_t xoshiro_bounded( struct xoshiro256 *, uint64_t );
+double   xoshiro_double( struct xoshiro256 * );
+
+/* Philox4x32-10: a "counter-based" generator. The random numbers for counter
+   value c are a fixed function of (key, c), so any of them can be made, in
+   any order, by any thread.
+*/
+void philox4x32( const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4] );
+
+/* Bulk fills, made with Philox. Element i depends only on (seed, stream, i),
+   so the result doesn't depend on how many threads made it.
+*/
+void prng_fill_u32( uint32_t *, long, uint64_t, uint32_t );
+void prng_fill_int( int *, long, int, int, uint64_t, uint32_t );
+void prng_fill_double( double *, long, uint64_t, uint32_t );
+void prng_fill_normal( double *, long, double, double, uint64_t, uint32_t );
+
+#endif
@@ -0,0 +1,456 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * pyramid.c
+ *
+ * A 50000x50000 matrix of doubles is a 20 GB [basename].bin file. A screen
+ * has a few million pixels, so to show the whole matrix, each pixel stands
+ * for hundreds of numbers -- and the program still has to read all 20 GB to
+ * work out what to draw.
+ *
+ * A "pyramid" (as in maps and image viewers) keeps smaller copies of the
+ * matrix next to it. Level 1 has a cell for every 2x2 block of the matrix,
+ * level 2 one for every 4x4 block, and so on, down to a single cell. Each
+ * level is a quarter the size of the one before, so a viewer can read a
+ * whole level, or a window of one, that's about the size of the screen, and
+ * zoom in by going down a level.
+ *
+ * Each cell keeps the mean of the block under it, and also its smallest and
+ * biggest value: an average smooths away a single spike, but the max
+ * doesn't. They're stored as floats (a preview doesn't need 16 digits), so
+ * the whole pyramid is about half the size of the .bin file:
+ *
+ *   3 stats x 4 bytes x (1/4 + 1/16 + 1/64 + ...) = 4 bytes per number
+ *
+ * The pyramid is built in one pass, while the matrix is being written: feed
+ * the rows in with pyramid_add_rows() as they go out, and nothing needs to
+ * be read back. Each level only keeps one row in progress. Once two rows of
+ * level l-1 have gone into it (or one, at the bottom edge), the row of level
+ * l is done: it's written out, and then added to level l+1 the same way. The
+ * means are kept as sums until they're written, so they are exactly the
+ * means of the cells underneath, whatever the level (the blocks at the
+ * right and bottom edges can be smaller, when the size isn't a power of
+ * two). The work along each row is split among threads (OpenMP).
+ *
+ * The file, [basename].pyr, is a struct pyramid_header followed by the
+ * levels, each as three matrices (mean, min, max) of floats. Its header is
+ * written last, so a file that was never finished isn't taken for a real
+ * one. pyramid_read() reads any window of any level with one pread() per
+ * row (level 0 comes straight from the .bin file).
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pyramid.h"
+
+#define  PARALLEL_MIN  4096   // rows shorter than this aren't worth the threads
+
+// (fmin() and fmax() from math.h would do, but they take care over NaNs, which
+// stops the compiler from vectorising the loops)
+#define  MIN(a,b)  ((a) < (b) ? (a) : (b))
+#define  MAX(a,b)  ((a) > (b) ? (a) : (b))
+
+struct level
+{
+    int rows, cols;
+    int done;                   // rows written so far
+    int pending;                // rows of level l-1 in the current row
+    double *sum, *min, *max;    // the current row
+};
+
+struct pyramid_builder
+{
+    int fd;
+    int rows, cols, levels;
+    int rows_in;                // rows of the matrix added so far
+    struct level *level;        // level[1] .. level[levels]
+    off_t *base;                // where each level starts in the file
+    float *out;
+    int failed;
+};
+
+struct pyramid
+{
+    int bin, pyr;
+    struct pyramid_header h;
+    off_t *base;
+    double *row;                // for reading level 0
+    int row_len;
+};
+
+
+static int count_levels( int rows, int cols )
+/* How many times the size can be halved (rounding up) before it's 1x1 */
+{
+    int levels = 0;
+    while (rows > 1 || cols > 1)
+    {
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+        levels++;
+    }
+    return levels;
+}
+
+static off_t *level_offsets( int rows, int cols, int levels )
+/* base[l] = where level l starts in the file; base[levels+1] = its size */
+{
+    off_t *base = malloc( (levels + 2) * sizeof(off_t) );
+    if (base == NULL)
+        return NULL;
+    base[1] = sizeof(struct pyramid_header);
+    int l;
+    for (l = 1; l <= levels; l++)
+    {
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+        base[l+1] = base[l] + (off_t)PYR_STATS * rows * cols * sizeof(float);
+    }
+    return base;
+}
+
+static int write_all( int fd, const void *buf, size_t len, off_t off )
+/* pwrite() until it's all written. Returns 0, or -1 on failure. */
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite( fd, buf, len, off );
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf = (const char *)buf + n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all( int fd, void *buf, size_t len, off_t off )
+/* pread() until it's all read. Returns 0, or -1 on failure (or if the file
+ * ends first). */
+{
+    while (len > 0)
+    {
+        ssize_t n = pread( fd, buf, len, off );
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf = (char *)buf + n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/*****************************************************************************
+ * Building
+ *****************************************************************************/
+
+struct pyramid_builder *pyramid_create( const char *filename, int rows, int cols )
+/* Start a pyramid for a rows x cols matrix.
+ *
+ * Inputs:
+ *   const char *filename = where to write it (conventionally [basename].pyr)
+ *   int rows, cols       = the size of the matrix
+ * Returns:
+ *   struct pyramid_builder * = add the rows of the matrix to this in order,
+ *                              then call pyramid_finish(). NULL on failure.
+ */
+{
+    if (rows < 1 || cols < 1)
+        return NULL;
+
+    struct pyramid_builder *b = calloc( 1, sizeof(struct pyramid_builder) );
+    if (b == NULL)
+        return NULL;
+    b->rows = rows;
+    b->cols = cols;
+    b->levels = count_levels( rows, cols );
+    b->level = calloc( b->levels + 1, sizeof(struct level) );
+    b->base = level_offsets( rows, cols, b->levels );
+    b->out = malloc( PYR_STATS * ((cols + 1) / 2) * sizeof(float) );
+    b->fd = open( filename, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    int failed = (b->level == NULL || b->base == NULL || b->out == NULL || b->fd < 0);
+
+    int l;
+    for (l = 1; l <= b->levels && !failed; l++)
+    {
+        struct level *L = &b->level[l];
+        L->rows = (l == 1 ? (rows + 1) / 2 : (b->level[l-1].rows + 1) / 2);
+        L->cols = (l == 1 ? (cols + 1) / 2 : (b->level[l-1].cols + 1) / 2);
+        L->sum = malloc( L->cols * sizeof(double) );
+        L->min = malloc( L->cols * sizeof(double) );
+        L->max = malloc( L->cols * sizeof(double) );
+        failed = (L->sum == NULL || L->min == NULL || L->max == NULL);
+    }
+
+    // The whole file, so that the levels can be written in any order
+    if (failed || ftruncate( b->fd, b->base[b->levels + 1] ) != 0)
+    {
+        b->failed = 1;
+        pyramid_finish( b );
+        return NULL;
+    }
+    return b;
+}
+
+static void add_row( struct pyramid_builder *b, int l, const double *sum,
+                     const double *min, const double *max, int prev_rows, int prev_cols );
+
+static void finish_row( struct pyramid_builder *b, int l )
+/* Write out the current row of level l, and pass it on to level l+1 */
+{
+    struct level *L = &b->level[l];
+    long long r = L->done;
+    long long rh = (((r + 1) << l) < b->rows ? (r + 1) << l : b->rows) - (r << l);
+    float *mean = b->out, *lo = mean + L->cols, *hi = lo + L->cols;
+    int c;
+
+    #pragma omp parallel for schedule(static) if (L->cols >= PARALLEL_MIN)
+    for (c = 0; c < L->cols; c++)
+    {
+        long long c0 = (long long)c << l, c1 = (long long)(c + 1) << l;
+        long long cw = (c1 < b->cols ? c1 : b->cols) - c0;
+        mean[c] = L->sum[c] / (double)(rh * cw);
+        lo[c] = L->min[c];
+        hi[c] = L->max[c];
+    }
+
+    size_t len = L->cols * sizeof(float);
+    int s;
+    for (s = 0; s < PYR_STATS; s++)
+    {
+        off_t off = b->base[l] + ((off_t)s * L->rows + L->done) * len;
+        if (write_all( b->fd, b->out + (size_t)s * L->cols, len, off ) != 0)
+            b->failed = 1;
+    }
+
+    L->done++;
+    L->pending = 0;
+    if (l < b->levels)
+        add_row( b, l + 1, L->sum, L->min, L->max, L->rows, L->cols );
+}
+
+static void add_row( struct pyramid_builder *b, int l, const double *sum,
+                     const double *min, const double *max, int prev_rows, int prev_cols )
+/* Add a row of level l-1 (the sums, mins and maxes of its cells; for the
+ * matrix itself, all three are just the row) to level l's current row.
+ */
+{
+    struct level *L = &b->level[l];
+    int first = (L->pending == 0);
+    int c;
+
+    #pragma omp parallel for schedule(static) if (L->cols >= PARALLEL_MIN)
+    for (c = 0; c < L->cols; c++)
+    {
+        // Cells 2c and 2c+1 of level l-1 (just 2c, at the right edge)
+        int c0 = 2*c, c1 = (2*c + 1 < prev_cols ? 2*c + 1 : 2*c);
+        double s  = sum[c0] + (c1 != c0 ? sum[c1] : 0.0);
+        double lo = MIN( min[c0], min[c1] );
+        double hi = MAX( max[c0], max[c1] );
+        if (first)
+        {
+            L->sum[c] = s;
+            L->min[c] = lo;
+            L->max[c] = hi;
+        }
+        else
+        {
+            L->sum[c] += s;
+            L->min[c] = MIN( L->min[c], lo );
+            L->max[c] = MAX( L->max[c], hi );
+        }
+    }
+
+    L->pending++;
+    if (L->pending == 2 || 2 * L->done + L->pending == prev_rows)
+        finish_row( b, l );
+}
+
+int pyramid_add_rows( struct pyramid_builder *b, double **M, int n )
+/* Add the next n rows of the matrix (M[0] .. M[n-1], each cols long).
+ * Returns 0, or -1 if something couldn't be written (or there are more
+ * rows than the matrix has).
+ */
+{
+    int r;
+    if (b->rows_in + n > b->rows)
+        b->failed = 1;
+    for (r = 0; r < n && !b->failed; r++)
+    {
+        if (b->levels > 0)
+            add_row( b, 1, M[r], M[r], M[r], b->rows, b->cols );
+        b->rows_in++;
+    }
+    return (b->failed ? -1 : 0);
+}
+
+int pyramid_finish( struct pyramid_builder *b )
+/* Write the header (if all the rows went in and were written), close the
+ * file and free everything. Returns 0, or -1 on failure.
+ */
+{
+    int failed = (b->failed || b->rows_in != b->rows);
+    if (!failed)
+    {
+        struct pyramid_header h;
+        memset( &h, 0, sizeof(h) );
+        strncpy( h.magic, PYRAMID_MAGIC, sizeof(h.magic) );
+        h.rows = b->rows;
+        h.cols = b->cols;
+        h.levels = b->levels;
+        failed = (write_all( b->fd, &h, sizeof(h), 0 ) != 0);
+    }
+    if (b->fd >= 0 && close( b->fd ) != 0)
+        failed = 1;
+
+    int l;
+    if (b->level != NULL)
+        for (l = 1; l <= b->levels; l++)
+        {
+            free( b->level[l].sum );
+            free( b->level[l].min );
+            free( b->level[l].max );
+        }
+    free( b->level );
+    free( b->base );
+    free( b->out );
+    free( b );
+    return (failed ? -1 : 0);
+}
+
+
+/*****************************************************************************
+ * Reading
+ *****************************************************************************/
+
+struct pyramid *pyramid_open( const char *basename )
+/* Open [basename].bin and [basename].pyr. Returns NULL if either can't be
+ * opened, or they don't go together. */
+{
+    struct pyramid *p = calloc( 1, sizeof(struct pyramid) );
+    if (p == NULL)
+        return NULL;
+    char filename[1024];
+    snprintf( filename, sizeof(filename), "%s.bin", basename );
+    p->bin = open( filename, O_RDONLY );
+    snprintf( filename, sizeof(filename), "%s.pyr", basename );
+    p->pyr = open( filename, O_RDONLY );
+
+    struct stat st;
+    int ok = (p->bin >= 0 && p->pyr >= 0 &&
+              read_all( p->pyr, &p->h, sizeof(p->h), 0 ) == 0 &&
+              strncmp( p->h.magic, PYRAMID_MAGIC, sizeof(p->h.magic) ) == 0 &&
+              p->h.rows > 0 && p->h.cols > 0 &&
+              p->h.levels == count_levels( p->h.rows, p->h.cols ) &&
+              fstat( p->bin, &st ) == 0 &&
+              st.st_size == (off_t)p->h.rows * p->h.cols * (off_t)sizeof(double));
+    if (ok)
+    {
+        p->base = level_offsets( p->h.rows, p->h.cols, p->h.levels );
+        ok = (p->base != NULL && fstat( p->pyr, &st ) == 0 &&
+              st.st_size == p->base[p->h.levels + 1]);
+    }
+    if (!ok)
+    {
+        pyramid_close( p );
+        return NULL;
+    }
+    return p;
+}
+
+void pyramid_close( struct pyramid *p )
+{
+    if (p->bin >= 0)
+        close( p->bin );
+    if (p->pyr >= 0)
+        close( p->pyr );
+    free( p->base );
+    free( p->row );
+    free( p );
+}
+
+int pyramid_levels( const struct pyramid *p )
+/* The smallest level (1x1). Level 0 is the matrix itself. */
+{
+    return p->h.levels;
+}
+
+void pyramid_level_size( const struct pyramid *p, int level, int *rows, int *cols )
+{
+    long long r = p->h.rows, c = p->h.cols;
+    *rows = (int)((r + (1LL << level) - 1) >> level);
+    *cols = (int)((c + (1LL << level) - 1) >> level);
+}
+
+int pyramid_read( struct pyramid *p, int level, int stat, int r0, int c0,
+                  int h, int w, float *out )
+/* Read a window of one level.
+ *
+ * Inputs:
+ *   struct pyramid *p = from pyramid_open()
+ *   int level         = 0 (the matrix itself) .. pyramid_levels( p )
+ *   int stat          = PYR_MEAN, PYR_MIN or PYR_MAX (all the same for
+ *                       level 0)
+ *   int r0, c0        = the top left corner of the window, in the level's
+ *                       own rows and columns (see pyramid_level_size())
+ *   int h, w          = the size of the window
+ *   float *out        = room for h*w floats, which get the window row by row
+ * Returns:
+ *   0, or -1 if the window doesn't fit in the level or can't be read
+ */
+{
+    int rows, cols, r;
+    if (level < 0 || level > p->h.levels || stat < 0 || stat >= PYR_STATS)
+        return -1;
+    pyramid_level_size( p, level, &rows, &cols );
+    if (r0 < 0 || c0 < 0 || h < 0 || w < 0 || r0 + h > rows || c0 + w > cols)
+        return -1;
+
+    if (level == 0)
+    {
+        if (p->row_len < w)
+        {
+            free( p->row );
+            p->row = malloc( w * sizeof(double) );
+            p->row_len = (p->row == NULL ? 0 : w);
+            if (p->row == NULL)
+                return -1;
+        }
+        for (r = 0; r < h; r++)
+        {
+            off_t off = ((off_t)(r0 + r) * cols + c0) * sizeof(double);
+            if (read_all( p->bin, p->row, w * sizeof(double), off ) != 0)
+                return -1;
+            int c;
+            for (c = 0; c < w; c++)
+                out[(size_t)r * w + c] = p->row[c];
+        }
+        return 0;
+    }
+
+    off_t start = p->base[level] + (off_t)stat * rows * cols * sizeof(float);
+    if (w == cols)   // whole rows: one read does it
+        return read_all( p->pyr, out, (size_t)h * w * sizeof(float),
+                         start + (off_t)r0 * cols * sizeof(float) );
+    for (r = 0; r < h; r++)
+    {
+        off_t off = start + ((off_t)(r0 + r) * cols + c0) * sizeof(float);
+        if (read_all( p->pyr, out + (size_t)r * w, w * sizeof(float), off ) != 0)
+            return -1;
+    }
+    return 0;
+}
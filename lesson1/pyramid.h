@@ -0,0 +1,52 @@
+/*****************************************************************************
+ * pyramid.h
+ *
+ * Smaller and smaller copies of a big binary matrix (mean, min and max of
+ * each 2x2, 4x4, 8x8, ... block), for looking at it without reading all of
+ * it. See pyramid.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdint.h>
+
+#define  PYRAMID_MAGIC  "PYRAMID"
+
+// What each level keeps about the cells of the matrix under each of its cells
+#define  PYR_MEAN   0
+#define  PYR_MIN    1
+#define  PYR_MAX    2
+#define  PYR_STATS  3
+
+/* The start of a [basename].pyr file. Level 1 follows straight after (its
+   mean, then its min, then its max, each (rows/2) x (cols/2) floats, row by
+   row), then level 2, and so on.
+*/
+struct pyramid_header
+{
+    char    magic[8];
+    int32_t rows;       // the size of the matrix itself (level 0)
+    int32_t cols;
+    int32_t levels;     // levels 1 .. levels are in the file
+    int32_t reserved;
+};
+
+// Building: feed in the matrix a few rows at a time, as it's being written
+struct pyramid_builder;
+
+struct pyramid_builder *pyramid_create( const char *, int, int );
+int  pyramid_add_rows( struct pyramid_builder *, double **, int );
+int  pyramid_finish( struct pyramid_builder * );
+
+// Reading: any window of any level (level 0 comes from [basename].bin)
+struct pyramid;
+
+struct pyramid *pyramid_open( const char * );
+void pyramid_close( struct pyramid * );
+int  pyramid_levels( const struct pyramid * );
+void pyramid_level_size( const struct pyramid *, int, int *, int * );
+int  pyramid_read( struct pyramid *, int, int, int, int, int, int, float * );
+
+#endif
@@ -0,0 +1,214 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A demonstration of pyramid.c. It writes the same ripple matrix as
+ * fileio.c (see ripples.c), in the same binary format ([basename].bin).
+ * fileio.c builds the pyramid of a matrix it holds in memory; this writes
+ * a band of rows at a time, so that the whole matrix never has to be in
+ * memory at once (a 50000x50000 one would take 20 GB). Each band also goes
+ * into the pyramid, [basename].pyr, on its way out. Then it opens them again as a viewer
+ * would, draws the whole matrix in characters from a small level, reads a
+ * window of a bigger one, and checks some cells against the matrix itself.
+ *
+ *   $ make -f Makefile-advanced pyramid_demo
+ *   $ ./pyramid_demo ripples 4000 4000
+ *   $ ./pyramid_demo ripples 50000 50000      (20 GB + 10 GB of disk)
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "pyramid.h"
+#include "ripples.h"
+
+#define  BAND_ROWS  256    // rows made and written at a time
+#define  PREVIEW    64     // the most columns of characters to draw
+#define  WINDOW     512    // the window to read
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void usage()
+{
+    printf( "usage: pyramid_demo [basename] [rows cols]\n\n" );
+    printf( "Writes the ripples from fileio.c to [basename].bin, and a pyramid of\n" );
+    printf( "smaller and smaller copies of it to [basename].pyr (see pyramid.c),\n" );
+    printf( "then uses the pyramid to draw the whole matrix.\n" );
+}
+
+static void draw( const float *M, int rows, int cols )
+/* One character per cell, from ' ' (-1) to '@' (1). Characters are about
+ * twice as tall as they are wide, so only every other row is drawn. */
+{
+    const char *shades = " .:-=+*#%@";
+    int n = strlen( shades ), r, c;
+    for (r = 0; r < rows; r += 2)
+    {
+        for (c = 0; c < cols; c++)
+        {
+            int i = (int)((M[(size_t)r * cols + c] + 1.0) / 2.0 * n);
+            putchar( shades[i < 0 ? 0 : (i >= n ? n - 1 : i)] );
+        }
+        putchar( '\n' );
+    }
+}
+
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 2)
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    int rows = (argc > 3 ? atoi( argv[2] ) : 4000);
+    int cols = (argc > 3 ? atoi( argv[3] ) : 4000);
+
+    char binfile[1024], pyrfile[1024];
+    snprintf( binfile, sizeof(binfile), "%s.bin", argv[1] );
+    snprintf( pyrfile, sizeof(pyrfile), "%s.pyr", argv[1] );
+
+    // 1) Write the matrix and the pyramid together, a band at a time
+    double **band = malloc( BAND_ROWS * sizeof(double *) );
+    double *data = malloc( (size_t)BAND_ROWS * cols * sizeof(double) );
+    FILE *f = fopen( binfile, "w" );
+    struct pyramid_builder *b = pyramid_create( pyrfile, rows, cols );
+    if (band == NULL || data == NULL || f == NULL || b == NULL)
+    {
+        fprintf( stderr, "error: could not start writing %s and %s\n", binfile, pyrfile );
+        exit(EXIT_FAILURE);
+    }
+    int r, c;
+    for (r = 0; r < BAND_ROWS; r++)
+        band[r] = data + (size_t)r * cols;
+
+    double t_make = 0.0, t_write = 0.0, t_pyramid = 0.0, start;
+    for (r = 0; r < rows; r += BAND_ROWS)
+    {
+        int n = (rows - r < BAND_ROWS ? rows - r : BAND_ROWS);
+        start = now();
+        make_ripple_rows( band, r, n, rows, cols );
+        t_make += now() - start;
+
+        start = now();
+        if (fwrite( data, sizeof(double), (size_t)n * cols, f ) != (size_t)n * cols)
+        {
+            fprintf( stderr, "error: could not write %s\n", binfile );
+            exit(EXIT_FAILURE);
+        }
+        t_write += now() - start;
+
+        start = now();
+        if (pyramid_add_rows( b, band, n ) != 0)
+        {
+            fprintf( stderr, "error: could not write %s\n", pyrfile );
+            exit(EXIT_FAILURE);
+        }
+        t_pyramid += now() - start;
+    }
+    start = now();
+    if (fclose( f ) != 0 || pyramid_finish( b ) != 0)
+    {
+        fprintf( stderr, "error: could not finish %s and %s\n", binfile, pyrfile );
+        exit(EXIT_FAILURE);
+    }
+    t_write += now() - start;
+    free( data );
+    free( band );
+
+    printf( "%dx%d matrix: making it %.3f s, writing %s %.3f s, pyramid %.3f s\n",
+            rows, cols, t_make, binfile, t_write, t_pyramid );
+
+    // 2) Look at it as a viewer would
+    struct pyramid *p = pyramid_open( argv[1] );
+    if (p == NULL)
+    {
+        fprintf( stderr, "error: could not open %s and %s\n", binfile, pyrfile );
+        exit(EXIT_FAILURE);
+    }
+
+    // The whole matrix, from the first level that's no more than PREVIEW wide
+    int level, lrows, lcols;
+    for (level = 0; level < pyramid_levels( p ); level++)
+    {
+        pyramid_level_size( p, level, &lrows, &lcols );
+        if (lcols <= PREVIEW)
+            break;
+    }
+    pyramid_level_size( p, level, &lrows, &lcols );
+    float *preview = malloc( (size_t)lrows * lcols * sizeof(float) );
+    start = now();
+    if (preview == NULL || pyramid_read( p, level, PYR_MEAN, 0, 0, lrows, lcols, preview ) != 0)
+    {
+        fprintf( stderr, "error: could not read level %d\n", level );
+        exit(EXIT_FAILURE);
+    }
+    double t_preview = now() - start;
+    printf( "\nLevel %d (%dx%d, each cell the mean of up to %dx%d), read in %.6f s:\n\n",
+            level, lrows, lcols, 1 << level, 1 << level, t_preview );
+    draw( preview, lrows, lcols );
+    free( preview );
+
+    // A window from the middle of level 2 (or whatever's there), and the
+    // same cells worked out from the matrix itself
+    int wl = (pyramid_levels( p ) < 2 ? pyramid_levels( p ) : 2);
+    pyramid_level_size( p, wl, &lrows, &lcols );
+    int h = (lrows < WINDOW ? lrows : WINDOW), w = (lcols < WINDOW ? lcols : WINDOW);
+    int r0 = (lrows - h) / 2, c0 = (lcols - w) / 2, k = 1 << wl;
+    float *win[PYR_STATS];
+    float *cells = malloc( (size_t)k * cols * sizeof(float) );
+    int s;
+    start = now();
+    for (s = 0; s < PYR_STATS; s++)
+    {
+        win[s] = malloc( (size_t)h * w * sizeof(float) );
+        if (win[s] == NULL || pyramid_read( p, wl, s, r0, c0, h, w, win[s] ) != 0)
+        {
+            fprintf( stderr, "error: could not read a window of level %d\n", wl );
+            exit(EXIT_FAILURE);
+        }
+    }
+    double t_window = now() - start;
+
+    // Check the first row of the window
+    double max_error = 0.0;
+    int rk = (k < rows - r0 * k ? k : rows - r0 * k);
+    if (cells == NULL || pyramid_read( p, 0, PYR_MEAN, r0 * k, 0, rk, cols, cells ) != 0)
+    {
+        fprintf( stderr, "error: could not read the matrix\n" );
+        exit(EXIT_FAILURE);
+    }
+    for (c = 0; c < w; c++)
+    {
+        int cc0 = (c0 + c) * k, cc1 = (cc0 + k < cols ? cc0 + k : cols), i, j;
+        double sum = 0.0, lo = INFINITY, hi = -INFINITY;
+        for (i = 0; i < rk; i++)
+            for (j = cc0; j < cc1; j++)
+            {
+                double x = cells[(size_t)i * cols + j];
+                sum += x;
+                lo = fmin( lo, x );
+                hi = fmax( hi, x );
+            }
+        max_error = fmax( max_error, fabs( win[PYR_MEAN][c] - sum / (rk * (cc1 - cc0)) ) );
+        max_error = fmax( max_error, fabs( win[PYR_MIN][c] - lo ) );
+        max_error = fmax( max_error, fabs( win[PYR_MAX][c] - hi ) );
+    }
+    printf( "\nA %dx%d window of level %d (mean, min and max), read in %.6f s;\n", h, w, wl, t_window );
+    printf( "largest difference from the matrix itself (in its first row): %g\n", max_error );
+
+    for (s = 0; s < PYR_STATS; s++)
+        free( win[s] );
+    free( cells );
+    pyramid_close( p );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * ripples.c
+ *
+ * The pattern of concentric ripples that fileio.c writes out. mio_demo.c,
+ * wave_demo.c, pyramid_demo.c, lesson3/placement_demo.c and the Python
+ * Matrix in python-integration/matrix.c start from the very same matrix, so
+ * they all use these functions rather than each keeping its own copy of
+ * the formula (which would only have to drift once for their files to stop
+ * matching).
+ *
+ * make_ripple_rows() makes any band of rows on its own, so a matrix too big
+ * to hold in memory can be made (and written) a band at a time, as
+ * pyramid_demo.c does. The rows are shared among threads, if OpenMP is
+ * switched on.
+ *
+ *****************************************************************************/
+
+#include <math.h>
+
+#include "ripples.h"
+
+
+void make_ripple_rows( double **band, int r0, int n, int rows, int cols )
+/* This function will populate a band of rows of a rows x cols matrix with
+ * values between -1.0 and 1.0 such that they form a pattern of concentric
+ * ripples spreading out from the centre of the whole matrix.
+ *
+ * Inputs:
+ *   double **band = where to put the rows (band[0] .. band[n-1], each cols
+ *                   long)
+ *   int r0        = the first row of the matrix to make
+ *   int n         = the number of rows to make
+ *   int rows      = the number of rows in the whole matrix
+ *   int cols      = the number of columns in the whole matrix
+ */
+{
+    // First, find the centre of the array
+    int xc = cols / 2; // <-- Integer division!!
+    int yc = rows / 2;
+
+    // Some variables to help calculate the ripples
+
+    double ripple_size = (rows < cols ? rows / 6.0 : cols / 6.0);
+    /*                                ^            ^
+       C-style ternary operator! -----+------------+
+       (COND ? X : Y) is shorthand for
+       if (COND is true), use value X, otherwise use Y
+    */
+
+    // Now, iterate through the array elements. Each row is independent of
+    // the others, so the threads can share them out.
+    int r, c;    // to iterate through (r)ows and (c)olumns, respectively
+    #pragma omp parallel for private(c) schedule(static)
+    for (r = 0; r < n; r++)
+    for (c = 0; c < cols; c++)
+    {
+        // In the following, "hypot", "cos", and "M_PI" are all from math.h
+        double dist = hypot( c-xc, r0+r-yc ); // i.e. distance from centre
+        band[r][c] = cos( 2.0 * M_PI * dist / ripple_size );
+    }
+}
+
+
+void make_ripples( double **M, int rows, int cols )
+/* This function will populate the whole of a rows x cols matrix with the
+ * ripples (see make_ripple_rows()).
+ *
+ * Inputs:
+ *   double **M = the 2D array to be populated
+ *   int rows   = the number of rows in M
+ *   int cols   = the number of columns in M
+ */
+{
+    make_ripple_rows( M, 0, rows, rows, cols );
+}
@@ -0,0 +1,15 @@
+/*****************************************************************************
+ * ripples.h
+ *
+ * The matrix of concentric ripples that fileio.c writes out, and that the
+ * other programs here start from. See ripples.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef RIPPLES_H
+#define RIPPLES_H
+
+void make_ripples( double **, int, int );
+void make_ripple_rows( double **, int, int, int, int );
+
+#endif
@@ -0,0 +1,298 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * wave.c
+ *
+ * The ripples that fileio.c makes are a fine starting point for a wave: let
+ * go of them, and they spread out, bounce off the edges and interfere. The
+ * 2-D wave equation, with a grid spacing dx and time step dt, becomes
+ *
+ *   u[t+1][r][c] = 2 u[t][r][c] - u[t-1][r][c]
+ *                + C^2 ( u[t][r-1][c] + u[t][r+1][c] + u[t][r][c-1] + u[t][r][c+1]
+ *                        - 4 u[t][r][c] )
+ *
+ * where C = (wave speed) * dt / dx (the "Courant number") must be at most
+ * 1/sqrt(2), or the numbers blow up. Each new value needs five neighbouring
+ * values from now and one from the step before (a "stencil"). The edges of
+ * the field are held where they start.
+ *
+ * The obvious way to do it, wave_run_simple(), sweeps the whole field once
+ * per step. That does about 7 floating-point operations per cell, and moves
+ * 24 bytes per cell to and from memory (read two fields, write one): a
+ * modern core can do the arithmetic several times faster than memory can
+ * deliver the numbers, so once the field doesn't fit in the cache, the
+ * sweep goes exactly as fast as memory does, however many cores join in.
+ *
+ * wave_run() gets around that with "temporal blocking": it takes a tile of
+ * the field, small enough to stay in the cache, and takes several steps
+ * (block_steps) on it before moving on. The catch is that the cells on a
+ * tile's edge need their neighbours' values, which the neighbouring tiles
+ * haven't computed yet. So each tile is copied out with a border block_steps
+ * cells wide; after each step the outermost ring of the copy is out of date
+ * (its own neighbours were missing), and the part that's still right
+ * shrinks by one cell all round. After block_steps steps, exactly the tile
+ * itself is left:
+ *
+ *     +-----------------+     +-----------------+     +-----------------+
+ *     | border          |     | . . . . . . . . |     | . . . . . . . . |
+ *     |   +---------+   |     | .  +---------+  |     | .             . |
+ *     |   |  tile   |   | --> | .  |         |  | --> | .  +---------+ . |
+ *     |   +---------+   |     | .  +---------+  |     | .  |  tile   | . |
+ *     |                 |     | . . . . . . . . |     | .  +---------+ . |
+ *     +-----------------+     +-----------------+     +-----------------+
+ *          step 0                 step 1                 step block_steps
+ *
+ * The border cells get computed by more than one tile (a little wasted
+ * work), but memory only sees each cell go in and out once per block_steps
+ * steps. Since the tiles don't depend on each other, threads (OpenMP) can
+ * each take a tile at a time. The results go to a second pair of fields,
+ * because other tiles still need the old values for their borders.
+ *
+ * The innermost loop, along a row, has no dependencies between one cell
+ * and the next, and "#pragma omp simd" tells the compiler so: it does four
+ * or eight cells per instruction with AVX (compile with -march=native).
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bigalloc.h"
+#include "wave.h"
+
+static double **new_field( int rows, int cols )
+/* One contiguous block with row pointers, as in create_matrix() in fileio.c.
+ * It's zeroed by the threads that will use it most, so that on a machine
+ * with several memory controllers each part lands close to them.
+ */
+{
+    double **M = malloc( rows * sizeof(double *) );
+    double *data = big_alloc( (size_t)rows * cols * sizeof(double), 0 );
+    if (M == NULL || data == NULL)
+    {
+        free( M );
+        if (data != NULL)
+            big_free( data );
+        return NULL;
+    }
+
+    int r;
+    #pragma omp parallel for schedule(static)
+    for (r = 0; r < rows; r++)
+    {
+        M[r] = data + (size_t)r * cols;
+        memset( M[r], 0, cols * sizeof(double) );
+    }
+    return M;
+}
+
+static void free_field( double **M )
+{
+    if (M != NULL)
+    {
+        big_free( M[0] );
+        free( M );
+    }
+}
+
+
+struct wave *wave_create( int rows, int cols, double courant )
+/* Set up a rows x cols field (all zero: fill in w->cur, then call
+ * wave_start()).
+ *
+ * Inputs:
+ *   int rows, cols  = the size of the field (at least 3x3)
+ *   double courant  = how many cells a wave moves in one step (at most
+ *                     1/sqrt(2) = 0.707...)
+ * Returns:
+ *   struct wave * = the new wave (free with wave_destroy()), or NULL
+ */
+{
+    if (rows < 3 || cols < 3 || !(courant > 0.0 && courant * courant <= 0.5))
+        return NULL;
+
+    struct wave *w = calloc( 1, sizeof(struct wave) );
+    if (w == NULL)
+        return NULL;
+    w->rows = rows;
+    w->cols = cols;
+    w->c2 = courant * courant;
+    w->prev = new_field( rows, cols );
+    w->cur = new_field( rows, cols );
+    w->next_prev = new_field( rows, cols );
+    w->next_cur = new_field( rows, cols );
+    if (w->prev == NULL || w->cur == NULL || w->next_prev == NULL || w->next_cur == NULL)
+    {
+        wave_destroy( w );
+        return NULL;
+    }
+    wave_set_tiling( w, 0, 0, 0 );
+    return w;
+}
+
+void wave_destroy( struct wave *w )
+{
+    free_field( w->prev );
+    free_field( w->cur );
+    free_field( w->next_prev );
+    free_field( w->next_cur );
+    free( w );
+}
+
+void wave_start( struct wave *w )
+/* Start from w->cur, standing still (the step before looks the same) */
+{
+    int r;
+    #pragma omp parallel for schedule(static)
+    for (r = 0; r < w->rows; r++)
+        memcpy( w->prev[r], w->cur[r], w->cols * sizeof(double) );
+    w->step = 0;
+}
+
+void wave_set_tiling( struct wave *w, int tile_rows, int tile_cols, int block_steps )
+/* How wave_run() works through the field: tiles of tile_rows x tile_cols,
+ * block_steps steps at a time. Each thread works on a copy of a tile and
+ * its border, which takes
+ *   2 * (tile_rows + 2*block_steps) * (tile_cols + 2*block_steps) * 8 bytes,
+ * and should fit in the (per core) L2 cache. 0 means the default.
+ */
+{
+    w->tile_rows = (tile_rows > 0 ? tile_rows : WAVE_TILE_ROWS);
+    w->tile_cols = (tile_cols > 0 ? tile_cols : WAVE_TILE_COLS);
+    w->block_steps = (block_steps > 0 ? block_steps : WAVE_BLOCK_STEPS);
+}
+
+
+static inline void step_row( double *restrict p, const double *restrict up,
+                             const double *restrict u, const double *restrict down,
+                             int c0, int c1, double c2 )
+/* One step along one row, for columns c0 to c1-1. p holds the row as it was
+ * a step ago, and gets the row a step from now; up, u and down are the rows
+ * above, at and below it now.
+ */
+{
+    double a = 2.0 - 4.0 * c2;
+    int c;
+    #pragma omp simd
+    for (c = c0; c < c1; c++)
+        p[c] = a * u[c] + c2 * (up[c] + down[c] + u[c-1] + u[c+1]) - p[c];
+}
+
+
+void wave_run_simple( struct wave *w, long steps )
+/* Take steps steps, sweeping the whole field once per step */
+{
+    long s;
+    for (s = 0; s < steps; s++)
+    {
+        int r;
+        #pragma omp parallel for schedule(static)
+        for (r = 1; r < w->rows - 1; r++)
+            step_row( w->prev[r], w->cur[r-1], w->cur[r], w->cur[r+1], 1, w->cols - 1, w->c2 );
+
+        double **t = w->prev;
+        w->prev = w->cur;
+        w->cur = t;
+        w->step++;
+    }
+}
+
+
+static void run_tile( struct wave *w, int r0, int c0, int T, double *lp, double *lc )
+/* T steps on the tile whose top left corner is (r0, c0), using the buffers
+ * lp and lc for the copy of it (and its border) from prev and cur. The tile
+ * ends up in next_prev and next_cur.
+ */
+{
+    int rows = w->rows, cols = w->cols;
+    int r1 = (r0 + w->tile_rows < rows ? r0 + w->tile_rows : rows);
+    int c1 = (c0 + w->tile_cols < cols ? c0 + w->tile_cols : cols);
+
+    // The copy: the tile plus a border of T cells, except past the field's edges
+    int br0 = (r0 - T > 0 ? r0 - T : 0), br1 = (r1 + T < rows ? r1 + T : rows);
+    int bc0 = (c0 - T > 0 ? c0 - T : 0), bc1 = (c1 + T < cols ? c1 + T : cols);
+    int h = br1 - br0, n = bc1 - bc0;
+    int r, s;
+    for (r = 0; r < h; r++)
+    {
+        memcpy( lp + (size_t)r * n, w->prev[br0 + r] + bc0, n * sizeof(double) );
+        memcpy( lc + (size_t)r * n, w->cur[br0 + r] + bc0, n * sizeof(double) );
+    }
+
+    for (s = 1; s <= T; s++)
+    {
+        // The part still worth updating shrinks by a cell all round each step,
+        // except at the edges of the field, which don't move
+        int lo_r = (br0 == 0 ? 1 : s), hi_r = (br1 == rows ? h - 1 : h - s);
+        int lo_c = (bc0 == 0 ? 1 : s), hi_c = (bc1 == cols ? n - 1 : n - s);
+        for (r = lo_r; r < hi_r; r++)
+            step_row( lp + (size_t)r * n, lc + (size_t)(r-1) * n, lc + (size_t)r * n,
+                      lc + (size_t)(r+1) * n, lo_c, hi_c, w->c2 );
+
+        double *t = lp;
+        lp = lc;
+        lc = t;
+    }
+
+    for (r = r0; r < r1; r++)
+    {
+        size_t off = (size_t)(r - br0) * n + (c0 - bc0);
+        memcpy( w->next_prev[r] + c0, lp + off, (c1 - c0) * sizeof(double) );
+        memcpy( w->next_cur[r] + c0, lc + off, (c1 - c0) * sizeof(double) );
+    }
+}
+
+void wave_run( struct wave *w, long steps )
+/* Take steps steps, block_steps at a time, tile by tile (see the top of
+ * this file). The result is exactly the same as wave_run_simple()'s.
+ */
+{
+    int B = w->block_steps;
+    long tiles_down = (w->rows + w->tile_rows - 1) / w->tile_rows;
+    long tiles_across = (w->cols + w->tile_cols - 1) / w->tile_cols;
+    size_t buf_size = (size_t)(w->tile_rows + 2*B) * (w->tile_cols + 2*B) * sizeof(double);
+
+    #pragma omp parallel
+    {
+        // Every thread has its own copy of a tile to work on
+        double *lp = aligned_alloc( 64, (buf_size + 63) / 64 * 64 );
+        double *lc = aligned_alloc( 64, (buf_size + 63) / 64 * 64 );
+        long done;
+        if (lp == NULL || lc == NULL)
+        {
+            fprintf( stderr, "error: wave_run: could not allocate %zu bytes\n", 2 * buf_size );
+            exit(EXIT_FAILURE);
+        }
+
+        for (done = 0; done < steps; done += B)
+        {
+            int T = (steps - done < B ? steps - done : B);
+            long t;
+
+            #pragma omp for schedule(dynamic)
+            for (t = 0; t < tiles_down * tiles_across; t++)
+                run_tile( w, (t / tiles_across) * w->tile_rows,
+                          (t % tiles_across) * w->tile_cols, T, lp, lc );
+
+            // Everyone has finished with prev and cur: now swap them with
+            // next_prev and next_cur (and wait until that's done)
+            #pragma omp single
+            {
+                double **t1 = w->prev, **t2 = w->cur;
+                w->prev = w->next_prev;
+                w->cur = w->next_cur;
+                w->next_prev = t1;
+                w->next_cur = t2;
+                w->step += T;
+            }
+        }
+
+        free( lp );
+        free( lc );
+    }
+}
@@ -0,0 +1,36 @@
+/*****************************************************************************
+ * wave.h
+ *
+ * Stepping the 2-D wave equation forward in time, many steps per trip
+ * through memory. See wave.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef WAVE_H
+#define WAVE_H
+
+// Default tiling (see wave_set_tiling())
+#define  WAVE_TILE_ROWS    64
+#define  WAVE_TILE_COLS    512
+#define  WAVE_BLOCK_STEPS  16
+
+struct wave
+{
+    int rows, cols;
+    double c2;                  // (c dt / dx)^2: at most 0.5, or it blows up
+    double **prev, **cur;       // the field one step ago, and now
+    double **next_prev, **next_cur;
+    long step;                  // steps taken so far
+    int tile_rows, tile_cols;   // how wave_run() cuts up the field...
+    int block_steps;            // ... and how many steps it takes per tile
+};
+
+struct wave *wave_create( int, int, double );
+void wave_destroy( struct wave * );
+void wave_start( struct wave * );
+void wave_set_tiling( struct wave *, int, int, int );
+
+void wave_run( struct wave *, long );
+void wave_run_simple( struct wave *, long );
+
+#endif
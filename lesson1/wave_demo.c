@@ -0,0 +1,189 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A demonstration of wave.c. It starts a wave from the ripples of fileio.c,
+ * takes the given number of steps (writing a snapshot of the field every so
+ * often), and reports how many cells it updated per second. Then it does the
+ * same again with one sweep of the field per step, checks that the answers
+ * agree, and compares both with how fast memory can copy.
+ *
+ *   $ make -f Makefile-advanced wave_demo
+ *   $ ./wave_demo ripples 4000 4000 400              (no snapshots)
+ *   $ ./wave_demo ripples 4000 4000 400 100          (ripples_000100.bin, ...)
+ *   $ ./wave_demo ripples 4000 4000 400 100 f16      (ripples_000100.f16, ...)
+ *   $ OMP_NUM_THREADS=8 WAVE_TILE=64,512,16 ./wave_demo ripples 8000 8000 400
+ *
+ * The snapshots are in the same format as fileio.c's [basename].bin (or,
+ * with an encoding, matrix_codec.c's).
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bigalloc.h"
+#include "matrix_codec.h"
+#include "parallel_write.h"
+#include "ripples.h"
+#include "wave.h"
+
+#define  COURANT  0.5
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void usage()
+{
+    printf( "usage: wave_demo [basename] [rows cols [steps [every [encoding]]]]\n\n" );
+    printf( "Lets the ripples from fileio.c go, and times the 2-D wave equation\n" );
+    printf( "(see wave.c). Every \"every\" steps (if given), the field is written\n" );
+    printf( "to [basename]_[step].bin, or [basename]_[step].[encoding] if an encoding\n" );
+    printf( "(f64, f32, f16, bf16, i16 or i8) is given.\n" );
+    printf( "WAVE_TILE=rows,cols,steps in the environment sets the tiling.\n" );
+}
+
+static double snapshot( const char *basename, struct wave *w, const char *encoding )
+/* Write the field as it is now. Returns the time it took. */
+{
+    char filename[1024];
+    double start = now();
+    int failed;
+    if (encoding == NULL)
+    {
+        snprintf( filename, sizeof(filename), "%s_%06ld.bin", basename, w->step );
+        int direct;
+        failed = write_matrix_parallel( filename, w->cur, w->rows, w->cols, 4, &direct );
+    }
+    else
+    {
+        snprintf( filename, sizeof(filename), "%s_%06ld.%s", basename, w->step, encoding );
+        FILE *f = fopen( filename, "w" );
+        failed = (f == NULL ||
+                  write_matrix_encoded( f, w->cur, w->rows, w->cols, encoding_from_name( encoding ) ) != 0);
+        if (f != NULL)
+            fclose( f );
+    }
+    if (failed)
+    {
+        fprintf( stderr, "error: could not write %s\n", filename );
+        exit(EXIT_FAILURE);
+    }
+    return now() - start;
+}
+
+static double copy_bandwidth( double **from, double **to, int rows, int cols )
+/* How fast memory can copy one field to another, in bytes per second
+ * (counting the bytes read and the bytes written) */
+{
+    double best = 0.0;
+    int i, r;
+    for (i = 0; i < 3; i++)
+    {
+        double start = now();
+        #pragma omp parallel for schedule(static)
+        for (r = 0; r < rows; r++)
+            memcpy( to[r], from[r], cols * sizeof(double) );
+        double rate = 2.0 * rows * cols * sizeof(double) / (now() - start);
+        best = fmax( best, rate );
+    }
+    return best;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 2)
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    int rows   = (argc > 3 ? atoi( argv[2] ) : 2000);
+    int cols   = (argc > 3 ? atoi( argv[3] ) : 2000);
+    long steps = (argc > 4 ? atol( argv[4] ) : 200);
+    long every = (argc > 5 ? atol( argv[5] ) : 0);
+    const char *encoding = (argc > 6 ? argv[6] : NULL);
+    if (encoding != NULL && encoding_from_name( encoding ) < 0)
+    {
+        fprintf( stderr, "error: unknown encoding '%s'\n", encoding );
+        exit(EXIT_FAILURE);
+    }
+    if (every <= 0)
+        every = steps;
+
+    struct wave *w = wave_create( rows, cols, COURANT );
+    if (w == NULL)
+    {
+        fprintf( stderr, "error: could not set up a %dx%d wave\n", rows, cols );
+        exit(EXIT_FAILURE);
+    }
+    const char *tiling = getenv( "WAVE_TILE" );
+    if (tiling != NULL)
+    {
+        int tr = 0, tc = 0, bs = 0;
+        sscanf( tiling, "%d,%d,%d", &tr, &tc, &bs );
+        wave_set_tiling( w, tr, tc, bs );
+    }
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    double cells = (double)(rows - 2) * (cols - 2) * steps;
+
+    // 1) Tiled, several steps at a time, with snapshots
+    make_ripples( w->cur, rows, cols );
+    wave_start( w );
+    double t_io = 0.0, start = now();
+    while (w->step < steps)
+    {
+        wave_run( w, (steps - w->step < every ? steps - w->step : every) );
+        if (argc > 5)
+            t_io += snapshot( argv[1], w, encoding );
+    }
+    double t_tiled = now() - start - t_io;
+
+    // Keep the answer to compare (next_prev isn't needed between runs)
+    double **tiled = w->next_prev;
+    int r, c;
+    for (r = 0; r < rows; r++)
+        memcpy( tiled[r], w->cur[r], cols * sizeof(double) );
+
+    // 2) One sweep per step
+    make_ripples( w->cur, rows, cols );
+    wave_start( w );
+    start = now();
+    wave_run_simple( w, steps );
+    double t_simple = now() - start;
+
+    double max_diff = 0.0;
+    for (r = 0; r < rows; r++)
+        for (c = 0; c < cols; c++)
+            max_diff = fmax( max_diff, fabs( tiled[r][c] - w->cur[r][c] ) );
+
+    double bw = copy_bandwidth( w->cur, w->prev, rows, cols );
+
+    printf( "%dx%d field, %ld steps, %d thread%s, tiles %dx%d, %d steps per tile\n",
+            rows, cols, steps, threads, threads == 1 ? "" : "s",
+            w->tile_rows, w->tile_cols, w->block_steps );
+    printf( "  tiled:      %7.3f s, %8.1f Mcells/s", t_tiled, cells / t_tiled / 1e6 );
+    if (argc > 5)
+        printf( " (+ %.3f s writing snapshots)", t_io );
+    printf( "\n" );
+    printf( "  one sweep:  %7.3f s, %8.1f Mcells/s, moving %.1f GB/s\n", t_simple,
+            cells / t_simple / 1e6, 24.0 * cells / t_simple / 1e9 );
+    printf( "  memcpy:                                moving %.1f GB/s\n", bw / 1e9 );
+    printf( "  largest difference between the two: %g\n", max_diff );
+
+    wave_destroy( w );
+    return (max_diff == 0.0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
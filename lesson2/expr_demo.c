@@ -0,0 +1,132 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A demonstration of mymath_expr.c. It calculates
+ *
+ *   f = ((x + y) * (x - y)) / (x * y + 1) - x / y
+ *
+ * for every element of two big arrays, x and y, twice: first one operation
+ * at a time, using the functions in mymath.c and a temporary array for each
+ * intermediate result, and then all at once, with mymath_expr.c.
+ *
+ *   $ make -f Makefile-expr
+ *   $ ./expr_demo
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "mymath_expr.h"
+
+// The functions in mymath.c (see lesson2.txt for making a header for them)
+double add( double, double );
+double subtract( double, double );
+double multiply( double, double );
+double divide( double, double );
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double *new_array( long n )
+{
+    double *a = malloc( n * sizeof(double) );
+    if (a == NULL)
+    {
+        fprintf( stderr, "error: could not allocate %ld doubles\n", n );
+        exit(EXIT_FAILURE);
+    }
+    return a;
+}
+
+static void apply( double (*f)( double, double ), const double *a, const double *b, double *out, long n )
+/* out[i] = f( a[i], b[i] ): one whole pass over memory per operation */
+{
+    long i;
+    for (i = 0; i < n; i++)
+        out[i] = f( a[i], b[i] );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    long n = (argc > 1 ? atol( argv[1] ) : 20000000);
+    long i;
+
+    double *x = new_array( n ), *y = new_array( n );
+    for (i = 0; i < n; i++)
+    {
+        x[i] = 1.0 + i % 1000;
+        y[i] = 2.0 + i % 777;
+    }
+
+    /* One operation at a time: 8 passes, 7 temporary arrays */
+    double *t[7], *f1 = new_array( n );
+    int k;
+    for (k = 0; k < 7; k++)
+        t[k] = new_array( n );
+    double *one = new_array( n );
+    for (i = 0; i < n; i++)
+        one[i] = 1.0;
+
+    double start = now();
+    apply( add,      x,    y,    t[0], n );   // x + y
+    apply( subtract, x,    y,    t[1], n );   // x - y
+    apply( multiply, t[0], t[1], t[2], n );   // (x + y) * (x - y)
+    apply( multiply, x,    y,    t[3], n );   // x * y
+    apply( add,      t[3], one,  t[4], n );   // x * y + 1
+    apply( divide,   t[2], t[4], t[5], n );
+    apply( divide,   x,    y,    t[6], n );   // x / y
+    apply( subtract, t[5], t[6], f1,   n );
+    double eager = now() - start;
+
+    /* All at once. Building the expression calculates nothing yet. */
+    struct expr_graph g;
+    expr_graph_init( &g );
+    struct expr *X = expr_buffer( &g, x );
+    struct expr *Y = expr_buffer( &g, y );
+    struct expr *f =
+        expr_subtract( &g,
+            expr_divide( &g,
+                expr_multiply( &g, expr_add( &g, X, Y ), expr_subtract( &g, X, Y ) ),
+                expr_add( &g, expr_multiply( &g, X, Y ), expr_scalar( &g, 1.0 ) ) ),
+            expr_divide( &g, X, Y ) );
+
+    double *f2 = new_array( n );
+    start = now();
+    if (expr_eval( &g, f, f2, n ) != 0)
+    {
+        fprintf( stderr, "error: expr_eval failed\n" );
+        exit(EXIT_FAILURE);
+    }
+    double lazy = now() - start;
+
+    // They should agree exactly: it's the same arithmetic in the same order
+    long mismatches = 0;
+    for (i = 0; i < n; i++)
+        mismatches += (f1[i] != f2[i]);
+
+    printf( "%ld elements, 8 operations\n", n );
+    printf( "  one at a time: %.3f s (%.0f MB of memory traffic)\n",
+            eager, 8 * 3 * n * sizeof(double) / 1e6 );
+    printf( "  fused:         %.3f s (%.0f MB)\n",
+            lazy, 3 * n * sizeof(double) / 1e6 );
+    printf( "  %ld mismatches\n", mismatches );
+
+    expr_graph_free( &g );
+    for (k = 0; k < 7; k++)
+        free( t[k] );
+    free( one );
+    free( x );
+    free( y );
+    free( f1 );
+    free( f2 );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,358 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * mymath_expr.c
+ *
+ * Suppose x and y are arrays of a million numbers, and we want
+ *
+ *   divide( add( x, y ), multiply( x, y ) )
+ *
+ * for every element. Written as one loop per operation, that's three passes
+ * over memory and two temporary arrays of a million numbers: add() writes
+ * its answer out to memory, and divide() reads it straight back in. For
+ * operations this cheap, all that reading and writing takes far longer than
+ * the arithmetic. The fast way is one loop that does all three operations
+ * on each element while it's in a register, but writing that loop by hand
+ * for every formula gets old quickly.
+ *
+ * So this file does it "lazily". expr_add() and friends don't calculate
+ * anything; they just record what should be calculated, as a graph of
+ * nodes (a tree, except that a node can be used more than once, like x
+ * above). expr_eval() then
+ *
+ *   1) turns the graph into a list of instructions, in an order where each
+ *      node comes after the nodes it uses, giving every intermediate result
+ *      a "slot" (a small scratch array), and reusing a slot once nothing
+ *      needs its contents any more;
+ *   2) runs the whole list on one block of BLOCK elements at a time. The
+ *      slots are only BLOCK elements long, so they stay in the L1 cache,
+ *      and each instruction is a simple loop over a block, which the
+ *      compiler vectorises. Only the inputs are read from memory, and only
+ *      the answer is written back.
+ *
+ * The operations mean exactly what add(), subtract(), multiply() and
+ * divide() in mymath.c mean, element by element.
+ *
+ * (C++ programmers would do this with "expression templates", which build
+ * the same graph at compile time. In C we build it at run time, which costs
+ * a few microseconds per expr_eval(), no matter how long the arrays are.)
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mymath_expr.h"
+
+#define  BLOCK  256   // elements per block: 2 KiB per slot
+
+struct operand
+{
+    const double *buffer;  // an input array, or NULL to use...
+    int slot;              // ... this slot
+};
+
+struct instruction
+{
+    expr_type op;
+    int dst;               // a slot, or -1 for the output array
+    struct operand a, b;
+};
+
+struct program
+{
+    struct instruction *code;
+    int ncode;
+    int nslots;
+    int *free_slots;       // a stack of slots that are no longer needed
+    int nfree;
+    struct expr **scalars; // scalar nodes, whose slots are filled once
+    int nscalars;
+};
+
+void expr_graph_init( struct expr_graph *g )
+{
+    g->nodes = NULL;
+    g->failed = 0;
+}
+
+
+void expr_graph_free( struct expr_graph *g )
+/* Free every node made in g */
+{
+    while (g->nodes != NULL)
+    {
+        struct expr *next = g->nodes->next;
+        free( g->nodes );
+        g->nodes = next;
+    }
+}
+
+
+static struct expr *new_node( struct expr_graph *g, expr_type type,
+                              struct expr *left, struct expr *right )
+{
+    // Building on a node that failed to allocate fails too
+    if (type >= EXPR_ADD && (left == NULL || right == NULL))
+        return NULL;
+
+    struct expr *e = calloc( 1, sizeof(struct expr) );
+    if (e == NULL)
+    {
+        g->failed = 1;
+        return NULL;
+    }
+    e->type = type;
+    e->left = left;
+    e->right = right;
+    e->next = g->nodes;
+    g->nodes = e;
+    return e;
+}
+
+
+struct expr *expr_buffer( struct expr_graph *g, const double *x )
+/* A node standing for the array x (which must still exist at expr_eval()) */
+{
+    struct expr *e = new_node( g, EXPR_BUFFER, NULL, NULL );
+    if (e != NULL)
+        e->buffer = x;
+    return e;
+}
+
+struct expr *expr_scalar( struct expr_graph *g, double value )
+{
+    struct expr *e = new_node( g, EXPR_SCALAR, NULL, NULL );
+    if (e != NULL)
+        e->value = value;
+    return e;
+}
+
+struct expr *expr_add( struct expr_graph *g, struct expr *x, struct expr *y )
+{
+    return new_node( g, EXPR_ADD, x, y );
+}
+
+struct expr *expr_subtract( struct expr_graph *g, struct expr *x, struct expr *y )
+{
+    return new_node( g, EXPR_SUBTRACT, x, y );
+}
+
+struct expr *expr_multiply( struct expr_graph *g, struct expr *x, struct expr *y )
+{
+    return new_node( g, EXPR_MULTIPLY, x, y );
+}
+
+struct expr *expr_divide( struct expr_graph *g, struct expr *x, struct expr *y )
+{
+    return new_node( g, EXPR_DIVIDE, x, y );
+}
+
+/*****************************************************************************
+ * Turning a graph into a list of instructions
+ *****************************************************************************/
+
+static void count_uses( struct program *p, struct expr *e )
+/* First pass: count how many times each node is used as an input, so that
+ * we know when its slot can be reused. Scalars get slots of their own here,
+ * which are filled once and never reused.
+ */
+{
+    if (e->mark != 0)
+        return;
+    e->mark = 1;
+    if (e->type == EXPR_SCALAR)
+    {
+        e->slot = p->nslots++;
+        p->scalars[p->nscalars++] = e;
+    }
+    else if (e->type >= EXPR_ADD)
+    {
+        e->left->uses++;
+        e->right->uses++;
+        count_uses( p, e->left );
+        count_uses( p, e->right );
+    }
+}
+
+
+static int take_slot( struct program *p )
+{
+    if (p->nfree > 0)
+        return p->free_slots[--p->nfree];
+    return p->nslots++;
+}
+
+
+static void release( struct program *p, struct expr *e )
+/* One use of e has been emitted; if it was the last, its slot is free */
+{
+    if (e->type >= EXPR_ADD && --e->uses == 0)
+        p->free_slots[p->nfree++] = e->slot;
+}
+
+
+static struct operand operand_of( const struct expr *e )
+{
+    struct operand o;
+    o.buffer = (e->type == EXPR_BUFFER ? e->buffer : NULL);
+    o.slot = e->slot;
+    return o;
+}
+
+
+static void emit( struct program *p, struct expr *e, const struct expr *root )
+/* Second pass: emit the instructions for e's inputs, then for e itself */
+{
+    if (e->mark == 2)
+        return;
+    e->mark = 2;
+
+    if (e->type == EXPR_BUFFER)
+    {
+        e->slot = -1;
+        return;
+    }
+    if (e->type == EXPR_SCALAR)
+        return;
+
+    emit( p, e->left, root );
+    emit( p, e->right, root );
+
+    /* Take our slot before freeing the inputs' slots, so that no loop ever
+       writes to the slot it's reading from. The root writes to the output.
+    */
+    struct instruction *in = &p->code[p->ncode++];
+    in->op = e->type;
+    in->a = operand_of( e->left );
+    in->b = operand_of( e->right );
+    in->dst = e->slot = (e == root ? -1 : take_slot( p ));
+
+    release( p, e->left );
+    release( p, e->right );
+}
+
+/*****************************************************************************
+ * Running the instructions
+ *****************************************************************************/
+
+static void run_block( const struct program *p, double *slots, double *out, long offset, int len )
+/* Run every instruction on elements offset .. offset+len-1 */
+{
+    int i, k;
+    for (i = 0; i < p->ncode; i++)
+    {
+        const struct instruction *in = &p->code[i];
+        const double *a = (in->a.buffer ? in->a.buffer + offset : slots + in->a.slot * BLOCK);
+        const double *b = (in->b.buffer ? in->b.buffer + offset : slots + in->b.slot * BLOCK);
+        double *d = (in->dst < 0 ? out + offset : slots + in->dst * BLOCK);
+
+        /* One plain loop per operation (rather than a switch inside one
+           loop) is what lets the compiler vectorise them */
+        switch (in->op)
+        {
+            case EXPR_ADD:       for (k = 0; k < len; k++) d[k] = a[k] + b[k];  break;
+            case EXPR_SUBTRACT:  for (k = 0; k < len; k++) d[k] = a[k] - b[k];  break;
+            case EXPR_MULTIPLY:  for (k = 0; k < len; k++) d[k] = a[k] * b[k];  break;
+            case EXPR_DIVIDE:    for (k = 0; k < len; k++) d[k] = a[k] / b[k];  break;
+            default:             break;
+        }
+    }
+}
+
+
+int expr_eval( struct expr_graph *g, struct expr *root, double *out, long n )
+/* Evaluate root for every element 0 <= i < n, writing the answers to out.
+ *
+ * out may be one of the input buffers: each block of the inputs is read
+ * before that block of out is written. The graph can be evaluated again,
+ * e.g. after the contents of the buffers change.
+ *
+ * Inputs:
+ *   struct expr_graph *g = the graph root was made in
+ *   struct expr *root    = the expression to evaluate
+ *   double *out          = where to put the n answers
+ *   long n               = the number of elements
+ * Returns:
+ *   int = 0 on success, -1 if building the graph failed or out of memory
+ */
+{
+    if (g->failed || root == NULL)
+        return -1;
+
+    long i;
+
+    // Expressions without any operations have no instructions to run
+    if (root->type == EXPR_BUFFER)
+    {
+        memmove( out, root->buffer, n * sizeof(double) );
+        return 0;
+    }
+    if (root->type == EXPR_SCALAR)
+    {
+        for (i = 0; i < n; i++)
+            out[i] = root->value;
+        return 0;
+    }
+
+    // Compile
+    struct expr *e;
+    int nnodes = 0;
+    for (e = g->nodes; e != NULL; e = e->next)
+    {
+        e->mark = e->uses = 0;
+        nnodes++;
+    }
+
+    struct program p;
+    memset( &p, 0, sizeof(p) );
+    p.code       = malloc( nnodes * sizeof(struct instruction) );
+    p.free_slots = malloc( nnodes * sizeof(int) );
+    p.scalars    = malloc( nnodes * sizeof(struct expr *) );
+    int failed = (p.code == NULL || p.free_slots == NULL || p.scalars == NULL);
+
+    if (failed)
+    {
+        free( p.code );
+        free( p.free_slots );
+        free( p.scalars );
+        return -1;
+    }
+
+    count_uses( &p, root );
+    emit( &p, root, root );
+
+    // Run, one block at a time, each thread with its own slots
+#ifdef _OPENMP
+#pragma omp parallel reduction(|:failed) if(n > 16*BLOCK)
+#endif
+    {
+        double *slots = aligned_alloc( 64, p.nslots * BLOCK * sizeof(double) );
+        if (slots == NULL)
+            failed = 1;
+        else
+        {
+            int s, k;
+            for (s = 0; s < p.nscalars; s++)
+                for (k = 0; k < BLOCK; k++)
+                    slots[p.scalars[s]->slot * BLOCK + k] = p.scalars[s]->value;
+
+            long nblocks = (n + BLOCK - 1) / BLOCK, b;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+            for (b = 0; b < nblocks; b++)
+            {
+                long offset = b * BLOCK;
+                run_block( &p, slots, out, offset, (n - offset < BLOCK ? n - offset : BLOCK) );
+            }
+            free( slots );
+        }
+    }
+
+    free( p.code );
+    free( p.free_slots );
+    free( p.scalars );
+    return (failed ? -1 : 0);
+}
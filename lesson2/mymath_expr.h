@@ -0,0 +1,55 @@
+/*****************************************************************************
+ * mymath_expr.h
+ *
+ * Lazy, fused evaluation of add/subtract/multiply/divide over arrays.
+ * See mymath_expr.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef MYMATH_EXPR_H
+#define MYMATH_EXPR_H
+
+typedef enum expr_type_t
+{
+    EXPR_BUFFER   = 0,   // an array of doubles
+    EXPR_SCALAR   = 1,   // one number, the same for every element
+    EXPR_ADD      = 2,
+    EXPR_SUBTRACT = 3,
+    EXPR_MULTIPLY = 4,
+    EXPR_DIVIDE   = 5
+} expr_type;
+
+struct expr
+{
+    expr_type type;
+    const double *buffer;       // for EXPR_BUFFER
+    double value;               // for EXPR_SCALAR
+    struct expr *left, *right;  // for the operations
+    struct expr *next;          // (every node in a graph, for freeing)
+
+    // Scratch space for expr_eval()
+    int mark;
+    int uses;
+    int slot;
+};
+
+/* A graph owns all the nodes made in it, and frees them all at once */
+struct expr_graph
+{
+    struct expr *nodes;
+    int failed;                 // set if a node couldn't be allocated
+};
+
+void expr_graph_init( struct expr_graph * );
+void expr_graph_free( struct expr_graph * );
+
+struct expr *expr_buffer( struct expr_graph *, const double * );
+struct expr *expr_scalar( struct expr_graph *, double );
+struct expr *expr_add( struct expr_graph *, struct expr *, struct expr * );
+struct expr *expr_subtract( struct expr_graph *, struct expr *, struct expr * );
+struct expr *expr_multiply( struct expr_graph *, struct expr *, struct expr * );
+struct expr *expr_divide( struct expr_graph *, struct expr *, struct expr * );
+
+int expr_eval( struct expr_graph *, struct expr *, double *, long );
+
+#endif
@@ -0,0 +1,114 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * smallmat.c
+ *
+ * The batched versions of the functions in smallmat.h, which do the same
+ * thing to every matrix in an array: c[i] = a[i] b[i], and so on. Each one
+ * is just a loop around the inline function for one matrix, but because
+ * that function is compiled into the loop, nothing is passed on the stack
+ * and the compiler can overlap the work on neighbouring matrices.
+ *
+ * Built with -fopenmp, the arrays are shared out among all the cores.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+
+#include "smallmat.h"
+
+#ifdef _OPENMP
+#define PARALLEL_FOR  _Pragma( "omp parallel for schedule(static)" )
+#define PARALLEL_FOR_SUM( x )  _Pragma( SMALLMAT_STR( omp parallel for schedule(static) reduction(+:x) ) )
+#define SMALLMAT_STR( s )  #s
+#else
+#define PARALLEL_FOR
+#define PARALLEL_FOR_SUM( x )
+#endif
+
+/* The same four functions for each size. (A macro, rather than including a
+   file three times as smallmat.h does, because they're so short.)
+
+   matN_mul_batch(   a, b, c, n )   : c[i] = a[i] b[i]
+   matN_mulv_batch(  a, x, y, n )   : y[i] = a[i] x[i]
+   matN_inv_batch(   a, inv, det, n ) : inv[i] = the inverse of a[i], and
+                                      det[i] its determinant (det may be
+                                      NULL). Returns how many were singular
+                                      (their inv[i] is left untouched).
+   matN_solve_batch( a, b, x, n )   : solve a[i] x[i] = b[i]. Returns how
+                                      many were singular.
+*/
+#define SMALLMAT_BATCH( N )                                                   \
+                                                                              \
+void mat##N##_mul_batch( const struct mat##N *a, const struct mat##N *b,      \
+                         struct mat##N *c, long n )                           \
+{                                                                             \
+    PARALLEL_FOR                                                              \
+    for (long i = 0; i < n; i++)                                              \
+        c[i] = mat##N##_mul( a[i], b[i] );                                    \
+}                                                                             \
+                                                                              \
+void mat##N##_mulv_batch( const struct mat##N *a, const struct vec##N *x,     \
+                          struct vec##N *y, long n )                          \
+{                                                                             \
+    PARALLEL_FOR                                                              \
+    for (long i = 0; i < n; i++)                                              \
+        y[i] = mat##N##_mulv( a[i], x[i] );                                   \
+}                                                                             \
+                                                                              \
+long mat##N##_inv_batch( const struct mat##N *a, struct mat##N *inv,          \
+                         double *det, long n )                                \
+{                                                                             \
+    long singular = 0;                                                        \
+    PARALLEL_FOR_SUM( singular )                                              \
+    for (long i = 0; i < n; i++)                                              \
+    {                                                                         \
+        double d = mat##N##_inv( a[i], &inv[i] );                             \
+        if (det != NULL)                                                      \
+            det[i] = d;                                                       \
+        singular += (d == 0.0);                                               \
+    }                                                                         \
+    return singular;                                                          \
+}                                                                             \
+                                                                              \
+long mat##N##_solve_batch( const struct mat##N *a, const struct vec##N *b,    \
+                           struct vec##N *x, long n )                         \
+{                                                                             \
+    long singular = 0;                                                        \
+    PARALLEL_FOR_SUM( singular )                                              \
+    for (long i = 0; i < n; i++)                                              \
+        singular += (mat##N##_solve( a[i], b[i], &x[i] ) != 0);               \
+    return singular;                                                          \
+}
+
+SMALLMAT_BATCH( 3 )
+SMALLMAT_BATCH( 4 )
+SMALLMAT_BATCH( 6 )
+
+
+void mat3_apply_batch( struct mat3 R, struct point3d t, const struct point3d *in,
+                       struct point3d *out, long n )
+/* out[i] = R in[i] + t for n points (in and out may be the same array).
+ *
+ * Inputs:
+ *   struct mat3 R             = e.g. a rotation
+ *   struct point3d t          = e.g. a translation
+ *   const struct point3d *in  = the points to transform
+ *   struct point3d *out       = where to put the transformed points
+ *   long n                    = the number of points
+ */
+{
+    PARALLEL_FOR
+    for (long i = 0; i < n; i++)
+        out[i] = mat3_apply( R, t, in[i] );
+}
+
+
+void mat4_apply_batch( struct mat4 T, const struct point3d *in, struct point3d *out, long n )
+/* out[i] = in[i] transformed by the homogeneous matrix T (see mat4_apply()) */
+{
+    PARALLEL_FOR
+    for (long i = 0; i < n; i++)
+        out[i] = mat4_apply( T, in[i] );
+}
@@ -0,0 +1,305 @@
+/*****************************************************************************
+ * smallmat.h
+ *
+ * Small matrices and vectors (3x3, 4x4 and 6x6) whose size is fixed when
+ * the program is compiled.
+ *
+ * A function like "multiply( int n, double a[n][n], ... )" (see example4()
+ * in lesson1/stack_memory.c for arrays like these) has to loop, because it
+ * doesn't know n until it runs. For a 3x3 matrix, the looping costs about
+ * as much as the arithmetic. When the size is a constant, the compiler can
+ * write every multiplication out in full ("unrolling" the loops), and keep
+ * the whole matrix in registers instead of memory.
+ *
+ * Everything here is a "static inline" function in the header, so each call
+ * is compiled right into the code that calls it. Matrices are passed and
+ * returned by value, e.g.
+ *
+ *   struct mat3 R = ...;
+ *   struct vec3 x = mat3_mulv( R, v );
+ *   double det = mat3_inv( R, &Rinv );   // det == 0 means no inverse
+ *
+ * which after inlining costs nothing: the compiler just keeps using the
+ * same registers. Each size gets:
+ *
+ *   matN_identity, matN_transpose, matN_mul, matN_mulv
+ *   matN_det, matN_inv, matN_solve              (the fastest way for N)
+ *   matN_det_elim, matN_inv_elim, matN_solve_elim  (elimination with
+ *                                                   pivoting, for any N)
+ *   matN_mul_batch, matN_mulv_batch, matN_inv_batch, matN_solve_batch
+ *                                    (whole arrays of them, in smallmat.c)
+ *
+ * For 3x3 and 4x4, matN_det/inv/solve use the "closed form" formulas
+ * (cofactors), which have no loops or branches at all, but can lose more
+ * accuracy than elimination when a matrix is nearly singular. For 6x6 the
+ * formulas get too big, so those are the elimination ones.
+ *
+ *****************************************************************************/
+
+#ifndef SMALLMAT_H
+#define SMALLMAT_H
+
+#include <math.h>
+
+// The same point3d as in struct.c
+#ifndef POINT3D_DEFINED
+#define POINT3D_DEFINED
+struct point3d
+{
+    double x;
+    double y;
+    double z;
+};
+#endif
+
+// Glue two names together, after expanding any macros in them
+#define SMALLMAT_CAT_( a, b )  a##b
+#define SMALLMAT_CAT( a, b )   SMALLMAT_CAT_( a, b )
+
+// Ask the compiler to unroll the next loop completely
+#define SMALLMAT_UNROLL  _Pragma( "GCC unroll 8" )
+
+/* Gaussian elimination with partial pivoting, which works for any size.
+   Swapping row k with the pivot row p would normally mean indexing with p,
+   which isn't known until run time, and that would force the matrix out of
+   registers and into memory. Instead, every row below k is checked with
+   "if (i == p)": once the loops are unrolled, every index is a constant
+   again, and the checks become conditional moves. extra_swap is run (with
+   the same i and k) to swap anything else that goes along with the rows.
+*/
+#define SMALLMAT_PIVOT( a, k, p, extra_swap )                           \
+    do {                                                                \
+        double best = fabs( a.m[k][k] );                                \
+        p = k;                                                          \
+        SMALLMAT_UNROLL                                                 \
+        for (int i = k + 1; i < SMALLMAT_N; i++)                        \
+            if (fabs( a.m[i][k] ) > best)                               \
+            {                                                           \
+                best = fabs( a.m[i][k] );                               \
+                p = i;                                                  \
+            }                                                           \
+        SMALLMAT_UNROLL                                                 \
+        for (int i = k + 1; i < SMALLMAT_N; i++)                        \
+            if (i == p)                                                 \
+            {                                                           \
+                SMALLMAT_UNROLL                                         \
+                for (int j = 0; j < SMALLMAT_N; j++)                    \
+                {                                                       \
+                    double tmp = a.m[i][j];                             \
+                    a.m[i][j] = a.m[k][j];                              \
+                    a.m[k][j] = tmp;                                    \
+                }                                                       \
+                extra_swap;                                             \
+            }                                                           \
+    } while (0)
+
+#define SMALLMAT_N 3
+#include "smallmat_template.h"
+#undef SMALLMAT_N
+
+#define SMALLMAT_N 4
+#include "smallmat_template.h"
+#undef SMALLMAT_N
+
+#define SMALLMAT_N 6
+#include "smallmat_template.h"
+#undef SMALLMAT_N
+
+
+/*****************************************************************************
+ * 3x3
+ *****************************************************************************/
+
+static inline double mat3_det( struct mat3 a )
+{
+    return a.m[0][0] * (a.m[1][1] * a.m[2][2] - a.m[1][2] * a.m[2][1])
+         - a.m[0][1] * (a.m[1][0] * a.m[2][2] - a.m[1][2] * a.m[2][0])
+         + a.m[0][2] * (a.m[1][0] * a.m[2][1] - a.m[1][1] * a.m[2][0]);
+}
+
+static inline double mat3_inv( struct mat3 a, struct mat3 *inv )
+/* The inverse is the transpose of the matrix of cofactors, divided by the
+ * determinant (and the first column of cofactors gives the determinant).
+ *
+ * Inputs:
+ *   struct mat3 a    = the matrix to invert
+ *   struct mat3 *inv = where to put its inverse (untouched if a is singular)
+ * Returns:
+ *   double = the determinant of a (0 if a is singular)
+ */
+{
+    struct mat3 c;
+    c.m[0][0] = a.m[1][1] * a.m[2][2] - a.m[1][2] * a.m[2][1];
+    c.m[0][1] = a.m[0][2] * a.m[2][1] - a.m[0][1] * a.m[2][2];
+    c.m[0][2] = a.m[0][1] * a.m[1][2] - a.m[0][2] * a.m[1][1];
+    c.m[1][0] = a.m[1][2] * a.m[2][0] - a.m[1][0] * a.m[2][2];
+    c.m[1][1] = a.m[0][0] * a.m[2][2] - a.m[0][2] * a.m[2][0];
+    c.m[1][2] = a.m[0][2] * a.m[1][0] - a.m[0][0] * a.m[1][2];
+    c.m[2][0] = a.m[1][0] * a.m[2][1] - a.m[1][1] * a.m[2][0];
+    c.m[2][1] = a.m[0][1] * a.m[2][0] - a.m[0][0] * a.m[2][1];
+    c.m[2][2] = a.m[0][0] * a.m[1][1] - a.m[0][1] * a.m[1][0];
+
+    double det = a.m[0][0] * c.m[0][0] + a.m[0][1] * c.m[1][0] + a.m[0][2] * c.m[2][0];
+    if (det == 0.0)
+        return 0.0;
+
+    double r = 1.0 / det;
+    SMALLMAT_UNROLL
+    for (int i = 0; i < 3; i++)
+    SMALLMAT_UNROLL
+    for (int j = 0; j < 3; j++)
+        c.m[i][j] *= r;
+    *inv = c;
+    return det;
+}
+
+static inline int mat3_solve( struct mat3 a, struct vec3 b, struct vec3 *x )
+/* Solve a x = b. Returns 0 on success, -1 if a is singular. */
+{
+    struct mat3 inv;
+    if (mat3_inv( a, &inv ) == 0.0)
+        return -1;
+    *x = mat3_mulv( inv, b );
+    return 0;
+}
+
+static inline struct point3d mat3_apply( struct mat3 R, struct point3d t, struct point3d p )
+/* R p + t: e.g. rotate a particle, then move it */
+{
+    struct point3d q;
+    q.x = R.m[0][0] * p.x + R.m[0][1] * p.y + R.m[0][2] * p.z + t.x;
+    q.y = R.m[1][0] * p.x + R.m[1][1] * p.y + R.m[1][2] * p.z + t.y;
+    q.z = R.m[2][0] * p.x + R.m[2][1] * p.y + R.m[2][2] * p.z + t.z;
+    return q;
+}
+
+
+/*****************************************************************************
+ * 4x4
+ *****************************************************************************/
+
+static inline double mat4_inv( struct mat4 a, struct mat4 *inv )
+/* The same idea as mat3_inv(), organised around the six 2x2 determinants of
+ * the top two rows (s) and of the bottom two rows (c): every cofactor is a
+ * combination of three of them.
+ *
+ * Inputs:
+ *   struct mat4 a    = the matrix to invert
+ *   struct mat4 *inv = where to put its inverse (untouched if a is singular)
+ * Returns:
+ *   double = the determinant of a (0 if a is singular)
+ */
+{
+    double s0 = a.m[0][0] * a.m[1][1] - a.m[1][0] * a.m[0][1];
+    double s1 = a.m[0][0] * a.m[1][2] - a.m[1][0] * a.m[0][2];
+    double s2 = a.m[0][0] * a.m[1][3] - a.m[1][0] * a.m[0][3];
+    double s3 = a.m[0][1] * a.m[1][2] - a.m[1][1] * a.m[0][2];
+    double s4 = a.m[0][1] * a.m[1][3] - a.m[1][1] * a.m[0][3];
+    double s5 = a.m[0][2] * a.m[1][3] - a.m[1][2] * a.m[0][3];
+
+    double c5 = a.m[2][2] * a.m[3][3] - a.m[3][2] * a.m[2][3];
+    double c4 = a.m[2][1] * a.m[3][3] - a.m[3][1] * a.m[2][3];
+    double c3 = a.m[2][1] * a.m[3][2] - a.m[3][1] * a.m[2][2];
+    double c2 = a.m[2][0] * a.m[3][3] - a.m[3][0] * a.m[2][3];
+    double c1 = a.m[2][0] * a.m[3][2] - a.m[3][0] * a.m[2][2];
+    double c0 = a.m[2][0] * a.m[3][1] - a.m[3][0] * a.m[2][1];
+
+    double det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (det == 0.0)
+        return 0.0;
+    double r = 1.0 / det;
+
+    struct mat4 b;
+    b.m[0][0] = ( a.m[1][1] * c5 - a.m[1][2] * c4 + a.m[1][3] * c3) * r;
+    b.m[0][1] = (-a.m[0][1] * c5 + a.m[0][2] * c4 - a.m[0][3] * c3) * r;
+    b.m[0][2] = ( a.m[3][1] * s5 - a.m[3][2] * s4 + a.m[3][3] * s3) * r;
+    b.m[0][3] = (-a.m[2][1] * s5 + a.m[2][2] * s4 - a.m[2][3] * s3) * r;
+
+    b.m[1][0] = (-a.m[1][0] * c5 + a.m[1][2] * c2 - a.m[1][3] * c1) * r;
+    b.m[1][1] = ( a.m[0][0] * c5 - a.m[0][2] * c2 + a.m[0][3] * c1) * r;
+    b.m[1][2] = (-a.m[3][0] * s5 + a.m[3][2] * s2 - a.m[3][3] * s1) * r;
+    b.m[1][3] = ( a.m[2][0] * s5 - a.m[2][2] * s2 + a.m[2][3] * s1) * r;
+
+    b.m[2][0] = ( a.m[1][0] * c4 - a.m[1][1] * c2 + a.m[1][3] * c0) * r;
+    b.m[2][1] = (-a.m[0][0] * c4 + a.m[0][1] * c2 - a.m[0][3] * c0) * r;
+    b.m[2][2] = ( a.m[3][0] * s4 - a.m[3][1] * s2 + a.m[3][3] * s0) * r;
+    b.m[2][3] = (-a.m[2][0] * s4 + a.m[2][1] * s2 - a.m[2][3] * s0) * r;
+
+    b.m[3][0] = (-a.m[1][0] * c3 + a.m[1][1] * c1 - a.m[1][2] * c0) * r;
+    b.m[3][1] = ( a.m[0][0] * c3 - a.m[0][1] * c1 + a.m[0][2] * c0) * r;
+    b.m[3][2] = (-a.m[3][0] * s3 + a.m[3][1] * s1 - a.m[3][2] * s0) * r;
+    b.m[3][3] = ( a.m[2][0] * s3 - a.m[2][1] * s1 + a.m[2][2] * s0) * r;
+
+    *inv = b;
+    return det;
+}
+
+static inline double mat4_det( struct mat4 a )
+{
+    double s0 = a.m[0][0] * a.m[1][1] - a.m[1][0] * a.m[0][1];
+    double s1 = a.m[0][0] * a.m[1][2] - a.m[1][0] * a.m[0][2];
+    double s2 = a.m[0][0] * a.m[1][3] - a.m[1][0] * a.m[0][3];
+    double s3 = a.m[0][1] * a.m[1][2] - a.m[1][1] * a.m[0][2];
+    double s4 = a.m[0][1] * a.m[1][3] - a.m[1][1] * a.m[0][3];
+    double s5 = a.m[0][2] * a.m[1][3] - a.m[1][2] * a.m[0][3];
+
+    double c5 = a.m[2][2] * a.m[3][3] - a.m[3][2] * a.m[2][3];
+    double c4 = a.m[2][1] * a.m[3][3] - a.m[3][1] * a.m[2][3];
+    double c3 = a.m[2][1] * a.m[3][2] - a.m[3][1] * a.m[2][2];
+    double c2 = a.m[2][0] * a.m[3][3] - a.m[3][0] * a.m[2][3];
+    double c1 = a.m[2][0] * a.m[3][2] - a.m[3][0] * a.m[2][2];
+    double c0 = a.m[2][0] * a.m[3][1] - a.m[3][0] * a.m[2][1];
+
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
+static inline int mat4_solve( struct mat4 a, struct vec4 b, struct vec4 *x )
+/* Solve a x = b. Returns 0 on success, -1 if a is singular. */
+{
+    struct mat4 inv;
+    if (mat4_inv( a, &inv ) == 0.0)
+        return -1;
+    *x = mat4_mulv( inv, b );
+    return 0;
+}
+
+static inline struct point3d mat4_apply( struct mat4 T, struct point3d p )
+/* Transform p by the homogeneous ("graphics") matrix T, i.e. T (x, y, z, 1),
+   divided through by the fourth coordinate. */
+{
+    struct vec4 h = { { p.x, p.y, p.z, 1.0 } };
+    h = mat4_mulv( T, h );
+    double r = 1.0 / h.v[3];
+    struct point3d q = { h.v[0] * r, h.v[1] * r, h.v[2] * r };
+    return q;
+}
+
+
+/*****************************************************************************
+ * 6x6
+ *****************************************************************************/
+
+static inline double mat6_det( struct mat6 a )
+{
+    return mat6_det_elim( a );
+}
+
+static inline double mat6_inv( struct mat6 a, struct mat6 *inv )
+{
+    return mat6_inv_elim( a, inv );
+}
+
+static inline int mat6_solve( struct mat6 a, struct vec6 b, struct vec6 *x )
+{
+    return mat6_solve_elim( a, b, x );
+}
+
+
+/*****************************************************************************
+ * Transforming whole arrays of points (in smallmat.c)
+ *****************************************************************************/
+
+void mat3_apply_batch( struct mat3, struct point3d, const struct point3d *, struct point3d *, long );
+void mat4_apply_batch( struct mat4, const struct point3d *, struct point3d *, long );
+
+#endif
@@ -0,0 +1,236 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A demonstration of smallmat.h. For lots of random 3x3, 4x4 and 6x6
+ * matrices, it multiplies pairs of them, inverts them and solves a x = b,
+ * first with ordinary functions that take the size as an argument, then
+ * with the fixed-size ones. The answers should agree (to rounding).
+ *
+ *   $ make -f Makefile-smallmat
+ *   $ ./smallmat_demo           (a million of each size)
+ *   $ ./smallmat_demo 100000
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "smallmat.h"
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int runtime( int n )
+/* Hide n from the compiler, so that the "generic" functions really do find
+   out the size at run time (otherwise it might work it out and unroll them
+   anyway, which would spoil the comparison). */
+{
+    volatile int v = n;
+    return v;
+}
+
+
+/*****************************************************************************
+ * Size-as-an-argument versions
+ *****************************************************************************/
+
+static void mul_generic( int n, double a[n][n], double b[n][n], double c[n][n] )
+{
+    int i, j, k;
+    for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+    {
+        c[i][j] = 0.0;
+        for (k = 0; k < n; k++)
+            c[i][j] += a[i][k] * b[k][j];
+    }
+}
+
+static double inv_generic( int n, double a_in[n][n], double inv[n][n] )
+/* Gauss-Jordan elimination with partial pivoting; returns the determinant */
+{
+    double a[n][n];
+    double det = 1.0;
+    int i, j, k;
+    for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+    {
+        a[i][j] = a_in[i][j];
+        inv[i][j] = (i == j);
+    }
+
+    for (k = 0; k < n; k++)
+    {
+        int p = k;
+        for (i = k + 1; i < n; i++)
+            if (fabs( a[i][k] ) > fabs( a[p][k] ))
+                p = i;
+        if (a[p][k] == 0.0)
+            return 0.0;
+        if (p != k)
+        {
+            for (j = 0; j < n; j++)
+            {
+                double tmp = a[p][j];    a[p][j] = a[k][j];    a[k][j] = tmp;
+                tmp = inv[p][j];  inv[p][j] = inv[k][j];  inv[k][j] = tmp;
+            }
+            det = -det;
+        }
+        det *= a[k][k];
+
+        double r = 1.0 / a[k][k];
+        for (j = 0; j < n; j++)
+        {
+            a[k][j] *= r;
+            inv[k][j] *= r;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (i == k)
+                continue;
+            double f = a[i][k];
+            for (j = 0; j < n; j++)
+            {
+                a[i][j] -= f * a[k][j];
+                inv[i][j] -= f * inv[k][j];
+            }
+        }
+    }
+    return det;
+}
+
+static void solve_generic( int n, double a[n][n], double b[n], double x[n] )
+{
+    double inv[n][n];
+    int i, j;
+    inv_generic( n, a, inv );
+    for (i = 0; i < n; i++)
+    {
+        x[i] = 0.0;
+        for (j = 0; j < n; j++)
+            x[i] += inv[i][j] * b[j];
+    }
+}
+
+
+/*****************************************************************************
+ * The comparison, once for each size
+ *****************************************************************************/
+
+static double max_diff( const double *x, const double *y, long n )
+{
+    double d = 0.0;
+    long i;
+    for (i = 0; i < n; i++)
+        d = fmax( d, fabs( x[i] - y[i] ) );
+    return d;
+}
+
+static void report( int N, const char *op, double t_generic, double t_fixed, long count, double diff )
+{
+    printf( "%dx%d %-6s %10.1f %10.1f %8.1fx %12.2e\n", N, N, op,
+            t_generic / count * 1e9, t_fixed / count * 1e9, t_generic / t_fixed, diff );
+}
+
+/* Random matrices, with a big diagonal so they're nowhere near singular.
+   (Written once, as a macro, because each size has its own struct type.) */
+#define COMPARE( N )                                                          \
+static void compare##N( long count )                                          \
+{                                                                             \
+    struct mat##N *A = malloc( count * sizeof(struct mat##N) );               \
+    struct mat##N *B = malloc( count * sizeof(struct mat##N) );               \
+    struct mat##N *C1 = malloc( count * sizeof(struct mat##N) );              \
+    struct mat##N *C2 = malloc( count * sizeof(struct mat##N) );              \
+    struct vec##N *b = malloc( count * sizeof(struct vec##N) );               \
+    struct vec##N *x1 = malloc( count * sizeof(struct vec##N) );              \
+    struct vec##N *x2 = malloc( count * sizeof(struct vec##N) );              \
+    long i;                                                                   \
+    int j, k, n = runtime( N );                                               \
+    for (i = 0; i < count; i++)                                               \
+    for (j = 0; j < N; j++)                                                   \
+    {                                                                         \
+        for (k = 0; k < N; k++)                                               \
+        {                                                                     \
+            A[i].m[j][k] = rand() / (double)RAND_MAX - 0.5 + (j == k) * N;    \
+            B[i].m[j][k] = rand() / (double)RAND_MAX - 0.5;                   \
+        }                                                                     \
+        b[i].v[j] = rand() / (double)RAND_MAX;                                \
+    }                                                                         \
+    long doubles = count * N * N;                                             \
+    /* Touch the outputs first, so the timings don't include the OS       */ \
+    /* handing out fresh pages (see lesson1/bigalloc.c)                   */ \
+    memset( C1, 0, count * sizeof(struct mat##N) );                           \
+    memset( C2, 0, count * sizeof(struct mat##N) );                           \
+    memset( x1, 0, count * sizeof(struct vec##N) );                           \
+    memset( x2, 0, count * sizeof(struct vec##N) );                           \
+    double t0, t1, t2;                                                        \
+                                                                              \
+    t0 = now();                                                               \
+    for (i = 0; i < count; i++)                                               \
+        mul_generic( n, A[i].m, B[i].m, C1[i].m );                            \
+    t1 = now();                                                               \
+    mat##N##_mul_batch( A, B, C2, count );                                    \
+    t2 = now();                                                               \
+    report( N, "mul", t1 - t0, t2 - t1, count,                                \
+            max_diff( &C1[0].m[0][0], &C2[0].m[0][0], doubles ) );            \
+                                                                              \
+    t0 = now();                                                               \
+    for (i = 0; i < count; i++)                                               \
+        inv_generic( n, A[i].m, C1[i].m );                                    \
+    t1 = now();                                                               \
+    long singular = mat##N##_inv_batch( A, C2, NULL, count );                 \
+    t2 = now();                                                               \
+    report( N, "inv", t1 - t0, t2 - t1, count,                                \
+            max_diff( &C1[0].m[0][0], &C2[0].m[0][0], doubles ) );            \
+                                                                              \
+    t0 = now();                                                               \
+    for (i = 0; i < count; i++)                                               \
+        solve_generic( n, A[i].m, b[i].v, x1[i].v );                          \
+    t1 = now();                                                               \
+    singular += mat##N##_solve_batch( A, b, x2, count );                      \
+    t2 = now();                                                               \
+    report( N, "solve", t1 - t0, t2 - t1, count,                              \
+            max_diff( x1[0].v, x2[0].v, count * N ) );                        \
+                                                                              \
+    if (singular > 0)                                                         \
+        printf( "    (%ld singular matrices)\n", singular );                  \
+    free( A );  free( B );  free( C1 );  free( C2 );                          \
+    free( b );  free( x1 );  free( x2 );                                      \
+}
+
+COMPARE( 3 )
+COMPARE( 4 )
+COMPARE( 6 )
+
+
+int main( int argc, char *argv[] )
+{
+    long count = (argc > 1 ? atol( argv[1] ) : 1000000);
+    if (count < 1)
+    {
+        fprintf( stderr, "usage: smallmat_demo [count >= 1]\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    srand( 1 );
+    printf( "%ld matrices of each size (times are ns per matrix)\n\n", count );
+    printf( "size op        generic      fixed  speedup     max diff\n" );
+    compare3( count );
+    compare4( count );
+    compare6( count );
+
+    // And the determinants should agree with the elimination ones
+    struct mat4 T = mat4_identity();
+    T.m[0][1] = 2.0;  T.m[1][0] = -1.0;  T.m[2][3] = 0.5;  T.m[3][2] = 3.0;
+    printf( "\ndet: closed form %g, elimination %g\n", mat4_det( T ), mat4_det_elim( T ) );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,230 @@
+/*****************************************************************************
+ * smallmat_template.h
+ *
+ * The size-independent half of smallmat.h. Don't include this yourself:
+ * smallmat.h includes it once for each size, with SMALLMAT_N set to 3, 4
+ * and 6. C has no templates, but this trick gets the same effect: every
+ * loop below runs a fixed number of times that the compiler knows, so it
+ * can unroll it completely and keep the elements in registers.
+ *
+ * Names are pasted together from the size, so with SMALLMAT_N = 4,
+ * FN(mul) becomes mat4_mul and struct MAT becomes struct mat4.
+ *
+ *****************************************************************************/
+
+#define MAT       SMALLMAT_CAT( mat, SMALLMAT_N )
+#define VEC       SMALLMAT_CAT( vec, SMALLMAT_N )
+#define FN(name)  SMALLMAT_CAT( MAT, _##name )
+
+struct MAT
+{
+    double m[SMALLMAT_N][SMALLMAT_N];
+};
+
+struct VEC
+{
+    double v[SMALLMAT_N];
+};
+
+
+static inline struct MAT FN(identity)( void )
+{
+    struct MAT I;
+    SMALLMAT_UNROLL
+    for (int i = 0; i < SMALLMAT_N; i++)
+    SMALLMAT_UNROLL
+    for (int j = 0; j < SMALLMAT_N; j++)
+        I.m[i][j] = (i == j);
+    return I;
+}
+
+
+static inline struct MAT FN(transpose)( struct MAT a )
+{
+    struct MAT t;
+    SMALLMAT_UNROLL
+    for (int i = 0; i < SMALLMAT_N; i++)
+    SMALLMAT_UNROLL
+    for (int j = 0; j < SMALLMAT_N; j++)
+        t.m[i][j] = a.m[j][i];
+    return t;
+}
+
+
+static inline struct MAT FN(mul)( struct MAT a, struct MAT b )
+/* a times b. The j loop is innermost, so each row of the result is a sum of
+   scaled rows of b, which the compiler can do with vector instructions. */
+{
+    struct MAT c;
+    SMALLMAT_UNROLL
+    for (int i = 0; i < SMALLMAT_N; i++)
+    {
+        SMALLMAT_UNROLL
+        for (int j = 0; j < SMALLMAT_N; j++)
+            c.m[i][j] = a.m[i][0] * b.m[0][j];
+        SMALLMAT_UNROLL
+        for (int k = 1; k < SMALLMAT_N; k++)
+        SMALLMAT_UNROLL
+        for (int j = 0; j < SMALLMAT_N; j++)
+            c.m[i][j] += a.m[i][k] * b.m[k][j];
+    }
+    return c;
+}
+
+
+static inline struct VEC FN(mulv)( struct MAT a, struct VEC x )
+/* a times the column vector x */
+{
+    struct VEC y;
+    SMALLMAT_UNROLL
+    for (int i = 0; i < SMALLMAT_N; i++)
+    {
+        y.v[i] = 0.0;
+        SMALLMAT_UNROLL
+        for (int k = 0; k < SMALLMAT_N; k++)
+            y.v[i] += a.m[i][k] * x.v[k];
+    }
+    return y;
+}
+
+
+static inline double FN(det_elim)( struct MAT a )
+/* The determinant, by elimination (0 if a is singular) */
+{
+    double det = 1.0;
+    SMALLMAT_UNROLL
+    for (int k = 0; k < SMALLMAT_N; k++)
+    {
+        int p;
+        SMALLMAT_PIVOT( a, k, p, det = -det );
+        if (a.m[k][k] == 0.0)
+            return 0.0;
+        det *= a.m[k][k];
+
+        SMALLMAT_UNROLL
+        for (int i = k + 1; i < SMALLMAT_N; i++)
+        {
+            double f = a.m[i][k] / a.m[k][k];
+            SMALLMAT_UNROLL
+            for (int j = k + 1; j < SMALLMAT_N; j++)
+                a.m[i][j] -= f * a.m[k][j];
+        }
+    }
+    return det;
+}
+
+
+static inline double FN(inv_elim)( struct MAT a, struct MAT *inv )
+/* Gauss-Jordan elimination: the row operations that turn a into the
+ * identity turn the identity into the inverse of a.
+ *
+ * Inputs:
+ *   struct MAT a    = the matrix to invert
+ *   struct MAT *inv = where to put its inverse (untouched if a is singular)
+ * Returns:
+ *   double = the determinant of a (0 if a is singular)
+ */
+{
+    struct MAT b = FN(identity)();
+    double det = 1.0;
+
+    SMALLMAT_UNROLL
+    for (int k = 0; k < SMALLMAT_N; k++)
+    {
+        int p;
+        SMALLMAT_PIVOT( a, k, p,
+            det = -det;
+            SMALLMAT_UNROLL
+            for (int j = 0; j < SMALLMAT_N; j++)
+            {
+                double tmp = b.m[i][j];
+                b.m[i][j] = b.m[k][j];
+                b.m[k][j] = tmp;
+            } );
+        if (a.m[k][k] == 0.0)
+            return 0.0;
+        det *= a.m[k][k];
+
+        // Scale row k so the pivot is 1...
+        double r = 1.0 / a.m[k][k];
+        SMALLMAT_UNROLL
+        for (int j = 0; j < SMALLMAT_N; j++)
+        {
+            a.m[k][j] *= r;
+            b.m[k][j] *= r;
+        }
+
+        // ...and clear column k from every other row
+        SMALLMAT_UNROLL
+        for (int i = 0; i < SMALLMAT_N; i++)
+        {
+            if (i == k)
+                continue;
+            double f = a.m[i][k];
+            SMALLMAT_UNROLL
+            for (int j = 0; j < SMALLMAT_N; j++)
+            {
+                a.m[i][j] -= f * a.m[k][j];
+                b.m[i][j] -= f * b.m[k][j];
+            }
+        }
+    }
+
+    *inv = b;
+    return det;
+}
+
+
+static inline int FN(solve_elim)( struct MAT a, struct VEC b, struct VEC *x )
+/* Solve a x = b by elimination (pivoting as in SMALLMAT_PIVOT, see
+ * smallmat.h) and back substitution.
+ * Returns:
+ *   int = 0 on success, -1 if a is singular (x is untouched)
+ */
+{
+    SMALLMAT_UNROLL
+    for (int k = 0; k < SMALLMAT_N; k++)
+    {
+        int p;
+        SMALLMAT_PIVOT( a, k, p,
+            double tmp = b.v[i];
+            b.v[i] = b.v[k];
+            b.v[k] = tmp );
+        if (a.m[k][k] == 0.0)
+            return -1;
+
+        SMALLMAT_UNROLL
+        for (int i = k + 1; i < SMALLMAT_N; i++)
+        {
+            double f = a.m[i][k] / a.m[k][k];
+            SMALLMAT_UNROLL
+            for (int j = k + 1; j < SMALLMAT_N; j++)
+                a.m[i][j] -= f * a.m[k][j];
+            b.v[i] -= f * b.v[k];
+        }
+    }
+
+    struct VEC y;
+    SMALLMAT_UNROLL
+    for (int i = SMALLMAT_N - 1; i >= 0; i--)
+    {
+        double s = b.v[i];
+        SMALLMAT_UNROLL
+        for (int j = i + 1; j < SMALLMAT_N; j++)
+            s -= a.m[i][j] * y.v[j];
+        y.v[i] = s / a.m[i][i];
+    }
+    *x = y;
+    return 0;
+}
+
+
+/* The batched versions, in smallmat.c */
+void FN(mul_batch)( const struct MAT *, const struct MAT *, struct MAT *, long );
+void FN(mulv_batch)( const struct MAT *, const struct VEC *, struct VEC *, long );
+long FN(inv_batch)( const struct MAT *, struct MAT *, double *, long );
+long FN(solve_batch)( const struct MAT *, const struct VEC *, struct VEC *, long );
+
+#undef MAT
+#undef VEC
+#undef FN
@@ -0,0 +1,604 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * spatial.c
+ *
+ * "Which points are near this one?" Checking every point takes n steps per
+ * question, so asking it for every point in a cloud takes n^2 steps: a
+ * million points means a trillion distance calculations. The trick is to
+ * sort the points in advance so that most of them can be ruled out without
+ * looking at them. There are two classic ways:
+ *
+ *   A uniform grid cuts space into equal cubes and lists the points in each
+ *   one. To find the points within r of q, only look in the cubes that
+ *   overlap the sphere. Simple and fast, as long as the points are spread
+ *   out evenly (a cube holding half the points doesn't rule much out).
+ *
+ *   A k-d tree splits the points in half at the median along one axis, then
+ *   splits each half along another axis, and so on. A search goes down the
+ *   side the query point is on first, and only visits the other side if the
+ *   splitting plane is closer than the best answer so far. It adapts to how
+ *   the points are spread, and answers "the k nearest" as well as "all
+ *   within r", in about log n steps per question.
+ *
+ * Both store the points themselves in a sorted copy, so that points that are
+ * close in space are close in memory too, which makes good use of the
+ * caches. The k-d tree doesn't even have nodes: the tree is the array (see
+ * spatial.h). Query functions write the original indices of the points they
+ * find into an array the caller provides; if it's too small, they still
+ * return the full count, so the caller can try again with a bigger one.
+ *
+ * Built with -fopenmp, building the tree and the batched queries use all
+ * the cores.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "spatial.h"
+
+#define  LEAF  8           // ranges this small are just scanned
+#define  TASK_CUTOFF  20000  // build ranges this big in a separate task
+
+static inline double coord( const struct point3d *p, int d )
+{
+    return (d == 0 ? p->x : d == 1 ? p->y : p->z);
+}
+
+static inline double dist2( const struct point3d *a, const struct point3d *b )
+{
+    double dx = a->x - b->x, dy = a->y - b->y, dz = a->z - b->z;
+    return dx*dx + dy*dy + dz*dz;
+}
+
+static inline int in_box( const struct point3d *p, const struct point3d *lo, const struct point3d *hi )
+{
+    return (p->x >= lo->x && p->x <= hi->x &&
+            p->y >= lo->y && p->y <= hi->y &&
+            p->z >= lo->z && p->z <= hi->z);
+}
+
+static inline void found( long id, long *ids, long max, long *count )
+{
+    if (*count < max)
+        ids[*count] = id;
+    (*count)++;
+}
+
+/*****************************************************************************
+ * Uniform grid
+ *****************************************************************************/
+
+static void cell_of( const struct grid *g, const struct point3d *p, int c[3] )
+/* The cell p is in (clamped to the grid, for points outside it). The
+ * clamping is done before converting to an integer: a coordinate like 1e30
+ * or INFINITY doesn't fit in one, and converting it is undefined.
+ */
+{
+    int d;
+    for (d = 0; d < 3; d++)
+    {
+        double i = floor( (coord( p, d ) - coord( &g->lo, d )) / g->cell );
+        c[d] = (i >= g->dims[d] - 1 ? g->dims[d] - 1 : i > 0 ? (int)i : 0);
+    }
+}
+
+static inline long cell_index( const struct grid *g, int cx, int cy, int cz )
+{
+    return ((long)cz * g->dims[1] + cy) * g->dims[0] + cx;
+}
+
+
+int grid_build( struct grid *g, const struct point3d *points, long n, double cell )
+/* Sort n points into a grid of cubes of side cell.
+ *
+ * Inputs:
+ *   struct grid *g              = the grid to fill in
+ *   const struct point3d *points = the points (copied; needn't be kept)
+ *   long n                      = the number of points
+ *   double cell                 = the side of each cube, e.g. the query radius
+ * Returns:
+ *   int = 0 on success, -1 on failure (out of memory, or too many cells)
+ */
+{
+    memset( g, 0, sizeof(struct grid) );
+    if (n <= 0 || !(cell > 0))
+        return -1;
+
+    // The bounding box of the points
+    struct point3d lo = points[0], hi = points[0];
+    long i;
+    for (i = 1; i < n; i++)
+    {
+        lo.x = fmin( lo.x, points[i].x );  hi.x = fmax( hi.x, points[i].x );
+        lo.y = fmin( lo.y, points[i].y );  hi.y = fmax( hi.y, points[i].y );
+        lo.z = fmin( lo.z, points[i].z );  hi.z = fmax( hi.z, points[i].z );
+    }
+
+    g->cell = cell;
+    g->lo = lo;
+    g->n = n;
+    double ncells = 1;
+    int d;
+    for (d = 0; d < 3; d++)
+    {
+        g->dims[d] = (int)fmin( floor( (coord( &hi, d ) - coord( &lo, d )) / cell ) + 1, 1 << 20 );
+        ncells *= g->dims[d];
+    }
+    if (ncells > 4.0 * n + 1024)   // far more cells than points: pick a bigger cell
+        return -1;
+
+    long nc = (long)ncells;
+    long *cell_id = malloc( n * sizeof(long) );
+    g->start  = calloc( nc + 1, sizeof(long) );
+    g->points = malloc( n * sizeof(struct point3d) );
+    g->id     = malloc( n * sizeof(long) );
+    if (!cell_id || !g->start || !g->points || !g->id)
+    {
+        free( cell_id );
+        grid_free( g );
+        return -1;
+    }
+
+    // Which cell each point is in (the expensive part, so in parallel)...
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (i = 0; i < n; i++)
+    {
+        int c[3];
+        cell_of( g, &points[i], c );
+        cell_id[i] = cell_index( g, c[0], c[1], c[2] );
+    }
+
+    // ... then a "counting sort": count the points in each cell, add up the
+    // counts to find where each cell starts, and drop each point into place
+    for (i = 0; i < n; i++)
+        g->start[cell_id[i] + 1]++;
+    long c;
+    for (c = 0; c < nc; c++)
+        g->start[c + 1] += g->start[c];
+    long *next = cell_id;   // (reuse: cell_id[i] becomes point i's position)
+    for (i = 0; i < n; i++)
+        next[i] = g->start[cell_id[i]]++;
+    for (c = nc; c > 0; c--)   // (that moved every start up one cell: undo it)
+        g->start[c] = g->start[c - 1];
+    g->start[0] = 0;
+    for (i = 0; i < n; i++)
+    {
+        g->points[next[i]] = points[i];
+        g->id[next[i]] = i;
+    }
+
+    free( cell_id );
+    return 0;
+}
+
+
+void grid_free( struct grid *g )
+{
+    free( g->points );
+    free( g->id );
+    free( g->start );
+    memset( g, 0, sizeof(struct grid) );
+}
+
+
+static long grid_search( const struct grid *g, const struct point3d *lo, const struct point3d *hi,
+                         const struct point3d *q, double r2, long *ids, long max )
+/* Every point in the cells overlapping the box lo..hi that is within the box
+ * (q == NULL) or within sqrt(r2) of q.
+ */
+{
+    int c0[3], c1[3];
+    cell_of( g, lo, c0 );
+    cell_of( g, hi, c1 );
+
+    long count = 0;
+    int cy, cz;
+    for (cz = c0[2]; cz <= c1[2]; cz++)
+        for (cy = c0[1]; cy <= c1[1]; cy++)
+        {
+            // Cells in a row along x are next to each other in memory
+            long first = g->start[cell_index( g, c0[0], cy, cz )];
+            long last  = g->start[cell_index( g, c1[0], cy, cz ) + 1];
+            long i;
+            for (i = first; i < last; i++)
+                if (q != NULL ? dist2( &g->points[i], q ) <= r2
+                              : in_box( &g->points[i], lo, hi ))
+                    found( g->id[i], ids, max, &count );
+        }
+    return count;
+}
+
+
+long grid_radius( const struct grid *g, const struct point3d *q, double r, long *ids, long max )
+/* Find the points within distance r of q.
+ *
+ * Inputs:
+ *   const struct grid *g    = the grid
+ *   const struct point3d *q = the query point
+ *   double r                = the radius
+ *   long *ids               = where to put the (original) indices found
+ *   long max                = how many ids there's room for
+ * Returns:
+ *   long = how many points were found (which may be more than max)
+ */
+{
+    struct point3d lo = { q->x - r, q->y - r, q->z - r };
+    struct point3d hi = { q->x + r, q->y + r, q->z + r };
+    return grid_search( g, &lo, &hi, q, r*r, ids, max );
+}
+
+
+long grid_box( const struct grid *g, const struct point3d *lo, const struct point3d *hi, long *ids, long max )
+/* Find the points with lo <= p <= hi (in all three coordinates). Returns the
+ * count, as for grid_radius().
+ */
+{
+    return grid_search( g, lo, hi, NULL, 0.0, ids, max );
+}
+
+/*****************************************************************************
+ * k-d tree
+ *****************************************************************************/
+
+static void swap( struct kdtree *t, long i, long j )
+{
+    struct point3d p = t->points[i];
+    t->points[i] = t->points[j];
+    t->points[j] = p;
+    long id = t->id[i];
+    t->id[i] = t->id[j];
+    t->id[j] = id;
+}
+
+
+static void select_median( struct kdtree *t, long lo, long hi, long m, int d )
+/* Rearrange points[lo..hi-1] so that points[m] is the one that would be
+ * there if they were sorted by coordinate d, with smaller (or equal) ones
+ * before it and bigger (or equal) ones after it ("quickselect").
+ */
+{
+    while (hi - lo > 1)
+    {
+        // Median of three, as the pivot
+        long mid = lo + (hi - lo) / 2;
+        if (coord( &t->points[mid], d )  < coord( &t->points[lo], d ))  swap( t, mid, lo );
+        if (coord( &t->points[hi-1], d ) < coord( &t->points[lo], d ))  swap( t, hi-1, lo );
+        if (coord( &t->points[hi-1], d ) < coord( &t->points[mid], d )) swap( t, hi-1, mid );
+        double pivot = coord( &t->points[mid], d );
+
+        // Split into < pivot, == pivot, > pivot
+        long lt = lo, i = lo, gt = hi;
+        while (i < gt)
+        {
+            double v = coord( &t->points[i], d );
+            if (v < pivot)       swap( t, lt++, i++ );
+            else if (v > pivot)  swap( t, i, --gt );
+            else                 i++;
+        }
+
+        if (m < lt)        hi = lt;
+        else if (m >= gt)  lo = gt;
+        else               return;
+    }
+}
+
+
+static void build( struct kdtree *t, long lo, long hi )
+{
+    if (hi - lo <= LEAF)
+        return;
+
+    // Split along whichever axis the points are most spread out in
+    struct point3d mn = t->points[lo], mx = t->points[lo];
+    long i;
+    for (i = lo + 1; i < hi; i++)
+    {
+        mn.x = fmin( mn.x, t->points[i].x );  mx.x = fmax( mx.x, t->points[i].x );
+        mn.y = fmin( mn.y, t->points[i].y );  mx.y = fmax( mx.y, t->points[i].y );
+        mn.z = fmin( mn.z, t->points[i].z );  mx.z = fmax( mx.z, t->points[i].z );
+    }
+    double ex = mx.x - mn.x, ey = mx.y - mn.y, ez = mx.z - mn.z;
+    int d = (ex >= ey && ex >= ez ? 0 : ey >= ez ? 1 : 2);
+
+    long m = lo + (hi - lo) / 2;
+    select_median( t, lo, hi, m, d );
+    t->split[m] = d;
+
+    // The two halves don't overlap, so they can be built at the same time
+#ifdef _OPENMP
+#pragma omp task if(hi - lo > TASK_CUTOFF)
+#endif
+    build( t, lo, m );
+    build( t, m + 1, hi );
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+}
+
+
+int kdtree_build( struct kdtree *t, const struct point3d *points, long n )
+/* Build a k-d tree of n points (which are copied; they needn't be kept).
+ *
+ * Returns: 0 on success, -1 if out of memory
+ */
+{
+    t->n = n;
+    t->points = malloc( (n > 0 ? n : 1) * sizeof(struct point3d) );
+    t->id     = malloc( (n > 0 ? n : 1) * sizeof(long) );
+    t->split  = calloc( (n > 0 ? n : 1), 1 );
+    if (!t->points || !t->id || !t->split)
+    {
+        kdtree_free( t );
+        return -1;
+    }
+
+    long i;
+    for (i = 0; i < n; i++)
+    {
+        t->points[i] = points[i];
+        t->id[i] = i;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single
+#endif
+    build( t, 0, n );
+
+    return 0;
+}
+
+
+void kdtree_free( struct kdtree *t )
+{
+    free( t->points );
+    free( t->id );
+    free( t->split );
+    memset( t, 0, sizeof(struct kdtree) );
+}
+
+/* The k nearest so far are kept in a "max-heap": an array where each entry
+   is at least as far as its two children (at 2i+1 and 2i+2), so the
+   farthest one is always at the top, ready to be replaced.
+*/
+struct heap
+{
+    int size, k;
+    long *id;
+    double *d2;
+};
+
+static void heap_offer( struct heap *h, long id, double d2 )
+{
+    int i;
+    if (h->size < h->k)
+    {
+        // Add at the bottom, and move it up past any nearer parents
+        i = h->size++;
+        while (i > 0 && h->d2[(i - 1) / 2] < d2)
+        {
+            h->d2[i] = h->d2[(i - 1) / 2];
+            h->id[i] = h->id[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    }
+    else if (d2 < h->d2[0])
+    {
+        // Replace the top, and move it down past any farther children
+        i = 0;
+        while (1)
+        {
+            int c = 2*i + 1;
+            if (c >= h->size)
+                break;
+            if (c + 1 < h->size && h->d2[c + 1] > h->d2[c])
+                c++;
+            if (h->d2[c] <= d2)
+                break;
+            h->d2[i] = h->d2[c];
+            h->id[i] = h->id[c];
+            i = c;
+        }
+    }
+    else
+        return;
+    h->d2[i] = d2;
+    h->id[i] = id;
+}
+
+static inline double heap_worst( const struct heap *h )
+{
+    return (h->size < h->k ? INFINITY : h->d2[0]);
+}
+
+
+static void knn( const struct kdtree *t, long lo, long hi, const struct point3d *q, struct heap *h )
+{
+    if (hi - lo <= LEAF)
+    {
+        long i;
+        for (i = lo; i < hi; i++)
+            heap_offer( h, i, dist2( &t->points[i], q ) );
+        return;
+    }
+
+    long m = lo + (hi - lo) / 2;
+    int d = t->split[m];
+    double diff = coord( q, d ) - coord( &t->points[m], d );
+
+    heap_offer( h, m, dist2( &t->points[m], q ) );
+
+    // The side q is on first; the other side only if the plane is near enough
+    if (diff < 0)
+    {
+        knn( t, lo, m, q, h );
+        if (diff*diff < heap_worst( h ))
+            knn( t, m + 1, hi, q, h );
+    }
+    else
+    {
+        knn( t, m + 1, hi, q, h );
+        if (diff*diff < heap_worst( h ))
+            knn( t, lo, m, q, h );
+    }
+}
+
+
+int kdtree_knn( const struct kdtree *t, const struct point3d *q, int k, long *ids, double *d2 )
+/* Find the k points nearest to q.
+ *
+ * Inputs:
+ *   const struct kdtree *t  = the tree
+ *   const struct point3d *q = the query point
+ *   int k                   = how many neighbours to find
+ *   long *ids               = (output) their original indices, nearest first
+ *   double *d2              = (output) their squared distances from q
+ * Returns:
+ *   int = how many were found (k, unless the tree has fewer points)
+ */
+{
+    struct heap h = { 0, k, ids, d2 };
+    if (k <= 0)
+        return 0;
+    knn( t, 0, t->n, q, &h );
+
+    /* Sort them, nearest first. k is small, so an insertion sort will do.
+       (Until now the ids have been positions in the tree.)
+    */
+    int found_k = h.size;
+    int i, j;
+    for (i = 1; i < found_k; i++)
+    {
+        long id = ids[i];
+        double d = d2[i];
+        for (j = i; j > 0 && d2[j - 1] > d; j--)
+        {
+            ids[j] = ids[j - 1];
+            d2[j] = d2[j - 1];
+        }
+        ids[j] = id;
+        d2[j] = d;
+    }
+    for (i = 0; i < found_k; i++)
+        ids[i] = t->id[ids[i]];
+    return found_k;
+}
+
+
+static void range( const struct kdtree *t, long lo, long hi, const struct point3d *blo, const struct point3d *bhi,
+                   const struct point3d *q, double r2, long *ids, long max, long *count )
+/* Every point within the box blo..bhi (q == NULL), or within sqrt(r2) of q
+ * (in which case blo..bhi is the box around that sphere, used for pruning)
+ */
+{
+    if (hi - lo <= LEAF)
+    {
+        long i;
+        for (i = lo; i < hi; i++)
+            if (q != NULL ? dist2( &t->points[i], q ) <= r2
+                          : in_box( &t->points[i], blo, bhi ))
+                found( t->id[i], ids, max, count );
+        return;
+    }
+
+    long m = lo + (hi - lo) / 2;
+    int d = t->split[m];
+    double s = coord( &t->points[m], d );
+
+    if (q != NULL ? dist2( &t->points[m], q ) <= r2 : in_box( &t->points[m], blo, bhi ))
+        found( t->id[m], ids, max, count );
+    if (coord( blo, d ) <= s)
+        range( t, lo, m, blo, bhi, q, r2, ids, max, count );
+    if (coord( bhi, d ) >= s)
+        range( t, m + 1, hi, blo, bhi, q, r2, ids, max, count );
+}
+
+
+long kdtree_radius( const struct kdtree *t, const struct point3d *q, double r, long *ids, long max )
+/* Find the points within distance r of q. Returns the count, as for
+ * grid_radius().
+ */
+{
+    struct point3d lo = { q->x - r, q->y - r, q->z - r };
+    struct point3d hi = { q->x + r, q->y + r, q->z + r };
+    long count = 0;
+    range( t, 0, t->n, &lo, &hi, q, r*r, ids, max, &count );
+    return count;
+}
+
+
+long kdtree_box( const struct kdtree *t, const struct point3d *lo, const struct point3d *hi, long *ids, long max )
+/* Find the points with lo <= p <= hi. Returns the count, as for grid_radius(). */
+{
+    long count = 0;
+    range( t, 0, t->n, lo, hi, NULL, 0.0, ids, max, &count );
+    return count;
+}
+
+/*****************************************************************************
+ * Batched queries
+ *****************************************************************************/
+
+void kdtree_knn_batch( const struct kdtree *t, const struct point3d *queries, long nq, int k,
+                       long *ids, double *d2 )
+/* kdtree_knn() for each of nq queries: query i's neighbours go in
+ * ids[i*k .. i*k+k-1] and d2[i*k .. i*k+k-1] (with -1 and INFINITY if the
+ * tree has fewer than k points).
+ */
+{
+    long i;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+    for (i = 0; i < nq; i++)
+    {
+        int j = kdtree_knn( t, &queries[i], k, &ids[i*k], &d2[i*k] );
+        for ( ; j < k; j++)
+        {
+            ids[i*k + j] = -1;
+            d2[i*k + j] = INFINITY;
+        }
+    }
+}
+
+
+long *kdtree_radius_batch( const struct kdtree *t, const struct point3d *queries, long nq, double r,
+                           long *offsets )
+/* kdtree_radius() for each of nq queries. The results are returned in one
+ * array (to be freed by the caller): query i's are at offsets[i] ..
+ * offsets[i+1]-1, so offsets must have room for nq+1 numbers.
+ *
+ * Returns: the results, or NULL if out of memory
+ */
+{
+    long i;
+
+    // First count, then fill in: the counts tell us where each query's go
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+    for (i = 0; i < nq; i++)
+        offsets[i + 1] = kdtree_radius( t, &queries[i], r, NULL, 0 );
+
+    offsets[0] = 0;
+    for (i = 0; i < nq; i++)
+        offsets[i + 1] += offsets[i];
+
+    long *ids = malloc( (offsets[nq] > 0 ? offsets[nq] : 1) * sizeof(long) );
+    if (ids == NULL)
+        return NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+    for (i = 0; i < nq; i++)
+        kdtree_radius( t, &queries[i], r, &ids[offsets[i]], offsets[i + 1] - offsets[i] );
+
+    return ids;
+}
@@ -0,0 +1,64 @@
+/*****************************************************************************
+ * spatial.h
+ *
+ * Finding nearby points quickly: a uniform grid and a k-d tree.
+ * See spatial.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+// The same point3d as in struct.c
+#ifndef POINT3D_DEFINED
+#define POINT3D_DEFINED
+struct point3d
+{
+    double x;
+    double y;
+    double z;
+};
+#endif
+
+/* A uniform grid: space is cut into cubes of side "cell", and the points
+   are sorted by which cube they're in. Good for radius queries when the
+   radius is about the size of a cell and the points are spread evenly.
+*/
+struct grid
+{
+    double cell;
+    struct point3d lo;         // the corner of cell (0,0,0)
+    int dims[3];               // cells in each direction
+    long n;
+    struct point3d *points;    // the points, sorted by cell
+    long *id;                  // id[i] = the original index of points[i]
+    long *start;               // cell c's points are start[c] .. start[c+1]-1
+};
+
+/* A k-d tree, stored "implicitly" in a sorted copy of the points: the point
+   in the middle of a range splits it in two (along dimension split[m]), and
+   the two halves are its children. No pointers, no separate nodes.
+*/
+struct kdtree
+{
+    long n;
+    struct point3d *points;
+    long *id;                  // id[i] = the original index of points[i]
+    unsigned char *split;      // the dimension (0, 1, 2) each middle point splits
+};
+
+int  grid_build( struct grid *, const struct point3d *, long, double );
+void grid_free( struct grid * );
+long grid_radius( const struct grid *, const struct point3d *, double, long *, long );
+long grid_box( const struct grid *, const struct point3d *, const struct point3d *, long *, long );
+
+int  kdtree_build( struct kdtree *, const struct point3d *, long );
+void kdtree_free( struct kdtree * );
+int  kdtree_knn( const struct kdtree *, const struct point3d *, int, long *, double * );
+long kdtree_radius( const struct kdtree *, const struct point3d *, double, long *, long );
+long kdtree_box( const struct kdtree *, const struct point3d *, const struct point3d *, long *, long );
+
+void kdtree_knn_batch( const struct kdtree *, const struct point3d *, long, int, long *, double * );
+long *kdtree_radius_batch( const struct kdtree *, const struct point3d *, long, double, long * );
+
+#endif
@@ -0,0 +1,159 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A demonstration of spatial.c. For every point in a random cloud, it finds
+ * the nearest other point, and counts the points within a small radius,
+ * first by checking every pair (n^2 distance calculations), then with the
+ * k-d tree and the grid. The answers should agree.
+ *
+ *   $ make -f Makefile-spatial
+ *   $ ./spatial_demo           (20000 points)
+ *   $ ./spatial_demo 1000000   (skips the brute force, which takes too long)
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "spatial.h"
+
+#define  BRUTE_FORCE_MAX  50000
+
+static double dist2( const struct point3d *a, const struct point3d *b )
+{
+    double dx = a->x - b->x, dy = a->y - b->y, dz = a->z - b->z;
+    return dx*dx + dy*dy + dz*dz;
+}
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    long n = (argc > 1 ? atol( argv[1] ) : 20000);
+    if (n < 2)
+    {
+        fprintf( stderr, "usage: spatial_demo [n >= 2]\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    // A random cloud in the unit cube; r is chosen so each point has ~10 neighbours
+    struct point3d *P = malloc( n * sizeof(struct point3d) );
+    long *nearest[3], *within[3], i, j;
+    for (i = 0; i < 3; i++)
+    {
+        nearest[i] = calloc( n, sizeof(long) );
+        within[i]  = calloc( n, sizeof(long) );
+    }
+    srand( 1 );
+    for (i = 0; i < n; i++)
+    {
+        P[i].x = rand() / (double)RAND_MAX;
+        P[i].y = rand() / (double)RAND_MAX;
+        P[i].z = rand() / (double)RAND_MAX;
+    }
+    double r = cbrt( 10.0 / n * 3.0 / (4.0 * M_PI) );
+
+    // 1) Brute force
+    double start = now(), brute = 0;
+    if (n <= BRUTE_FORCE_MAX)
+    {
+        for (i = 0; i < n; i++)
+        {
+            double best = INFINITY;
+            for (j = 0; j < n; j++)
+            {
+                double d = dist2( &P[i], &P[j] );
+                if (j != i && d < best)
+                {
+                    best = d;
+                    nearest[0][i] = j;
+                }
+                within[0][i] += (d <= r*r);
+            }
+        }
+        brute = now() - start;
+    }
+
+    // 2) k-d tree: the 2 nearest to each point are itself and its neighbour
+    start = now();
+    struct kdtree tree;
+    if (kdtree_build( &tree, P, n ) != 0)
+    {
+        fprintf( stderr, "error: could not build the k-d tree\n" );
+        exit(EXIT_FAILURE);
+    }
+    double build_time = now() - start;
+    long *ids = malloc( 2 * n * sizeof(long) );
+    double *d2 = malloc( 2 * n * sizeof(double) );
+    kdtree_knn_batch( &tree, P, n, 2, ids, d2 );
+    for (i = 0; i < n; i++)
+        nearest[1][i] = (ids[2*i] == i ? ids[2*i + 1] : ids[2*i]);
+    long *offsets = malloc( (n + 1) * sizeof(long) );
+    long *found = kdtree_radius_batch( &tree, P, n, r, offsets );
+    for (i = 0; i < n; i++)
+        within[1][i] = offsets[i + 1] - offsets[i];
+    double tree_time = now() - start;
+
+    // 3) Grid, with cells the size of the radius (radius queries only)
+    start = now();
+    struct grid grid;
+    if (grid_build( &grid, P, n, r ) != 0)
+    {
+        fprintf( stderr, "error: could not build the grid\n" );
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++)
+        within[2][i] = grid_radius( &grid, &P[i], r, NULL, 0 );
+    double grid_time = now() - start;
+
+    // Queries reaching far outside the cloud (even to infinity) should
+    // find everything beyond their lower corner, just as the tree does
+    struct point3d mid = { 0.5, 0.5, 0.5 }, far = { 1e30, 1e30, 1e30 };
+    struct point3d inf = { INFINITY, INFINITY, INFINITY };
+    long far_tree = kdtree_box( &tree, &mid, &far, NULL, 0 );
+    long far_grid = grid_box( &grid, &mid, &far, NULL, 0 );
+    long inf_grid = grid_box( &grid, &mid, &inf, NULL, 0 );
+    long all_grid = grid_radius( &grid, &mid, 1e30, NULL, 0 );
+
+    // Compare (nearest neighbours can tie, so compare distances, not ids)
+    long disagree = (far_grid != far_tree) + (inf_grid != far_tree) + (all_grid != n);
+    for (i = 0; i < n; i++)
+    {
+        if (within[1][i] != within[2][i])
+            disagree++;
+        if (n <= BRUTE_FORCE_MAX &&
+            (within[0][i] != within[1][i] ||
+             dist2( &P[i], &P[nearest[0][i]] ) != dist2( &P[i], &P[nearest[1][i]] )))
+            disagree++;
+    }
+
+    printf( "%ld points, radius %.4f\n", n, r );
+    if (n <= BRUTE_FORCE_MAX)
+        printf( "  brute force: %8.3f s\n", brute );
+    printf( "  k-d tree:    %8.3f s (%.3f s to build)\n", tree_time, build_time );
+    printf( "  grid:        %8.3f s\n", grid_time );
+    printf( "  %ld disagreements\n", disagree );
+
+    kdtree_free( &tree );
+    grid_free( &grid );
+    free( found );
+    free( offsets );
+    free( ids );
+    free( d2 );
+    for (i = 0; i < 3; i++)
+    {
+        free( nearest[i] );
+        free( within[i] );
+    }
+    free( P );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * collatz.c
+ *
+ * q14.c and q14-openmp.c answer one question ("which start below a million
+ * has the longest chain?") and then exit. The functions here do the same
+ * search over any range [lo, hi), so that other programs can use it.
+ *
+ * Chain lengths are counted exactly as in q14.c: the number of steps to
+ * reach 1, where an odd x goes straight to (3x+1)/2 and counts as two steps.
+ * When several starts share the longest chain, the smallest one wins.
+ *
+ * collatz_search() follows the chain of every start in the range.
+ * collatz_search_pruned() gets exactly the same answer, while skipping every
+ * start that provably can't win. Each rule below names another start in the
+ * range that beats it (a longer chain, or an equally long one that's smaller):
+ *
+ *   1) n, if 2n is in the range: 2n -> n, so 2n's chain is one step longer.
+ *      This rules out the whole bottom half of [lo, hi).
+ *
+ *   2) n = 3t+2: then m = (2n-1)/3 = 2t+1 is odd, and (3m+1)/2 = n. So m is
+ *      smaller than n, and its chain is two steps longer -- unless m = 1,
+ *      whose chain stops before it gets anywhere (so 2 is never ruled out).
+ *
+ *   3) The residue sieve. Write n = 2^k q + r. The first k (shortcut) steps
+ *      of n's chain depend only on r, and land on 3^a q + f, where a (the
+ *      number of odd steps) and f depend only on r too. If a smaller residue
+ *      r' has the same a and f, then n' = 2^k q + r' arrives at the very same
+ *      number in the very same number of steps, so it ties with n, and wins
+ *      by being smaller. For example, with k = 3, 8q+4 and 8q+5 both reach
+ *      3q+2 after four steps. The bigger k is, the more residues merge.
+ *
+ * Both searches keep live counts of their progress (see metrics.c).
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "collatz.h"
+#include "metrics.h"
+
+
+// Live counts of the searches' progress
+static int m_starts, m_chains, m_steps, m_range;
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+
+static void register_metrics( void )
+{
+    m_starts = metrics_counter( "collatz_starts_total", "Starting numbers considered" );
+    m_chains = metrics_counter( "collatz_chains_total", "Chains followed all the way to 1" );
+    m_steps  = metrics_counter( "collatz_steps_total", "Steps along those chains (counted as in q14.c)" );
+    m_range  = metrics_gauge( "collatz_search_starts", "Starting numbers in the current search" );
+}
+
+
+int collatz_length( long x )
+/* The length of the chain starting at x, counted as in q14.c (x >= 1).
+ * (This is q14.c's recursive_collatz() written as a loop, which is what the
+ * compiler would hopefully have turned it into anyway.)
+ */
+{
+    int l = 0;
+    while (x != 1)
+    {
+        if (x % 2 == 0)
+        {
+            x >>= 1;
+            l += 1;
+        }
+        else
+        {
+            x = (3*x + 1) >> 1;
+            l += 2;
+        }
+    }
+    return l;
+}
+
+
+/* Keeping track of the best start so far, from several threads at once.
+   "Better" means longer, or just as long but smaller, so that the answer
+   doesn't depend on which thread got there first.
+*/
+struct best
+{
+    long start;
+    int length;
+};
+
+#pragma omp declare reduction(best_chain : struct best : \
+    omp_out = (omp_in.length > omp_out.length || \
+               (omp_in.length == omp_out.length && omp_in.start < omp_out.start)) ? omp_in : omp_out) \
+    initializer(omp_priv = (struct best){ 0, -1 })
+
+
+void collatz_search( long lo, long hi, struct collatz_result *result )
+/* Find the start in [lo, hi) with the longest chain, by brute force.
+ *
+ * Inputs:
+ *   long lo, hi = the range of starts to search (lo >= 1)
+ *   struct collatz_result *result = where to put the answer
+ */
+{
+    pthread_once( &metrics_once, register_metrics );
+    metrics_set( m_range, hi - lo );
+
+    struct best b = { 0, -1 };
+    long i;
+#pragma omp parallel for schedule(dynamic, 4096) reduction(best_chain:b)
+    for (i = lo; i < hi; i++)
+    {
+        int l = collatz_length( i );
+        metrics_add( m_starts, 1 );
+        metrics_add( m_chains, 1 );
+        metrics_add( m_steps, l );
+        if (l > b.length || (l == b.length && i < b.start))
+        {
+            b.length = l;
+            b.start = i;
+        }
+    }
+
+    result->start = b.start;
+    result->length = b.length;
+    result->evaluated = (hi > lo ? hi - lo : 0);
+    result->total = result->evaluated;
+}
+
+
+static int *make_sieve( int k )
+/* Work out which residues mod 2^k can be skipped (rule 3 above).
+ *
+ * Returns:
+ *   int * = an array of 2^k offsets: for each residue r that can be skipped,
+ *           how far below n the start that beats it lies (r - r'), and 0 for
+ *           residues that can't be skipped. NULL if out of memory.
+ */
+{
+    long m = 1L << k;
+    int *offset = calloc( m, sizeof(int) );
+
+    /* Residues are matched up with a hash table keyed on (a, f). Each slot
+       holds the smallest residue with that key, plus one (so 0 means empty).
+    */
+    long cap = 2 * m;
+    uint64_t *keys = malloc( cap * sizeof(uint64_t) );
+    long *first = calloc( cap, sizeof(long) );
+    if (offset == NULL || keys == NULL || first == NULL)
+    {
+        free( offset );
+        free( keys );
+        free( first );
+        return NULL;
+    }
+
+    long r;
+    for (r = 0; r < m; r++)
+    {
+        /* Follow n = 2^k q + r for k steps. Written as A*q + B, A stays even
+           until the very end, so the parity of n is just the parity of B,
+           and we don't need to keep track of A at all.
+        */
+        uint64_t B = r;
+        int a = 0;
+        for (int step = 0; step < k; step++)
+        {
+            if (B % 2 == 0)
+                B /= 2;
+            else
+            {
+                B = (3*B + 1) / 2;
+                a++;
+            }
+        }
+
+        uint64_t key = (B << 6) | a;    // a <= k <= 24 fits in the low 6 bits
+        long slot = (long)((key * 0x9e3779b97f4a7c15ull) >> 17) & (cap - 1);
+        while (first[slot] != 0 && keys[slot] != key)
+            slot = (slot + 1) & (cap - 1);
+
+        if (first[slot] == 0)
+        {
+            keys[slot] = key;
+            first[slot] = r + 1;
+        }
+        else
+            offset[r] = r - (first[slot] - 1);   // an earlier residue got there first
+    }
+
+    free( keys );
+    free( first );
+    return offset;
+}
+
+
+int collatz_search_pruned( long lo, long hi, int sieve_bits, struct collatz_result *result )
+/* Find the start in [lo, hi) with the longest chain, like collatz_search(),
+ * but only following the chains of starts that survive the rules at the top
+ * of this file.
+ *
+ * Inputs:
+ *   long lo, hi    = the range of starts to search (lo >= 1)
+ *   int sieve_bits = k, for a residue sieve modulo 2^k (0 to switch it off,
+ *                    up to COLLATZ_MAX_SIEVE_BITS)
+ *   struct collatz_result *result = where to put the answer; its evaluated
+ *                    and total members say how much work was saved
+ * Returns:
+ *   int = 0 on success, -1 if sieve_bits is out of range or there wasn't
+ *         enough memory for the sieve
+ */
+{
+    if (sieve_bits < 0 || sieve_bits > COLLATZ_MAX_SIEVE_BITS)
+        return -1;
+
+    int *offset = NULL;
+    long mask = (1L << sieve_bits) - 1;
+    if (sieve_bits > 0 && (offset = make_sieve( sieve_bits )) == NULL)
+        return -1;
+
+    // Rule 1: n is beaten by 2n whenever 2n < hi
+    long start = (hi + 1) / 2;
+    if (start < lo)
+        start = lo;
+
+    pthread_once( &metrics_once, register_metrics );
+    metrics_set( m_range, hi - lo );
+    metrics_add( m_starts, start - lo );   // rule 1 skips these all at once
+
+    struct best b = { 0, -1 };
+    long evaluated = 0;
+    long n;
+#pragma omp parallel for schedule(dynamic, 4096) reduction(best_chain:b) reduction(+:evaluated)
+    for (n = start; n < hi; n++)
+    {
+        metrics_add( m_starts, 1 );
+
+        // Rule 2: n = 3t+2 is beaten by (2n-1)/3, if that isn't 1
+        if (n % 3 == 2 && (2*n - 1) / 3 > 1 && (2*n - 1) / 3 >= lo)
+            continue;
+
+        /* Rule 3: the residue sieve. Both n and the start that beats it must
+           be at least 2^k (i.e. q >= 1), so that neither of them can reach 1
+           before the k steps are up.
+        */
+        if (offset != NULL && offset[n & mask] != 0)
+        {
+            long beater = n - offset[n & mask];
+            if (beater >= lo && beater > mask)
+                continue;
+        }
+
+        evaluated++;
+        int l = collatz_length( n );
+        metrics_add( m_chains, 1 );
+        metrics_add( m_steps, l );
+        if (l > b.length || (l == b.length && n < b.start))
+        {
+            b.length = l;
+            b.start = n;
+        }
+    }
+
+    free( offset );
+
+    result->start = b.start;
+    result->length = b.length;
+    result->evaluated = evaluated;
+    result->total = (hi > lo ? hi - lo : 0);
+    return 0;
+}
@@ -0,0 +1,26 @@
+/*****************************************************************************
+ * collatz.h
+ *
+ * The Collatz chain search of q14.c, as a reusable library.
+ * See collatz.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef COLLATZ_H
+#define COLLATZ_H
+
+struct collatz_result
+{
+    long start;      // the starting number with the longest chain
+    int  length;     // its chain length (counted the same way as q14.c)
+    long evaluated;  // how many starting numbers actually had their chain followed
+    long total;      // how many starting numbers were in the range
+};
+
+#define  COLLATZ_MAX_SIEVE_BITS  24
+
+int  collatz_length( long );
+void collatz_search( long, long, struct collatz_result * );
+int  collatz_search_pruned( long, long, int, struct collatz_result * );
+
+#endif
@@ -0,0 +1,134 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * collatz_client.c
+ *
+ * The client side of collatzd (see collatzd.c): connect once, then ask for
+ * as many chain lengths as you like. Each call sends one request and waits
+ * for its reply, so asking for a thousand lengths in one call costs about
+ * the same as asking for one -- send them in batches where you can.
+ *
+ * Every function returns 0 on success and -1 on failure (the daemon went
+ * away, or didn't like the request).
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "collatz_client.h"
+
+static int send_all( int fd, const void *buf, size_t len )
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send( fd, p, len, MSG_NOSIGNAL );
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int recv_all( int fd, void *buf, size_t len )
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv( fd, p, len, 0 );
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int ask( struct collatz_client *c, int op, const void *items, uint32_t count,
+                size_t item_size, void *results, uint32_t nresults, size_t result_size )
+/* Send one request, and read its reply into results, which must have room
+ * for nresults results.
+ */
+{
+    struct collatz_request req = { COLLATZ_MAGIC, op, 0, count, 0 };
+    struct collatz_reply rep;
+
+    if (send_all( c->fd, &req, sizeof(req) ) != 0 ||
+        send_all( c->fd, items, count * item_size ) != 0 ||
+        recv_all( c->fd, &rep, sizeof(rep) ) != 0)
+        return -1;
+    if (rep.magic != COLLATZ_MAGIC || rep.status != COLLATZ_OK || rep.count != nresults)
+        return -1;
+    return recv_all( c->fd, results, nresults * result_size );
+}
+
+
+int collatz_client_open( struct collatz_client *c, const char *path )
+/* Connect to collatzd.
+ *
+ * Inputs:
+ *   struct collatz_client *c = the connection to set up
+ *   const char *path         = its socket (NULL for COLLATZD_SOCKET)
+ */
+{
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    if (path == NULL)
+        path = COLLATZD_SOCKET;
+    if (strlen( path ) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy( addr.sun_path, path );
+
+    if ((c->fd = socket( AF_UNIX, SOCK_STREAM, 0 )) < 0)
+        return -1;
+    if (connect( c->fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0)
+    {
+        close( c->fd );
+        c->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void collatz_client_close( struct collatz_client *c )
+{
+    if (c->fd >= 0)
+        close( c->fd );
+    c->fd = -1;
+}
+
+
+int collatz_client_lengths( struct collatz_client *c, const uint64_t *x, uint16_t *length, uint32_t n )
+/* length[i] = the chain length of x[i], for n starts */
+{
+    return ask( c, COLLATZ_OP_LENGTHS, x, n, sizeof(uint64_t), length, n, sizeof(uint16_t) );
+}
+
+int collatz_client_range( struct collatz_client *c, uint64_t lo, uint64_t hi, uint16_t *length )
+/* length[i] = the chain length of lo + i, for every start in [lo, hi) */
+{
+    uint64_t range[2] = { lo, hi };
+    if (hi < lo || hi - lo > COLLATZ_MAX_COUNT)
+        return -1;
+    return ask( c, COLLATZ_OP_RANGE, range, 1, sizeof(range), length, hi - lo, sizeof(uint16_t) );
+}
+
+int collatz_client_best( struct collatz_client *c, const uint64_t *ranges, struct collatz_best *best, uint32_t n )
+/* best[i] = the start with the longest chain in [ranges[2i], ranges[2i+1]),
+ * for n ranges: the question q14.c answers.
+ */
+{
+    return ask( c, COLLATZ_OP_BEST, ranges, n, 2 * sizeof(uint64_t), best, n, sizeof(struct collatz_best) );
+}
+
+int collatz_client_stats( struct collatz_client *c, struct collatz_stats *stats )
+{
+    return ask( c, COLLATZ_OP_STATS, NULL, 0, 0, stats, 1, sizeof(struct collatz_stats) );
+}
@@ -0,0 +1,95 @@
+/*****************************************************************************
+ * collatz_client.h
+ *
+ * Asking a running collatzd for Collatz chain lengths, and the messages that
+ * go back and forth on its socket. See collatzd.c and collatz_client.c.
+ *
+ *****************************************************************************/
+
+#ifndef COLLATZ_CLIENT_H
+#define COLLATZ_CLIENT_H
+
+#include <stdint.h>
+
+#define  COLLATZD_SOCKET  "/tmp/collatzd.sock"   // where collatzd listens by default
+
+/* Every request is a header followed by "count" items, and every reply is a
+   header followed by "count" results. The numbers are in the machine's own
+   byte order: a Unix socket never leaves the machine, so there's no need to
+   convert them.
+
+     op                 items (request)           results (reply)
+     COLLATZ_OP_LENGTHS uint64_t x                uint16_t length of x
+     COLLATZ_OP_RANGE   uint64_t lo, hi (count=1) uint16_t length of lo..hi-1
+     COLLATZ_OP_BEST    uint64_t lo, hi per range struct collatz_best per range
+     COLLATZ_OP_STATS   (none)                    struct collatz_stats
+
+   Starts that are out of range (0, or too big to follow without the
+   numbers overflowing) get the length COLLATZ_INVALID. A RANGE may hold at
+   most COLLATZ_MAX_COUNT starts, and must not start beyond COLLATZ_MAX_START
+   (or end before it starts); the BEST ranges of one request may have at
+   most COLLATZ_MAX_COUNT starts between them beyond what collatzd's table
+   can cover (collatzd -N). Anything else gets COLLATZ_EBADREQ.
+*/
+#define  COLLATZ_MAGIC    0x315a4c43u  // "CLZ1"
+
+#define  COLLATZ_OP_LENGTHS  1
+#define  COLLATZ_OP_RANGE    2
+#define  COLLATZ_OP_BEST     3
+#define  COLLATZ_OP_STATS    4
+
+#define  COLLATZ_INVALID     0xffff
+#define  COLLATZ_MAX_START   (1ULL << 60)   // larger starts are COLLATZ_INVALID
+#define  COLLATZ_MAX_COUNT   (1u << 24)     // results per request
+
+// Reply statuses
+#define  COLLATZ_OK          0
+#define  COLLATZ_EBADREQ     1   // unknown op, wrong magic, too many items...
+#define  COLLATZ_ENOMEM      2
+
+struct collatz_request
+{
+    uint32_t magic;
+    uint16_t op;
+    uint16_t flags;        // (none yet; send 0)
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct collatz_reply
+{
+    uint32_t magic;
+    uint32_t status;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct collatz_best
+{
+    uint64_t start;        // the start in [lo, hi) with the longest chain...
+    uint32_t length;       // ...and its length (COLLATZ_INVALID for an empty range)
+    uint32_t pad;
+};
+
+struct collatz_stats
+{
+    uint64_t covered;      // lengths below this are in the daemon's table
+    uint64_t requests;     // requests answered so far
+    uint64_t values;       // lengths looked up so far
+    uint64_t clients;      // connections accepted so far
+};
+
+// A connection to collatzd
+struct collatz_client
+{
+    int fd;
+};
+
+int  collatz_client_open( struct collatz_client *, const char * );
+void collatz_client_close( struct collatz_client * );
+int  collatz_client_lengths( struct collatz_client *, const uint64_t *, uint16_t *, uint32_t );
+int  collatz_client_range( struct collatz_client *, uint64_t, uint64_t, uint16_t * );
+int  collatz_client_best( struct collatz_client *, const uint64_t *, struct collatz_best *, uint32_t );
+int  collatz_client_stats( struct collatz_client *, struct collatz_stats * );
+
+#endif
@@ -0,0 +1,338 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * collatz_db.c
+ *
+ * Every run of q14.c starts from scratch. But the chain length of a number
+ * never changes, so why not keep the answers in a file and reuse them? This
+ * is a "database" of chain lengths: a file holding a small header and then
+ * one 16-bit length for every start 1, 2, 3, ... up to however far it has
+ * got so far. Asking about a bigger range just extends it.
+ *
+ * The file is memory-mapped (see "man mmap"): rather than reading it in, we
+ * ask the operating system to make the file appear in our memory, and pages
+ * are loaded as we touch them. Several programs can map the same file at
+ * once, and they all share the one copy in the operating system's page
+ * cache. Only one of them may extend it at a time, which is enforced with a
+ * file lock (see "man flock"); the others just see the new lengths appear.
+ *
+ * Extending is fast, too: following the chain of x, as soon as it drops
+ * below the part of the file that's already filled in, we can look the
+ * rest of its length up instead of following it all the way to 1.
+ *
+ * Lookups and extensions are counted as they happen (see metrics.c), so a
+ * long extension can be watched, and the hit rate of the file checked.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <pthread.h>
+
+#include "collatz_db.h"
+#include "metrics.h"
+
+#define  HEADER_SIZE  sizeof(struct collatz_db_header)
+
+// Live counts of how the file is being used
+static int m_hits, m_misses, m_written, m_covered;
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+
+static void register_metrics( void )
+{
+    m_hits    = metrics_counter( "collatz_db_hits_total", "Chain lengths found in the file" );
+    m_misses  = metrics_counter( "collatz_db_misses_total", "Chain lengths worked out beyond the file" );
+    m_written = metrics_counter( "collatz_db_bytes_written_total", "Bytes of chain lengths added to the file" );
+    m_covered = metrics_gauge( "collatz_db_covered", "Every start below this is in the file" );
+    metrics_ratio( "collatz_db_hit_ratio", "Fraction of lookups found in the file", m_hits, m_misses );
+}
+
+
+static long load_covered( struct collatz_db *db )
+/* Other processes may be extending the file, so read "covered" atomically,
+ * and only after that trust the lengths below it.
+ */
+{
+    return __atomic_load_n( &db->header->covered, __ATOMIC_ACQUIRE );
+}
+
+
+static int map( struct collatz_db *db, size_t size )
+/* (Re)map the first size bytes of the file */
+{
+    if (db->header != NULL)
+        munmap( db->header, db->map_size );
+
+    int prot = PROT_READ | (db->writable ? PROT_WRITE : 0);
+    void *p = mmap( NULL, size, prot, MAP_SHARED, db->fd, 0 );
+    if (p == MAP_FAILED)
+    {
+        db->header = NULL;
+        return -1;
+    }
+    db->header = p;
+    db->length = (uint16_t *)((char *)p + HEADER_SIZE);
+    db->map_size = size;
+    return 0;
+}
+
+
+int collatz_db_open( struct collatz_db *db, const char *path, int writable )
+/* Open (and, if writable, create if necessary) a chain length database.
+ *
+ * Inputs:
+ *   struct collatz_db *db = the handle to fill in
+ *   const char *path      = the file
+ *   int writable          = 0 to only read from it, 1 to be able to extend it
+ * Returns:
+ *   int = 0 on success, -1 on failure
+ */
+{
+    memset( db, 0, sizeof(struct collatz_db) );
+    db->writable = writable;
+    db->fd = open( path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644 );
+    if (db->fd < 0)
+        return -1;
+
+    // A brand new file needs its header (and the length of 1, which is 0)
+    if (writable)
+    {
+        flock( db->fd, LOCK_EX );
+        struct stat st;
+        if (fstat( db->fd, &st ) == 0 && st.st_size == 0)
+        {
+            struct collatz_db_header h = { COLLATZ_DB_MAGIC, 1, sizeof(uint16_t), 2, 2, { 0 } };
+            uint16_t zeros[2] = { 0, 0 };
+            if (write( db->fd, &h, sizeof(h) ) != sizeof(h) ||
+                write( db->fd, zeros, sizeof(zeros) ) != sizeof(zeros))
+            {
+                flock( db->fd, LOCK_UN );
+                close( db->fd );
+                return -1;
+            }
+        }
+        flock( db->fd, LOCK_UN );
+    }
+
+    struct stat st;
+    if (fstat( db->fd, &st ) != 0 || (size_t)st.st_size < HEADER_SIZE ||
+        map( db, st.st_size ) != 0 ||
+        memcmp( db->header->magic, COLLATZ_DB_MAGIC, 8 ) != 0 ||
+        db->header->entry_size != sizeof(uint16_t))
+    {
+        collatz_db_close( db );
+        return -1;
+    }
+    return 0;
+}
+
+
+void collatz_db_close( struct collatz_db *db )
+{
+    if (db->header != NULL)
+        munmap( db->header, db->map_size );
+    if (db->fd >= 0)
+        close( db->fd );
+    db->header = NULL;
+    db->fd = -1;
+}
+
+
+int collatz_db_refresh( struct collatz_db *db )
+/* Pick up lengths that another process has added since we opened the file.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+{
+    struct stat st;
+    if (fstat( db->fd, &st ) != 0)
+        return -1;
+    if ((size_t)st.st_size > db->map_size)
+        return map( db, st.st_size );
+    return 0;
+}
+
+
+long collatz_db_covered( struct collatz_db *db )
+/* Lengths are known for every start below this (as far as our mapping goes) */
+{
+    long covered = load_covered( db );
+    long mapped = (db->map_size - HEADER_SIZE) / sizeof(uint16_t);
+    return (covered < mapped ? covered : mapped);
+}
+
+
+static int length_above( const uint16_t *table, long base, long x )
+/* The chain length of x, following the chain until it drops below base, and
+ * then looking the rest up in table. Returns -1 if the chain climbs too high
+ * for a long (which first happens for a start of about 8.5 billion).
+ */
+{
+    int l = 0;
+    while (x >= base)
+    {
+        if (x % 2 == 0)
+        {
+            x >>= 1;
+            l += 1;
+        }
+        else
+        {
+            if (x > (LONG_MAX - 1) / 3)
+                return -1;
+            x = (3*x + 1) >> 1;
+            l += 2;
+        }
+    }
+    return l + table[x];
+}
+
+
+int collatz_db_extend( struct collatz_db *db, long hi )
+/* Make sure the lengths of all starts below hi are in the file.
+ *
+ * Returns: 0 on success, -1 on failure (e.g. the file is read-only)
+ */
+{
+    if (!db->writable)
+        return (collatz_db_refresh( db ) == 0 && collatz_db_covered( db ) >= hi ? 0 : -1);
+
+    // Only one process at a time
+    flock( db->fd, LOCK_EX );
+    if (collatz_db_refresh( db ) != 0)
+    {
+        flock( db->fd, LOCK_UN );
+        return -1;
+    }
+
+    long covered = load_covered( db );
+    pthread_once( &metrics_once, register_metrics );
+    metrics_set( m_covered, covered );
+    if (covered >= hi)
+    {
+        flock( db->fd, LOCK_UN );
+        return 0;
+    }
+
+    // Make room
+    if (db->header->capacity < hi)
+    {
+        if (ftruncate( db->fd, HEADER_SIZE + hi * sizeof(uint16_t) ) != 0 ||
+            map( db, HEADER_SIZE + hi * sizeof(uint16_t) ) != 0)
+        {
+            flock( db->fd, LOCK_UN );
+            return -1;
+        }
+        db->header->capacity = hi;
+    }
+
+    /* Fill in the new lengths in stages, each at most doubling what's known,
+       so that every chain soon drops into the known part. (It has to drop
+       below x eventually, and x is at most twice the bottom of the stage.)
+    */
+    uint16_t *table = db->length;
+    int overflow = 0;
+    while (covered < hi)
+    {
+        long base = covered;
+        long top = (hi < 2*base ? hi : 2*base);
+        long x;
+#pragma omp parallel for schedule(static) reduction(|:overflow)
+        for (x = base; x < top; x++)
+        {
+            int l = length_above( table, base, x );
+            overflow |= (l < 0 || l > UINT16_MAX);
+            table[x] = l;
+        }
+        if (overflow)
+            break;
+
+        // Publish the new lengths to anyone else looking at the file
+        covered = top;
+        __atomic_store_n( &db->header->covered, covered, __ATOMIC_RELEASE );
+        metrics_add( m_written, (top - base) * sizeof(uint16_t) );
+        metrics_set( m_covered, covered );
+    }
+
+    flock( db->fd, LOCK_UN );
+    return (overflow ? -1 : 0);
+}
+
+
+int collatz_db_length( struct collatz_db *db, long x )
+/* The chain length of x: from the file if it's there, otherwise worked out
+ * (with the help of the file). Returns -1 if the chain climbs beyond what a
+ * long can hold.
+ */
+{
+    long covered = collatz_db_covered( db );
+    pthread_once( &metrics_once, register_metrics );
+    if (x < covered)
+    {
+        metrics_add( m_hits, 1 );
+        return db->length[x];
+    }
+    metrics_add( m_misses, 1 );
+    return length_above( db->length, covered, x );
+}
+
+
+int collatz_db_search( struct collatz_db *db, long lo, long hi, struct collatz_result *result )
+/* The same as collatz_search() in collatz.c, but using (and, if the database
+ * is writable, first extending) the database.
+ *
+ * Returns: 0 on success, -1 if the lengths aren't available
+ */
+{
+    pthread_once( &metrics_once, register_metrics );
+    if (collatz_db_extend( db, hi ) != 0)
+        return -1;
+
+    const uint16_t *table = db->length;
+    long best_start = 0;
+    int best_length = -1;
+
+    /* Scanning an array of 16-bit numbers is about as fast as a computer can
+       do anything. Each thread finds its own best, and then they compare.
+    */
+#pragma omp parallel
+    {
+        long my_start = 0;
+        int my_length = -1;
+        long x;
+        long my_count = 0;
+#pragma omp for schedule(static) nowait
+        for (x = lo; x < hi; x++)
+        {
+            if (table[x] > my_length)
+            {
+                my_length = table[x];
+                my_start = x;
+            }
+            my_count++;
+        }
+        // (Counted once per thread: this loop is too quick to slow down)
+        metrics_add( m_hits, my_count );
+#pragma omp critical
+        if (my_length > best_length || (my_length == best_length && my_start < best_start))
+        {
+            best_length = my_length;
+            best_start = my_start;
+        }
+    }
+
+    result->start = best_start;
+    result->length = best_length;
+    result->evaluated = 0;
+    result->total = (hi > lo ? hi - lo : 0);
+    return 0;
+}
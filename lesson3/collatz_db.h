@@ -0,0 +1,45 @@
+/*****************************************************************************
+ * collatz_db.h
+ *
+ * A file of Collatz chain lengths that persists between runs.
+ * See collatz_db.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef COLLATZ_DB_H
+#define COLLATZ_DB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "collatz.h"
+
+#define  COLLATZ_DB_MAGIC  "COLLATZ"
+
+struct collatz_db_header
+{
+    char    magic[8];
+    int32_t version;
+    int32_t entry_size;    // bytes per chain length (2)
+    int64_t covered;       // lengths are known for every start 1 <= x < covered
+    int64_t capacity;      // the file has room for starts up to capacity-1
+    char    pad[32];       // (keeps the lengths 64-byte aligned)
+};
+
+struct collatz_db
+{
+    int fd;
+    int writable;
+    size_t map_size;
+    struct collatz_db_header *header;
+    uint16_t *length;      // length[x] = chain length of x, for 1 <= x < covered
+};
+
+int  collatz_db_open( struct collatz_db *, const char *, int );
+void collatz_db_close( struct collatz_db * );
+long collatz_db_covered( struct collatz_db * );
+int  collatz_db_refresh( struct collatz_db * );
+int  collatz_db_extend( struct collatz_db *, long );
+int  collatz_db_length( struct collatz_db *, long );
+int  collatz_db_search( struct collatz_db *, long, long, struct collatz_result * );
+
+#endif
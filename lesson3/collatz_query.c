@@ -0,0 +1,163 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * collatz_query.c
+ *
+ * Asks a running collatzd about Collatz chains (see collatzd.c), using the
+ * client library in collatz_client.c.
+ *
+ *   $ ./collatz_query 27 97 871          (the chain lengths of these starts)
+ *   $ ./collatz_query -r 1 1000000       (q14's question, for any range)
+ *   $ ./collatz_query -S                 (what the daemon has been up to)
+ *   $ ./collatz_query -b 100000          (how long questions take)
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "collatz_client.h"
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void usage()
+{
+    printf( "usage: collatz_query [-s socket] x ...\n" );
+    printf( "       collatz_query [-s socket] -r lo hi\n" );
+    printf( "       collatz_query [-s socket] -S\n" );
+    printf( "       collatz_query [-s socket] -b n\n\n" );
+    printf( "Asks collatzd for the chain lengths of the starts x, the start with the\n" );
+    printf( "longest chain in [lo, hi), its statistics, or times n lookups (-b).\n" );
+    printf( "  -s socket  where collatzd is listening (default %s)\n", COLLATZD_SOCKET );
+}
+
+static void benchmark( struct collatz_client *c, long n )
+/* n lookups of random starts that the daemon has in its table (the "hot"
+   case), one request at a time and then all in one request. */
+{
+    struct collatz_stats s;
+    if (n < 1 || collatz_client_stats( c, &s ) != 0 || s.covered < 2)
+    {
+        fprintf( stderr, "error: could not ask the daemon anything\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t *x = malloc( n * sizeof(uint64_t) );
+    uint16_t *l1 = malloc( n * sizeof(uint16_t) );
+    uint16_t *l2 = malloc( n * sizeof(uint16_t) );
+    long i;
+    srand( 1 );
+    for (i = 0; i < n; i++)
+        x[i] = 1 + ((uint64_t)rand() * RAND_MAX + rand()) % (s.covered - 1);
+
+    double t0 = now();
+    for (i = 0; i < n; i++)
+        if (collatz_client_lengths( c, &x[i], &l1[i], 1 ) != 0)
+            exit(EXIT_FAILURE);
+    double t1 = now();
+    if (collatz_client_lengths( c, x, l2, n ) != 0)
+        exit(EXIT_FAILURE);
+    double t2 = now();
+
+    long differ = 0;
+    for (i = 0; i < n; i++)
+        differ += (l1[i] != l2[i]);
+
+    printf( "one at a time: %8.2f us per lookup\n", (t1 - t0) / n * 1e6 );
+    printf( "one batch:     %8.4f us per lookup (%.3f ms for all %ld)\n",
+            (t2 - t1) / n * 1e6, (t2 - t1) * 1e3, n );
+    if (differ)
+        printf( "error: %ld lengths differ between the two\n", differ );
+
+    free( x );
+    free( l1 );
+    free( l2 );
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *path = NULL;
+    int ranges = 0, stats = 0;
+    long bench = 0;
+
+    int opt;
+    while ((opt = getopt( argc, argv, "s:rSb:h" )) != -1)
+    {
+        switch (opt)
+        {
+            case 's':  path = optarg;          break;
+            case 'r':  ranges = 1;             break;
+            case 'S':  stats = 1;              break;
+            case 'b':  bench = atol( optarg ); break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+    int n = argc - optind;
+    if ((ranges && n != 2) || (!ranges && !stats && !bench && n < 1))
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    struct collatz_client c;
+    if (collatz_client_open( &c, path ) != 0)
+    {
+        fprintf( stderr, "error: could not connect to collatzd (is it running?)\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    int i, failed = 0;
+    if (bench)
+        benchmark( &c, bench );
+    else if (stats)
+    {
+        struct collatz_stats s;
+        if (!(failed = collatz_client_stats( &c, &s )))
+            printf( "covered %llu, requests %llu, lengths %llu, clients %llu\n",
+                    (unsigned long long)s.covered, (unsigned long long)s.requests,
+                    (unsigned long long)s.values, (unsigned long long)s.clients );
+    }
+    else if (ranges)
+    {
+        uint64_t r[2] = { strtoull( argv[optind], NULL, 10 ), strtoull( argv[optind + 1], NULL, 10 ) };
+        struct collatz_best b;
+        double t0 = now();
+        if (!(failed = collatz_client_best( &c, r, &b, 1 )))
+        {
+            printf( "%llu\n", (unsigned long long)b.start );
+            fprintf( stderr, "chain length %u, in %.3f ms\n", b.length, (now() - t0) * 1e3 );
+        }
+    }
+    else
+    {
+        uint64_t *x = malloc( n * sizeof(uint64_t) );
+        uint16_t *l = malloc( n * sizeof(uint16_t) );
+        for (i = 0; i < n; i++)
+            x[i] = strtoull( argv[optind + i], NULL, 10 );
+        if (!(failed = collatz_client_lengths( &c, x, l, n )))
+            for (i = 0; i < n; i++)
+            {
+                if (l[i] == COLLATZ_INVALID)
+                    printf( "%llu ?\n", (unsigned long long)x[i] );
+                else
+                    printf( "%llu %u\n", (unsigned long long)x[i], l[i] );
+            }
+        free( x );
+        free( l );
+    }
+
+    if (failed)
+        fprintf( stderr, "error: collatzd couldn't answer\n" );
+    collatz_client_close( &c );
+    return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
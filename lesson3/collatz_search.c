@@ -0,0 +1,169 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * collatz_search.c
+ *
+ * The same question as q14.c -- which start below N has the longest Collatz
+ * chain? -- but for any N, and optionally with the pruned search from
+ * collatz.c, which only follows the chains that could possibly win.
+ *
+ *   $ make -f Makefile-collatz
+ *   $ ./collatz_search -n 1000000            (every start, like q14-openmp.c)
+ *   $ ./collatz_search -n 1000000 -p 16      (pruned, with a 2^16 sieve)
+ *   $ ./collatz_search -n 1000000 -d q14.db  (remembering every length in q14.db)
+ *   $ ./collatz_search -c                    (check the pruning rules)
+ *
+ * For long runs, -s 10 prints the progress to stderr every 10 seconds, and
+ * -m :9100 lets Prometheus (or curl) ask for it at any time (see metrics.c):
+ *
+ *   $ ./collatz_search -n 10000000000 -p 20 -s 60 -m :9100 &
+ *   $ curl -s http://127.0.0.1:9100/metrics | grep -v '^#'
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>   // <-- getopt() lives here
+#include <omp.h>
+
+#include "collatz.h"
+#include "collatz_db.h"
+#include "metrics.h"
+
+// The ranges that -c checks
+#define  CHECK_LO    40
+#define  CHECK_HI    300
+#define  CHECK_BITS  8
+
+void usage()
+{
+    printf( "usage: collatz_search [-l lo] [-n hi] [-p bits | -d file [-r]] [-s secs] [-m where]\n" );
+    printf( "       collatz_search -c\n\n" );
+    printf( "Finds the start in [lo, hi) with the longest Collatz chain.\n" );
+    printf( "  -l lo    the smallest start to consider (default 3)\n" );
+    printf( "  -n hi    one more than the largest start (default 1000000)\n" );
+    printf( "  -p bits  prune the search, with a residue sieve modulo 2^bits\n" );
+    printf( "           (0 to %d; 0 uses the other rules only)\n", COLLATZ_MAX_SIEVE_BITS );
+    printf( "  -d file  look the chain lengths up in (and add them to) a database\n" );
+    printf( "  -r       only read from the database, don't extend it\n" );
+    printf( "  -s secs  print the progress to stderr every secs seconds\n" );
+    printf( "  -m where serve live metrics at where: \"unix:/path\", \"host:port\"\n" );
+    printf( "           or \":port\" (on 127.0.0.1)\n" );
+    printf( "  -c       check the pruned search against every start, over all the\n" );
+    printf( "           small ranges (where the rules' edge cases are), and exit\n" );
+}
+
+int check_pruning()
+/* Compare collatz_search_pruned() with collatz_search() over every range
+ * [lo, hi) with lo < CHECK_LO and hi < CHECK_HI (including the ones that
+ * start at 1 or 2, whose chains are too short for some of the rules), for
+ * every sieve size up to CHECK_BITS. Returns the number of disagreements.
+ */
+{
+    int failures = 0, bits;
+    long lo, hi;
+    for (lo = 1; lo < CHECK_LO; lo++)
+        for (hi = lo + 1; hi < CHECK_HI; hi++)
+        {
+            struct collatz_result want, got;
+            collatz_search( lo, hi, &want );
+            for (bits = 0; bits <= CHECK_BITS; bits++)
+            {
+                collatz_search_pruned( lo, hi, bits, &got );
+                if (got.start != want.start || got.length != want.length)
+                {
+                    fprintf( stderr, "[%ld, %ld) with %d bits: got %ld (length %d), "
+                             "expected %ld (length %d)\n", lo, hi, bits,
+                             got.start, got.length, want.start, want.length );
+                    failures++;
+                }
+            }
+        }
+    return failures;
+}
+
+int main( int argc, char *argv[] )
+{
+    long lo = 3, hi = 1000000;
+    int bits = -1;  // -1 means "don't prune"
+    const char *dbfile = NULL;
+    int readonly = 0;
+    double every = 0.0;
+    const char *serve = NULL;
+
+    /* getopt() goes through the command line options one at a time. The
+       string "l:n:p:d:rs:m:ch" lists the letters it should accept; a colon means
+       that the option takes a value, which it leaves in optarg.
+    */
+    int opt;
+    while ((opt = getopt( argc, argv, "l:n:p:d:rs:m:ch" )) != -1)
+    {
+        switch (opt)
+        {
+            case 'l':  lo = atol( optarg );    break;
+            case 'n':  hi = atol( optarg );    break;
+            case 'p':  bits = atoi( optarg );  break;
+            case 'd':  dbfile = optarg;        break;
+            case 'r':  readonly = 1;           break;
+            case 's':  every = atof( optarg ); break;
+            case 'm':  serve = optarg;         break;
+            case 'c':
+                if (check_pruning() != 0)
+                    exit(EXIT_FAILURE);
+                printf( "the pruned search agrees on every range\n" );
+                exit(EXIT_SUCCESS);
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (lo < 1 || hi <= lo)
+    {
+        fprintf( stderr, "error: need 1 <= lo < hi\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    if (serve != NULL && metrics_serve( serve ) != 0)
+    {
+        fprintf( stderr, "error: could not serve metrics at %s\n", serve );
+        exit(EXIT_FAILURE);
+    }
+    if (every > 0)
+        metrics_report( stderr, every );
+
+    struct collatz_result res;
+    double start = omp_get_wtime();
+    if (dbfile != NULL)
+    {
+        struct collatz_db db;
+        if (collatz_db_open( &db, dbfile, !readonly ) != 0)
+        {
+            fprintf( stderr, "error: could not open database %s\n", dbfile );
+            exit(EXIT_FAILURE);
+        }
+        if (collatz_db_search( &db, lo, hi, &res ) != 0)
+        {
+            fprintf( stderr, "error: %s only covers starts below %ld\n",
+                     dbfile, collatz_db_covered( &db ) );
+            exit(EXIT_FAILURE);
+        }
+        collatz_db_close( &db );
+    }
+    else if (bits < 0)
+        collatz_search( lo, hi, &res );
+    else if (collatz_search_pruned( lo, hi, bits, &res ) != 0)
+    {
+        fprintf( stderr, "error: could not make a sieve with %d bits\n", bits );
+        exit(EXIT_FAILURE);
+    }
+    double elapsed = omp_get_wtime() - start;
+    metrics_stop();
+
+    printf( "%ld\n", res.start );
+    fprintf( stderr, "chain length %d; followed %ld of %ld chains (%.1f%%) in %.3f s\n",
+             res.length, res.evaluated, res.total,
+             100.0 * res.evaluated / res.total, elapsed );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * collatz_test.c
+ *
+ * Checks that a running collatzd answers bad requests with an error, rather
+ * than with garbage or by falling over, and that it's still there to answer
+ * good ones afterwards. It talks to the socket directly instead of through
+ * collatz_client.c, because it needs to see the status of each reply (and
+ * to send what a careful client never would).
+ *
+ *   $ make -f Makefile-collatz check
+ *
+ * which starts a daemon on a socket of its own, runs this against it, and
+ * stops it again.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "collatz.h"
+#include "collatz_client.h"
+
+#define  CONNECT_TRIES  100    // a tenth of a second apart, while collatzd starts
+
+static int failures = 0;
+
+static int send_all( int fd, const void *buf, size_t len )
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send( fd, p, len, MSG_NOSIGNAL );
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int recv_all( int fd, void *buf, size_t len )
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv( fd, p, len, 0 );
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int connect_to( const char *path )
+/* Returns a connected socket, or -1 if collatzd never turned up */
+{
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    strncpy( addr.sun_path, path, sizeof(addr.sun_path) - 1 );
+
+    int tries;
+    for (tries = 0; tries < CONNECT_TRIES; tries++)
+    {
+        int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+        if (fd >= 0 && connect( fd, (struct sockaddr *)&addr, sizeof(addr) ) == 0)
+            return fd;
+        if (fd >= 0)
+            close( fd );
+        usleep( 100000 );
+    }
+    return -1;
+}
+
+static int ask_range( int fd, uint64_t lo, uint64_t hi, uint16_t *out, uint32_t room )
+/* Send a RANGE request. Returns the reply's status, with its lengths (if
+ * any, and if they fit) in out, or -1 if the connection went away.
+ */
+{
+    struct collatz_request req = { COLLATZ_MAGIC, COLLATZ_OP_RANGE, 0, 1, 0 };
+    uint64_t items[2] = { lo, hi };
+    struct collatz_reply rep;
+    if (send_all( fd, &req, sizeof(req) ) != 0 || send_all( fd, items, sizeof(items) ) != 0 ||
+        recv_all( fd, &rep, sizeof(rep) ) != 0 || rep.magic != COLLATZ_MAGIC)
+        return -1;
+    if (rep.count > room)
+        return -1;
+    if (recv_all( fd, out, rep.count * sizeof(uint16_t) ) != 0)
+        return -1;
+    return rep.status;
+}
+
+static void check( int ok, const char *what )
+{
+    printf( "%s  %s\n", ok ? "ok  " : "FAIL", what );
+    if (!ok)
+        failures++;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    const char *path = (argc > 1 ? argv[1] : COLLATZD_SOCKET);
+    int fd = connect_to( path );
+    if (fd < 0)
+    {
+        fprintf( stderr, "error: could not connect to collatzd at %s\n", path );
+        exit(EXIT_FAILURE);
+    }
+
+    uint16_t out[64];
+    uint64_t top = 1ULL << 63;
+
+    // Ranges that must be refused (on the one connection, which stays open)
+    check( ask_range( fd, 0x8000000100000000ULL, 0x8000000100000010ULL, out, 64 ) == COLLATZ_EBADREQ,
+           "RANGE starting at 2^63 + 2^32 is refused" );
+    check( ask_range( fd, top, top + 16, out, 64 ) == COLLATZ_EBADREQ,
+           "RANGE starting at 2^63 is refused" );
+    check( ask_range( fd, COLLATZ_MAX_START + 1, COLLATZ_MAX_START + 17, out, 64 ) == COLLATZ_EBADREQ,
+           "RANGE starting just past COLLATZ_MAX_START is refused" );
+    check( ask_range( fd, 100, 50, out, 64 ) == COLLATZ_EBADREQ,
+           "RANGE with hi < lo is refused" );
+    check( ask_range( fd, 1, 2 + (uint64_t)COLLATZ_MAX_COUNT, out, 64 ) == COLLATZ_EBADREQ,
+           "RANGE longer than COLLATZ_MAX_COUNT is refused" );
+    check( ask_range( fd, 0, UINT64_MAX, out, 64 ) == COLLATZ_EBADREQ,
+           "RANGE over every uint64_t is refused" );
+
+    // Ones that must still work afterwards
+    int i, same = 1;
+    check( ask_range( fd, 1, 65, out, 64 ) == COLLATZ_OK, "RANGE [1, 65) is answered" );
+    for (i = 0; i < 64; i++)
+        same = same && (out[i] == collatz_length( 1 + i ));
+    check( same, "... with the right lengths" );
+
+    uint64_t lo = COLLATZ_MAX_START - 3;
+    check( ask_range( fd, lo, lo + 8, out, 64 ) == COLLATZ_OK,
+           "RANGE across COLLATZ_MAX_START is answered" );
+    same = 1;
+    for (i = 4; i < 8; i++)
+        same = same && (out[i] == COLLATZ_INVALID);
+    check( same, "... with COLLATZ_INVALID past it" );
+    close( fd );
+
+    // And a new connection still gets through
+    fd = connect_to( path );
+    struct collatz_request req = { COLLATZ_MAGIC, COLLATZ_OP_STATS, 0, 0, 0 };
+    struct collatz_reply rep;
+    struct collatz_stats s;
+    check( fd >= 0 && send_all( fd, &req, sizeof(req) ) == 0 &&
+           recv_all( fd, &rep, sizeof(rep) ) == 0 && rep.status == COLLATZ_OK &&
+           rep.count == 1 && recv_all( fd, &s, sizeof(s) ) == 0,
+           "collatzd is still running" );
+    if (fd >= 0)
+        close( fd );
+
+    printf( "%s\n", failures ? "FAILED" : "all passed" );
+    return (failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,495 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * collatzd.c
+ *
+ * A "daemon": a program that starts once, then sits in the background
+ * answering questions from other programs. Here, the questions are "what
+ * are the chain lengths of these starts?" and "which start in this range has
+ * the longest chain?", and the answers come from a table of lengths (a
+ * collatz_db, see collatz_db.c) that stays in memory between questions. A
+ * program that would have spent seconds working the lengths out from
+ * scratch just asks, and gets them back in microseconds.
+ *
+ * Programs connect to a Unix domain socket: like a network connection, but
+ * to a file name on this computer rather than an address, and without any
+ * of the network stack in between. The messages are binary (see
+ * collatz_client.h): a small header, then an array of numbers. Nothing has
+ * to be parsed or formatted, so a request for a million lengths is mostly
+ * just one big memcpy. collatz_client.c does the talking for you.
+ *
+ * Each connection gets its own thread, and big requests are shared among
+ * the cores with OpenMP. They all use the one table, which only needs
+ * locking when it grows: a read-write lock lets any number of readers in at
+ * once, but makes the (rare) writer wait until it has the table to itself.
+ * The table grows when a range is asked about that goes beyond it; single
+ * lengths beyond it are just worked out (which is quick, since the chain
+ * soon drops back into the table).
+ *
+ *   $ make -f Makefile-collatz
+ *   $ ./collatzd -n 100000000 &
+ *   $ ./collatz_query 27 97 871
+ *   $ ./collatz_query -r 1 100000000
+ *   $ ./collatz_query -b 100000
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
+
+#include "collatz_db.h"
+#include "collatz_client.h"
+#include "metrics.h"
+
+#define  PARALLEL_MIN  4096      // requests smaller than this are done by one thread
+#define  BEST_CHUNK    (1L << 22) // how much of a range to search between checks
+
+static struct collatz_db db;
+static pthread_rwlock_t db_lock = PTHREAD_RWLOCK_INITIALIZER;
+static long max_covered;              // never grow the table beyond this
+
+static int m_requests, m_values, m_clients;
+static volatile sig_atomic_t stopping = 0;
+
+
+/*****************************************************************************
+ * Answering
+ *****************************************************************************/
+
+static uint16_t length_of( uint64_t x )
+// Call with db_lock held (for reading)
+{
+    if (x < 1 || x > COLLATZ_MAX_START)
+        return COLLATZ_INVALID;
+    int l = collatz_db_length( &db, (long)x );
+    return (l < 0 || l >= COLLATZ_INVALID ? COLLATZ_INVALID : l);
+}
+
+static void grow( uint64_t hi )
+/* Make the table cover [1, hi), if that's allowed. It at least doubles each
+   time, so that a series of growing ranges doesn't stop everyone over and
+   over again.
+*/
+{
+    pthread_rwlock_rdlock( &db_lock );
+    long covered = collatz_db_covered( &db );
+    pthread_rwlock_unlock( &db_lock );
+    if (hi <= (uint64_t)covered || covered >= max_covered)
+        return;
+
+    long target = (hi > (uint64_t)(2*covered) ? (long)hi : 2*covered);
+    if (target > max_covered)
+        target = max_covered;
+
+    pthread_rwlock_wrlock( &db_lock );   // waits for every reader to finish
+    if (collatz_db_extend( &db, target ) != 0)
+        fprintf( stderr, "collatzd: could not extend the table to %ld\n", target );
+    pthread_rwlock_unlock( &db_lock );
+}
+
+static void lengths( const uint64_t *x, uint16_t *out, long n )
+{
+    long i;
+#pragma omp parallel for schedule(static) if(n >= PARALLEL_MIN)
+    for (i = 0; i < n; i++)
+        out[i] = length_of( x[i] );
+}
+
+static void range( uint64_t lo, uint64_t hi, uint16_t *out )
+/* Call with lo <= hi (and hi - lo small enough to fit out). The comparison
+   with the table is unsigned: cast to a long, a huge hi would look negative,
+   and "covered" by the table. */
+{
+    long n = hi - lo, i;
+    if (lo >= 1 && hi <= (uint64_t)collatz_db_covered( &db ))
+    {
+        memcpy( out, &db.length[lo], n * sizeof(uint16_t) );
+        return;
+    }
+#pragma omp parallel for schedule(static) if(n >= PARALLEL_MIN)
+    for (i = 0; i < n; i++)
+        out[i] = length_of( lo + i );
+}
+
+static struct collatz_best best( uint64_t lo, uint64_t hi )
+/* The same answer as collatz_search(): the longest chain, and the smallest
+   start if there's a tie. Starts with invalid lengths are skipped. */
+{
+    struct collatz_best b = { 0, COLLATZ_INVALID, 0 };
+    if (lo < 1)
+        lo = 1;
+    if (hi <= lo)
+        return b;
+
+    int from_table = (hi <= (uint64_t)collatz_db_covered( &db ));
+#pragma omp parallel if(hi - lo >= PARALLEL_MIN)
+    {
+        uint64_t my_start = 0, x;
+        int my_length = -1;
+#pragma omp for schedule(static) nowait
+        for (x = lo; x < hi; x++)
+        {
+            int l = (from_table ? db.length[x] : length_of( x ));
+            if (l != COLLATZ_INVALID && l > my_length)
+            {
+                my_length = l;
+                my_start = x;
+            }
+        }
+#pragma omp critical
+        if (my_length >= 0 && (b.length == COLLATZ_INVALID || my_length > (int)b.length ||
+                               (my_length == (int)b.length && my_start < b.start)))
+        {
+            b.length = my_length;
+            b.start = my_start;
+        }
+    }
+    return b;
+}
+
+
+/*****************************************************************************
+ * Talking
+ *****************************************************************************/
+
+static int send_all( int fd, const void *buf, size_t len )
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send( fd, p, len, MSG_NOSIGNAL );
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int recv_all( int fd, void *buf, size_t len )
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv( fd, p, len, 0 );
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int reply( int fd, uint32_t status, const void *results, uint32_t count, size_t size )
+{
+    struct collatz_reply rep = { COLLATZ_MAGIC, status, count, 0 };
+    if (send_all( fd, &rep, sizeof(rep) ) != 0)
+        return -1;
+    return send_all( fd, results, (size_t)count * size );
+}
+
+static int hung_up( int fd )
+/* Has the client closed its end? (Then there's no point carrying on with
+ * its request.) Peeking doesn't take anything it has sent since. */
+{
+    char c;
+    ssize_t n = recv( fd, &c, 1, MSG_PEEK | MSG_DONTWAIT );
+    return (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR));
+}
+
+static uint64_t uncovered( uint64_t lo, uint64_t hi )
+/* How many starts in [lo, hi) lie beyond what the table may ever cover, and
+ * so would have to be worked out one by one */
+{
+    if (hi > COLLATZ_MAX_START)
+        hi = COLLATZ_MAX_START;
+    if (lo < (uint64_t)max_covered)
+        lo = max_covered;
+    return (hi > lo ? hi - lo : 0);
+}
+
+static int answer( int fd, const struct collatz_request *req )
+/* Read the items of one request, and send back the reply.
+ * Returns: 0 to carry on, -1 to hang up
+ */
+{
+    size_t item_size = (req->op == COLLATZ_OP_LENGTHS ? sizeof(uint64_t) :
+                        req->op == COLLATZ_OP_RANGE   ? 2 * sizeof(uint64_t) :
+                        req->op == COLLATZ_OP_BEST    ? 2 * sizeof(uint64_t) : 0);
+    if (req->magic != COLLATZ_MAGIC || req->count > COLLATZ_MAX_COUNT ||
+        (item_size == 0 && req->op != COLLATZ_OP_STATS) ||
+        (req->op == COLLATZ_OP_RANGE && req->count != 1))
+    {
+        // We can't tell where the next request starts, so give up on this one
+        reply( fd, COLLATZ_EBADREQ, NULL, 0, 0 );
+        return -1;
+    }
+
+    uint64_t *items = malloc( req->count * item_size + 1 );
+    if (items == NULL || recv_all( fd, items, req->count * item_size ) != 0)
+    {
+        free( items );
+        return -1;
+    }
+    metrics_add( m_requests, 1 );
+
+    int status = 0;
+    switch (req->op)
+    {
+        case COLLATZ_OP_LENGTHS:
+        {
+            uint16_t *out = malloc( req->count * sizeof(uint16_t) + 1 );
+            if (out == NULL)
+            {
+                status = reply( fd, COLLATZ_ENOMEM, NULL, 0, 0 );
+                break;
+            }
+            pthread_rwlock_rdlock( &db_lock );
+            lengths( items, out, req->count );
+            pthread_rwlock_unlock( &db_lock );
+            metrics_add( m_values, req->count );
+            status = reply( fd, COLLATZ_OK, out, req->count, sizeof(uint16_t) );
+            free( out );
+            break;
+        }
+
+        case COLLATZ_OP_RANGE:
+        {
+            // Check the range before doing any arithmetic with it. One that
+            // starts beyond COLLATZ_MAX_START has nothing in it to look up.
+            uint64_t lo = items[0], hi = items[1];
+            if (hi < lo || hi - lo > COLLATZ_MAX_COUNT || lo > COLLATZ_MAX_START)
+            {
+                status = reply( fd, COLLATZ_EBADREQ, NULL, 0, 0 );
+                break;
+            }
+            uint16_t *out = malloc( (hi - lo) * sizeof(uint16_t) + 1 );
+            if (out == NULL)
+            {
+                status = reply( fd, COLLATZ_ENOMEM, NULL, 0, 0 );
+                break;
+            }
+            grow( hi < COLLATZ_MAX_START ? hi : COLLATZ_MAX_START );
+            pthread_rwlock_rdlock( &db_lock );
+            range( lo, hi, out );
+            pthread_rwlock_unlock( &db_lock );
+            metrics_add( m_values, hi - lo );
+            status = reply( fd, COLLATZ_OK, out, hi - lo, sizeof(uint16_t) );
+            free( out );
+            break;
+        }
+
+        case COLLATZ_OP_BEST:
+        {
+            // Scanning the table is quick; working lengths out isn't, so
+            // there's a limit on how many starts can lie beyond it
+            uint64_t work = 0;
+            uint32_t i;
+            for (i = 0; i < req->count; i++)
+                work += uncovered( items[2*i], items[2*i + 1] );
+            if (work > COLLATZ_MAX_COUNT)
+            {
+                status = reply( fd, COLLATZ_EBADREQ, NULL, 0, 0 );
+                break;
+            }
+
+            struct collatz_best *out = malloc( req->count * sizeof(struct collatz_best) + 1 );
+            if (out == NULL)
+            {
+                status = reply( fd, COLLATZ_ENOMEM, NULL, 0, 0 );
+                break;
+            }
+            int gone = 0;
+            for (i = 0; i < req->count && !gone; i++)
+            {
+                uint64_t lo = items[2*i], hi = items[2*i + 1], from;
+                if (hi > COLLATZ_MAX_START)
+                    hi = COLLATZ_MAX_START;
+                grow( hi );
+
+                /* A bit at a time, in case the client hangs up. The chunks go
+                   up in order, so a later one only wins with a longer chain. */
+                out[i] = best( 0, 0 );
+                for (from = lo; from < hi && !gone; from += BEST_CHUNK)
+                {
+                    uint64_t to = (hi - from > BEST_CHUNK ? from + BEST_CHUNK : hi);
+                    pthread_rwlock_rdlock( &db_lock );
+                    struct collatz_best b = best( from, to );
+                    pthread_rwlock_unlock( &db_lock );
+                    if (b.length != COLLATZ_INVALID &&
+                        (out[i].length == COLLATZ_INVALID || b.length > out[i].length))
+                        out[i] = b;
+                    metrics_add( m_values, to - from );
+                    gone = hung_up( fd );
+                }
+            }
+            status = (gone ? -1 : reply( fd, COLLATZ_OK, out, req->count, sizeof(struct collatz_best) ));
+            free( out );
+            break;
+        }
+
+        case COLLATZ_OP_STATS:
+        {
+            struct collatz_stats s;
+            pthread_rwlock_rdlock( &db_lock );
+            s.covered = collatz_db_covered( &db );
+            pthread_rwlock_unlock( &db_lock );
+            s.requests = metrics_total( m_requests );
+            s.values = metrics_total( m_values );
+            s.clients = metrics_total( m_clients );
+            status = reply( fd, COLLATZ_OK, &s, 1, sizeof(s) );
+            break;
+        }
+    }
+
+    free( items );
+    return status;
+}
+
+static void *client( void *arg )
+// One of these threads for each connection, for as long as it stays open
+{
+    int fd = (int)(intptr_t)arg;
+    struct collatz_request req;
+    while (recv_all( fd, &req, sizeof(req) ) == 0)
+        if (answer( fd, &req ) != 0)
+            break;
+    close( fd );
+    return NULL;
+}
+
+
+/*****************************************************************************
+ * Starting up
+ *****************************************************************************/
+
+static void stop( int sig )
+{
+    (void)sig;
+    stopping = 1;    // (and accept() gets interrupted)
+}
+
+void usage()
+{
+    printf( "usage: collatzd [-s socket] [-d file] [-n lo_cover] [-N max_cover] [-m where]\n\n" );
+    printf( "Answers questions about Collatz chain lengths over a Unix socket.\n" );
+    printf( "  -s socket  where to listen (default %s)\n", COLLATZD_SOCKET );
+    printf( "  -d file    the table of lengths (default collatzd.db; see collatz_db.c)\n" );
+    printf( "  -n lo      fill the table in up to lo before starting (default 2^24)\n" );
+    printf( "  -N max     never grow the table beyond max (default 2^30)\n" );
+    printf( "  -m where   serve live metrics too (see metrics.c)\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *path = COLLATZD_SOCKET, *dbfile = "collatzd.db", *serve = NULL;
+    long initial = 1L << 24;
+    max_covered = 1L << 30;
+
+    int opt;
+    while ((opt = getopt( argc, argv, "s:d:n:N:m:h" )) != -1)
+    {
+        switch (opt)
+        {
+            case 's':  path = optarg;                break;
+            case 'd':  dbfile = optarg;              break;
+            case 'n':  initial = atol( optarg );     break;
+            case 'N':  max_covered = atol( optarg ); break;
+            case 'm':  serve = optarg;               break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (initial > max_covered)
+        max_covered = initial;
+
+    m_requests = metrics_counter( "collatzd_requests_total", "Requests answered" );
+    m_values   = metrics_counter( "collatzd_values_total", "Chain lengths looked up" );
+    m_clients  = metrics_counter( "collatzd_clients_total", "Connections accepted" );
+    if (serve != NULL && metrics_serve( serve ) != 0)
+    {
+        fprintf( stderr, "error: could not serve metrics at %s\n", serve );
+        exit(EXIT_FAILURE);
+    }
+
+    // Warm the table up before anyone asks
+    if (collatz_db_open( &db, dbfile, 1 ) != 0)
+    {
+        fprintf( stderr, "error: could not open %s\n", dbfile );
+        exit(EXIT_FAILURE);
+    }
+    double start = omp_get_wtime();
+    if (collatz_db_extend( &db, initial ) != 0)
+    {
+        fprintf( stderr, "error: could not fill %s up to %ld\n", dbfile, initial );
+        exit(EXIT_FAILURE);
+    }
+    fprintf( stderr, "collatzd: lengths below %ld ready in %.3f s\n",
+             collatz_db_covered( &db ), omp_get_wtime() - start );
+
+    // Listen on the socket
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    if (strlen( path ) >= sizeof(addr.sun_path))
+    {
+        fprintf( stderr, "error: socket path too long\n" );
+        exit(EXIT_FAILURE);
+    }
+    strcpy( addr.sun_path, path );
+    int listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+    unlink( path );    // left over from an earlier run
+    if (listener < 0 || bind( listener, (struct sockaddr *)&addr, sizeof(addr) ) != 0 ||
+        listen( listener, 64 ) != 0)
+    {
+        fprintf( stderr, "error: could not listen on %s\n", path );
+        exit(EXIT_FAILURE);
+    }
+    fprintf( stderr, "collatzd: listening on %s\n", path );
+
+    /* Stop cleanly on Ctrl-C or kill. Without SA_RESTART, the signal makes
+       accept() return (with errno EINTR), so the loop notices straight away.
+    */
+    struct sigaction sa;
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_handler = stop;
+    sigaction( SIGINT, &sa, NULL );
+    sigaction( SIGTERM, &sa, NULL );
+
+    pthread_attr_t attr;
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    while (!stopping)
+    {
+        int fd = accept( listener, NULL, NULL );
+        if (fd < 0)
+        {
+            if (errno != EINTR)
+                perror( "collatzd: accept" );
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create( &thread, &attr, client, (void *)(intptr_t)fd ) != 0)
+            close( fd );
+        else
+            metrics_add( m_clients, 1 );
+    }
+
+    // Any clients still connected are cut off when we exit
+    fprintf( stderr, "collatzd: stopping\n" );
+    close( listener );
+    unlink( path );
+    metrics_stop();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,490 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * matops.c
+ *
+ * The obvious loops for matrix operations are correct, but they can be ten
+ * or a hundred times slower than they need to be, almost entirely because
+ * of how they use the caches:
+ *
+ *   Transpose: reading A row by row means writing T column by column, and
+ *   every write lands on a different cache line (and, for big matrices, a
+ *   different page). By the time we come back to write the next element of
+ *   that line, it has been thrown out of the cache. The fix is "blocking":
+ *   transpose one small square tile at a time, small enough that both the
+ *   tile of A and the tile of T stay in the L1 cache.
+ *
+ *   Multiply: C = A*B does 2*n^3 arithmetic on only 3*n^2 numbers, so it
+ *   could be limited by the arithmetic rather than by memory. The naive
+ *   loop wastes that: it re-reads all of B for every row of A. Here we
+ *
+ *     1) copy ("pack") a KC x NC block of B into a buffer, in strips of 8
+ *        columns, so that it is contiguous and stays in the L2 cache;
+ *     2) run a "micro-kernel" that computes a 4 x 8 piece of C held in
+ *        32 local variables (which the compiler keeps in registers), one
+ *        rank-1 update per step along k. Each number loaded from memory
+ *        is used 4 or 8 times.
+ *
+ *   Maps and reductions: these do one or two operations per number loaded,
+ *   so nothing makes them faster than the memory bandwidth. We just make
+ *   sure they stream through memory in order, are vectorised, and use all
+ *   the threads. A column reduction, in particular, is done by each thread
+ *   summing whole rows into its own row-sized buffer, not by walking down
+ *   each column.
+ *
+ * The tile and block sizes come from the cache sizes found by sysprobe.c.
+ * Functions that take more than one matrix return -1 if the dimensions
+ * don't fit together (and do nothing), and 0 otherwise.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "matops.h"
+#include "sysprobe.h"
+
+#define  MR  4    // rows of C per micro-kernel call
+#define  NR  8    // columns of C per micro-kernel call
+
+#define  ELEM( M, r, c )  ((M)->data[(size_t)(r)*(M)->cols + (c)])
+
+
+struct matrix *matrix_create( int rows, int cols )
+/* Allocate a rows x cols matrix of zeros.
+ *
+ * The rows are zeroed by the threads of a schedule(static) loop (see
+ * placement.c for why that matters on machines with several sockets).
+ *
+ * Returns: the new matrix, or NULL on failure
+ */
+{
+    struct matrix *M = malloc( sizeof(struct matrix) );
+    size_t bytes = (size_t)rows * cols * sizeof(double);
+    bytes = (bytes + 63) / 64 * 64;
+    double *data = aligned_alloc( 64, bytes > 0 ? bytes : 64 );
+    if (M == NULL || data == NULL)
+    {
+        free( M );
+        free( data );
+        return NULL;
+    }
+
+    int r;
+#pragma omp parallel for schedule(static)
+    for (r = 0; r < rows; r++)
+        memset( data + (size_t)r * cols, 0, cols * sizeof(double) );
+
+    M->rows = rows;
+    M->cols = cols;
+    M->data = data;
+    M->owned = 1;
+    return M;
+}
+
+
+struct matrix *matrix_wrap( int rows, int cols, double *data )
+/* Make a struct matrix for data that already exists, e.g. M[0] of a double **
+ * matrix from placement_create_matrix(). matrix_destroy() won't free data.
+ */
+{
+    struct matrix *M = malloc( sizeof(struct matrix) );
+    if (M == NULL)
+        return NULL;
+    M->rows = rows;
+    M->cols = cols;
+    M->data = data;
+    M->owned = 0;
+    return M;
+}
+
+
+void matrix_destroy( struct matrix *M )
+{
+    if (M == NULL)
+        return;
+    if (M->owned)
+        free( M->data );
+    free( M );
+}
+
+/*****************************************************************************
+ * Transpose
+ *****************************************************************************/
+
+int matrix_transpose( const struct matrix *A, struct matrix *T )
+/* T = the transpose of A (A and T must not be the same matrix)
+ *
+ * Inputs:
+ *   const struct matrix *A = an m x n matrix
+ *   struct matrix *T       = an n x m matrix, overwritten
+ * Returns:
+ *   int = 0 on success, -1 if the dimensions don't match
+ */
+{
+    if (T->rows != A->cols || T->cols != A->rows)
+        return -1;
+
+    // Two tiles (one of A, one of T) in half of L1
+    int b = sysprobe_tile( sysprobe_get(), 1, sizeof(double), 2 );
+    int m = A->rows, n = A->cols;
+    int ii, jj;
+
+#pragma omp parallel for schedule(static) collapse(2)
+    for (ii = 0; ii < m; ii += b)
+        for (jj = 0; jj < n; jj += b)
+        {
+            int iend = (ii + b < m ? ii + b : m);
+            int jend = (jj + b < n ? jj + b : n);
+            int i, j;
+            for (j = jj; j < jend; j++)
+                for (i = ii; i < iend; i++)
+                    ELEM( T, j, i ) = ELEM( A, i, j );
+        }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * Multiply
+ *****************************************************************************/
+
+static void pack_b( const struct matrix *B, int k0, int kb, int j0, int nb, double *Bp )
+/* Copy B[k0 .. k0+kb-1][j0 .. j0+nb-1] into Bp, as strips of NR columns:
+ * strip s holds row k's NR numbers at Bp[(s*kb + k)*NR]. The last strip is
+ * padded with zeros.
+ */
+{
+    int nstrips = (nb + NR - 1) / NR;
+    int s;
+#pragma omp for schedule(static)
+    for (s = 0; s < nstrips; s++)
+    {
+        int k, j;
+        int jn = (nb - s*NR < NR ? nb - s*NR : NR);
+        for (k = 0; k < kb; k++)
+        {
+            const double *src = &ELEM( B, k0 + k, j0 + s*NR );
+            double *dst = Bp + ((size_t)s*kb + k) * NR;
+            for (j = 0; j < jn; j++)
+                dst[j] = src[j];
+            for ( ; j < NR; j++)
+                dst[j] = 0.0;
+        }
+    }
+}
+
+
+static void micro_kernel( int kb, const double *a[MR], const double *bp,
+                          double *c, int ldc, int mr, int nr )
+/* c[0..mr-1][0..nr-1] += a[0..mr-1][0..kb-1] * (a packed strip of B)
+ *
+ * The 4 x 8 accumulator is a local array with fixed sizes, and the inner
+ * loops have fixed trip counts, so the compiler unrolls them and keeps the
+ * whole thing in vector registers.
+ */
+{
+    double acc[MR][NR];
+    int i, j, k;
+
+    for (i = 0; i < MR; i++)
+        for (j = 0; j < NR; j++)
+            acc[i][j] = 0.0;
+
+    for (k = 0; k < kb; k++)
+    {
+        const double *b = bp + (size_t)k * NR;
+        for (i = 0; i < MR; i++)
+        {
+            double aik = a[i][k];
+            for (j = 0; j < NR; j++)
+                acc[i][j] += aik * b[j];
+        }
+    }
+
+    for (i = 0; i < mr; i++)
+        for (j = 0; j < nr; j++)
+            c[(size_t)i*ldc + j] += acc[i][j];
+}
+
+
+int matrix_multiply( const struct matrix *A, const struct matrix *B, struct matrix *C )
+/* C = A * B (C must not be the same matrix as A or B)
+ *
+ * Inputs:
+ *   const struct matrix *A = an m x k matrix
+ *   const struct matrix *B = a k x n matrix
+ *   struct matrix *C       = an m x n matrix, overwritten
+ * Returns:
+ *   int = 0 on success, -1 if the dimensions don't match or out of memory
+ */
+{
+    if (A->cols != B->rows || C->rows != A->rows || C->cols != B->cols)
+        return -1;
+
+    int m = A->rows, n = B->cols, kdim = A->cols;
+    const struct sysprobe *sp = sysprobe_get();
+
+    /* KC: a strip of NR columns of B (KC x NR doubles) sits in half of L1,
+           alongside the MR rows of A it's multiplied with.
+       NC: the whole packed block (KC x NC) sits in half of L2.
+    */
+    long l1 = sysprobe_cache_size( sp, 1 );
+    long l2 = sysprobe_cache_size( sp, 2 );
+    int kc = (l1 > 0 ? l1 : 32*1024) / 2 / (int)sizeof(double) / (NR + MR);
+    kc = (kc < 16 ? 16 : kc);
+    int nc = (l2 > 0 ? l2 : 256*1024) / 2 / (int)sizeof(double) / kc;
+    nc = (nc < NR ? NR : nc - nc % NR);
+
+    double *Bp = aligned_alloc( 64, (size_t)kc * (nc + NR) * sizeof(double) );
+    if (Bp == NULL)
+        return -1;
+
+    memset( C->data, 0, (size_t)m * n * sizeof(double) );
+
+    int j0, k0;
+    for (j0 = 0; j0 < n; j0 += nc)
+        for (k0 = 0; k0 < kdim; k0 += kc)
+        {
+            int nb = (n - j0 < nc ? n - j0 : nc);
+            int kb = (kdim - k0 < kc ? kdim - k0 : kc);
+            int nstrips = (nb + NR - 1) / NR;
+
+#pragma omp parallel
+            {
+                pack_b( B, k0, kb, j0, nb, Bp );   // (ends with a barrier)
+
+                int i0;
+#pragma omp for schedule(static)
+                for (i0 = 0; i0 < m; i0 += MR)
+                {
+                    int mr = (m - i0 < MR ? m - i0 : MR);
+                    const double *a[MR];
+                    int i, s;
+
+                    // Past the bottom edge, point at the last real row again
+                    for (i = 0; i < MR; i++)
+                        a[i] = &ELEM( A, i0 + (i < mr ? i : mr - 1), k0 );
+
+                    for (s = 0; s < nstrips; s++)
+                    {
+                        int nr = (nb - s*NR < NR ? nb - s*NR : NR);
+                        micro_kernel( kb, a, Bp + (size_t)s*kb*NR,
+                                      &ELEM( C, i0, j0 + s*NR ), n, mr, nr );
+                    }
+                }
+            }
+        }
+
+    free( Bp );
+    return 0;
+}
+
+/*****************************************************************************
+ * Elementwise maps
+ *****************************************************************************/
+
+static int same_shape( const struct matrix *A, const struct matrix *B )
+{
+    return (A->rows == B->rows && A->cols == B->cols);
+}
+
+
+int matrix_map( struct matrix *Y, const struct matrix *X, double (*f)( double ) )
+/* Y = f(X), element by element (Y may be X). E.g. matrix_map( M, M, fabs ) */
+{
+    if (!same_shape( X, Y ))
+        return -1;
+
+    long size = (long)X->rows * X->cols;
+    long i;
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < size; i++)
+        Y->data[i] = f( X->data[i] );
+    return 0;
+}
+
+
+int matrix_axpby( struct matrix *Z, double a, const struct matrix *X, double b, const struct matrix *Y )
+/* Z = a*X + b*Y, element by element (Z may be X or Y) */
+{
+    if (!same_shape( X, Y ) || !same_shape( X, Z ))
+        return -1;
+
+    long size = (long)X->rows * X->cols;
+    const double *x = X->data, *y = Y->data;
+    double *z = Z->data;
+    long i;
+#pragma omp parallel for simd schedule(static)
+    for (i = 0; i < size; i++)
+        z[i] = a * x[i] + b * y[i];
+    return 0;
+}
+
+
+int matrix_hadamard( struct matrix *Z, const struct matrix *X, const struct matrix *Y )
+/* Z = X * Y, element by element (Z may be X or Y) */
+{
+    if (!same_shape( X, Y ) || !same_shape( X, Z ))
+        return -1;
+
+    long size = (long)X->rows * X->cols;
+    const double *x = X->data, *y = Y->data;
+    double *z = Z->data;
+    long i;
+#pragma omp parallel for simd schedule(static)
+    for (i = 0; i < size; i++)
+        z[i] = x[i] * y[i];
+    return 0;
+}
+
+/*****************************************************************************
+ * Reductions
+ *****************************************************************************/
+
+static double identity( matrix_reduction op )
+{
+    switch (op)
+    {
+        case MAT_MIN:  return INFINITY;
+        case MAT_MAX:  return -INFINITY;
+        default:       return 0.0;
+    }
+}
+
+
+static void reduce_into( matrix_reduction op, double *acc, const double *x, int n )
+/* acc[j] = op( acc[j], x[j] ) for j < n. One simple loop per operation, so
+ * that each one vectorises.
+ */
+{
+    int j;
+    switch (op)
+    {
+        case MAT_SUM:
+#pragma omp simd
+            for (j = 0; j < n; j++) acc[j] += x[j];
+            break;
+        case MAT_SUMSQ:
+#pragma omp simd
+            for (j = 0; j < n; j++) acc[j] += x[j] * x[j];
+            break;
+        case MAT_MIN:
+#pragma omp simd
+            for (j = 0; j < n; j++) acc[j] = (x[j] < acc[j] ? x[j] : acc[j]);
+            break;
+        case MAT_MAX:
+#pragma omp simd
+            for (j = 0; j < n; j++) acc[j] = (x[j] > acc[j] ? x[j] : acc[j]);
+            break;
+    }
+}
+
+
+static double reduce_row( matrix_reduction op, const double *x, int n )
+{
+    double r = identity( op );
+    int j;
+    switch (op)
+    {
+        case MAT_SUM:
+#pragma omp simd reduction(+:r)
+            for (j = 0; j < n; j++) r += x[j];
+            break;
+        case MAT_SUMSQ:
+#pragma omp simd reduction(+:r)
+            for (j = 0; j < n; j++) r += x[j] * x[j];
+            break;
+        case MAT_MIN:
+#pragma omp simd reduction(min:r)
+            for (j = 0; j < n; j++) r = (x[j] < r ? x[j] : r);
+            break;
+        case MAT_MAX:
+#pragma omp simd reduction(max:r)
+            for (j = 0; j < n; j++) r = (x[j] > r ? x[j] : r);
+            break;
+    }
+    return r;
+}
+
+
+int matrix_reduce_rows( const struct matrix *A, matrix_reduction op, double *out )
+/* out[r] = the reduction of row r, for each of A's rows */
+{
+    int r;
+#pragma omp parallel for schedule(static)
+    for (r = 0; r < A->rows; r++)
+        out[r] = reduce_row( op, &ELEM( A, r, 0 ), A->cols );
+    return 0;
+}
+
+
+int matrix_reduce_cols( const struct matrix *A, matrix_reduction op, double *out )
+/* out[c] = the reduction of column c, for each of A's columns
+ *
+ * Returns: 0 on success, -1 if out of memory
+ */
+{
+    int n = A->cols;
+    int j, failed = 0;
+
+    for (j = 0; j < n; j++)
+        out[j] = identity( op );
+
+#pragma omp parallel reduction(|:failed)
+    {
+        // Each thread reduces its share of the rows into its own buffer...
+        double *acc = malloc( n * sizeof(double) );
+        if (acc == NULL)
+            failed = 1;
+        else
+        {
+            int r, k;
+            for (k = 0; k < n; k++)
+                acc[k] = identity( op );
+#pragma omp for schedule(static) nowait
+            for (r = 0; r < A->rows; r++)
+                reduce_into( op, acc, &ELEM( A, r, 0 ), n );
+
+            // ... and then the buffers are combined, one thread at a time
+#pragma omp critical
+            reduce_into( op == MAT_SUMSQ ? MAT_SUM : op, out, acc, n );
+            free( acc );
+        }
+    }
+
+    return (failed ? -1 : 0);
+}
+
+
+double matrix_reduce( const struct matrix *A, matrix_reduction op )
+/* The reduction of every element of A */
+{
+    long size = (long)A->rows * A->cols;
+    const double *x = A->data;
+    double r = identity( op );
+    long i;
+
+    switch (op)
+    {
+        case MAT_SUM:
+#pragma omp parallel for simd schedule(static) reduction(+:r)
+            for (i = 0; i < size; i++) r += x[i];
+            break;
+        case MAT_SUMSQ:
+#pragma omp parallel for simd schedule(static) reduction(+:r)
+            for (i = 0; i < size; i++) r += x[i] * x[i];
+            break;
+        case MAT_MIN:
+#pragma omp parallel for simd schedule(static) reduction(min:r)
+            for (i = 0; i < size; i++) r = (x[i] < r ? x[i] : r);
+            break;
+        case MAT_MAX:
+#pragma omp parallel for simd schedule(static) reduction(max:r)
+            for (i = 0; i < size; i++) r = (x[i] > r ? x[i] : r);
+            break;
+    }
+    return r;
+}
@@ -0,0 +1,48 @@
+/*****************************************************************************
+ * matops.h
+ *
+ * Operations on matrices stored in one flat, row-major block of doubles.
+ * See matops.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef MATOPS_H
+#define MATOPS_H
+
+/* Element (r,c) is data[r*cols + c], as in example2 of lesson1/heap_memory.c.
+   A double ** matrix from placement_create_matrix() (or lesson1's fileio.c)
+   is already laid out like this, starting at M[0]: see matrix_wrap().
+*/
+struct matrix
+{
+    int rows;
+    int cols;
+    double *data;
+    int owned;      // 1 if matrix_destroy() should free data
+};
+
+// What a reduction computes
+typedef enum matrix_reduction_t
+{
+    MAT_SUM   = 0,
+    MAT_SUMSQ = 1,
+    MAT_MIN   = 2,
+    MAT_MAX   = 3
+} matrix_reduction;
+
+struct matrix *matrix_create( int, int );
+struct matrix *matrix_wrap( int, int, double * );
+void matrix_destroy( struct matrix * );
+
+int matrix_transpose( const struct matrix *, struct matrix * );
+int matrix_multiply( const struct matrix *, const struct matrix *, struct matrix * );
+
+int matrix_map( struct matrix *, const struct matrix *, double (*)( double ) );
+int matrix_axpby( struct matrix *, double, const struct matrix *, double, const struct matrix * );
+int matrix_hadamard( struct matrix *, const struct matrix *, const struct matrix * );
+
+int    matrix_reduce_rows( const struct matrix *, matrix_reduction, double * );
+int    matrix_reduce_cols( const struct matrix *, matrix_reduction, double * );
+double matrix_reduce( const struct matrix *, matrix_reduction );
+
+#endif
@@ -0,0 +1,221 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A benchmark of matops.c, in the style of a "roofline" model.
+ *
+ * Every operation does some number of floating point operations (FLOPs) and
+ * has to move some minimum number of bytes to and from memory. Dividing one
+ * by the other gives its "arithmetic intensity" (FLOPs per byte). A machine
+ * can only do so many FLOPs per second, and only move so many bytes per
+ * second, so an operation runs at best at
+ *
+ *   min( peak FLOP/s, intensity x peak bytes/s )
+ *
+ * Low-intensity operations (maps, reductions, transposes) are limited by
+ * bandwidth; matrix multiply, with intensity growing with n, by arithmetic.
+ * This program measures the memory bandwidth (with a simple copy), times
+ * each operation (and the naive loops it replaces), and reports GFLOP/s,
+ * GB/s and how far each is from its bandwidth limit.
+ *
+ *   $ make -f Makefile-matops
+ *   $ ./matops_bench            (1024 x 1024 matrices)
+ *   $ ./matops_bench 2048       (the naive multiply takes minutes)
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "matops.h"
+
+#define  REPEATS  3
+
+static double peak_bw;   // bytes per second, measured by copying
+
+
+static void report( const char *name, double seconds, double flops, double bytes )
+{
+    double ai = flops / bytes;
+    double limit = ai * peak_bw;   // FLOP/s the bandwidth allows
+    printf( "%-22s %9.4f %9.2f %9.2f %9.3f", name, seconds,
+            flops / seconds * 1e-9, bytes / seconds * 1e-9, ai );
+    if (ai > 10)
+        printf( "  compute\n" );   // no machine has that little bandwidth
+    else if (flops > 0)
+        printf( " %8.0f%%\n", 100.0 * (flops / seconds) / limit );
+    else
+        printf( " %8.0f%%\n", 100.0 * (bytes / seconds) / peak_bw );
+}
+
+
+static double best_of( void (*f)( void * ), void *arg, int repeats )
+/* The fastest of a few runs of f(arg), in seconds */
+{
+    double best = INFINITY;
+    int i;
+    for (i = 0; i < repeats; i++)
+    {
+        double start = omp_get_wtime();
+        f( arg );
+        double t = omp_get_wtime() - start;
+        best = (t < best ? t : best);
+    }
+    return best;
+}
+
+/* The operations to time, each wrapped up to take a single argument */
+
+struct args
+{
+    struct matrix *A, *B, *C, *T;
+    double *v;
+};
+
+static void copy( void *p )
+{
+    struct args *a = p;
+    long size = (long)a->A->rows * a->A->cols, i;
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < size; i++)
+        a->C->data[i] = a->A->data[i];
+}
+
+static void naive_transpose( void *p )
+{
+    struct args *a = p;
+    int i, j, m = a->A->rows, n = a->A->cols;
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < m; i++)
+        for (j = 0; j < n; j++)
+            a->T->data[(size_t)j*m + i] = a->A->data[(size_t)i*n + j];
+}
+
+static void naive_multiply( void *p )
+{
+    struct args *a = p;
+    int i, j, k, n = a->A->rows;
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+        {
+            double sum = 0.0;
+            for (k = 0; k < n; k++)
+                sum += a->A->data[(size_t)i*n + k] * a->B->data[(size_t)k*n + j];
+            a->C->data[(size_t)i*n + j] = sum;
+        }
+}
+
+static void naive_col_sums( void *p )
+{
+    struct args *a = p;
+    int i, j, n = a->A->cols;
+#pragma omp parallel for schedule(static)
+    for (j = 0; j < n; j++)
+    {
+        double sum = 0.0;
+        for (i = 0; i < a->A->rows; i++)
+            sum += a->A->data[(size_t)i*n + j];
+        a->v[j] = sum;
+    }
+}
+
+static void transpose( void *p )  { struct args *a = p; matrix_transpose( a->A, a->T ); }
+static void multiply( void *p )   { struct args *a = p; matrix_multiply( a->A, a->B, a->C ); }
+static void axpby( void *p )      { struct args *a = p; matrix_axpby( a->C, 2.0, a->A, -1.0, a->B ); }
+static void map_exp( void *p )    { struct args *a = p; matrix_map( a->C, a->A, exp ); }
+static void row_sums( void *p )   { struct args *a = p; matrix_reduce_rows( a->A, MAT_SUM, a->v ); }
+static void col_sums( void *p )   { struct args *a = p; matrix_reduce_cols( a->A, MAT_SUM, a->v ); }
+static void col_max( void *p )    { struct args *a = p; matrix_reduce_cols( a->A, MAT_MAX, a->v ); }
+
+
+int main( int argc, char *argv[] )
+{
+    // The naive multiply is O(n^3) and cache-hostile: at 1024 it takes
+    // seconds, but 8 times as long at 2048
+    int n = (argc > 1 ? atoi( argv[1] ) : 1024);
+    if (n <= 0)
+    {
+        fprintf( stderr, "usage: matops_bench [n]\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    struct args a;
+    a.A = matrix_create( n, n );
+    a.B = matrix_create( n, n );
+    a.C = matrix_create( n, n );
+    a.T = matrix_create( n, n );
+    a.v = malloc( n * sizeof(double) );
+    if (!a.A || !a.B || !a.C || !a.T || !a.v)
+    {
+        fprintf( stderr, "error: could not allocate matrices\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    long i;
+    for (i = 0; i < (long)n*n; i++)
+    {
+        a.A->data[i] = sin( i * 0.001 );
+        a.B->data[i] = cos( i * 0.002 );
+    }
+
+    double N = n, mat = N * N * sizeof(double);   // bytes in one matrix
+
+    printf( "%d x %d matrices, %d threads\n\n", n, n, omp_get_max_threads() );
+    printf( "%-22s %9s %9s %9s %9s %9s\n", "operation", "seconds", "GFLOP/s",
+            "GB/s", "FLOP/byte", "of limit" );
+
+    peak_bw = 2 * mat / best_of( copy, &a, REPEATS );
+    report( "copy (bandwidth)", 2 * mat / peak_bw, 0, 2 * mat );
+
+    report( "transpose (naive)",   best_of( naive_transpose, &a, REPEATS ), 0, 2 * mat );
+    report( "transpose (blocked)", best_of( transpose, &a, REPEATS ),       0, 2 * mat );
+
+    /* Check the fast versions against the naive ones as we go. A transpose
+       only moves numbers, so the two must agree to the last bit.
+    */
+    struct matrix *check = matrix_create( n, n );
+    if (check == NULL)
+    {
+        fprintf( stderr, "error: could not allocate matrices\n" );
+        exit(EXIT_FAILURE);
+    }
+    matrix_transpose( a.A, check );
+    naive_transpose( &a );
+    if (memcmp( check->data, a.T->data, (size_t)n * n * sizeof(double) ) != 0)
+        fprintf( stderr, "warning: transposes don't agree\n" );
+
+    double mm_flops = 2 * N * N * N;
+    report( "multiply (naive)",   best_of( naive_multiply, &a, 1 ), mm_flops, 3 * mat );
+    matrix_transpose( a.C, check );   // (just somewhere to keep it)
+    report( "multiply (blocked)", best_of( multiply, &a, REPEATS ),       mm_flops, 3 * mat );
+    matrix_transpose( check, a.T );
+    matrix_axpby( a.T, 1.0, a.T, -1.0, a.C );
+    double err = sqrt( matrix_reduce( a.T, MAT_SUMSQ ) / matrix_reduce( a.C, MAT_SUMSQ ) );
+    if (err > 1e-12)
+        fprintf( stderr, "warning: multiplies differ by %g\n", err );
+
+    report( "axpby",               best_of( axpby, &a, REPEATS ),          3 * N * N, 3 * mat );
+    report( "map (exp)",           best_of( map_exp, &a, REPEATS ),        0,         2 * mat );
+    report( "row sums",            best_of( row_sums, &a, REPEATS ),       N * N,     mat );
+    report( "column sums (naive)", best_of( naive_col_sums, &a, REPEATS ), N * N,     mat );
+    report( "column sums",         best_of( col_sums, &a, REPEATS ),       N * N,     mat );
+    report( "column max",          best_of( col_max, &a, REPEATS ),        N * N,     mat );
+
+    printf( "\n\"of limit\" is the fraction of what the measured bandwidth allows\n"
+            "(for the operations with no FLOPs, of the bandwidth itself). It can\n"
+            "pass 100%% when the matrices fit in the caches. \"compute\" means\n"
+            "the operation is limited by arithmetic, not bandwidth.\n"
+            "(The naive multiply is only run once: it is slow.)\n" );
+
+    matrix_destroy( check );
+    matrix_destroy( a.A );
+    matrix_destroy( a.B );
+    matrix_destroy( a.C );
+    matrix_destroy( a.T );
+    free( a.v );
+    return EXIT_SUCCESS;
+}
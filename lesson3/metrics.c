@@ -0,0 +1,577 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * metrics.c
+ *
+ * q14-openmp.c prints one number at the end. That's fine when the end is a
+ * second away, but a search that runs for hours gives no sign of life in
+ * the meantime: is it nearly done? Has it slowed down? Has it stopped
+ * altogether? Did eight threads actually go eight times as fast?
+ *
+ * trace.c answers "what happened, and when" after the run is over. This
+ * answers "how is it going" during the run, with counters that the program
+ * bumps as it works (items done, steps taken, cache hits, bytes written)
+ * and gauges that it sets (how far it has got). Two ways to read them:
+ *
+ *   1) metrics_serve() starts a background thread that answers requests on
+ *      a Unix socket or a loopback TCP port with the current values, in the
+ *      text format that Prometheus (https://prometheus.io) scrapes:
+ *
+ *        $ curl http://127.0.0.1:9100/metrics
+ *        $ curl --unix-socket /tmp/run.sock http://localhost/metrics
+ *
+ *      Prometheus then works out rates, draws graphs and can raise alarms
+ *      when a run stalls.
+ *
+ *   2) metrics_report() starts a background thread that prints a one-line
+ *      summary (with rates) to stderr, or any FILE, every so often.
+ *
+ * Adding to a counter has to be cheap enough to do in the innermost loops,
+ * so each thread has its own copy of the counters, on its own cache lines
+ * (see metrics_add() in metrics.h). Per-thread values also show how evenly
+ * the work is spread: every counter is reported per thread, and Prometheus
+ * can add them up.
+ *
+ * Threads' counters are never freed, since the totals still need them after
+ * the threads have finished (OpenMP reuses its threads anyway).
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+
+enum { COUNTER, GAUGE, RATIO };
+
+struct metric
+{
+    char *name;
+    char *help;
+    int kind;
+    int num, other;      // for ratios: num / (num + other)
+    uint64_t gauge;      // for gauges: the bits of a double
+};
+
+/* One thread's copy of every counter. Starting each one on a fresh cache
+   line (_Alignas, and aligned_alloc) means no two threads ever write to the
+   same line.
+*/
+struct thread_counters
+{
+    _Alignas(64) uint64_t v[METRICS_MAX];
+    int number;
+    struct thread_counters *next;
+};
+
+/* Slot 0 is never reported: if the table is full, registering gives back 0,
+   so that metrics_add() still works (and needn't check) but goes nowhere.
+*/
+static struct metric metric[METRICS_MAX];
+static int nmetrics = 1;
+static struct thread_counters *threads = NULL;
+static int nthreads = 0;
+static uint64_t sink[METRICS_MAX];     // for threads we couldn't allocate for
+static double start_time = -1.0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+_Thread_local uint64_t *metrics_mine = NULL;
+
+// The background threads, and how to stop them
+static int stop_pipe[2] = { -1, -1 };
+static int server_fd = -1;
+static char *server_path = NULL;       // for Unix sockets, to remove at the end
+static pthread_t server_thread, report_thread;
+static int serving = 0, reporting = 0, stopping = 0;
+static pthread_cond_t stop_cond;
+static FILE *report_file;
+static double report_every;
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double uptime()
+{
+    return (start_time < 0 ? 0.0 : now() - start_time);
+}
+
+
+uint64_t *metrics_thread( void )
+/* Give the calling thread its own counters (called by metrics_add() the
+ * first time each thread uses it).
+ */
+{
+    struct thread_counters *t = aligned_alloc( 64, sizeof(struct thread_counters) );
+    if (t == NULL)
+        return (metrics_mine = sink);   // counts from this thread will be lost
+    memset( t, 0, sizeof(struct thread_counters) );
+
+    pthread_mutex_lock( &lock );
+    t->number = nthreads++;
+    t->next = threads;
+    threads = t;
+    pthread_mutex_unlock( &lock );
+
+    return (metrics_mine = t->v);
+}
+
+
+static int add_metric( const char *name, const char *help, int kind, int num, int other )
+{
+    int i;
+    pthread_mutex_lock( &lock );
+    if (start_time < 0)
+        start_time = now();
+
+    for (i = 1; i < nmetrics; i++)
+        if (strcmp( metric[i].name, name ) == 0)
+            break;
+
+    if (i == nmetrics && nmetrics < METRICS_MAX)
+    {
+        metric[i].name = strdup( name );
+        metric[i].help = strdup( help );
+        metric[i].kind = kind;
+        metric[i].num = num;
+        metric[i].other = other;
+        if (metric[i].name != NULL && metric[i].help != NULL)
+            nmetrics++;
+    }
+    pthread_mutex_unlock( &lock );
+
+    return (i < nmetrics ? i : 0);
+}
+
+int metrics_counter( const char *name, const char *help )
+/* Register a counter, which only ever goes up (Prometheus names for these
+ * usually end in "_total").
+ *
+ * Inputs:
+ *   const char *name = the name it is reported under, e.g. "items_total"
+ *   const char *help = a description, for humans
+ * Returns:
+ *   int = the id to pass to metrics_add()
+ */
+{
+    return add_metric( name, help, COUNTER, 0, 0 );
+}
+
+int metrics_gauge( const char *name, const char *help )
+/* Register a gauge: a value that is set, rather than added to. */
+{
+    return add_metric( name, help, GAUGE, 0, 0 );
+}
+
+int metrics_ratio( const char *name, const char *help, int num, int other )
+/* Register a value worked out from two counters, num / (num + other), such
+ * as a cache hit rate from the hits and the misses.
+ */
+{
+    return add_metric( name, help, RATIO, num, other );
+}
+
+void metrics_set( int id, double value )
+{
+    uint64_t bits;
+    memcpy( &bits, &value, sizeof(bits) );
+    __atomic_store_n( &metric[id].gauge, bits, __ATOMIC_RELAXED );
+}
+
+static double gauge_value( int id )
+{
+    uint64_t bits = __atomic_load_n( &metric[id].gauge, __ATOMIC_RELAXED );
+    double value;
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+static uint64_t total( int id )
+// Call with the lock held
+{
+    uint64_t sum = 0;
+    struct thread_counters *t;
+    for (t = threads; t != NULL; t = t->next)
+        sum += __atomic_load_n( &t->v[id], __ATOMIC_RELAXED );
+    return sum;
+}
+
+static double ratio( int id )
+// Call with the lock held
+{
+    double num = total( metric[id].num );
+    double all = num + total( metric[id].other );
+    return (all > 0 ? num / all : NAN);
+}
+
+uint64_t metrics_total( int id )
+/* A counter's value, added up over all the threads */
+{
+    pthread_mutex_lock( &lock );
+    uint64_t sum = total( id );
+    pthread_mutex_unlock( &lock );
+    return sum;
+}
+
+
+int metrics_write( FILE *f )
+/* Write every metric to f, in Prometheus's text format: "# HELP" and
+ * "# TYPE" lines, and then one "name{labels} value" line per value.
+ *
+ * Returns: 0 on success, -1 if the writing failed
+ */
+{
+    int i;
+    struct thread_counters *t;
+
+    pthread_mutex_lock( &lock );
+    for (i = 1; i < nmetrics; i++)
+    {
+        fprintf( f, "# HELP %s %s\n", metric[i].name, metric[i].help );
+        fprintf( f, "# TYPE %s %s\n", metric[i].name,
+                 metric[i].kind == COUNTER ? "counter" : "gauge" );
+        if (metric[i].kind == COUNTER)
+        {
+            for (t = threads; t != NULL; t = t->next)
+                fprintf( f, "%s{thread=\"%d\"} %llu\n", metric[i].name, t->number,
+                         (unsigned long long)__atomic_load_n( &t->v[i], __ATOMIC_RELAXED ) );
+        }
+        else
+        {
+            double v = (metric[i].kind == GAUGE ? gauge_value( i ) : ratio( i ));
+            if (isnan( v ))
+                fprintf( f, "%s NaN\n", metric[i].name );
+            else
+                fprintf( f, "%s %.17g\n", metric[i].name, v );
+        }
+    }
+    fprintf( f, "# HELP metrics_uptime_seconds Seconds since the first metric was registered\n" );
+    fprintf( f, "# TYPE metrics_uptime_seconds gauge\n" );
+    fprintf( f, "metrics_uptime_seconds %.3f\n", uptime() );
+    fprintf( f, "# HELP metrics_threads Threads that have added to a counter\n" );
+    fprintf( f, "# TYPE metrics_threads gauge\n" );
+    fprintf( f, "metrics_threads %d\n", nthreads );
+    pthread_mutex_unlock( &lock );
+
+    return (ferror( f ) ? -1 : 0);
+}
+
+
+/*****************************************************************************
+ * The server
+ *****************************************************************************/
+
+static int open_socket( const char *where )
+/* "unix:/some/path" for a Unix socket, otherwise "host:port" or ":port" for
+ * TCP (with the host defaulting to 127.0.0.1, so that only programs on this
+ * computer can connect). Returns a listening socket, or -1.
+ */
+{
+    int fd;
+    if (strncmp( where, "unix:", 5 ) == 0)
+    {
+        struct sockaddr_un addr;
+        memset( &addr, 0, sizeof(addr) );
+        addr.sun_family = AF_UNIX;
+        if (strlen( where + 5 ) >= sizeof(addr.sun_path))
+            return -1;
+        strcpy( addr.sun_path, where + 5 );
+
+        if ((fd = socket( AF_UNIX, SOCK_STREAM, 0 )) < 0)
+            return -1;
+        unlink( addr.sun_path );    // left over from an earlier run
+        if (bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0 || listen( fd, 16 ) != 0)
+        {
+            close( fd );
+            return -1;
+        }
+        server_path = strdup( addr.sun_path );
+        return fd;
+    }
+
+    const char *colon = strrchr( where, ':' );
+    char host[64] = "127.0.0.1";
+    if (colon == NULL)
+        colon = where - 1;                   // just a port number
+    else if (colon > where)
+    {
+        if ((size_t)(colon - where) >= sizeof(host))
+            return -1;
+        memcpy( host, where, colon - where );
+        host[colon - where] = '\0';
+    }
+
+    struct sockaddr_in addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( atoi( colon + 1 ) );
+    if (inet_pton( AF_INET, host, &addr.sin_addr ) != 1)
+        return -1;
+
+    if ((fd = socket( AF_INET, SOCK_STREAM, 0 )) < 0)
+        return -1;
+    int yes = 1;
+    setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes) );
+    if (bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0 || listen( fd, 16 ) != 0)
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+static void send_all( int fd, const char *buf, size_t len )
+{
+    while (len > 0)
+    {
+        ssize_t n = send( fd, buf, len, MSG_NOSIGNAL );  // no SIGPIPE if they hang up
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void answer( int fd )
+/* Whatever was asked, reply with all the metrics, as an HTTP response. */
+{
+    // Read the request (up to the blank line that ends it), but don't wait
+    // more than a second for a client that never sends one
+    struct timeval timeout = { 1, 0 };
+    setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+    char request[4096];
+    size_t got = 0;
+    while (got < sizeof(request) - 1)
+    {
+        ssize_t n = recv( fd, request + got, sizeof(request) - 1 - got, 0 );
+        if (n <= 0)
+            break;
+        got += n;
+        request[got] = '\0';
+        if (strstr( request, "\r\n\r\n" ) != NULL || strstr( request, "\n\n" ) != NULL)
+            break;
+    }
+
+    // Write the body into memory first, so we know how long it is
+    char *body = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream( &body, &len );
+    if (f == NULL)
+        return;
+    metrics_write( f );
+    fclose( f );
+
+    char header[256];
+    int n = snprintf( header, sizeof(header),
+                      "HTTP/1.0 200 OK\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: %zu\r\n"
+                      "\r\n", len );
+    send_all( fd, header, n );
+    send_all( fd, body, len );
+    free( body );
+}
+
+static void *serve( void *arg )
+{
+    (void)arg;
+    struct pollfd p[2] = { { server_fd, POLLIN, 0 }, { stop_pipe[0], POLLIN, 0 } };
+    while (1)
+    {
+        if (poll( p, 2, -1 ) < 0 && errno != EINTR)
+            break;
+        if (p[1].revents)             // metrics_stop()
+            break;
+        if (p[0].revents & POLLIN)
+        {
+            int fd = accept( server_fd, NULL, NULL );
+            if (fd >= 0)
+            {
+                answer( fd );
+                close( fd );
+            }
+        }
+    }
+    return NULL;
+}
+
+int metrics_serve( const char *where )
+/* Start answering requests for the metrics in the background.
+ *
+ * Inputs:
+ *   const char *where = "unix:/path/to/socket", "host:port" or ":port"
+ * Returns:
+ *   int = 0 on success, -1 on failure (e.g. the port is already in use)
+ */
+{
+    if (serving)
+        return -1;
+    if (stop_pipe[0] < 0 && pipe( stop_pipe ) != 0)
+        return -1;
+    if ((server_fd = open_socket( where )) < 0)
+        return -1;
+    if (pthread_create( &server_thread, NULL, serve, NULL ) != 0)
+    {
+        close( server_fd );
+        server_fd = -1;
+        return -1;
+    }
+
+    pthread_mutex_lock( &lock );
+    if (start_time < 0)
+        start_time = now();
+    pthread_mutex_unlock( &lock );
+    serving = 1;
+    return 0;
+}
+
+
+/*****************************************************************************
+ * The summary
+ *****************************************************************************/
+
+static void summarise( FILE *f, uint64_t *last, double *last_time )
+/* One line: every counter's total and its rate since the last line, and
+ * every gauge and ratio. If no counter moved at all, say so: that's what a
+ * stalled run looks like.
+ */
+{
+    double t = now(), dt = t - *last_time;
+    int i, moved = 0, counters = 0;
+
+    pthread_mutex_lock( &lock );
+    fprintf( f, "[metrics %8.1f s]", uptime() );
+    for (i = 1; i < nmetrics; i++)
+    {
+        if (metric[i].kind == COUNTER)
+        {
+            uint64_t v = total( i );
+            fprintf( f, "  %s %llu (%.4g/s)", metric[i].name, (unsigned long long)v,
+                     dt > 0 ? (v - last[i]) / dt : 0.0 );
+            moved |= (v != last[i]);
+            counters++;
+            last[i] = v;
+        }
+        else
+            fprintf( f, "  %s %.4g", metric[i].name,
+                     metric[i].kind == GAUGE ? gauge_value( i ) : ratio( i ) );
+    }
+    fprintf( f, "  threads %d", nthreads );
+    pthread_mutex_unlock( &lock );
+
+    if (counters > 0 && !moved)
+        fprintf( f, "  -- NO PROGRESS" );
+    fprintf( f, "\n" );
+    fflush( f );
+    *last_time = t;
+}
+
+static void *report( void *arg )
+{
+    (void)arg;
+    uint64_t last[METRICS_MAX] = { 0 };
+    double last_time = (start_time < 0 ? now() : start_time);
+
+    pthread_mutex_lock( &lock );
+    while (!stopping)
+    {
+        // Sleep until the next report is due (or until metrics_stop())
+        struct timespec until;
+        clock_gettime( CLOCK_MONOTONIC, &until );
+        double wake = until.tv_sec + until.tv_nsec * 1e-9 + report_every;
+        until.tv_sec = (time_t)wake;
+        until.tv_nsec = (long)((wake - until.tv_sec) * 1e9);
+        while (!stopping && pthread_cond_timedwait( &stop_cond, &lock, &until ) != ETIMEDOUT)
+            ;
+        pthread_mutex_unlock( &lock );
+
+        summarise( report_file, last, &last_time );  // the last one is printed on the way out
+
+        pthread_mutex_lock( &lock );
+    }
+    pthread_mutex_unlock( &lock );
+    return NULL;
+}
+
+int metrics_report( FILE *f, double seconds )
+/* Print a summary line to f every so many seconds, in the background, and
+ * once more when metrics_stop() is called.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+{
+    if (reporting || !(seconds > 0))
+        return -1;
+
+    // The timed wait has to use the same clock as now()
+    pthread_condattr_t attr;
+    pthread_condattr_init( &attr );
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+    pthread_cond_init( &stop_cond, &attr );
+    pthread_condattr_destroy( &attr );
+
+    report_file = f;
+    report_every = seconds;
+    pthread_mutex_lock( &lock );
+    if (start_time < 0)
+        start_time = now();
+    pthread_mutex_unlock( &lock );
+
+    if (pthread_create( &report_thread, NULL, report, NULL ) != 0)
+        return -1;
+    reporting = 1;
+    return 0;
+}
+
+
+void metrics_stop( void )
+/* Stop the background threads (printing a last summary, if reporting). The
+ * counters themselves carry on working.
+ */
+{
+    pthread_mutex_lock( &lock );
+    stopping = 1;
+    if (reporting)
+        pthread_cond_signal( &stop_cond );
+    pthread_mutex_unlock( &lock );
+
+    if (serving)
+    {
+        char c = 'x';
+        if (write( stop_pipe[1], &c, 1 ) < 0) {}    // wakes up poll()
+        pthread_join( server_thread, NULL );
+        if (read( stop_pipe[0], &c, 1 ) < 0) {}     // ready for next time
+        close( server_fd );
+        server_fd = -1;
+        if (server_path != NULL)
+        {
+            unlink( server_path );
+            free( server_path );
+            server_path = NULL;
+        }
+        serving = 0;
+    }
+    if (reporting)
+    {
+        pthread_join( report_thread, NULL );
+        pthread_cond_destroy( &stop_cond );
+        reporting = 0;
+    }
+
+    stopping = 0;
+}
@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * metrics.h
+ *
+ * Live counters for long runs, which can be read while the program is still
+ * going. See metrics.c for details.
+ *
+ * Usage:
+ *
+ *   int items = metrics_counter( "items_total", "Items processed" );
+ *   int hits  = metrics_counter( "cache_hits_total", "Cache hits" );
+ *   int miss  = metrics_counter( "cache_misses_total", "Cache misses" );
+ *   metrics_ratio( "cache_hit_ratio", "Fraction of lookups that hit", hits, miss );
+ *
+ *   metrics_serve( "127.0.0.1:9100" );   (or "unix:/tmp/run.sock")
+ *   metrics_report( stderr, 10.0 );      (a summary line every 10 s)
+ *
+ *   ... in any thread, as often as you like:
+ *   metrics_add( items, 1 );
+ *
+ *   metrics_stop();
+ *
+ * Registering the same name twice gives back the same id, so libraries can
+ * register their own counters without worrying about who went first.
+ *
+ *****************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define  METRICS_MAX  64    // counters, gauges and ratios altogether
+
+/* Each thread adds to its own copy of every counter, and only the thread
+   itself ever writes to it, so there are no locks and no "lock add"
+   instructions, and no other thread's writes keep stealing the cache line.
+   (Readers add all the copies up.) The relaxed atomic load and store just
+   stop the compiler from tearing or caching the value; on x86 and ARM they
+   are ordinary loads and stores.
+*/
+extern _Thread_local uint64_t *metrics_mine;
+uint64_t *metrics_thread( void );
+
+static inline void metrics_add( int id, uint64_t n )
+{
+    uint64_t *mine = metrics_mine;
+    if (mine == NULL)
+        mine = metrics_thread();   // this thread's first time
+    __atomic_store_n( &mine[id], __atomic_load_n( &mine[id], __ATOMIC_RELAXED ) + n,
+                      __ATOMIC_RELAXED );
+}
+
+int  metrics_counter( const char *, const char * );
+int  metrics_gauge( const char *, const char * );
+int  metrics_ratio( const char *, const char *, int, int );
+void metrics_set( int, double );
+
+uint64_t metrics_total( int );
+int  metrics_write( FILE * );
+
+int  metrics_serve( const char * );
+int  metrics_report( FILE *, double );
+void metrics_stop( void );
+
+#endif
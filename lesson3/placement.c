@@ -0,0 +1,233 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * placement.c
+ *
+ * On a machine with more than one socket, each socket has its own memory
+ * (its own "NUMA node"). A core can read the other socket's memory, but it
+ * has to go across the link between the sockets, which is slower and easily
+ * saturated. Two things decide how much of that traffic there is:
+ *
+ *   1) Which CPU each thread runs on. Unless told otherwise, the operating
+ *      system is free to put OpenMP's threads anywhere, and to move them.
+ *
+ *   2) Where each page of memory lives. Linux puts a page on the node of
+ *      whichever thread first *writes* to it ("first touch"), which is not
+ *      necessarily the thread that called malloc(). If one thread fills a
+ *      whole matrix, all of it ends up on that thread's node.
+ *
+ * placement_bind_omp() pins each OpenMP thread to a CPU, following a policy:
+ *
+ *   compact      fill the cores of the first socket, then the next, ...
+ *                (threads share caches, good for small thread counts)
+ *   scatter      alternate between sockets (uses every socket's memory
+ *                bandwidth, good for memory-bound loops)
+ *   0,2,4-7      exactly these CPUs, in this order
+ *
+ * Hyperthreads are only used once every physical core has a thread.
+ *
+ * placement_create_matrix() allocates a matrix (in the same double ** form
+ * as create_matrix() in lesson1/fileio.c) whose rows are first touched by
+ * the threads of a schedule(static) loop. Any later schedule(static) loop
+ * over the rows, with the same number of threads, then finds its rows in
+ * local memory.
+ *
+ * (OpenMP itself can pin threads too, with OMP_PROC_BIND and OMP_PLACES,
+ * if your compiler's runtime supports them. Doing it by hand shows what's
+ * going on, and works the same everywhere.)
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE   // for sched_getcpu() and the CPU_SET macros
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <omp.h>
+
+#include "placement.h"
+#include "sysprobe.h"
+
+
+static int cmp_compact( const void *a, const void *b )
+{
+    const struct cpu_info *x = a, *y = b;
+    if (x->smt     != y->smt)     return x->smt - y->smt;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core    != y->core)    return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int cmp_scatter( const void *a, const void *b )
+{
+    const struct cpu_info *x = a, *y = b;
+    if (x->smt  != y->smt)  return x->smt - y->smt;
+    if (x->core != y->core) return x->core - y->core;   // the n'th core of each
+    if (x->package != y->package) return x->package - y->package;  // package in turn
+    return x->cpu - y->cpu;
+}
+
+
+int placement_parse( const char *spec, struct placement *p )
+/* Turn a policy name ("none", "compact", "scatter") or a CPU list (e.g.
+ * "0,2,4-7") into a placement.
+ *
+ * Returns: 0 on success, -1 if spec isn't understood.
+ */
+{
+    memset( p, 0, sizeof(struct placement) );
+
+    if (spec == NULL || *spec == '\0' || strcmp( spec, "none" ) == 0)
+    {
+        p->policy = PLACE_NONE;
+        return 0;
+    }
+
+    if (strcmp( spec, "compact" ) == 0 || strcmp( spec, "scatter" ) == 0)
+    {
+        struct cpu_info cpus[PLACEMENT_MAX_CPUS];
+        int n = sysprobe_cpus( cpus, PLACEMENT_MAX_CPUS );
+
+        p->policy = (spec[0] == 'c' ? PLACE_COMPACT : PLACE_SCATTER);
+        qsort( cpus, n, sizeof(struct cpu_info),
+               p->policy == PLACE_COMPACT ? cmp_compact : cmp_scatter );
+        for (int i = 0; i < n; i++)
+            p->cpus[i] = cpus[i].cpu;
+        p->ncpus = n;
+        return 0;
+    }
+
+    p->policy = PLACE_EXPLICIT;
+    p->ncpus = sysprobe_parse_cpu_list( spec, p->cpus, PLACEMENT_MAX_CPUS );
+    if (p->ncpus <= 0)
+        return -1;
+    if (p->ncpus > PLACEMENT_MAX_CPUS)
+        p->ncpus = PLACEMENT_MAX_CPUS;
+    return 0;
+}
+
+
+int placement_from_env( struct placement *p )
+/* The same as placement_parse(), using the PLACEMENT environment variable
+ * (and PLACE_NONE if it isn't set).
+ */
+{
+    return placement_parse( getenv( "PLACEMENT" ), p );
+}
+
+
+int placement_bind_omp( const struct placement *p )
+/* Pin each thread of the OpenMP thread team to its CPU. OpenMP keeps the same
+ * threads around between parallel regions, so they stay pinned for all the
+ * parallel loops that follow (as long as they use the same number of threads).
+ *
+ * Returns: 0 on success, or -1 if any of the threads couldn't be pinned
+ *          (e.g. a CPU in an explicit list doesn't exist).
+ */
+{
+    if (p->policy == PLACE_NONE || p->ncpus == 0)
+        return 0;
+
+    int failed = 0;
+#pragma omp parallel reduction(+:failed)
+    {
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        CPU_SET( p->cpus[omp_get_thread_num() % p->ncpus], &set );
+        if (pthread_setaffinity_np( pthread_self(), sizeof(set), &set ) != 0)
+            failed++;
+    }
+    return (failed ? -1 : 0);
+}
+
+
+void placement_report( FILE *f, const struct placement *p )
+/* Print the policy in p, and which CPU (and NUMA node) each OpenMP thread
+ * is actually on right now
+ */
+{
+    static const char *names[] = { "none", "compact", "scatter", "explicit" };
+    fprintf( f, "placement: %s", names[p->policy] );
+    for (int i = 0; i < p->ncpus; i++)
+        fprintf( f, "%s%d", (i == 0 ? " (cpus " : ","), p->cpus[i] );
+    fprintf( f, "%s\n", (p->ncpus > 0 ? ")" : "") );
+
+    struct cpu_info cpus[PLACEMENT_MAX_CPUS];
+    int n = sysprobe_cpus( cpus, PLACEMENT_MAX_CPUS );
+
+    int nthreads = omp_get_max_threads();
+    int *where = malloc( nthreads * sizeof(int) );
+#pragma omp parallel
+    where[omp_get_thread_num()] = sched_getcpu();
+
+    fprintf( f, "thread  cpu  socket  core  node\n" );
+    for (int t = 0; t < nthreads; t++)
+    {
+        int i;
+        for (i = 0; i < n && cpus[i].cpu != where[t]; i++);
+        if (i < n)
+            fprintf( f, "%6d %4d %7d %5d %5d\n", t, where[t],
+                     cpus[i].package, cpus[i].core, cpus[i].node );
+        else
+            fprintf( f, "%6d %4d       ?     ?     ?\n", t, where[t] );
+    }
+    free( where );
+}
+
+
+double **placement_create_matrix( int rows, int cols )
+/* Allocate a rows x cols matrix, like create_matrix() in lesson1/fileio.c,
+ * but with all the elements in one contiguous block whose rows are first
+ * touched (zeroed) by the threads of a schedule(static) loop.
+ *
+ * Memory allocated with this function should be freed with the function
+ *   placement_destroy_matrix()
+ *
+ * Returns:
+ *   double ** = a pointer to the row pointers, or NULL on failure
+ */
+{
+    // (at least one row pointer, even if there are no rows: see below)
+    double **M = malloc( (rows > 0 ? rows : 1) * sizeof(double *) );
+
+    /* malloc() only reserves the addresses; no page is given any memory until
+       something writes to it. aligned_alloc() keeps rows from sharing pages
+       with whatever malloc() hands out next.
+    */
+    size_t bytes = (size_t)rows * cols * sizeof(double);
+    bytes = (bytes + 4095) / 4096 * 4096;
+    double *data = aligned_alloc( 4096, bytes );
+    if (M == NULL || (data == NULL && bytes > 0))   // (an empty matrix may get NULL)
+    {
+        free( M );
+        free( data );
+        return NULL;
+    }
+
+    /* M[0] is always the start of the block, which is how
+       placement_destroy_matrix() finds it again, even for a matrix with no
+       rows.
+    */
+    M[0] = data;
+
+    int r;
+#pragma omp parallel for schedule(static)
+    for (r = 0; r < rows; r++)
+    {
+        M[r] = data + (size_t)r * cols;
+        memset( M[r], 0, cols * sizeof(double) );
+    }
+
+    return M;
+}
+
+
+void placement_destroy_matrix( double **M )
+{
+    if (M == NULL)
+        return;
+    free( M[0] );
+    free( M );
+}
@@ -0,0 +1,40 @@
+/*****************************************************************************
+ * placement.h
+ *
+ * Choosing which CPU each OpenMP thread runs on, and making sure the memory
+ * each thread works on lives on that CPU's NUMA node.
+ * See placement.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdio.h>
+
+#define  PLACEMENT_MAX_CPUS  1024
+
+typedef enum placement_policy_t
+{
+    PLACE_NONE     = 0,   // leave it to the operating system
+    PLACE_COMPACT  = 1,   // fill one socket's cores before moving to the next
+    PLACE_SCATTER  = 2,   // spread threads round-robin over sockets
+    PLACE_EXPLICIT = 3    // use a list of CPUs given by the user
+} placement_policy;
+
+struct placement
+{
+    placement_policy policy;
+    int ncpus;
+    int cpus[PLACEMENT_MAX_CPUS];   // thread t goes on cpus[t % ncpus]
+};
+
+int  placement_parse( const char *, struct placement * );
+int  placement_from_env( struct placement * );
+int  placement_bind_omp( const struct placement * );
+void placement_report( FILE *, const struct placement * );
+
+double **placement_create_matrix( int, int );
+void placement_destroy_matrix( double ** );
+
+#endif
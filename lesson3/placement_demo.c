@@ -0,0 +1,97 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A demonstration of placement.c: it fills a large matrix with the ripples
+ * from lesson1/ripples.c, in parallel, and then runs the Collatz search from
+ * q14-openmp.c, reporting where the threads ended up. Try it with different
+ * policies, and compare the timings on a machine with more than one socket:
+ *
+ *   $ make -f Makefile-placement
+ *   $ PLACEMENT=none    ./placement_demo
+ *   $ PLACEMENT=compact ./placement_demo
+ *   $ PLACEMENT=scatter ./placement_demo
+ *   $ PLACEMENT=0,2,4,6 OMP_NUM_THREADS=4 ./placement_demo
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <omp.h>
+
+#include "placement.h"
+#include "ripples.h"    // from lesson1: see Makefile-placement
+
+static int collatz_length( long x )
+{
+    int l = 0;
+    while (x != 1)
+    {
+        x = (x % 2 == 0 ? x >> 1 : 3*x + 1);
+        l++;
+    }
+    return l;
+}
+
+int main()
+{
+    struct placement p;
+    if (placement_from_env( &p ) != 0)
+    {
+        fprintf( stderr, "error: PLACEMENT should be none, compact, scatter, "
+                         "or a list of CPUs like 0,2,4-7\n" );
+        exit(EXIT_FAILURE);
+    }
+    if (placement_bind_omp( &p ) != 0)
+        fprintf( stderr, "warning: could not pin every thread\n" );
+    placement_report( stdout, &p );
+
+    int rows = 8000, cols = 8000;
+    double start = omp_get_wtime();
+    double **M = placement_create_matrix( rows, cols );
+    if (M == NULL)
+    {
+        fprintf( stderr, "error: could not allocate matrix\n" );
+        exit(EXIT_FAILURE);
+    }
+    double allocated = omp_get_wtime();
+    // make_ripples() shares the rows out with schedule(static), just like
+    // placement_create_matrix(), so each thread writes to rows in its own
+    // NUMA node's memory
+    make_ripples( M, rows, cols );
+    double filled = omp_get_wtime();
+
+    printf( "\n%dx%d matrix: first touch %.3f s, make_ripples %.3f s\n",
+            rows, cols, allocated - start, filled - allocated );
+    placement_destroy_matrix( M );
+
+    long best = 1;
+    int best_length = 0;
+    start = omp_get_wtime();
+#pragma omp parallel
+    {
+        // Each thread keeps its own best, so the threads only have to take
+        // turns once each, at the end
+        long i, my_best = 1;
+        int my_length = 0;
+#pragma omp for schedule(dynamic, 1000) nowait
+        for (i = 3; i < 1000000; i++)
+        {
+            int l = collatz_length( i );
+            if (l > my_length)
+            {
+                my_length = l;
+                my_best = i;
+            }
+        }
+#pragma omp critical
+        if (my_length > best_length || (my_length == best_length && my_best < best))
+        {
+            best_length = my_length;
+            best = my_best;
+        }
+    }
+    printf( "Collatz search: %ld, %.3f s\n", best, omp_get_wtime() - start );
+
+    return EXIT_SUCCESS;
+}
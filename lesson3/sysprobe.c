@@ -0,0 +1,534 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * sysprobe.c
+ *
+ * check_system.c decides what system it's on at *compile* time, using tokens
+ * like __linux__ that the compiler defines for us. That's fine for choosing
+ * an operating system, but it can't tell us anything about the particular
+ * machine the program ends up running on: which SIMD instructions the CPU
+ * has, how big its caches are, how many cores (and sockets) there are, or
+ * whether huge pages are available. The functions here find all that out
+ * at *run* time, so that number-crunching code can choose its SIMD path,
+ * tile sizes and thread counts for itself, instead of being hand-tuned for
+ * each machine.
+ *
+ * On x86 we ask the CPU directly with the "cpuid" instruction. Everything
+ * else comes from the files Linux provides under /sys and /proc; on other
+ * systems we fall back to sensible guesses.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "sysprobe.h"
+
+#define  MAX_CPUS  4096
+
+
+static long read_long( const char *path, long fallback )
+/* Read a single integer from a (sysfs) file, or return fallback if we can't.
+ * Sizes like "32K" or "8M" are converted to bytes.
+ */
+{
+    FILE *f = fopen( path, "r" );
+    if (f == NULL)
+        return fallback;
+
+    long value;
+    char suffix = '\0';
+    int n = fscanf( f, "%ld%c", &value, &suffix );
+    fclose( f );
+
+    if (n < 1)
+        return fallback;
+    if (suffix == 'K')  value *= 1024;
+    if (suffix == 'M')  value *= 1024*1024;
+    if (suffix == 'G')  value *= 1024*1024*1024;
+    return value;
+}
+
+
+int sysprobe_parse_cpu_list( const char *list, int *cpus, int max )
+/* Parse a list of CPUs in the format Linux uses, such as "0-3,8,10-11".
+ *
+ * Inputs:
+ *   const char *list = the list
+ *   int *cpus        = where to put the CPU numbers (may be NULL, to just
+ *                      count them)
+ *   int max          = the most CPU numbers to store in cpus
+ * Returns:
+ *   int = the number of CPUs in the list (even if more than max), or -1 if
+ *         the list doesn't make sense
+ */
+{
+    int count = 0;
+    const char *p = list;
+    while (*p != '\0' && *p != '\n')
+    {
+        char *end;
+        long lo = strtol( p, &end, 10 ), hi = lo;
+        if (end == p || lo < 0)
+            return -1;
+        p = end;
+        if (*p == '-')
+        {
+            hi = strtol( p + 1, &end, 10 );
+            if (end == p + 1 || hi < lo)
+                return -1;
+            p = end;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++, count++)
+            if (cpus != NULL && count < max)
+                cpus[count] = cpu;
+        if (*p == ',')
+            p++;
+        else if (*p != '\0' && *p != '\n')
+            return -1;
+    }
+    return count;
+}
+
+
+static int read_cpu_list( const char *path, int *cpus, int max )
+/* Read a sysfs CPU list file (see above), or return 0 if it can't be read */
+{
+    char line[4096] = "";
+    FILE *f = fopen( path, "r" );
+    if (f == NULL)
+        return 0;
+    if (fgets( line, sizeof(line), f ) == NULL)
+        line[0] = '\0';
+    fclose( f );
+
+    int n = sysprobe_parse_cpu_list( line, cpus, max );
+    return (n > 0 ? n : 0);
+}
+
+
+static void detect_isa( struct sysprobe *sp )
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    // Leaf 0: the vendor string, spread over ebx, edx, ecx (in that order)
+    if (!__get_cpuid( 0, &eax, &ebx, &ecx, &edx ))
+        return;
+    unsigned int max_leaf = eax;
+    memcpy( sp->vendor + 0, &ebx, 4 );
+    memcpy( sp->vendor + 4, &edx, 4 );
+    memcpy( sp->vendor + 8, &ecx, 4 );
+    sp->vendor[12] = '\0';
+
+    // Leaf 1: the original feature flags
+    __get_cpuid( 1, &eax, &ebx, &ecx, &edx );
+    if (edx & (1 << 26))  sp->isa |= ISA_SSE2;
+    if (ecx & (1 << 0))   sp->isa |= ISA_SSE3;
+    if (ecx & (1 << 9))   sp->isa |= ISA_SSSE3;
+    if (ecx & (1 << 19))  sp->isa |= ISA_SSE41;
+    if (ecx & (1 << 20))  sp->isa |= ISA_SSE42;
+    if (ecx & (1 << 23))  sp->isa |= ISA_POPCNT;
+
+    /* The CPU having AVX isn't enough: the operating system also has to save
+       the wider registers when it switches between threads. It says so via
+       the OSXSAVE bit, after which the XCR0 register (read with "xgetbv")
+       tells us which register sets it looks after.
+    */
+    unsigned int xcr0 = 0;
+    if (ecx & (1 << 27))
+    {
+        unsigned int hi;
+        __asm__ ( "xgetbv" : "=a"(xcr0), "=d"(hi) : "c"(0) );
+    }
+    int os_avx    = (xcr0 & 0x06) == 0x06;  // SSE and AVX state
+    int os_avx512 = (xcr0 & 0xe6) == 0xe6;  // ... plus the opmask and ZMM state
+
+    if (os_avx && (ecx & (1 << 28)))  sp->isa |= ISA_AVX;
+    if (os_avx && (ecx & (1 << 12)))  sp->isa |= ISA_FMA;
+
+    // Leaf 7: the newer extensions
+    if (max_leaf >= 7)
+    {
+        __cpuid_count( 7, 0, eax, ebx, ecx, edx );
+        if (os_avx && (ebx & (1 << 5)))      sp->isa |= ISA_AVX2;
+        if (ebx & (1 << 8))                  sp->isa |= ISA_BMI2;
+        if (os_avx512 && (ebx & (1 << 16)))  sp->isa |= ISA_AVX512F;
+        if (os_avx512 && (ebx & (1 << 17)))  sp->isa |= ISA_AVX512DQ;
+        if (os_avx512 && (ebx & (1u << 30))) sp->isa |= ISA_AVX512BW;
+        if (os_avx512 && (ebx & (1u << 31))) sp->isa |= ISA_AVX512VL;
+    }
+
+    // Leaves 0x80000002-4: the marketing name of the processor
+    __get_cpuid( 0x80000000, &eax, &ebx, &ecx, &edx );
+    if (eax >= 0x80000004)
+    {
+        unsigned int *brand = (unsigned int *)sp->brand;
+        for (unsigned int leaf = 0; leaf < 3; leaf++)
+            __get_cpuid( 0x80000002 + leaf, brand + 4*leaf,     brand + 4*leaf + 1,
+                                            brand + 4*leaf + 2, brand + 4*leaf + 3 );
+        sp->brand[48] = '\0';
+    }
+#elif defined(__aarch64__)
+    strcpy( sp->vendor, "ARM" );
+    sp->isa |= ISA_NEON;   // every 64-bit ARM CPU has NEON
+#endif
+}
+
+
+static void detect_caches( struct sysprobe *sp )
+{
+    char path[256];
+    int idx;
+    for (idx = 0; sp->ncaches < SYSPROBE_MAX_CACHES; idx++)
+    {
+        struct cache_info *c = &sp->caches[sp->ncaches];
+        const char *dir = "/sys/devices/system/cpu/cpu0/cache/index";
+
+        sprintf( path, "%s%d/level", dir, idx );
+        if ((c->level = read_long( path, -1 )) < 0)
+            break;
+
+        sprintf( path, "%s%d/type", dir, idx );
+        FILE *f = fopen( path, "r" );   // "Data", "Instruction" or "Unified"
+        int first = (f != NULL ? fgetc( f ) : 'U');
+        c->type = (first == 'D' || first == 'I' ? first : 'U');
+        if (f != NULL)
+            fclose( f );
+
+        sprintf( path, "%s%d/size", dir, idx );
+        c->size = read_long( path, 0 );
+        sprintf( path, "%s%d/coherency_line_size", dir, idx );
+        c->line_size = read_long( path, 64 );
+        sprintf( path, "%s%d/shared_cpu_list", dir, idx );
+        c->shared_by = read_cpu_list( path, NULL, 0 );
+
+        sp->ncaches++;
+    }
+
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    // glibc can also tell us (which helps where /sys is missing)
+    if (sp->ncaches == 0)
+    {
+        long sizes[3] = { sysconf( _SC_LEVEL1_DCACHE_SIZE ),
+                          sysconf( _SC_LEVEL2_CACHE_SIZE ),
+                          sysconf( _SC_LEVEL3_CACHE_SIZE ) };
+        for (idx = 0; idx < 3; idx++)
+        {
+            if (sizes[idx] <= 0)
+                continue;
+            struct cache_info *c = &sp->caches[sp->ncaches++];
+            c->level = idx + 1;
+            c->type = (idx == 0 ? 'D' : 'U');
+            c->size = sizes[idx];
+            c->line_size = sysconf( _SC_LEVEL1_DCACHE_LINESIZE );
+            c->shared_by = 0;
+        }
+    }
+#endif
+
+    sp->line_size = 64;  // a good guess, if all else fails
+    for (idx = 0; idx < sp->ncaches; idx++)
+        if (sp->caches[idx].level == 1 && sp->caches[idx].type != 'I' &&
+            sp->caches[idx].line_size > 0)
+            sp->line_size = sp->caches[idx].line_size;
+}
+
+
+static void detect_topology( struct sysprobe *sp )
+{
+    sp->logical_cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    if (sp->logical_cpus < 1)
+        sp->logical_cpus = 1;
+
+    /* A physical core is a unique (package, core) pair. Hyperthreads share
+       them, so there are often twice as many logical CPUs as cores.
+    */
+    long seen[MAX_CPUS];
+    int ncores = 0, nsockets = 0;
+    long max_package = -1;
+    char path[256];
+    int cpu;
+    for (cpu = 0; cpu < MAX_CPUS; cpu++)
+    {
+        sprintf( path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu );
+        long package = read_long( path, -1 );
+        if (package < 0)
+        {
+            if (cpu >= sp->logical_cpus)
+                break;
+            continue;   // offline CPUs leave gaps
+        }
+        sprintf( path, "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu );
+        long key = (package << 20) | read_long( path, cpu );
+
+        int i;
+        for (i = 0; i < ncores && seen[i] != key; i++);
+        if (i == ncores)
+            seen[ncores++] = key;
+
+        if (package > max_package)
+        {
+            max_package = package;
+            nsockets = package + 1;
+        }
+    }
+
+    sp->physical_cores = (ncores > 0 ? ncores : sp->logical_cpus);
+    sp->sockets = (nsockets > 0 ? nsockets : 1);
+
+    sp->numa_nodes = 0;
+    for (int node = 0; node < MAX_CPUS; node++)
+    {
+        sprintf( path, "/sys/devices/system/node/node%d/cpulist", node );
+        if (access( path, R_OK ) != 0)
+            break;
+        sp->numa_nodes++;
+    }
+    if (sp->numa_nodes == 0)
+        sp->numa_nodes = 1;
+}
+
+
+static void detect_memory( struct sysprobe *sp )
+{
+    sp->page_size = sysconf( _SC_PAGESIZE );
+
+    FILE *f = fopen( "/proc/meminfo", "r" );
+    if (f != NULL)
+    {
+        char line[256];
+        while (fgets( line, sizeof(line), f ) != NULL)
+        {
+            sscanf( line, "HugePages_Total: %ld", &sp->hugepages_total );
+            sscanf( line, "HugePages_Free: %ld", &sp->hugepages_free );
+            if (sscanf( line, "Hugepagesize: %ld", &sp->hugepage_size ) == 1)
+                sp->hugepage_size *= 1024;  // it's given in kB
+        }
+        fclose( f );
+    }
+
+    /* The transparent huge page setting looks like "always [madvise] never",
+       with the current choice in brackets.
+    */
+    sp->thp = THP_UNAVAILABLE;
+    f = fopen( "/sys/kernel/mm/transparent_hugepage/enabled", "r" );
+    if (f != NULL)
+    {
+        char line[256] = "";
+        if (fgets( line, sizeof(line), f ) != NULL)
+        {
+            if      (strstr( line, "[always]" )  != NULL)  sp->thp = THP_ALWAYS;
+            else if (strstr( line, "[madvise]" ) != NULL)  sp->thp = THP_MADVISE;
+            else if (strstr( line, "[never]" )   != NULL)  sp->thp = THP_NEVER;
+        }
+        fclose( f );
+    }
+}
+
+
+int sysprobe_cpus( struct cpu_info *cpus, int max )
+/* List the online CPUs, with where each one sits: which socket (package),
+ * which physical core, which of that core's hyperthreads, and which NUMA node.
+ *
+ * Inputs:
+ *   struct cpu_info *cpus = array to fill in
+ *   int max               = the length of cpus
+ * Returns:
+ *   int = the number of CPUs filled in
+ */
+{
+    char path[256];
+    int n = 0, cpu;
+    for (cpu = 0; cpu < MAX_CPUS && n < max; cpu++)
+    {
+        sprintf( path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu );
+        long package = read_long( path, -1 );
+        if (package < 0)
+        {
+            if (cpu >= sysconf( _SC_NPROCESSORS_CONF ))
+                break;
+            continue;
+        }
+        sprintf( path, "/sys/devices/system/cpu/cpu%d/online", cpu );
+        if (read_long( path, 1 ) == 0)
+            continue;
+
+        struct cpu_info *c = &cpus[n++];
+        c->cpu = cpu;
+        c->package = package;
+        sprintf( path, "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu );
+        c->core = read_long( path, cpu );
+        c->node = 0;
+
+        // Our thread number on this core = how many siblings come before us
+        int siblings[64];
+        sprintf( path, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu );
+        int nsib = read_cpu_list( path, siblings, 64 );
+        c->smt = 0;
+        for (int i = 0; i < nsib && i < 64; i++)
+            if (siblings[i] < cpu)
+                c->smt++;
+    }
+
+    // Fill in the NUMA nodes from each node's own list of CPUs
+    int node_cpus[MAX_CPUS];
+    for (int node = 0; node < MAX_CPUS; node++)
+    {
+        sprintf( path, "/sys/devices/system/node/node%d/cpulist", node );
+        if (access( path, R_OK ) != 0)
+            break;
+        int count = read_cpu_list( path, node_cpus, MAX_CPUS );
+        for (int i = 0; i < count && i < MAX_CPUS; i++)
+            for (int j = 0; j < n; j++)
+                if (cpus[j].cpu == node_cpus[i])
+                    cpus[j].node = node;
+    }
+
+    // Without /sys, just number them in order
+    if (n == 0)
+        for (n = 0; n < sysconf( _SC_NPROCESSORS_ONLN ) && n < max; n++)
+        {
+            cpus[n].cpu = cpus[n].core = n;
+            cpus[n].package = cpus[n].node = cpus[n].smt = 0;
+        }
+
+    return n;
+}
+
+
+void sysprobe_detect( struct sysprobe *sp )
+/* Fill in *sp with everything we can find out about this machine.
+ *
+ * Inputs:
+ *   struct sysprobe *sp = the struct to fill in
+ * Returns: (NONE)
+ */
+{
+    memset( sp, 0, sizeof(struct sysprobe) );
+    detect_isa( sp );
+    detect_caches( sp );
+    detect_topology( sp );
+    detect_memory( sp );
+}
+
+
+static struct sysprobe the_probe;
+static pthread_once_t probe_once = PTHREAD_ONCE_INIT;
+
+static void probe_once_fn()
+{
+    sysprobe_detect( &the_probe );
+}
+
+const struct sysprobe *sysprobe_get()
+/* The same as sysprobe_detect(), but only probes the first time it's called
+ * (the machine isn't going to change while we're running), and is safe to
+ * call from any thread.
+ */
+{
+    pthread_once( &probe_once, probe_once_fn );
+    return &the_probe;
+}
+
+
+int sysprobe_has( const struct sysprobe *sp, unsigned int isa )
+/* Returns true if the machine has ALL of the ISA_* extensions in isa, e.g.
+ *   sysprobe_has( sp, ISA_AVX2 | ISA_FMA )
+ */
+{
+    return (sp->isa & isa) == isa;
+}
+
+
+long sysprobe_cache_size( const struct sysprobe *sp, int level )
+/* Returns the size in bytes of the data (or unified) cache at the given level,
+ * or 0 if there isn't one.
+ */
+{
+    for (int i = 0; i < sp->ncaches; i++)
+        if (sp->caches[i].level == level && sp->caches[i].type != 'I')
+            return sp->caches[i].size;
+    return 0;
+}
+
+
+int sysprobe_threads( const struct sysprobe *sp )
+/* The number of threads to use for number crunching: one per physical core.
+ * (Hyperthreads share a core's floating point units, so they rarely help.)
+ * The OMP_NUM_THREADS environment variable, if set, wins.
+ */
+{
+    const char *env = getenv( "OMP_NUM_THREADS" );
+    if (env != NULL && atoi( env ) > 0)
+        return atoi( env );
+    return sp->physical_cores;
+}
+
+
+int sysprobe_tile( const struct sysprobe *sp, int level, size_t elem_size, int ntiles )
+/* The side length (in elements) of a square tile such that ntiles of them fit
+ * comfortably (i.e. in half) of one core's share of the given cache level,
+ * rounded down to a whole number of cache lines. E.g. for a blocked
+ * transpose of doubles, which touches two tiles at a time:
+ *   int b = sysprobe_tile( sp, 1, sizeof(double), 2 );
+ */
+{
+    long size = sysprobe_cache_size( sp, level );
+    if (size <= 0)
+        size = 32*1024;
+    for (int i = 0; i < sp->ncaches; i++)
+        if (sp->caches[i].level == level && sp->caches[i].type != 'I' &&
+            sp->caches[i].shared_by > 1)
+        {
+            // Per core, not per logical CPU: hyperthreads share the cache anyway
+            int cores = sp->caches[i].shared_by * sp->physical_cores / sp->logical_cpus;
+            size /= (cores > 1 ? cores : 1);
+        }
+
+    long elems = size / 2 / ntiles / elem_size;
+    int side = 1;
+    while ((long)(side + 1) * (side + 1) <= elems)
+        side++;
+
+    int per_line = sp->line_size / elem_size;
+    if (per_line > 1 && side > per_line)
+        side -= side % per_line;
+    return side;
+}
+
+
+void sysprobe_print( FILE *f, const struct sysprobe *sp )
+/* A human-readable summary of *sp, written to f */
+{
+    static const char *isa_names[] = {
+        "sse2", "sse3", "ssse3", "sse4.1", "sse4.2", "popcnt", "avx", "fma",
+        "avx2", "bmi2", "avx512f", "avx512dq", "avx512bw", "avx512vl", "neon" };
+    static const char *thp_names[] = { "unavailable", "never", "madvise", "always" };
+
+    fprintf( f, "CPU:       %s %s\n", sp->vendor, sp->brand );
+    fprintf( f, "ISA:      " );
+    for (unsigned int i = 0; i < sizeof(isa_names)/sizeof(isa_names[0]); i++)
+        if (sp->isa & (1u << i))
+            fprintf( f, " %s", isa_names[i] );
+    fprintf( f, "\n" );
+    fprintf( f, "Topology:  %d socket(s), %d physical core(s), %d logical CPU(s), "
+                "%d NUMA node(s)\n",
+             sp->sockets, sp->physical_cores, sp->logical_cpus, sp->numa_nodes );
+    for (int i = 0; i < sp->ncaches; i++)
+        fprintf( f, "Cache:     L%d%c %6ld KiB, %d-byte lines, shared by %d CPU(s)\n",
+                 sp->caches[i].level, sp->caches[i].type, sp->caches[i].size / 1024,
+                 sp->caches[i].line_size, sp->caches[i].shared_by );
+    fprintf( f, "Pages:     %ld bytes; huge pages %ld KiB (%ld of %ld free); "
+                "transparent huge pages: %s\n",
+             sp->page_size, sp->hugepage_size / 1024, sp->hugepages_free,
+             sp->hugepages_total, thp_names[sp->thp] );
+}
@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * sysprobe.h
+ *
+ * Finding out what machine we're running on, at run time.
+ * See sysprobe.c for details.
+ *
+ *****************************************************************************/
+
+#ifndef SYSPROBE_H
+#define SYSPROBE_H
+
+#include <stdio.h>
+
+// Instruction set extensions (bit flags for struct sysprobe's isa member)
+#define  ISA_SSE2      (1u << 0)
+#define  ISA_SSE3      (1u << 1)
+#define  ISA_SSSE3     (1u << 2)
+#define  ISA_SSE41     (1u << 3)
+#define  ISA_SSE42     (1u << 4)
+#define  ISA_POPCNT    (1u << 5)
+#define  ISA_AVX       (1u << 6)
+#define  ISA_FMA       (1u << 7)
+#define  ISA_AVX2      (1u << 8)
+#define  ISA_BMI2      (1u << 9)
+#define  ISA_AVX512F   (1u << 10)
+#define  ISA_AVX512DQ  (1u << 11)
+#define  ISA_AVX512BW  (1u << 12)
+#define  ISA_AVX512VL  (1u << 13)
+#define  ISA_NEON      (1u << 14)
+
+#define  SYSPROBE_MAX_CACHES  8
+
+struct cache_info
+{
+    int  level;      // 1, 2, 3, ...
+    char type;       // 'D'ata, 'I'nstruction, or 'U'nified
+    long size;       // in bytes
+    int  line_size;  // in bytes
+    int  shared_by;  // number of logical CPUs sharing this cache
+};
+
+struct sysprobe
+{
+    char vendor[16];
+    char brand[64];
+    unsigned int isa;           // ISA_* flags, only set if the OS supports them too
+
+    int logical_cpus;
+    int physical_cores;
+    int sockets;
+    int numa_nodes;
+
+    int ncaches;
+    struct cache_info caches[SYSPROBE_MAX_CACHES];
+    int line_size;              // cache line size (of the L1 data cache)
+
+    long page_size;
+    long hugepage_size;         // 0 if unknown
+    long hugepages_total;       // pre-allocated (MAP_HUGETLB) huge pages
+    long hugepages_free;
+    int  thp;                   // transparent huge pages: THP_* below
+};
+
+// Where one logical CPU sits in the machine
+struct cpu_info
+{
+    int cpu;        // the number the OS knows it by
+    int package;    // socket
+    int core;       // physical core (within the package)
+    int smt;        // 0 for a core's first hyperthread, 1 for its second, ...
+    int node;       // NUMA node
+};
+
+#define  THP_UNAVAILABLE  0
+#define  THP_NEVER        1
+#define  THP_MADVISE      2
+#define  THP_ALWAYS       3
+
+void sysprobe_detect( struct sysprobe * );
+const struct sysprobe *sysprobe_get();
+void sysprobe_print( FILE *, const struct sysprobe * );
+
+int  sysprobe_has( const struct sysprobe *, unsigned int );
+long sysprobe_cache_size( const struct sysprobe *, int );
+int  sysprobe_threads( const struct sysprobe * );
+int  sysprobe_tile( const struct sysprobe *, int, size_t, int );
+
+int  sysprobe_cpus( struct cpu_info *, int );
+int  sysprobe_parse_cpu_list( const char *, int *, int );
+
+#endif
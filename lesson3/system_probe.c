@@ -0,0 +1,35 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * This program prints out what sysprobe.c finds out about the machine it's
+ * running on, and the settings it would suggest for some number crunching.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "sysprobe.h"
+
+int main()
+{
+    const struct sysprobe *sp = sysprobe_get();
+
+    sysprobe_print( stdout, sp );
+
+    printf( "\nSuggestions:\n" );
+    printf( "  threads:                     %d\n", sysprobe_threads( sp ) );
+    printf( "  SIMD path:                   %s\n",
+            sysprobe_has( sp, ISA_AVX512F )         ? "AVX-512" :
+            sysprobe_has( sp, ISA_AVX2 | ISA_FMA )  ? "AVX2 + FMA" :
+            sysprobe_has( sp, ISA_SSE2 )            ? "SSE2" :
+            sysprobe_has( sp, ISA_NEON )            ? "NEON" : "scalar" );
+    printf( "  transpose tile (doubles, L1): %d x %d\n",
+            sysprobe_tile( sp, 1, sizeof(double), 2 ),
+            sysprobe_tile( sp, 1, sizeof(double), 2 ) );
+    printf( "  matmul tile (doubles, L2):   %d x %d\n",
+            sysprobe_tile( sp, 2, sizeof(double), 3 ),
+            sysprobe_tile( sp, 2, sizeof(double), 3 ) );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,286 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * trace.c
+ *
+ * check_system.c shows the classic way of adding debugging output:
+ *
+ *   #ifdef VERBOSE
+ *       fprintf( stderr, "..." );
+ *   #endif
+ *
+ * That's fine for a menu, but in a tight loop each of those fprintf's is a
+ * formatted, unbuffered write to stderr, guarded by a lock that all the
+ * threads fight over. Switching VERBOSE on changes the very timing you were
+ * trying to look at.
+ *
+ * This tracer keeps the compile-time switch (see TRACE_LEVEL in trace.h),
+ * but makes the enabled events cheap:
+ *
+ *   1) An event is just a timestamp, a pointer to its (constant) name and one
+ *      number. Nothing is formatted.
+ *   2) Each thread writes into its own ring buffer, so there are no locks.
+ *      If a buffer ever fills up, events are dropped (and counted) rather
+ *      than making the thread wait.
+ *   3) A background thread empties the buffers into a binary file every few
+ *      milliseconds.
+ *
+ * trace2json.c turns the file into Chrome's trace format, which can be
+ * viewed at chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Timestamps come from CLOCK_MONOTONIC. Compile with -DTRACE_USE_RDTSC (on
+ * x86) to read the CPU's time stamp counter instead, which is a little
+ * cheaper. Either way, the file records the clock at the start and end,
+ * so that the converter can turn ticks into nanoseconds.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "trace.h"
+
+#ifndef TRACE_RING_SIZE
+#define  TRACE_RING_SIZE  (1 << 16)    // events per thread; must be a power of 2
+#endif
+
+#define  TRACE_FLUSH_NS   (10*1000*1000)
+
+#if defined(TRACE_USE_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define  TRACE_CLOCK  TRACE_CLOCK_TSC
+#else
+#define  TRACE_CLOCK  TRACE_CLOCK_NS
+#endif
+
+
+struct trace_ring
+{
+    struct trace_record events[TRACE_RING_SIZE];
+    _Alignas(64) atomic_uint_fast64_t head;   // next to read  (the flusher's)
+    _Alignas(64) atomic_uint_fast64_t tail;   // next to write (the thread's)
+    atomic_uint_fast64_t dropped;
+    uint32_t tid;
+    struct trace_ring *next;                  // all the rings, in a list
+};
+
+static atomic_int trace_on;
+static _Atomic(struct trace_ring *) rings;
+static atomic_uint next_tid = 1;
+static _Thread_local struct trace_ring *my_ring;
+
+static FILE *trace_file;
+static pthread_t flusher;
+static atomic_int flusher_stop;
+
+
+static uint64_t nanoseconds()
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static inline uint64_t timestamp()
+{
+#if TRACE_CLOCK == TRACE_CLOCK_TSC
+    return __rdtsc();
+#else
+    return nanoseconds();
+#endif
+}
+
+
+static struct trace_ring *new_ring()
+/* Called the first time a thread records an event */
+{
+    struct trace_ring *ring = calloc( 1, sizeof(struct trace_ring) );
+    if (ring == NULL)
+        return NULL;
+    ring->tid = atomic_fetch_add( &next_tid, 1 );
+
+    // Push it onto the front of the list, without a lock
+    struct trace_ring *first = atomic_load( &rings );
+    do
+        ring->next = first;
+    while (!atomic_compare_exchange_weak( &rings, &first, ring ));
+
+    return ring;
+}
+
+
+void trace_event( int level, int phase, const char *name, int64_t arg )
+/* Record one event. Use the TRACE_* macros rather than calling this directly,
+ * so that disabled levels disappear at compile time.
+ */
+{
+    if (!atomic_load_explicit( &trace_on, memory_order_relaxed ))
+        return;
+    if (my_ring == NULL && (my_ring = new_ring()) == NULL)
+        return;
+
+    struct trace_ring *ring = my_ring;
+    uint64_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+    uint64_t head = atomic_load_explicit( &ring->head, memory_order_acquire );
+    if (tail - head >= TRACE_RING_SIZE)
+    {
+        atomic_fetch_add_explicit( &ring->dropped, 1, memory_order_relaxed );
+        return;
+    }
+
+    struct trace_record *r = &ring->events[tail & (TRACE_RING_SIZE - 1)];
+    r->type  = phase;
+    r->level = level;
+    r->tid   = ring->tid;
+    r->ts    = timestamp();
+    r->name  = (uint64_t)(uintptr_t)name;
+    r->arg   = arg;
+
+    // Publish it: the flusher won't look at it until it sees the new tail
+    atomic_store_explicit( &ring->tail, tail + 1, memory_order_release );
+}
+
+
+/* The flusher has to tell the converter what each name pointer means, but
+   only the first time it sees it. It remembers which ones it has already
+   written in a simple hash set.
+*/
+static uint64_t *names_seen;
+static size_t names_cap, names_count;
+
+static int name_is_new( uint64_t name )
+{
+    if (2 * (names_count + 1) > names_cap)
+    {
+        size_t old_cap = names_cap;
+        uint64_t *old = names_seen;
+        names_cap = (old_cap ? 2 * old_cap : 256);
+        names_seen = calloc( names_cap, sizeof(uint64_t) );
+        names_count = 0;
+        for (size_t i = 0; i < old_cap; i++)
+            if (old[i])
+                name_is_new( old[i] );
+        free( old );
+    }
+
+    size_t i = (name * 0x9e3779b97f4a7c15ull) & (names_cap - 1);
+    while (names_seen[i] != 0)
+    {
+        if (names_seen[i] == name)
+            return 0;
+        i = (i + 1) & (names_cap - 1);
+    }
+    names_seen[i] = name;
+    names_count++;
+    return 1;
+}
+
+
+static void write_name( uint64_t name )
+{
+    const char *s = (const char *)(uintptr_t)name;
+    struct trace_record r = { .type = TRACE_RECORD_NAME, .name = name };
+    r.arg = strlen( s );
+    fwrite( &r, sizeof(r), 1, trace_file );
+
+    char pad[8] = { 0 };
+    fwrite( s, 1, r.arg, trace_file );
+    fwrite( pad, 1, (8 - r.arg % 8) % 8, trace_file );
+}
+
+
+static void write_clock()
+{
+    struct trace_record r = { .type = TRACE_RECORD_CLOCK };
+    r.ts  = timestamp();
+    r.arg = nanoseconds();
+    fwrite( &r, sizeof(r), 1, trace_file );
+}
+
+
+static void drain()
+/* Move everything currently in the rings into the file */
+{
+    for (struct trace_ring *ring = atomic_load( &rings ); ring != NULL; ring = ring->next)
+    {
+        uint64_t head = atomic_load_explicit( &ring->head, memory_order_relaxed );
+        uint64_t tail = atomic_load_explicit( &ring->tail, memory_order_acquire );
+        for (; head != tail; head++)
+        {
+            struct trace_record *r = &ring->events[head & (TRACE_RING_SIZE - 1)];
+            if (name_is_new( r->name ))
+                write_name( r->name );
+            fwrite( r, sizeof(*r), 1, trace_file );
+        }
+        atomic_store_explicit( &ring->head, head, memory_order_release );
+
+        uint64_t dropped = atomic_exchange( &ring->dropped, 0 );
+        if (dropped > 0)
+        {
+            struct trace_record r = { .type = TRACE_RECORD_DROP, .tid = ring->tid };
+            r.arg = dropped;
+            fwrite( &r, sizeof(r), 1, trace_file );
+        }
+    }
+}
+
+
+static void *flush_loop( void *unused )
+{
+    (void)unused;
+    struct timespec pause = { 0, TRACE_FLUSH_NS };
+    while (!atomic_load( &flusher_stop ))
+    {
+        nanosleep( &pause, NULL );
+        drain();
+    }
+    return NULL;
+}
+
+
+int trace_start( const char *filename )
+/* Start recording events to the named file.
+ *
+ * Returns: 0 on success, -1 if the file couldn't be opened.
+ */
+{
+    trace_file = fopen( filename, "wb" );
+    if (trace_file == NULL)
+        return -1;
+
+    struct trace_header h = { TRACE_MAGIC, TRACE_CLOCK, sizeof(struct trace_record) };
+    fwrite( &h, sizeof(h), 1, trace_file );
+    write_clock();
+
+    atomic_store( &flusher_stop, 0 );
+    if (pthread_create( &flusher, NULL, flush_loop, NULL ) != 0)
+    {
+        fclose( trace_file );
+        return -1;
+    }
+    atomic_store( &trace_on, 1 );
+    return 0;
+}
+
+
+void trace_stop()
+/* Stop recording, write out whatever is left, and close the file. */
+{
+    if (!atomic_exchange( &trace_on, 0 ))
+        return;
+    atomic_store( &flusher_stop, 1 );
+    pthread_join( flusher, NULL );
+
+    drain();
+    write_clock();
+    fclose( trace_file );
+
+    free( names_seen );
+    names_seen = NULL;
+    names_cap = names_count = 0;
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ * trace.h
+ *
+ * Low-overhead tracing, switched on and off at compile time.
+ * See trace.c for details.
+ *
+ * Usage:
+ *
+ *   #define TRACE_LEVEL TRACE_LEVEL_INFO    (or compile with -DTRACE_LEVEL=3)
+ *   #include "trace.h"
+ *
+ *   trace_start( "run.trace" );
+ *   TRACE_BEGIN( TRACE_LEVEL_INFO, "solve" );
+ *   TRACE_COUNTER( TRACE_LEVEL_DEBUG, "queue length", n );
+ *   TRACE_END( TRACE_LEVEL_INFO, "solve" );
+ *   trace_stop();
+ *
+ * Event names must be string literals (or otherwise live for the whole run):
+ * only the pointer is recorded when the event happens.
+ *
+ *****************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define  TRACE_LEVEL_OFF    0
+#define  TRACE_LEVEL_ERROR  1
+#define  TRACE_LEVEL_WARN   2
+#define  TRACE_LEVEL_INFO   3
+#define  TRACE_LEVEL_DEBUG  4
+
+/* Anything above TRACE_LEVEL is removed by the preprocessor, so it costs
+   nothing at all. By default, that's everything.
+*/
+#ifndef TRACE_LEVEL
+#define  TRACE_LEVEL  TRACE_LEVEL_OFF
+#endif
+
+// The kinds of event (the same letters the Chrome trace format uses)
+#define  TRACE_PHASE_BEGIN    'B'
+#define  TRACE_PHASE_END      'E'
+#define  TRACE_PHASE_INSTANT  'i'
+#define  TRACE_PHASE_COUNTER  'C'
+
+/* The level is compared with TRACE_LEVEL using a plain "if" on two constants,
+   which the compiler throws away (along with the call) when it's false.
+*/
+#define  TRACE_EVENT(level, phase, name, arg) \
+    do { if ((level) <= TRACE_LEVEL) trace_event( (level), (phase), (name), (arg) ); } while (0)
+
+#define  TRACE_BEGIN(level, name)           TRACE_EVENT( (level), TRACE_PHASE_BEGIN,   (name), 0 )
+#define  TRACE_END(level, name)             TRACE_EVENT( (level), TRACE_PHASE_END,     (name), 0 )
+#define  TRACE_INSTANT(level, name, arg)    TRACE_EVENT( (level), TRACE_PHASE_INSTANT, (name), (arg) )
+#define  TRACE_COUNTER(level, name, value)  TRACE_EVENT( (level), TRACE_PHASE_COUNTER, (name), (value) )
+
+// What gets written to the trace file, one record per event
+struct trace_record
+{
+    uint8_t  type;      // one of the phases above, or TRACE_RECORD_NAME/CLOCK
+    uint8_t  level;
+    uint16_t pad;
+    uint32_t tid;       // which thread (numbered 1, 2, ... in order of first event)
+    uint64_t ts;        // a timestamp (see TRACE_CLOCK_*)
+    uint64_t name;      // an id for the name, defined in an earlier NAME record
+    int64_t  arg;       // for counters, the value; for NAME records, the length
+};
+
+#define  TRACE_RECORD_NAME   'N'  // followed by the name itself, padded to 8 bytes
+#define  TRACE_RECORD_CLOCK  'K'  // ts is a timestamp, and arg the same moment in ns;
+                                  // there's one at the start and one at the end
+#define  TRACE_RECORD_DROP   'D'  // arg events were lost from thread tid's buffer
+
+#define  TRACE_MAGIC        "CTRACE1"
+#define  TRACE_CLOCK_NS     0     // timestamps are CLOCK_MONOTONIC nanoseconds
+#define  TRACE_CLOCK_TSC    1     // timestamps are rdtsc ticks
+
+struct trace_header
+{
+    char     magic[8];
+    uint32_t clock;
+    uint32_t record_size;
+};
+
+int  trace_start( const char * );
+void trace_stop();
+void trace_event( int, int, const char *, int64_t );
+
+#endif
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * trace2json.c
+ *
+ * Converts a binary trace file written by trace.c into the JSON "Trace Event
+ * Format" understood by chrome://tracing and https://ui.perfetto.dev.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+struct name
+{
+    uint64_t id;
+    char *text;
+};
+
+static struct name *names;
+static size_t nnames;
+
+
+static const char *lookup( uint64_t id )
+{
+    for (size_t i = nnames; i > 0; i--)    // recent names are the likeliest
+        if (names[i-1].id == id)
+            return names[i-1].text;
+    return "?";
+}
+
+
+static void print_json_string( FILE *f, const char *s )
+{
+    fputc( '"', f );
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc( '\\', f );
+        if ((unsigned char)*s < 0x20)
+            fprintf( f, "\\u%04x", *s );
+        else
+            fputc( *s, f );
+    }
+    fputc( '"', f );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 3)
+    {
+        printf( "usage: trace2json [trace file] [json file]\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *in = fopen( argv[1], "rb" );
+    FILE *out = fopen( argv[2], "w" );
+    if (in == NULL || out == NULL)
+    {
+        fprintf( stderr, "error: could not open %s or %s\n", argv[1], argv[2] );
+        exit(EXIT_FAILURE);
+    }
+
+    struct trace_header h;
+    if (fread( &h, sizeof(h), 1, in ) != 1 || memcmp( h.magic, TRACE_MAGIC, 8 ) != 0 ||
+        h.record_size != sizeof(struct trace_record))
+    {
+        fprintf( stderr, "error: %s is not a trace file\n", argv[1] );
+        exit(EXIT_FAILURE);
+    }
+
+    /* The two CLOCK records (one at the start and one at the end) tell us
+       how fast the clock ticks, and give us a starting time to measure
+       from. They're at either end of the file, so that means reading it
+       twice.
+    */
+    struct trace_record r;
+    int nclocks = 0;
+    uint64_t ticks[2] = { 0 }, ns[2] = { 0 };
+    while (fread( &r, sizeof(r), 1, in ) == 1)
+    {
+        if (r.type == TRACE_RECORD_CLOCK)
+        {
+            int which = (nclocks++ == 0 ? 0 : 1);
+            ticks[which] = r.ts;
+            ns[which] = r.arg;
+        }
+        if (r.type == TRACE_RECORD_NAME)
+            fseek( in, (r.arg + 7) / 8 * 8, SEEK_CUR );
+    }
+    double ns_per_tick = 1.0;
+    if (h.clock == TRACE_CLOCK_TSC && nclocks >= 2 && ticks[1] > ticks[0])
+        ns_per_tick = (double)(ns[1] - ns[0]) / (ticks[1] - ticks[0]);
+    fseek( in, sizeof(h), SEEK_SET );
+
+    uint64_t nevents = 0, ndropped = 0;
+    int first = 1;
+
+    fprintf( out, "{\"traceEvents\":[\n" );
+    while (fread( &r, sizeof(r), 1, in ) == 1)
+    {
+        switch (r.type)
+        {
+            case TRACE_RECORD_NAME:
+                names = realloc( names, (nnames + 1) * sizeof(struct name) );
+                names[nnames].id = r.name;
+                names[nnames].text = calloc( (r.arg + 7) / 8 * 8 + 1, 1 );
+                if (fread( names[nnames].text, 1, (r.arg + 7) / 8 * 8, in ) == 0 && r.arg > 0)
+                    names[nnames].text[0] = '\0';
+                names[nnames].text[r.arg] = '\0';
+                nnames++;
+                break;
+            case TRACE_RECORD_CLOCK:
+                break;
+            case TRACE_RECORD_DROP:
+                ndropped += r.arg;
+                break;
+            default:
+            {
+                // Chrome wants microseconds, which we count from trace_start()
+                double us = ((int64_t)(r.ts - ticks[0]) * ns_per_tick) / 1000.0;
+                fprintf( out, "%s{\"name\":", first ? "" : ",\n" );
+                print_json_string( out, lookup( r.name ) );
+                fprintf( out, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                         r.type, us, r.tid );
+                if (r.type == TRACE_PHASE_COUNTER)
+                    fprintf( out, ",\"args\":{\"value\":%lld}", (long long)r.arg );
+                else if (r.type == TRACE_PHASE_INSTANT)
+                    fprintf( out, ",\"s\":\"t\",\"args\":{\"arg\":%lld}", (long long)r.arg );
+                fprintf( out, "}" );
+                first = 0;
+                nevents++;
+            }
+        }
+    }
+    fprintf( out, "\n]}\n" );
+
+    fclose( in );
+    fclose( out );
+
+    fprintf( stderr, "%llu events written to %s", (unsigned long long)nevents, argv[2] );
+    if (ndropped > 0)
+        fprintf( stderr, " (%llu dropped because a buffer was full)", (unsigned long long)ndropped );
+    fprintf( stderr, "\n" );
+
+    return EXIT_SUCCESS;
+}
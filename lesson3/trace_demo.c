@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * C Mini-tutorial
+ * ---------------
+ *
+ * A demonstration of trace.c: it times the Collatz chains of q14-openmp.c,
+ * with every thread recording when it starts and finishes each block of
+ * numbers. Compile it with different TRACE_LEVELs (see Makefile-trace) to
+ * see that the disabled events cost nothing:
+ *
+ *   $ make -f Makefile-trace
+ *   $ ./trace_demo demo.trace          <-- TRACE_LEVEL_DEBUG: every block
+ *   $ ./trace2json demo.trace demo.json
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <omp.h>
+
+#include "trace.h"
+
+#define  N      1000000
+#define  BLOCK  10000
+
+static int collatz_length( long x )
+{
+    int l = 0;
+    while (x != 1)
+    {
+        x = (x % 2 == 0 ? x >> 1 : 3*x + 1);
+        l++;
+    }
+    return l;
+}
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 2)
+    {
+        printf( "usage: trace_demo [trace file]\n" );
+        exit(EXIT_FAILURE);
+    }
+
+    if (trace_start( argv[1] ) != 0)
+    {
+        fprintf( stderr, "error: could not open %s\n", argv[1] );
+        exit(EXIT_FAILURE);
+    }
+
+    double start = omp_get_wtime();
+    TRACE_BEGIN( TRACE_LEVEL_INFO, "search" );
+
+    long best = 1;
+    int best_length = 0;
+    long b;
+#pragma omp parallel for schedule(dynamic)
+    for (b = 1; b < N; b += BLOCK)
+    {
+        TRACE_BEGIN( TRACE_LEVEL_DEBUG, "block" );
+        long i, block_best = b;
+        int block_length = -1;
+        for (i = b; i < b + BLOCK && i < N; i++)
+        {
+            int l = collatz_length( i );
+            if (l > block_length)
+            {
+                block_length = l;
+                block_best = i;
+            }
+        }
+
+        // Only one visit per block to the shared answer (a critical section
+        // for every start would take longer than the search itself)
+#pragma omp critical
+        if (block_length > best_length || (block_length == best_length && block_best < best))
+        {
+            best_length = block_length;
+            best = block_best;
+            TRACE_COUNTER( TRACE_LEVEL_INFO, "longest chain", block_length );
+        }
+        TRACE_END( TRACE_LEVEL_DEBUG, "block" );
+    }
+
+    TRACE_END( TRACE_LEVEL_INFO, "search" );
+    double elapsed = omp_get_wtime() - start;
+
+    trace_stop();
+
+    printf( "%ld (chain length %d), found in %.3f s\n", best, best_length, elapsed );
+    return EXIT_SUCCESS;
+}
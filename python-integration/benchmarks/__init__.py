@@ -0,0 +1,21 @@
+"""
+Benchmarks for the C functions in cfunctions.c.
+
+The demo scripts show *how* to call C from Python; this package measures
+how *fast* those calls are. Every exported function is timed through each
+of the ways we know how to reach it:
+
+  ctypes     -- cfunctions.so built with Makefile-cfunctions, loaded by hand
+  extension  -- the same code built and installed as part of mypackage
+  numpy      -- functions that take ndpointer arrays (bulk work per call)
+
+over a sweep of sizes, reporting per-call latency and throughput.
+
+Run it standalone (from the python-integration directory):
+
+    $ python -m benchmarks --json results.json
+
+or under pytest-benchmark:
+
+    $ pytest benchmarks/bench_pytest.py --benchmark-json=results.json
+"""
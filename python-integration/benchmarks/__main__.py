@@ -0,0 +1,79 @@
+"""
+Standalone benchmark runner:
+
+    $ python -m benchmarks [--filter NAME] [--json FILE] [--profile NAME]
+
+Results go to stdout as a table, and (with --json) to a file that can be
+kept around and compared against later runs.
+"""
+import argparse
+import cProfile
+import json
+import pstats
+import sys
+import time
+
+from . import cases
+from . import runner
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(prog="python -m benchmarks",
+                                     description=__doc__.split("\n\n")[0])
+    parser.add_argument("--filter", default="",
+                        help="only run cases whose name contains this")
+    parser.add_argument("--json", metavar="FILE",
+                        help="write the results to FILE as JSON")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="repeats per measurement (the best is kept)")
+    parser.add_argument("--min-time", type=float, default=0.2,
+                        help="minimum seconds per repeat")
+    parser.add_argument("--profile", metavar="NAME",
+                        help="instead of timing, run cProfile over the "
+                             "largest size of each matching case")
+    args = parser.parse_args(argv)
+
+    selected = [c for c in cases.all_cases()
+                if (args.profile or args.filter) in c.name]
+    if not selected:
+        sys.exit("no benchmark cases found (did you build cfunctions.so "
+                 "or install mypackage?)")
+
+    if args.profile:
+        for case in selected:
+            profile(case)
+        return
+
+    results = []
+    print("%-32s %10s %14s %14s %12s" % ("case", "size", "ns/call", "items/s", "MB/s"))
+    for case in selected:
+        for size in case.sizes:
+            r = runner.run_case(case, size, args.repeat, args.min_time)
+            results.append(r)
+            mbps = r.get("bytes_per_sec", 0) / 1e6
+            print("%-32s %10d %14.1f %14.4g %12s" % (
+                case.name, size, r["ns_per_call"], r["items_per_sec"],
+                "%.1f" % mbps if mbps else "-"))
+            sys.stdout.flush()
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"metadata": runner.metadata(), "results": results}, f, indent=1)
+
+
+def profile(case, seconds=2.0):
+    size = case.sizes[-1]
+    fn = case.make(size)
+    print("=== %s, size %d" % (case.name, size))
+    prof = cProfile.Profile()
+    with runner.quiet_stdout():
+        end = time.perf_counter() + seconds
+        prof.enable()
+        while time.perf_counter() < end:
+            fn()
+        prof.disable()
+    pstats.Stats(prof).sort_stats("cumulative").print_stats(10)
+
+
+if __name__ == "__main__":
+    main()
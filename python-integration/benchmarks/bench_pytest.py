@@ -0,0 +1,23 @@
+"""
+The same cases as `python -m benchmarks`, but as pytest-benchmark tests:
+
+    $ pytest benchmarks/bench_pytest.py --benchmark-json=results.json
+"""
+import pytest
+
+from benchmarks import cases
+from benchmarks.runner import quiet_stdout
+
+
+PARAMS = [(c, size) for c in cases.all_cases() for size in c.sizes]
+
+
+@pytest.mark.parametrize("case,size", PARAMS,
+                         ids=["%s-%d" % (c.name, size) for c, size in PARAMS])
+def test_binding(benchmark, case, size):
+    fn = case.make(size)
+    benchmark.extra_info["items_per_call"] = case.items(size)
+    if case.nbytes is not None:
+        benchmark.extra_info["bytes_per_call"] = case.nbytes(size)
+    with quiet_stdout():
+        benchmark(fn)
@@ -0,0 +1,264 @@
+"""
+The things to measure.
+
+A Case knows how to build a zero-argument callable for a given size, and
+how many items (and bytes) one call of it processes, so that the runner can
+report both per-call latency and throughput.
+"""
+import asyncio
+import ctypes as ctp
+import math
+import os
+import weakref
+
+from numpy.ctypeslib import ndpointer
+import numpy as np
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+CTYPES_LIBRARY = os.path.join(HERE, os.pardir, "cfunctions.so")
+
+
+class Result(ctp.Structure):
+    _fields_ = [
+        ("N", ctp.c_int),
+        ("L", ctp.c_float),
+    ]
+
+
+def load_ctypes(path=CTYPES_LIBRARY):
+    """Load cfunctions.so directly and give every function its signature."""
+    lib = ctp.cdll.LoadLibrary(path)
+    _bytes = ndpointer(np.uint8, flags='C_CONTIGUOUS')
+    _offsets = ndpointer(np.int64, flags='C_CONTIGUOUS')
+
+    lib.fib.restype = ctp.c_int
+    lib.fib.argtypes = [ctp.c_int]
+    lib.weird_function.restype = ctp.c_double
+    lib.weird_function.argtypes = [ctp.c_int, ctp.c_float, ctp.c_char]
+    lib.hello.argtypes = [ctp.c_char_p]
+    lib.simulate.restype = Result
+    lib.simulate.argtypes = [ctp.c_float, ctp.c_float]
+    lib.fib_sequence.argtypes = [ctp.c_int, ndpointer(np.uint64), ndpointer(np.uint64)]
+    lib.simulate_sweep.argtypes = [ctp.c_int] + [
+        ndpointer(t, flags='C_CONTIGUOUS') for t in (np.float32, np.float32, np.int32, np.float32)]
+    lib.simulate_sweep_double.argtypes = [ctp.c_int] + [
+        ndpointer(t, flags='C_CONTIGUOUS') for t in (np.float64, np.float64, np.int64, np.float64)]
+    lib.simulate_grid.argtypes = [ctp.c_float, ctp.c_float, ctp.c_int,
+                                  ctp.c_float, ctp.c_float, ctp.c_int] + [
+        ndpointer(t, flags='C_CONTIGUOUS') for t in (np.int32, np.float32)]
+    lib.simulate_grid_double.argtypes = [ctp.c_double, ctp.c_double, ctp.c_int,
+                                         ctp.c_double, ctp.c_double, ctp.c_int] + [
+        ndpointer(t, flags='C_CONTIGUOUS') for t in (np.int64, np.float64)]
+    lib.hello_batch.restype = ctp.c_int64
+    lib.hello_batch.argtypes = [ctp.c_int, _bytes, _offsets, _bytes, ctp.c_int64]
+    lib.hello_batch_fd.restype = ctp.c_int64
+    lib.hello_batch_fd.argtypes = [ctp.c_int, ctp.c_int, _bytes, _offsets]
+    return lib
+
+
+def load_extension():
+    import mypackage
+    return mypackage
+
+
+def backends():
+    """The backends that are actually available, as a {name: module} dict."""
+    found = {}
+    try:
+        found["ctypes"] = load_ctypes()
+    except OSError:
+        pass
+    try:
+        found["extension"] = load_extension()
+    except (ImportError, IndexError):
+        pass
+    return found
+
+
+class Case(object):
+    def __init__(self, function, path, sizes, make, items=None, nbytes=None):
+        self.function = function
+        self.path = path
+        self.sizes = sizes
+        self.make = make                        # make(size) -> callable
+        self.items = items or (lambda size: 1)  # items processed per call
+        self.nbytes = nbytes                    # bytes produced per call
+
+    @property
+    def name(self):
+        return "%s[%s]" % (self.function, self.path)
+
+
+def _names(n):
+    names = ["name%d" % i for i in range(n)]
+    encoded = [s.encode() for s in names]
+    offsets = np.zeros(n + 1, dtype=np.int64)
+    np.cumsum([len(e) for e in encoded], out=offsets[1:])
+    return np.frombuffer(b"".join(encoded), dtype=np.uint8), offsets
+
+
+def _batch_size(names, offsets):
+    return int(offsets[-1] - offsets[0]) + (len(offsets) - 1) * len("Hello, !\n")
+
+
+def scalar_cases(path, lib):
+    """One C call per Python call: this is all ctypes overhead."""
+    return [
+        Case("fib", path, [1, 10, 46],
+             lambda n: lambda: lib.fib(n)),
+        Case("weird_function", path, [1],
+             lambda n: lambda: lib.weird_function(n, 2.5, b'y')),
+        Case("simulate", path, [1],
+             lambda n: lambda: lib.simulate(12.0, 0.1)),
+        Case("hello", path, [8, 64, 1024],
+             lambda n: (lambda name: lambda: lib.hello(name))(b"x" * n)),
+    ]
+
+
+def numpy_cases(path, lib):
+    """Functions that do a whole array's worth of work in one call."""
+    devnull = os.open(os.devnull, os.O_WRONLY)
+
+    def fib_sequence(n):
+        seq0 = np.empty(n, dtype=np.uint64)
+        seq1 = np.empty(n, dtype=np.uint64)
+        return lambda: lib.fib_sequence(n, seq0, seq1)
+
+    def hello_batch(n):
+        names, offsets = _names(n)
+        out = np.empty(_batch_size(names, offsets), dtype=np.uint8)
+        return lambda: lib.hello_batch(n, names, offsets, out, len(out))
+
+    def hello_batch_fd(n):
+        names, offsets = _names(n)
+        return lambda: lib.hello_batch_fd(devnull, n, names, offsets)
+
+    def simulate_sweep(ftype, itype, sweep):
+        def make(n):
+            L = np.linspace(1.0, 100.0, n).astype(ftype)
+            dx = np.full(n, 0.01, dtype=ftype)
+            N_out = np.empty(n, dtype=itype)
+            L_out = np.empty(n, dtype=ftype)
+            return lambda: sweep(n, L, dx, N_out, L_out)
+        return make
+
+    def simulate_grid(ftype, itype, grid):
+        # A k x k grid, where k*k is the size
+        def make(n):
+            k = math.isqrt(n)
+            N_out = np.empty((k, k), dtype=itype)
+            L_out = np.empty((k, k), dtype=ftype)
+            return lambda: grid(1.0, 0.1, k, 0.01, 0.001, k, N_out, L_out)
+        return make
+
+    nbytes = lambda n: _batch_size(*_names(n))
+    sizes = [1, 100, 10000, 1000000]
+
+    # fib_sequence calls fib(fib(i)), which is a loop of fib(i) iterations,
+    # so its cost explodes with n (and fib(i) overflows an int past n=46).
+    return [
+        Case("fib_sequence", path, [5, 10, 20, 25], fib_sequence, items=lambda n: n),
+        Case("simulate_sweep", path, sizes,
+             simulate_sweep(np.float32, np.int32, lib.simulate_sweep), items=lambda n: n),
+        Case("simulate_sweep_double", path, sizes,
+             simulate_sweep(np.float64, np.int64, lib.simulate_sweep_double), items=lambda n: n),
+        Case("simulate_grid", path, sizes,
+             simulate_grid(np.float32, np.int32, lib.simulate_grid), items=lambda n: n),
+        Case("simulate_grid_double", path, sizes,
+             simulate_grid(np.float64, np.int64, lib.simulate_grid_double), items=lambda n: n),
+        Case("hello_batch", path, sizes, hello_batch, items=lambda n: n, nbytes=nbytes),
+        Case("hello_batch_fd", path, sizes, hello_batch_fd, items=lambda n: n, nbytes=nbytes),
+    ]
+
+
+def _close_pool(pool, loop):
+    pool.close()
+    loop.close()
+
+
+def wrapper_cases(pkg):
+    """mypackage's pure-Python wrappers, including their packing overhead."""
+    shm_name = "/benchmarks-%d" % os.getpid()
+
+    def hello_many(n):
+        names = ["name%d" % i for i in range(n)]
+        return lambda: pkg.hello_many(names)
+
+    def simulate_many(n):
+        L = np.linspace(1.0, 100.0, n)
+        return lambda: pkg.simulate_many(L, 0.01)
+
+    def simulate_range(n):
+        k = math.isqrt(n)
+        return lambda: pkg.simulate_range(1.0, 0.1, k, 0.01, 0.001, k)
+
+    def shared_empty(n):
+        # Create, map and remove a new array each call
+        def fn():
+            pkg.shared_empty(shm_name, (n,))
+            pkg.shared_unlink(shm_name)
+        return fn
+
+    def shared_open(n):
+        # Map an array that already exists (as a worker process would)
+        pkg.shared_empty(shm_name, (n,))
+        fn = lambda: pkg.shared_open(shm_name)
+        weakref.finalize(fn, pkg.shared_unlink, shm_name)
+        return fn
+
+    def job_pool(n):
+        # Submitting a job and awaiting it, on an event loop of its own
+        loop = asyncio.new_event_loop()
+        pool = pkg.JobPool(loop=loop)
+
+        async def run():
+            return await pool.fib_sequence(n)
+        fn = lambda: loop.run_until_complete(run())
+        weakref.finalize(fn, _close_pool, pool, loop)
+        return fn
+
+    sizes = [1, 100, 10000, 1000000]
+
+    return [
+        Case("hello_many", "extension", sizes, hello_many,
+             items=lambda n: n, nbytes=lambda n: _batch_size(*_names(n))),
+        Case("simulate_many", "extension", sizes, simulate_many, items=lambda n: n),
+        Case("simulate_range", "extension", sizes, simulate_range, items=lambda n: n),
+        # The shared arrays and Matrix() are only mapped or allocated, never
+        # touched, so it's the time per call that counts for these
+        Case("shared_empty", "extension", [1, 10000, 1000000], shared_empty),
+        Case("shared_open", "extension", [1, 10000, 1000000], shared_open),
+        # Like fib_sequence above, but in a JobPool thread: the difference is
+        # the cost of the round trip through the pool and the event loop
+        Case("JobPool.fib_sequence", "extension", [5, 10, 20, 25], job_pool,
+             items=lambda n: n),
+        Case("Matrix", "extension", [1, 100, 1000],
+             lambda n: lambda: pkg.Matrix(n, n)),
+        Case("Matrix.ripples", "extension", [1, 100, 1000],
+             lambda n: lambda: pkg.Matrix.ripples(n, n),
+             items=lambda n: n * n, nbytes=lambda n: n * n * 8),
+        # Views of an existing matrix: these should cost the same at any size
+        Case("asarray(Matrix)", "extension", [1, 1000],
+             lambda n: (lambda m: lambda: np.asarray(m))(pkg.Matrix(n, n))),
+        Case("from_dlpack(Matrix)", "extension", [1, 1000],
+             lambda n: (lambda m: lambda: np.from_dlpack(m))(pkg.Matrix(n, n))),
+        # fib_big(n) is exact for any n (fib(n) stops being right at 47)
+        Case("fib_big", "extension", [46, 10000, 1000000, 10000000],
+             lambda n: lambda: pkg.fib_big(n)),
+        Case("fib_big_str", "extension", [10000, 1000000],
+             lambda n: lambda: pkg.fib_big_str(n)),
+        # decimal_str(3**n), which has about 0.48*n digits
+        Case("decimal_str", "extension", [1000, 100000, 1000000],
+             lambda n: (lambda x: lambda: pkg.decimal_str(x))(3 ** n)),
+    ]
+
+
+def all_cases():
+    cases = []
+    for path, lib in backends().items():
+        cases += scalar_cases(path, lib)
+        cases += numpy_cases("numpy-" + path, lib)
+        if path == "extension":
+            cases += wrapper_cases(lib)
+    return cases
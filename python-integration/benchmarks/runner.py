@@ -0,0 +1,75 @@
+"""
+Time the cases in cases.py and collect the results.
+"""
+import contextlib
+import ctypes as ctp
+import datetime
+import os
+import platform
+import sys
+import timeit
+
+import numpy as np
+
+
+@contextlib.contextmanager
+def quiet_stdout():
+    """Send file descriptor 1 to /dev/null, so that C's printf() doesn't
+    flood the terminal (or cost us terminal rendering time)."""
+    sys.stdout.flush()
+    saved = os.dup(1)
+    devnull = os.open(os.devnull, os.O_WRONLY)
+    os.dup2(devnull, 1)
+    try:
+        yield
+    finally:
+        ctp.CDLL(None).fflush(None)   # empty C's stdio buffers into /dev/null
+        os.dup2(saved, 1)
+        os.close(saved)
+        os.close(devnull)
+
+
+def measure(fn, repeat=5, min_time=0.2):
+    """Return (calls per repeat, best seconds per call) for fn()."""
+    timer = timeit.Timer(fn)
+    number = 1
+    while True:                       # like Timer.autorange(), but with min_time
+        elapsed = timer.timeit(number)
+        if elapsed >= min_time or number >= 10**7:
+            break
+        number *= 10 if elapsed < min_time / 10 else 2
+    best = min(timer.repeat(repeat, number)) / number
+    return number, best
+
+
+def run_case(case, size, repeat=5, min_time=0.2):
+    fn = case.make(size)
+    with quiet_stdout():
+        calls, seconds = measure(fn, repeat, min_time)
+
+    items = case.items(size)
+    record = {
+        "function": case.function,
+        "path": case.path,
+        "size": size,
+        "calls": calls,
+        "repeat": repeat,
+        "ns_per_call": seconds * 1e9,
+        "items_per_call": items,
+        "items_per_sec": items / seconds,
+    }
+    if case.nbytes is not None:
+        record["bytes_per_sec"] = case.nbytes(size) / seconds
+    return record
+
+
+def metadata():
+    return {
+        "timestamp": datetime.datetime.now(datetime.timezone.utc).isoformat(),
+        "python": platform.python_version(),
+        "numpy": np.__version__,
+        "platform": platform.platform(),
+        "machine": platform.machine(),
+        "processor": platform.processor(),
+        "cpus": os.cpu_count(),
+    }
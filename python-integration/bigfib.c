@@ -0,0 +1,762 @@
+/*
+  bigfib.c -- exact Fibonacci numbers of any size
+
+  Used in mypackage (fib_big, fib_big_str). fib() in cfunctions.c returns
+  an int, so it is wrong from F(47) on; F(n) has about 0.694*n bits, and
+  for n in the millions it only fits in a number spread over many words.
+
+  A number here is an array of 64-bit "limbs", least significant first
+  (so a number is written in base 2^64, the way we write decimal numbers
+  in base 10). F(n) comes from "fast doubling":
+
+    F(2k-1) = F(k)^2 + F(k-1)^2
+    F(2k+1) = 4F(k)^2 - F(k-1)^2 + 2(-1)^k
+    F(2k)   = F(2k+1) - F(2k-1)
+
+  which gets from the pair F(k), F(k-1) to F(2k), F(2k-1) or F(2k+1), F(2k)
+  with two squarings, walking down the bits of n. Nearly all the time goes
+  into the last few squarings, so the multiplication is what matters, and
+  the best way to multiply depends on how big the numbers are:
+
+    - small:  schoolbook, limb by limb, as on paper          O(n^2)
+    - medium: Karatsuba, three half-size products for four    O(n^1.58)
+    - large:  a number-theoretic transform (an FFT done in    O(n log n)
+              modular arithmetic, so it is exact)
+
+  The transform splits and works through its stages in parallel (OpenMP)
+  once it is big enough for that to pay; bigfib_set_threads() limits it.
+
+  Decimal output needs the number divided by powers of ten, which is slow
+  one digit (or one 19-digit limb) at a time -- quadratic. big_to_decimal
+  instead divides by 10^(19*2^k) to split the number into two halves with
+  the same number of digits, and recurses on both; each division is done
+  with a precomputed reciprocal, so it costs a couple of multiplications.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bigfib.h"
+
+typedef uint64_t limb;
+typedef unsigned __int128 dlimb;
+
+// Crossovers between the multiplications (in limbs of the shorter number)
+#define KARATSUBA_MIN  32
+#define NTT_MIN        2500
+
+// Transforms at least this long are split between threads
+#define PARALLEL_NTT   (1 << 15)
+
+static int nthreads = 0;   // 0 = as many as OpenMP likes
+
+
+void bigfib_set_threads(int n){
+  // Use at most n threads to multiply (0 = OpenMP's default, 1 = none)
+  nthreads = n < 0 ? 0 : n;
+}
+
+static int threads(void){
+#ifdef _OPENMP
+  return nthreads > 0 ? nthreads : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void bigfib_free(void *p){
+  free(p);
+}
+
+
+/* Limb arrays
+   -----------
+   The low-level functions take (pointer, length) pairs and never allocate;
+   the result r must not overlap an input unless stated. */
+
+static size_t norm(const limb *a, size_t n){
+  // Length of a without its leading zero limbs
+  while (n > 0 && a[n-1] == 0) n--;
+  return n;
+}
+
+static int cmp(const limb *a, size_t an, const limb *b, size_t bn){
+  an = norm(a, an);
+  bn = norm(b, bn);
+  if (an != bn) return an < bn ? -1 : 1;
+  while (an-- > 0)
+    if (a[an] != b[an]) return a[an] < b[an] ? -1 : 1;
+  return 0;
+}
+
+static limb add(limb *r, const limb *a, size_t an, const limb *b, size_t bn){
+  // r = a + b, an >= bn, r has an limbs (and may be a). Returns the carry.
+  limb c = 0;
+  for (size_t i=0; i<bn; i++){
+    limb s = a[i] + c;
+    c = s < c;
+    limb t = s + b[i];
+    c += t < s;
+    r[i] = t;
+  }
+  for (size_t i=bn; i<an; i++){
+    limb s = a[i] + c;
+    c = s < c;
+    r[i] = s;
+  }
+  return c;
+}
+
+static limb sub(limb *r, const limb *a, size_t an, const limb *b, size_t bn){
+  // r = a - b, an >= bn, r has an limbs (and may be a). Returns the borrow.
+  limb c = 0;
+  for (size_t i=0; i<bn; i++){
+    limb d = a[i] - b[i];
+    limb c2 = a[i] < b[i];
+    r[i] = d - c;
+    c = c2 | (d < c);
+  }
+  for (size_t i=bn; i<an; i++){
+    limb d = a[i];
+    r[i] = d - c;
+    c = d < c;
+  }
+  return c;
+}
+
+static limb addmul_1(limb *r, const limb *a, size_t n, limb b){
+  // r += a * b over n limbs. Returns the limb carried out of the top.
+  dlimb c = 0;
+  for (size_t i=0; i<n; i++){
+    c += (dlimb)a[i] * b + r[i];
+    r[i] = (limb)c;
+    c >>= 64;
+  }
+  return (limb)c;
+}
+
+static int mul(limb *r, const limb *a, size_t an, const limb *b, size_t bn);
+
+static void mul_schoolbook(limb *r, const limb *a, size_t an, const limb *b, size_t bn){
+  memset(r, 0, an * sizeof(limb));
+  for (size_t j=0; j<bn; j++)
+    r[an+j] = addmul_1(r+j, a, an, b[j]);
+}
+
+static int mul_karatsuba(limb *r, const limb *a, size_t an, const limb *b, size_t bn){
+  // bn <= an < 2*bn. With a = a1*X + a0, b = b1*X + b0 (X = 2^(64m)),
+  //   a*b = a1*b1*X^2 + ((a0+a1)(b0+b1) - a0*b0 - a1*b1)*X + a0*b0
+  // which is three multiplications of half the size instead of four.
+  size_t m = an / 2;
+  const limb *a0 = a, *a1 = a + m, *b0 = b, *b1 = b + m;
+  size_t a1n = an - m, b1n = bn - m;       // a1n >= m, 1 <= b1n <= a1n
+
+  size_t san = a1n + 1, sbn = (b1n > m ? b1n : m) + 1;
+  limb *sa = malloc((san + sbn + san + sbn) * sizeof(limb));
+  if (sa == NULL) return -1;
+  limb *sb = sa + san, *z1 = sb + sbn;
+
+  int square = (a == b && an == bn);
+  sa[a1n] = add(sa, a1, a1n, a0, m);
+  if (b1n > m) sb[b1n] = add(sb, b1, b1n, b0, m);
+  else         sb[m] = add(sb, b0, m, b1, b1n);
+  san = norm(sa, san);
+  sbn = norm(sb, sbn);
+
+  if (mul(r, a0, m, b0, m) != 0 ||                  // a0*b0 -> r[0, 2m)
+      mul(r + 2*m, a1, a1n, b1, b1n) != 0 ||        // a1*b1 -> r[2m, an+bn)
+      (square ? mul(z1, sa, san, sa, san)           // a squaring stays one
+              : mul(z1, sa, san, sb, sbn)) != 0){
+    free(sa);
+    return -1;
+  }
+
+  size_t z1n = san + sbn;
+  sub(z1, z1, z1n, r, norm(r, 2*m));
+  sub(z1, z1, z1n, r + 2*m, norm(r + 2*m, an + bn - 2*m));
+  z1n = norm(z1, z1n);
+  add(r + m, r + m, an + bn - m, z1, z1n);
+  free(sa);
+  return 0;
+}
+
+static int mul_unbalanced(limb *r, const limb *a, size_t an, const limb *b, size_t bn){
+  // an >= 2*bn: multiply b by one bn-limb piece of a at a time
+  limb *t = malloc(2 * bn * sizeof(limb));
+  if (t == NULL) return -1;
+  memset(r, 0, (an + bn) * sizeof(limb));
+  for (size_t i=0; i<an; i+=bn){
+    size_t n = an - i < bn ? an - i : bn;
+    if (mul(t, a + i, n, b, bn) != 0){
+      free(t);
+      return -1;
+    }
+    add(r + i, r + i, an + bn - i, t, n + bn);
+  }
+  free(t);
+  return 0;
+}
+
+
+/* The number-theoretic transform
+   ------------------------------
+   An FFT multiplies two polynomials by evaluating them at the n-th roots
+   of unity, multiplying the values, and interpolating back. Doing it with
+   integers modulo the prime p = 2^64 - 2^32 + 1 instead of with complex
+   numbers makes it exact, and this p has roots of unity of every order up
+   to 2^32 and is cheap to reduce by.
+
+   The numbers are cut into b-bit digits, the coefficients of the
+   polynomials. A coefficient of the product is a sum of products of two
+   digits, one for each digit of the shorter number, and b is chosen as
+   large as it can be with that sum still below p, so nothing is lost:
+   from 25 bits for a few thousand limbs down to 16 bits (which is enough
+   for anything that fits in memory). */
+
+#define P    0xffffffff00000001ULL
+#define EPS  0xffffffffULL        // 2^64 - p
+
+// The conditional corrections are done with masks rather than ifs: on
+// random data a branch here is mispredicted half the time, which made the
+// whole transform twice as slow.
+#define MASK(c) (-(limb)(c))
+
+static inline limb mod_add(limb a, limb b){
+  limb s = a + b;
+  s += EPS & MASK(s < a);         // wrapped past 2^64
+  return s - (P & MASK(s >= P));
+}
+
+static inline limb mod_sub(limb a, limb b){
+  limb d = a - b;
+  return d - (EPS & MASK(a < b));
+}
+
+static inline limb mod_mul(limb a, limb b){
+  // 2^64 = 2^32 - 1 and 2^96 = -1 (mod p), so the 128-bit product
+  // lo + 2^64*hl + 2^96*hh reduces with a few adds and subtracts
+  dlimb x = (dlimb)a * b;
+  limb lo = (limb)x, hi = (limb)(x >> 64);
+  limb hh = hi >> 32, hl = hi & EPS;
+  limb t = lo - hh;
+  t -= EPS & MASK(lo < hh);
+  limb s = t + hl * EPS;
+  s += EPS & MASK(s < t);
+  return s - (P & MASK(s >= P));
+}
+
+static limb mod_pow(limb a, uint64_t e){
+  limb r = 1;
+  for (; e; e >>= 1, a = mod_mul(a, a))
+    if (e & 1) r = mod_mul(r, a);
+  return r;
+}
+
+static void roots(limb *w, size_t n){
+  // w[j] = g^j for j < n/2, g a primitive n-th root of unity.
+  // 7 generates the multiplicative group, so 7^((p-1)/n) has order n.
+  limb g = mod_pow(7, (P - 1) / n);
+  w[0] = 1;
+  for (size_t j=1; j<n/2; j++) w[j] = mod_mul(w[j-1], g);
+}
+
+static void invert_roots(limb *w, size_t n){
+  // Turn roots(w, n) into the powers of 1/g: g^-j = g^(n-j) = -g^(n/2-j)
+  for (size_t j=1; j<n/4; j++){
+    limb t = w[j]; w[j] = w[n/2 - j]; w[n/2 - j] = t;
+  }
+  for (size_t j=1; j<n/2; j++) w[j] = P - w[j];
+}
+
+static int log2_of(size_t n){
+  // log2(n), rounded up
+  int k = 0;
+  while (((size_t)1 << k) < n) k++;
+  return k;
+}
+
+static void ntt(limb *a, size_t n, const limb *w, int inverse){
+  // In-place transform of length n (a power of two). The forward one
+  // (decimation in frequency) leaves its output in bit-reversed order and
+  // the inverse (decimation in time) expects it that way, so neither has
+  // to shuffle the data. Each stage is n/2 independent butterflies, which
+  // the threads share out.
+  int logn = log2_of(n);
+  long half_n = n / 2;
+  #pragma omp parallel num_threads(threads()) if(n >= PARALLEL_NTT)
+  for (int s=0; s<logn; s++){
+    int lh = inverse ? s : logn - 1 - s;      // log2 of the half-length
+    size_t half = (size_t)1 << lh;
+    int shift = logn - 1 - lh;                // twiddle stride is 2^shift
+    #pragma omp for schedule(static)
+    for (long k=0; k<half_n; k++){
+      size_t j = k & (half - 1);
+      size_t i = ((k >> lh) << (lh + 1)) + j;
+      limb u = a[i], v = a[i + half], t = w[j << shift];
+      if (!inverse){
+        a[i] = mod_add(u, v);
+        a[i + half] = mod_mul(mod_sub(u, v), t);
+      }
+      else{
+        v = mod_mul(v, t);
+        a[i] = mod_add(u, v);
+        a[i + half] = mod_sub(u, v);
+      }
+    }
+  }
+}
+
+static int digit_bits(size_t an, size_t bn){
+  // The widest digits for which no coefficient of the product reaches p:
+  // a sum of d products below 2^2b is below 2^(2b + log2(d)) <= 2^63
+  size_t shorter = an < bn ? an : bn;
+  int b = 32;
+  while (2*b + log2_of((64*shorter + b - 1) / b) > 63) b--;
+  return b;
+}
+
+static size_t to_digits(limb *f, size_t n, const limb *a, size_t an, int b){
+  // Cut a into b-bit digits f[0..n), returning how many it took
+  limb mask = ((limb)1 << b) - 1;
+  dlimb bits = 0;
+  int have = 0;
+  size_t k = 0;
+  for (size_t i=0; i<an; i++){
+    bits |= (dlimb)a[i] << have;
+    have += 64;
+    for (; have >= b; have -= b, bits >>= b) f[k++] = (limb)bits & mask;
+  }
+  if (have > 0) f[k++] = (limb)bits;
+  memset(f + k, 0, (n - k) * sizeof(limb));
+  return k;
+}
+
+static int mul_ntt(limb *r, const limb *a, size_t an, const limb *b, size_t bn){
+  int square = (a == b && an == bn);
+  int bits = digit_bits(an, bn);
+  size_t da = (64*an + bits - 1) / bits, db = (64*bn + bits - 1) / bits;
+  size_t n = (size_t)1 << log2_of(da + db);
+  limb *fa = malloc(n * sizeof(limb));
+  limb *fb = square ? fa : malloc(n * sizeof(limb));
+  limb *w = malloc(n / 2 * sizeof(limb));
+  if (fa == NULL || fb == NULL || w == NULL){
+    free(w);
+    if (fb != fa) free(fb);
+    free(fa);
+    return -1;
+  }
+
+  roots(w, n);
+  to_digits(fa, n, a, an, bits);
+  ntt(fa, n, w, 0);
+  if (!square){
+    to_digits(fb, n, b, bn, bits);
+    ntt(fb, n, w, 0);
+  }
+  limb scale = mod_pow(n % P, P - 2);        // 1/n
+  for (size_t i=0; i<n; i++)
+    fa[i] = mod_mul(mod_mul(fa[i], fb[i]), scale);
+  invert_roots(w, n);
+  ntt(fa, n, w, 1);
+
+  // Each coefficient is exact now, but far bigger than a digit: add them
+  // up at their places, carrying as we go, and pack the digits into limbs
+  limb mask = ((limb)1 << bits) - 1;
+  dlimb carry = 0, out = 0;
+  int have = 0;
+  size_t k = 0;
+  for (size_t i=0; i<n; i++){
+    carry += fa[i];
+    out |= (dlimb)((limb)carry & mask) << have;
+    carry >>= bits;
+    have += bits;
+    if (have >= 64){
+      if (k < an + bn) r[k++] = (limb)out;
+      out >>= 64;
+      have -= 64;
+    }
+  }
+  for (; k < an + bn; out >>= 64) r[k++] = (limb)out;
+
+  free(w);
+  if (!square) free(fb);
+  free(fa);
+  return 0;
+}
+
+static int mul(limb *r, const limb *a, size_t an, const limb *b, size_t bn){
+  // r = a * b; r has an + bn limbs and overlaps neither a nor b. Returns 0,
+  // or -1 if there wasn't the memory for it (r is then garbage).
+  if (an < bn){
+    const limb *t = a; a = b; b = t;
+    size_t tn = an; an = bn; bn = tn;
+  }
+  if (bn == 0)                 memset(r, 0, an * sizeof(limb));
+  else if (bn < KARATSUBA_MIN) mul_schoolbook(r, a, an, b, bn);
+  else if (bn >= NTT_MIN)      return mul_ntt(r, a, an, b, bn);
+  else if (an >= 2*bn)         return mul_unbalanced(r, a, an, b, bn);
+  else                         return mul_karatsuba(r, a, an, b, bn);
+  return 0;
+}
+
+uint64_t *big_mul(const uint64_t *a, size_t an, const uint64_t *b, size_t bn){
+  // Returns a * b in a new array of an + bn limbs (free with bigfib_free),
+  // or NULL if out of memory
+  limb *r = malloc((an + bn ? an + bn : 1) * sizeof(limb));
+  if (r != NULL && mul(r, a, an, b, bn) != 0){
+    free(r);
+    r = NULL;
+  }
+  return r;
+}
+
+/* Fibonacci
+   --------- */
+
+uint64_t *bigfib(long n, size_t *nlimbs){
+  // Returns F(n) (n >= 0) as *nlimbs limbs, least significant first, in a
+  // new array to free with bigfib_free, or NULL if out of memory. F(0) = 0
+  // has no limbs.
+  if (n < 0) return NULL;
+
+  // F(n) < 2^(0.6943 n), so every number below fits in cap limbs
+  size_t cap = (size_t)(n * 0.6943 / 64) + 4;
+  limb *buf[4];
+  int failed = 0;
+  for (int i=0; i<4; i++)
+    failed |= (buf[i] = malloc(2 * cap * sizeof(limb))) == NULL;
+  if (failed){
+    for (int i=0; i<4; i++) free(buf[i]);
+    return NULL;
+  }
+
+  // fk = F(k), fk1 = F(k-1), starting from k = 1 (the top bit of n)
+  limb *fk = buf[0], *fk1 = buf[1], *x = buf[2], *y = buf[3];
+  size_t fkn = 1, fk1n = 0;
+  fk[0] = 1;
+  int k_odd = 1;
+
+  int top = 63;
+  while (top > 0 && !((unsigned long)n >> top & 1)) top--;
+  for (int bit=top-1; bit>=0 && n > 1; bit--){
+    // x = F(k)^2, y = F(k-1)^2
+    if (mul(x, fk, fkn, fk, fkn) != 0 || mul(y, fk1, fk1n, fk1, fk1n) != 0){
+      failed = 1;
+      break;
+    }
+    size_t xn = norm(x, 2*fkn), yn = norm(y, 2*fk1n);
+
+    // fk1 = F(2k-1) = x + y
+    memcpy(fk1, x, xn * sizeof(limb));
+    fk1[xn] = add(fk1, fk1, xn, y, yn);
+    fk1n = norm(fk1, xn + 1);
+
+    // x = F(2k+1) = 4x - y + 2(-1)^k
+    x[xn] = x[xn-1] >> 62;
+    for (size_t i=xn-1; i>0; i--) x[i] = x[i] << 2 | x[i-1] >> 62;
+    x[0] <<= 2;
+    xn++;
+    sub(x, x, xn, y, yn);
+    limb two = 2;
+    if (k_odd) sub(x, x, xn, &two, 1);
+    else       add(x, x, xn, &two, 1);
+    xn = norm(x, xn);
+
+    // y = F(2k) = F(2k+1) - F(2k-1)
+    sub(y, x, xn, fk1, fk1n);
+    yn = norm(y, xn);
+
+    limb *old = fk;
+    if ((unsigned long)n >> bit & 1){
+      // k -> 2k+1: (F(2k+1), F(2k))
+      fk = x;   fkn = xn;
+      x = fk1;  fk1 = y;  fk1n = yn;
+      y = old;
+      k_odd = 1;
+    }
+    else{
+      // k -> 2k: (F(2k), F(2k-1))
+      fk = y;   fkn = yn;
+      y = old;
+      k_odd = 0;
+    }
+  }
+  if (n == 0) fkn = 0;
+
+
+  limb *r = failed ? NULL : malloc((fkn ? fkn : 1) * sizeof(limb));
+  if (r != NULL){
+    memcpy(r, fk, fkn * sizeof(limb));
+    *nlimbs = fkn;
+  }
+  for (int i=0; i<4; i++) free(buf[i]);
+  return r;
+}
+
+/* Decimal
+   -------
+   Split x into 19*2^k-digit halves with one division by D = 10^(19*2^k):
+   x = q*D + r, and recurse on both. Dividing uses Barrett's trick: with
+   mu = floor(4^L/D), where D has L bits, q is at most two more than
+
+     ((x >> (L-1)) * mu) >> (L+1)
+
+   for any x < D^2. The reciprocals of the 10^(19*2^k) are each one Newton
+   step from the square of the one before, since D_k = D_(k-1)^2.
+
+   Everything here that allocates returns 0, or -1 if it ran out of memory
+   (having freed what it had so far, and left no number behind). */
+
+struct num{
+  limb *d;
+  size_t n;        // normalised length
+};
+
+#define NUM_NONE ((struct num){ NULL, 0 })
+
+struct level{
+  struct num D, mu;
+  size_t L;        // bits in D
+};
+
+static int num_new(struct num *x, size_t n){
+  // *x = n limbs, not yet set
+  x->d = malloc((n ? n : 1) * sizeof(limb));
+  x->n = n;
+  return x->d == NULL ? -1 : 0;
+}
+
+static size_t num_bits(struct num x){
+  return x.n ? 64*x.n - __builtin_clzll(x.d[x.n-1]) : 0;
+}
+
+static int num_mul(struct num *r, struct num a, struct num b){
+  if (num_new(r, a.n + b.n) != 0) return -1;
+  if (mul(r->d, a.d, a.n, b.d, b.n) != 0){
+    free(r->d);
+    *r = NUM_NONE;
+    return -1;
+  }
+  r->n = norm(r->d, r->n);
+  return 0;
+}
+
+static int num_shr(struct num *r, struct num a, size_t bits){
+  size_t w = bits / 64, s = bits % 64;
+  if (num_new(r, w >= a.n ? 0 : a.n - w) != 0) return -1;
+  for (size_t i=0; i<r->n; i++){
+    r->d[i] = a.d[i+w] >> s;
+    if (s && i+w+1 < a.n) r->d[i] |= a.d[i+w+1] << (64 - s);
+  }
+  r->n = norm(r->d, r->n);
+  return 0;
+}
+
+static int num_pow2(struct num *r, size_t bits){
+  if (num_new(r, bits/64 + 1) != 0) return -1;
+  memset(r->d, 0, r->n * sizeof(limb));
+  r->d[bits/64] = (limb)1 << (bits % 64);
+  return 0;
+}
+
+static void num_add_to(struct num *a, struct num b, size_t room){
+  // *a += b; a has room for room limbs
+  add(a->d, a->d, room, b.d, b.n);
+  a->n = norm(a->d, room);
+}
+
+static void num_sub_from(struct num *a, struct num b){
+  // *a -= b, b <= *a
+  sub(a->d, a->d, a->n, b.d, b.n);
+  a->n = norm(a->d, a->n);
+}
+
+static int num_copy(struct num *r, struct num a, size_t room){
+  if (num_new(r, room) != 0) return -1;
+  memcpy(r->d, a.d, a.n * sizeof(limb));
+  memset(r->d + a.n, 0, (room - a.n) * sizeof(limb));
+  r->n = a.n;
+  return 0;
+}
+
+static int reciprocal(struct level *l, const struct level *prev){
+  // l->mu = floor(4^L / D), starting from the square of prev->mu, which is
+  // right to about half of its bits; one Newton step doubles that, and the
+  // last few units are found by checking mu*D against 4^L
+  struct num S = NUM_NONE, sq = NUM_NONE, mu = NUM_NONE, T = NUM_NONE, e = NUM_NONE;
+  struct num me = NUM_NONE, corr = NUM_NONE, mu1 = NUM_NONE, t = NUM_NONE, mu2 = NUM_NONE;
+  struct num one = { (limb[]){ 1 }, 1 };
+  size_t room, mroom;
+  int below, err = -1;
+
+  if (num_pow2(&S, 2 * l->L) != 0 || num_mul(&sq, prev->mu, prev->mu) != 0 ||
+      num_shr(&mu, sq, 4*prev->L - 2*l->L) != 0)
+    goto out;
+
+  // mu += mu * (4^L - D*mu) / 4^L
+  if (num_mul(&T, l->D, mu) != 0) goto out;
+  below = cmp(T.d, T.n, S.d, S.n) <= 0;
+  if ((below ? num_copy(&e, S, S.n) : num_copy(&e, T, T.n)) != 0) goto out;
+  num_sub_from(&e, below ? T : S);
+  if (num_mul(&me, mu, e) != 0 || num_shr(&corr, me, 2 * l->L) != 0 ||
+      num_copy(&mu1, mu, mu.n + 1) != 0)
+    goto out;
+  if (below) num_add_to(&mu1, corr, mu.n + 1);
+  else       num_sub_from(&mu1, corr);
+
+  // Now within a few units: make it exact
+  room = S.n + l->D.n + 1;
+  mroom = mu1.n + 1;
+  free(T.d);
+  T = NUM_NONE;
+  if (num_mul(&t, l->D, mu1) != 0 || num_copy(&T, t, room) != 0 ||
+      num_copy(&mu2, mu1, mroom) != 0)
+    goto out;
+  while (cmp(T.d, T.n, S.d, S.n) > 0){
+    num_sub_from(&T, l->D);
+    num_sub_from(&mu2, one);
+  }
+  for (;;){
+    num_add_to(&T, l->D, room);
+    if (cmp(T.d, T.n, S.d, S.n) > 0) break;
+    num_add_to(&mu2, one, mroom);
+  }
+  l->mu = mu2;
+  mu2 = NUM_NONE;
+  err = 0;
+
+out:
+  free(S.d); free(sq.d); free(mu.d); free(T.d); free(e.d);
+  free(me.d); free(corr.d); free(mu1.d); free(t.d); free(mu2.d);
+  return err;
+}
+
+static int divrem(struct num x, const struct level *l, struct num *q, struct num *r){
+  // q, r = x / D, x % D for x < D^2
+  struct num t = NUM_NONE, tm = NUM_NONE, qd = NUM_NONE;
+  int err = -1;
+  *q = *r = NUM_NONE;
+
+  if (num_shr(&t, x, l->L - 1) != 0 || num_mul(&tm, t, l->mu) != 0 ||
+      num_shr(q, tm, l->L + 1) != 0 || num_mul(&qd, *q, l->D) != 0 ||
+      num_copy(r, x, x.n) != 0)
+    goto out;
+  num_sub_from(r, qd);
+  if (cmp(r->d, r->n, l->D.d, l->D.n) >= 0){
+    struct num one = { (limb[]){ 1 }, 1 };
+    size_t room = q->n + 1;
+    struct num q1;
+    if (num_copy(&q1, *q, room) != 0) goto out;
+    free(q->d);
+    *q = q1;
+    while (cmp(r->d, r->n, l->D.d, l->D.n) >= 0){
+      num_sub_from(r, l->D);
+      num_add_to(q, one, room);
+    }
+  }
+  err = 0;
+
+out:
+  free(t.d);
+  free(tm.d);
+  free(qd.d);
+  if (err){
+    free(q->d);
+    free(r->d);
+    *q = *r = NUM_NONE;
+  }
+  return err;
+}
+
+#define TEN19 10000000000000000000ULL
+
+static char *digits(char *out, struct num x, const struct level *lv, int k, int pad){
+  // Write x < 10^(19*2^(k+1)) in decimal at out, and return the end (NULL
+  // if out of memory). If pad, write exactly 19*2^(k+1) digits (leading
+  // zeros and all).
+  if (k == 0){
+    // Down to two limbs: x < 10^38
+    dlimb v = x.n == 0 ? 0 : x.n == 1 ? x.d[0] : (dlimb)x.d[1] << 64 | x.d[0];
+    unsigned long long hi = v / TEN19, lo = v % TEN19;
+    char tmp[40];
+    int len;
+    if (pad)     len = sprintf(tmp, "%019llu%019llu", hi, lo);
+    else if (hi) len = sprintf(tmp, "%llu%019llu", hi, lo);
+    else         len = sprintf(tmp, "%llu", lo);
+    memcpy(out, tmp, len);
+    return out + len;
+  }
+
+  struct num q, r;
+  if (divrem(x, &lv[k], &q, &r) != 0) return NULL;
+  char *end;
+  if (q.n || pad){
+    end = digits(out, q, lv, k-1, pad);
+    if (end != NULL) end = digits(end, r, lv, k-1, 1);
+  }
+  else end = digits(out, r, lv, k-1, 0);
+  free(q.d);
+  free(r.d);
+  return end;
+}
+
+char *big_to_decimal(const uint64_t *x, size_t n, size_t *ndigits){
+  // Returns x (n limbs) in decimal, as a new nul-terminated string to free
+  // with bigfib_free, or NULL if out of memory. *ndigits (if not NULL) gets
+  // its length.
+  struct num xn = { (limb *)x, norm(x, n) };
+  size_t bits = num_bits(xn);
+  char *s = NULL, *end = NULL;
+
+  // D_0 = 10^19, and 4^64 / 10^19 is small enough to work out directly
+  struct level lv[64];
+  int k = 0;
+  lv[0].D = lv[0].mu = NUM_NONE;
+  if (num_new(&lv[0].D, 1) != 0 || num_new(&lv[0].mu, 2) != 0) goto out;
+  lv[0].D.d[0] = TEN19;
+  lv[0].L = 64;
+  dlimb mu0 = ~(dlimb)0 / TEN19;
+  lv[0].mu.d[0] = (limb)mu0;
+  lv[0].mu.d[1] = (limb)(mu0 >> 64);
+
+  // Levels up to the first D with x < D^2 (D >= 2^(L-1), so bits <= 2L-2
+  // is enough)
+  while (bits > 2*lv[k].L - 2){
+    k++;
+    lv[k].mu = NUM_NONE;
+    if (num_mul(&lv[k].D, lv[k-1].D, lv[k-1].D) != 0) goto out;
+    lv[k].L = num_bits(lv[k].D);
+    if (reciprocal(&lv[k], &lv[k-1]) != 0) goto out;
+  }
+
+  s = malloc(((size_t)19 << (k+1)) + 2);
+  if (s != NULL && (end = digits(s, xn, lv, k, 0)) == NULL){
+    free(s);
+    s = NULL;
+  }
+  if (s != NULL){
+    *end = '\0';
+    if (ndigits) *ndigits = end - s;
+  }
+
+out:
+  for (int i=0; i<=k; i++){
+    free(lv[i].D.d);
+    free(lv[i].mu.d);
+  }
+  return s;
+}
+
+char *bigfib_decimal(long n, size_t *ndigits){
+  // F(n) in decimal (see big_to_decimal), or NULL if out of memory
+  size_t nl;
+  uint64_t *f = bigfib(n, &nl);
+  if (f == NULL) return NULL;
+  char *s = big_to_decimal(f, nl, ndigits);
+  free(f);
+  return s;
+}
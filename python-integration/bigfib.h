@@ -0,0 +1,19 @@
+/*
+  bigfib.h -- exact Fibonacci numbers of any size
+
+  See bigfib.c.
+ */
+#ifndef BIGFIB_H
+#define BIGFIB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint64_t *bigfib(long n, size_t *nlimbs);
+char *bigfib_decimal(long n, size_t *ndigits);
+char *big_to_decimal(const uint64_t *x, size_t n, size_t *ndigits);
+uint64_t *big_mul(const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+void bigfib_set_threads(int nthreads);
+void bigfib_free(void *p);
+
+#endif
@@ -5,6 +5,15 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "cfunctions.h"
 
 int fib(int n) {
   // Determine the nth fibbonacci number
@@ -31,6 +40,109 @@ void hello(char *name){
 }
 
 
+/* =================================================
+   Batched versions of hello(), used in mypackage.
+
+   Instead of one call (and one stdio flush) per name, all the names are
+   passed in a single packed UTF-8 buffer, Arrow-style: name i occupies
+   the bytes names[offsets[i]] up to (but not including) names[offsets[i+1]],
+   so there are n+1 offsets. The names don't need to be null-terminated.
+   =================================================
+*/
+static const char HELLO_PREFIX[] = "Hello, ";
+static const char HELLO_SUFFIX[] = "!\n";
+#define HELLO_PREFIX_LEN (sizeof(HELLO_PREFIX) - 1)
+#define HELLO_SUFFIX_LEN (sizeof(HELLO_SUFFIX) - 1)
+
+#ifndef IOV_MAX      // POSIX only guarantees 16, but Linux and Mac both allow 1024
+#define IOV_MAX 1024
+#endif
+
+int64_t hello_batch_size(int n, const int64_t *offsets){
+  // The number of bytes hello_batch() will write for these names
+  return (offsets[n] - offsets[0]) + n*(int64_t)(HELLO_PREFIX_LEN + HELLO_SUFFIX_LEN);
+}
+
+int64_t hello_batch(int n, const char *names, const int64_t *offsets,
+                    char *out, int64_t out_size){
+  // Format all the greetings into the caller's buffer, back to back.
+  // Returns the number of bytes written, or -1 if out is too small.
+  if (hello_batch_size(n, offsets) > out_size) return -1;
+
+  char *p = out;
+  for (int i=0; i<n; i++){
+    int64_t len = offsets[i+1] - offsets[i];
+    memcpy(p, HELLO_PREFIX, HELLO_PREFIX_LEN);  p += HELLO_PREFIX_LEN;
+    memcpy(p, names + offsets[i], len);         p += len;
+    memcpy(p, HELLO_SUFFIX, HELLO_SUFFIX_LEN);  p += HELLO_SUFFIX_LEN;
+  }
+  return p - out;
+}
+
+char *hello_batch_alloc(int n, const char *names, const int64_t *offsets,
+                        int64_t *out_len){
+  // As hello_batch(), but the library allocates the buffer.
+  // It must be given back with free_buffer() when you're done with it.
+  int64_t size = hello_batch_size(n, offsets);
+  char *out = malloc(size > 0 ? size : 1);
+  if (out == NULL) return NULL;
+
+  *out_len = hello_batch(n, names, offsets, out, size);
+  return out;
+}
+
+void free_buffer(char *buf){
+  // Memory created in C has to be freed in C
+  free(buf);
+}
+
+int64_t hello_batch_fd(int fd, int n, const char *names, const int64_t *offsets){
+  // Write all the greetings straight to a file descriptor with writev().
+  // Nothing is copied: each greeting is three iovecs, pointing at the
+  // prefix, the name (inside the caller's buffer), and the suffix.
+  // Returns the number of bytes written, or -1 on error (see errno).
+  enum { NAMES_PER_CALL = IOV_MAX / 3 };
+  struct iovec iov[NAMES_PER_CALL * 3];
+  int64_t total = 0;
+
+  for (int start=0; start<n; start+=NAMES_PER_CALL){
+    int count = (n - start < NAMES_PER_CALL) ? n - start : NAMES_PER_CALL;
+    int niov = 0;
+    for (int i=start; i<start+count; i++){
+      iov[niov].iov_base = (void *)HELLO_PREFIX;
+      iov[niov++].iov_len = HELLO_PREFIX_LEN;
+      iov[niov].iov_base = (void *)(names + offsets[i]);
+      iov[niov++].iov_len = offsets[i+1] - offsets[i];
+      iov[niov].iov_base = (void *)HELLO_SUFFIX;
+      iov[niov++].iov_len = HELLO_SUFFIX_LEN;
+    }
+
+    // writev() is allowed to stop part way, so keep going until
+    // everything in this chunk has gone out
+    struct iovec *cur = iov;
+    while (niov > 0){
+      ssize_t written = writev(fd, cur, niov);
+      if (written < 0){
+        if (errno == EINTR) continue;
+        return -1;
+      }
+      total += written;
+      while (niov > 0 && (size_t)written >= cur->iov_len){
+        written -= cur->iov_len;
+        cur++;
+        niov--;
+      }
+      if (niov > 0){
+        cur->iov_base = (char *)cur->iov_base + written;
+        cur->iov_len -= written;
+      }
+    }
+  }
+  return total;
+}
+// =================================================
+
+
 
 /* =================================================
    The following functions/structures are used in
@@ -49,6 +161,76 @@ struct Result simulate(float L, float dx){
   result.L = dx*result.N;
   return result;
 }
+
+
+/* Sweeps: simulate() for many (L, dx) pairs in one call.
+
+   Rather than an array of struct Results (an "array of structs"), the
+   answers go into one array of Ns and one array of Ls (a "struct of
+   arrays"), which numpy can use directly, with no conversion per element.
+   The loops are split over threads with OpenMP (if compiled with -fopenmp),
+   but only when there's enough work to pay for starting the threads.
+
+   The _double versions do the arithmetic in double precision: in float,
+   1.0/0.001 comes out just under 1000, which truncates to N = 999. Double
+   precision alone doesn't cure that (0.3/0.1 is 2.9999999999999996), so
+   they also take an L/dx within rounding error of a whole number to be
+   that number, and only round down what's left.
+*/
+#define SWEEP_MIN_PARALLEL 16384
+
+static int64_t whole_steps(double L, double dx){
+  double q = L/dx;
+  double r = round(q);
+  return (fabs(q - r) < 1e-9*fabs(q)) ? (int64_t)r : (int64_t)floor(q);
+}
+
+void simulate_sweep(int n, const float *L, const float *dx, int *N_out, float *L_out){
+  #pragma omp parallel for schedule(static) if(n > SWEEP_MIN_PARALLEL)
+  for (int i=0; i<n; i++){
+    N_out[i] = L[i]/dx[i];
+    L_out[i] = dx[i]*N_out[i];
+  }
+}
+
+void simulate_sweep_double(int n, const double *L, const double *dx,
+                           int64_t *N_out, double *L_out){
+  #pragma omp parallel for schedule(static) if(n > SWEEP_MIN_PARALLEL)
+  for (int i=0; i<n; i++){
+    N_out[i] = whole_steps(L[i], dx[i]);
+    L_out[i] = dx[i]*N_out[i];
+  }
+}
+
+void simulate_grid(float L0, float dL, int nL, float dx0, float ddx, int ndx,
+                   int *N_out, float *L_out){
+  // Every combination of L = L0 + i*dL and dx = dx0 + j*ddx, with the
+  // results stored row-major, i.e. at index i*ndx + j
+  #pragma omp parallel for schedule(static) if((long)nL*ndx > SWEEP_MIN_PARALLEL)
+  for (int i=0; i<nL; i++){
+    float L = L0 + i*dL;
+    for (int j=0; j<ndx; j++){
+      float dx = dx0 + j*ddx;
+      long idx = (long)i*ndx + j;
+      N_out[idx] = L/dx;
+      L_out[idx] = dx*N_out[idx];
+    }
+  }
+}
+
+void simulate_grid_double(double L0, double dL, int nL, double dx0, double ddx, int ndx,
+                          int64_t *N_out, double *L_out){
+  #pragma omp parallel for schedule(static) if((long)nL*ndx > SWEEP_MIN_PARALLEL)
+  for (int i=0; i<nL; i++){
+    double L = L0 + i*dL;
+    for (int j=0; j<ndx; j++){
+      double dx = dx0 + j*ddx;
+      long idx = (long)i*ndx + j;
+      N_out[idx] = whole_steps(L, dx);
+      L_out[idx] = dx*N_out[idx];
+    }
+  }
+}
 // =================================================
 
 
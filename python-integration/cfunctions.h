@@ -0,0 +1,17 @@
+/*
+  cfunctions.h -- prototypes for the functions in cfunctions.c
+
+  Only needed by the other C files that get compiled into the same library;
+  Python finds the functions by name.
+ */
+#ifndef CFUNCTIONS_H
+#define CFUNCTIONS_H
+
+#include <stdint.h>
+
+int fib(int n);
+double weird_function(int n, float x, char c);
+void hello(char *name);
+int fib_sequence(int n, unsigned long *seq0, unsigned long *seq1);
+
+#endif
@@ -0,0 +1,313 @@
+/*
+  jobs.c -- run long C computations in the background
+
+  Used in mypackage (JobPool). A call like fib_sequence() blocks whichever
+  Python thread called it until it's finished. Here, the call just puts the
+  work on a queue and returns a handle straight away, and a pool of C threads
+  does the work. When a job finishes, the pool's file descriptor becomes
+  readable, so an asyncio event loop (or select/poll) can wait on it
+  alongside everything else it's doing. Then job_pool_reap() says which jobs
+  are the ones that finished.
+
+  Jobs can report how far along they are, and can be cancelled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "cfunctions.h"
+#include "jobs.h"
+
+
+struct job{
+  job_fn fn;
+  void *arg;
+  int free_arg;             // free(arg) along with the job
+
+  atomic_int status;        // an enum job_status
+  atomic_int cancel;        // set by job_cancel()
+  atomic_int_fast64_t progress;
+  int64_t total;
+
+  struct job *next;         // for the pool's queues
+};
+
+struct job_pool{
+  pthread_mutex_t lock;
+  pthread_cond_t wake;      // signalled when there's work (or on shutdown)
+  struct job *head, *tail;  // jobs waiting to run
+  struct job *finished;     // jobs done, waiting to be reaped
+  int shutdown;
+
+  int nthreads;
+  pthread_t *threads;
+  struct job **running;     // running[i] = the job worker i is running (or NULL)
+  int nslots;               // how many workers have claimed a slot in running
+
+  int fd_read, fd_write;    // the same eventfd on Linux, a pipe elsewhere
+};
+
+
+static void notify(struct job_pool *pool){
+  // Make the pool's file descriptor readable
+  uint64_t one = 1;
+#ifdef __linux__
+  if (write(pool->fd_write, &one, sizeof(one)) < 0) {}  // can only fail if the count overflows
+#else
+  if (write(pool->fd_write, &one, 1) < 0) {}            // the pipe is full, so already readable
+#endif
+}
+
+
+static void finish(struct job_pool *pool, struct job *job, int status){
+  atomic_store(&job->status, status);
+  pthread_mutex_lock(&pool->lock);
+  job->next = pool->finished;
+  pool->finished = job;
+  pthread_mutex_unlock(&pool->lock);
+  notify(pool);
+}
+
+
+static void *worker(void *p){
+  struct job_pool *pool = p;
+
+  pthread_mutex_lock(&pool->lock);
+  int slot = pool->nslots++;
+  pthread_mutex_unlock(&pool->lock);
+
+  while (1){
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head == NULL && !pool->shutdown)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->head == NULL){  // shutting down, and nothing left to do
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    struct job *job = pool->head;
+    pool->head = job->next;
+    if (pool->head == NULL) pool->tail = NULL;
+    pool->running[slot] = job;   // so that job_pool_destroy() can cancel it
+    pthread_mutex_unlock(&pool->lock);
+
+    int err = 0;
+    if (!atomic_load(&job->cancel)){
+      atomic_store(&job->status, JOB_RUNNING);
+      err = job->fn(job, job->arg);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running[slot] = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (atomic_load(&job->cancel)) finish(pool, job, JOB_CANCELLED);
+    else finish(pool, job, err ? JOB_FAILED : JOB_DONE);
+  }
+}
+
+
+struct job_pool *job_pool_create(int nthreads){
+  // Start a pool of nthreads worker threads (one per CPU if nthreads <= 0).
+  // Returns NULL on failure.
+  if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads <= 0) nthreads = 1;
+
+  struct job_pool *pool = calloc(1, sizeof(struct job_pool));
+  if (pool == NULL) return NULL;
+
+#ifdef __linux__
+  pool->fd_read = pool->fd_write = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (pool->fd_read < 0){
+    free(pool);
+    return NULL;
+  }
+#else
+  int fds[2];
+  if (pipe(fds) < 0){
+    free(pool);
+    return NULL;
+  }
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  pool->fd_read = fds[0];
+  pool->fd_write = fds[1];
+#endif
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+
+  pool->threads = malloc(nthreads * sizeof(pthread_t));
+  pool->running = calloc(nthreads, sizeof(struct job *));
+  if (pool->threads == NULL || pool->running == NULL) nthreads = 0;
+  for (pool->nthreads = 0; pool->nthreads < nthreads; pool->nthreads++){
+    if (pthread_create(&pool->threads[pool->nthreads], NULL, worker, pool) != 0)
+      break;
+  }
+  if (pool->nthreads == 0){
+    job_pool_destroy(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+
+void job_pool_destroy(struct job_pool *pool){
+  // Cancel everything still queued or running, wait for the threads to
+  // finish, and free the pool. Jobs that were never reaped are freed too.
+  // (A running job stops the next time it checks job_cancelled().)
+  pthread_mutex_lock(&pool->lock);
+  for (struct job *job = pool->head; job != NULL; job = job->next)
+    atomic_store(&job->cancel, 1);
+  for (int i=0; i<pool->nslots; i++)
+    if (pool->running[i] != NULL) atomic_store(&pool->running[i]->cancel, 1);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i=0; i<pool->nthreads; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  while (pool->finished != NULL){
+    struct job *job = pool->finished;
+    pool->finished = job->next;
+    job_free(job);
+  }
+
+  close(pool->fd_read);
+  if (pool->fd_write != pool->fd_read) close(pool->fd_write);
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->threads);
+  free(pool->running);
+  free(pool);
+}
+
+
+int job_pool_fd(struct job_pool *pool){
+  // The file descriptor to wait on. It becomes readable when a job finishes.
+  return pool->fd_read;
+}
+
+
+int job_pool_reap(struct job_pool *pool, struct job **finished, int max){
+  // Collect up to max finished jobs into the array finished, and return how
+  // many there were. Once reaped, it's up to you to job_free() them.
+  // Call this until it returns fewer than max, to be sure you've got them all.
+  uint64_t count;
+  while (read(pool->fd_read, &count, sizeof(count)) > 0) {}  // reset the fd
+
+  int n = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (n < max && pool->finished != NULL){
+    finished[n++] = pool->finished;
+    pool->finished = pool->finished->next;
+  }
+  int more = (pool->finished != NULL);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (more) notify(pool);  // so nobody sleeps through the rest
+  return n;
+}
+
+
+static struct job *submit(struct job_pool *pool, job_fn fn, void *arg,
+                          int64_t total, int free_arg){
+  struct job *job = calloc(1, sizeof(struct job));
+  if (job == NULL) return NULL;
+  job->fn = fn;
+  job->arg = arg;
+  job->free_arg = free_arg;
+  job->total = total;
+  atomic_init(&job->status, JOB_PENDING);
+  atomic_init(&job->cancel, 0);
+  atomic_init(&job->progress, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->tail) pool->tail->next = job;
+  else pool->head = job;
+  pool->tail = job;
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  return job;
+}
+
+struct job *job_submit(struct job_pool *pool, job_fn fn, void *arg, int64_t total){
+  // Queue up fn(job, arg) to be run by the pool. total is how much progress
+  // counts as "finished" (for reporting only). Returns NULL on failure.
+  return submit(pool, fn, arg, total, 0);
+}
+
+
+void job_cancel(struct job *job){
+  // Ask for a job to stop. It still turns up in job_pool_reap(), with the
+  // status JOB_CANCELLED (unless it had already finished).
+  atomic_store(&job->cancel, 1);
+}
+
+int job_cancelled(struct job *job){
+  return atomic_load_explicit(&job->cancel, memory_order_relaxed);
+}
+
+void job_add_progress(struct job *job, int64_t amount){
+  atomic_fetch_add_explicit(&job->progress, amount, memory_order_relaxed);
+}
+
+int64_t job_progress(struct job *job){
+  return atomic_load_explicit(&job->progress, memory_order_relaxed);
+}
+
+int64_t job_total(struct job *job){
+  return job->total;
+}
+
+int job_status(struct job *job){
+  return atomic_load(&job->status);
+}
+
+void job_free(struct job *job){
+  // Only for jobs that have been reaped
+  if (job->free_arg) free(job->arg);
+  free(job);
+}
+
+
+/* =================================================
+   Background versions of the functions in cfunctions.c
+   =================================================
+*/
+struct fib_sequence_args{
+  int n;
+  unsigned long *seq0, *seq1;
+};
+
+static int fib_sequence_job(struct job *job, void *p){
+  // The same as fib_sequence(), but it can be cancelled between elements
+  struct fib_sequence_args *args = p;
+  for (int i=0; i<args->n && !job_cancelled(job); i++){
+    args->seq0[i] = fib(i);
+    args->seq1[i] = fib(args->seq0[i]);
+    job_add_progress(job, 1);
+  }
+  return 0;
+}
+
+struct job *job_submit_fib_sequence(struct job_pool *pool, int n,
+                                    unsigned long *seq0, unsigned long *seq1){
+  struct fib_sequence_args *args = malloc(sizeof(struct fib_sequence_args));
+  if (args == NULL) return NULL;
+  args->n = n;
+  args->seq0 = seq0;
+  args->seq1 = seq1;
+
+  struct job *job = submit(pool, fib_sequence_job, args, n, 1);
+  if (job == NULL) free(args);
+  return job;
+}
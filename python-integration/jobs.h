@@ -0,0 +1,44 @@
+/*
+  jobs.h -- run long C computations in the background
+
+  See jobs.c.
+ */
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdint.h>
+
+enum job_status{
+  JOB_PENDING   = 0,
+  JOB_RUNNING   = 1,
+  JOB_DONE      = 2,
+  JOB_CANCELLED = 3,
+  JOB_FAILED    = 4
+};
+
+struct job;
+struct job_pool;
+
+/* The work itself. It should call job_add_progress() as it goes, check
+   job_cancelled() every so often (and return early if so), and return 0
+   on success. */
+typedef int (*job_fn)(struct job *job, void *arg);
+
+struct job_pool *job_pool_create(int nthreads);
+void job_pool_destroy(struct job_pool *pool);
+int job_pool_fd(struct job_pool *pool);
+int job_pool_reap(struct job_pool *pool, struct job **finished, int max);
+
+struct job *job_submit(struct job_pool *pool, job_fn fn, void *arg, int64_t total);
+void job_cancel(struct job *job);
+int job_cancelled(struct job *job);
+void job_add_progress(struct job *job, int64_t amount);
+int64_t job_progress(struct job *job);
+int64_t job_total(struct job *job);
+int job_status(struct job *job);
+void job_free(struct job *job);
+
+struct job *job_submit_fib_sequence(struct job_pool *pool, int n,
+                                    unsigned long *seq0, unsigned long *seq1);
+
+#endif
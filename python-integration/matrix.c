@@ -0,0 +1,130 @@
+/*
+  matrix.c -- reference-counted C matrices that Python can view in place
+
+  Used in mypackage (Matrix). Copying a big matrix into a new numpy array
+  every time Python wants to look at it doubles the memory and costs a
+  full pass over the data. Instead, numpy can be handed a view of the C
+  memory itself -- but then the memory must stay put for as long as any
+  view of it exists, however many there are, and be freed exactly once
+  after the last one goes away.
+
+  So each matrix carries a reference count. Whoever creates one holds the
+  first reference, and everything that hands out a view takes another:
+  Python's Matrix object holds one, and every DLPack export holds one that
+  is dropped by its deleter. The memory goes when the count reaches zero.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
+
+#include "matrix.h"
+#include "ripples.h"    // lesson1/ripples.c, built into the library too
+
+// numpy likes 64-byte aligned data (and so do AVX-512 loads)
+#define MATRIX_ALIGN 64
+
+// How many matrices haven't been freed yet (handy for spotting leaks)
+static atomic_int_fast64_t live = 0;
+
+
+struct matrix *matrix_create(int64_t rows, int64_t cols){
+  // Allocate a rows x cols matrix, with its one reference belonging to the
+  // caller. The elements are not initialised. Returns NULL on failure.
+  if (rows < 0 || cols < 0) return NULL;
+
+  struct matrix *m = malloc(sizeof(*m));
+  if (m == NULL) return NULL;
+
+  size_t nbytes = (size_t)rows * cols * sizeof(double);
+  nbytes = (nbytes + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+  m->data = aligned_alloc(MATRIX_ALIGN, nbytes ? nbytes : MATRIX_ALIGN);
+  m->M = malloc((rows ? rows : 1) * sizeof(double *));
+  if (m->data == NULL || m->M == NULL){
+    free(m->data);
+    free(m->M);
+    free(m);
+    return NULL;
+  }
+
+  for (int64_t r=0; r<rows; r++) m->M[r] = m->data + r*cols;
+  m->rows = m->shape[0] = rows;
+  m->cols = m->shape[1] = cols;
+  atomic_init(&m->refs, 1);
+  atomic_fetch_add(&live, 1);
+  return m;
+}
+
+
+struct matrix *matrix_retain(struct matrix *m){
+  // Take another reference to m. Returns m, for convenience.
+  atomic_fetch_add_explicit(&m->refs, 1, memory_order_relaxed);
+  return m;
+}
+
+
+void matrix_release(struct matrix *m){
+  // Drop a reference to m, freeing it if that was the last one. The
+  // acq_rel makes every write made through the other references visible
+  // before we free it.
+  if (m == NULL) return;
+  if (atomic_fetch_sub_explicit(&m->refs, 1, memory_order_acq_rel) != 1) return;
+
+  free(m->data);
+  free(m->M);
+  free(m);
+  atomic_fetch_sub(&live, 1);
+}
+
+
+int64_t matrix_live(void){
+  return atomic_load(&live);
+}
+
+
+double *matrix_data(struct matrix *m){ return m->data; }
+int64_t matrix_rows(struct matrix *m){ return m->rows; }
+int64_t matrix_cols(struct matrix *m){ return m->cols; }
+
+
+int matrix_make_ripples(struct matrix *m){
+  // Fill m with concentric ripples, using lesson1's own make_ripples() so
+  // that results can be compared with fileio.c's files. That takes int
+  // sizes, so returns -1 (leaving m alone) if m is too big for it, else 0.
+  if (m->rows > INT_MAX || m->cols > INT_MAX) return -1;
+  make_ripples(m->M, (int)m->rows, (int)m->cols);
+  return 0;
+}
+
+
+static void matrix_dlpack_deleter(DLManagedTensor *t){
+  matrix_release(t->manager_ctx);
+  free(t);
+}
+
+
+DLManagedTensor *matrix_to_dlpack(struct matrix *m){
+  // Describe m as a DLPack tensor, which holds its own reference to m.
+  // Whoever ends up with it must call its deleter (once) when finished.
+  DLManagedTensor *t = malloc(sizeof(*t));
+  if (t == NULL) return NULL;
+
+  t->dl_tensor.data = m->data;
+  t->dl_tensor.device = (DLDevice){ kDLCPU, 0 };
+  t->dl_tensor.ndim = 2;
+  t->dl_tensor.dtype = (DLDataType){ kDLFloat, 64, 1 };
+  t->dl_tensor.shape = m->shape;     // lives as long as m does
+  t->dl_tensor.strides = NULL;       // C order
+  t->dl_tensor.byte_offset = 0;
+  t->manager_ctx = matrix_retain(m);
+  t->deleter = matrix_dlpack_deleter;
+  return t;
+}
+
+
+void dlpack_delete(DLManagedTensor *t){
+  // Python can't call a function pointer inside a struct very easily, so
+  // this does it for a DLPack capsule that nobody consumed.
+  if (t != NULL && t->deleter != NULL) t->deleter(t);
+}
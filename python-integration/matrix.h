@@ -0,0 +1,70 @@
+/*
+  matrix.h -- reference-counted C matrices that Python can view in place
+
+  See matrix.c.
+ */
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* The parts of DLPack (https://github.com/dmlc/dlpack, dlpack.h) that we
+   need. The layout has to match dlpack.h exactly, because numpy (and
+   torch, cupy, jax...) read these structs straight out of our memory. */
+enum{ kDLCPU = 1 };
+enum{ kDLInt = 0, kDLUInt = 1, kDLFloat = 2 };
+
+typedef struct{
+  int32_t device_type;      // kDLCPU for ordinary memory
+  int32_t device_id;
+} DLDevice;
+
+typedef struct{
+  uint8_t code;             // kDLFloat etc.
+  uint8_t bits;
+  uint16_t lanes;
+} DLDataType;
+
+typedef struct{
+  void *data;
+  DLDevice device;
+  int32_t ndim;
+  DLDataType dtype;
+  int64_t *shape;
+  int64_t *strides;         // in elements, not bytes (NULL = C order)
+  uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor{
+  DLTensor dl_tensor;
+  void *manager_ctx;
+  void (*deleter)(struct DLManagedTensor *self);
+} DLManagedTensor;
+
+
+/* A rows x cols matrix of doubles in one contiguous, C-ordered block, with
+   row pointers so that it can also be used as a double ** (like
+   create_matrix() in lesson1/fileio.c). */
+struct matrix{
+  int64_t rows, cols;
+  double *data;
+  double **M;               // M[r] == data + r*cols
+  int64_t shape[2];         // for DLPack
+  atomic_int refs;          // freed when this drops to 0
+};
+
+struct matrix *matrix_create(int64_t rows, int64_t cols);
+struct matrix *matrix_retain(struct matrix *m);
+void matrix_release(struct matrix *m);
+int64_t matrix_live(void);
+
+double *matrix_data(struct matrix *m);
+int64_t matrix_rows(struct matrix *m);
+int64_t matrix_cols(struct matrix *m);
+int matrix_make_ripples(struct matrix *m);
+
+DLManagedTensor *matrix_to_dlpack(struct matrix *m);
+void dlpack_delete(DLManagedTensor *t);
+
+#endif
@@ -2,12 +2,19 @@ import ctypes as ctp   # Import the ctypes module, which does the heavy lifting
 import os
 import sys
 import glob
+import asyncio
+import weakref
 
 from numpy.ctypeslib import ndpointer
 import numpy as np
 
 # Here we tell Python which objects in this module to actually export.
-__all__ = ['fib', 'weird_function', 'hello', 'simulate', 'fib_sequence']
+__all__ = ['fib', 'weird_function', 'hello', 'simulate', 'fib_sequence',
+           'pack_strings', 'hello_many',
+           'shared_empty', 'shared_open', 'shared_unlink',
+           'simulate_many', 'simulate_range',
+           'JobPool', 'Job', 'Matrix',
+           'fib_big', 'fib_big_str', 'decimal_str', 'bigfib_set_threads']
 
 
 # Read in the shared object
@@ -20,8 +27,19 @@ lib = ctp.cdll.LoadLibrary(SharedLibraryLocation)
 fib = lib.fib
 weird_function = lib.weird_function
 hello = lib.hello
+hello_batch_size = lib.hello_batch_size
+hello_batch = lib.hello_batch
+hello_batch_fd = lib.hello_batch_fd
 simulate = lib.simulate
+simulate_sweep = lib.simulate_sweep
+simulate_sweep_double = lib.simulate_sweep_double
+simulate_grid = lib.simulate_grid
+simulate_grid_double = lib.simulate_grid_double
 fib_sequence = lib.fib_sequence
+shm_array_create = lib.shm_array_create
+shm_array_open = lib.shm_array_open
+shm_array_close = lib.shm_array_close
+shm_array_unlink = lib.shm_array_unlink
 
 
 # Create the wrappers for each
@@ -37,6 +55,59 @@ weird_function.argtypes = [ctp.c_int, ctp.c_float, ctp.c_char]
 hello.argtypes = [ctp.c_char_p]
 
 
+# The batched versions take a packed buffer of names plus n+1 offsets
+_bytes = ndpointer(np.uint8, flags='C_CONTIGUOUS')
+_offsets = ndpointer(np.int64, flags='C_CONTIGUOUS')
+
+hello_batch_size.restype = ctp.c_int64
+hello_batch_size.argtypes = [ctp.c_int, _offsets]
+
+hello_batch.restype = ctp.c_int64
+hello_batch.argtypes = [ctp.c_int, _bytes, _offsets, _bytes, ctp.c_int64]
+
+hello_batch_fd.restype = ctp.c_int64
+hello_batch_fd.argtypes = [ctp.c_int, ctp.c_int, _bytes, _offsets]
+
+
+def pack_strings(names):
+    """Pack a list of str into one UTF-8 buffer and an array of n+1 offsets.
+
+    If your strings are already packed (e.g. the data and offsets buffers of
+    an Arrow string array), skip this and pass them to hello_many() directly.
+    """
+    encoded = [name.encode() for name in names]
+    offsets = np.zeros(len(encoded) + 1, dtype=np.int64)
+    np.cumsum([len(e) for e in encoded], out=offsets[1:])
+    return np.frombuffer(b"".join(encoded), dtype=np.uint8), offsets
+
+
+def hello_many(names, offsets=None, out=None, fd=None):
+    """Greet lots of names with a single call into C.
+
+    names is either a list of str, or a packed uint8 buffer, in which case
+    offsets must be given too. If fd is given, the greetings are written
+    straight to that file descriptor and the number of bytes is returned.
+    Otherwise they are formatted into out (allocated if not given), and the
+    filled part of out is returned as a uint8 array.
+    """
+    if offsets is None:
+        names, offsets = pack_strings(names)
+    n = len(offsets) - 1
+
+    if fd is not None:
+        written = hello_batch_fd(fd, n, names, offsets)
+        if written < 0:
+            raise OSError("hello_batch_fd failed")
+        return written
+
+    size = hello_batch_size(n, offsets)
+    if out is None:
+        out = np.empty(size, dtype=np.uint8)
+    if hello_batch(n, names, offsets, out, len(out)) < 0:
+        raise ValueError("out is too small: need %d bytes" % size)
+    return out[:size]
+
+
 class Result(ctp.Structure):
     _fields_ = [
         ("N", ctp.c_int),
@@ -45,5 +116,461 @@ class Result(ctp.Structure):
 simulate.argtypes = [ctp.c_float, ctp.c_float]
 simulate.restype = Result 
 
+
+# The sweeps write into separate arrays of N and L ("struct of arrays")
+_array = lambda dtype: ndpointer(dtype, flags='C_CONTIGUOUS')
+
+simulate_sweep.argtypes = [ctp.c_int, _array(np.float32), _array(np.float32),
+                           _array(np.int32), _array(np.float32)]
+simulate_sweep_double.argtypes = [ctp.c_int, _array(np.float64), _array(np.float64),
+                                  _array(np.int64), _array(np.float64)]
+simulate_grid.argtypes = [ctp.c_float, ctp.c_float, ctp.c_int,
+                          ctp.c_float, ctp.c_float, ctp.c_int,
+                          _array(np.int32), _array(np.float32)]
+simulate_grid_double.argtypes = [ctp.c_double, ctp.c_double, ctp.c_int,
+                                 ctp.c_double, ctp.c_double, ctp.c_int,
+                                 _array(np.int64), _array(np.float64)]
+
+
+def simulate_many(L, dx, double=False):
+    """simulate() over arrays of L and dx (which are broadcast together).
+
+    Returns (N, L) as two arrays of the broadcast shape. With double=True,
+    the arithmetic is done in double precision, and N is int64.
+    """
+    ftype, itype = (np.float64, np.int64) if double else (np.float32, np.int32)
+    L, dx = np.broadcast_arrays(np.asarray(L, dtype=ftype), np.asarray(dx, dtype=ftype))
+    L_in = np.ascontiguousarray(L)
+    dx_in = np.ascontiguousarray(dx)
+    N_out = np.empty(L.shape, dtype=itype)
+    L_out = np.empty(L.shape, dtype=ftype)
+    sweep = simulate_sweep_double if double else simulate_sweep
+    sweep(L_in.size, L_in, dx_in, N_out, L_out)
+    return N_out, L_out
+
+
+def simulate_range(L0, dL, nL, dx0, ddx, ndx, double=False):
+    """simulate() over every combination of L = L0 + i*dL (i < nL) and
+    dx = dx0 + j*ddx (j < ndx), without building the inputs in Python.
+
+    Returns (N, L) as two arrays of shape (nL, ndx).
+    """
+    ftype, itype = (np.float64, np.int64) if double else (np.float32, np.int32)
+    N_out = np.empty((nL, ndx), dtype=itype)
+    L_out = np.empty((nL, ndx), dtype=ftype)
+    grid = simulate_grid_double if double else simulate_grid
+    grid(L0, dL, nL, dx0, ddx, ndx, N_out, L_out)
+    return N_out, L_out
+
         
 fib_sequence.argtypes = [ctp.c_int, ndpointer(np.uint64), ndpointer(np.uint64)]
+
+
+# Shared-memory arrays
+# ====================
+SHM_ARRAY_MAX_DIMS = 8
+
+class ShmArrayHeader(ctp.Structure):
+    _fields_ = [
+        ("magic", ctp.c_char * 8),
+        ("dtype", ctp.c_char * 8),
+        ("itemsize", ctp.c_int64),
+        ("ndim", ctp.c_int64),
+        ("shape", ctp.c_int64 * SHM_ARRAY_MAX_DIMS),
+        ("nbytes", ctp.c_int64),
+        ("data_offset", ctp.c_int64),
+    ]
+
+shm_array_create.restype = ctp.c_void_p
+shm_array_create.argtypes = [ctp.c_char_p, ctp.c_char_p, ctp.c_int64, ctp.c_int,
+                             ndpointer(np.int64, flags='C_CONTIGUOUS')]
+shm_array_open.restype = ctp.c_void_p
+shm_array_open.argtypes = [ctp.c_char_p, ctp.POINTER(ShmArrayHeader)]
+shm_array_close.restype = ctp.c_int
+shm_array_close.argtypes = [ctp.c_void_p]
+shm_array_unlink.restype = ctp.c_int
+shm_array_unlink.argtypes = [ctp.c_char_p]
+
+
+class _SharedMapping(object):
+    """Owns one mapping of a shared-memory array.
+
+    numpy arrays made from it keep it alive (it becomes their .base), and
+    the memory is unmapped when the last of them goes away.
+    """
+    def __init__(self, address, shape, dtype):
+        self.__array_interface__ = {
+            'version': 3,
+            'shape': tuple(shape),
+            'typestr': dtype.str,
+            'data': (address, False),
+        }
+        weakref.finalize(self, shm_array_close, address)
+
+
+def _shm_name(name):
+    # POSIX shared memory names have to start with a slash
+    return str.encode(name if name.startswith('/') else '/' + name)
+
+
+def shared_empty(name, shape, dtype=np.float64):
+    """Create a new array in shared memory, which other processes can then
+    open with shared_open(name). The contents start out as zeros.
+
+    Call shared_unlink(name) when everyone is done with it.
+    """
+    dtype = np.dtype(dtype)
+    shape = np.atleast_1d(np.asarray(shape, dtype=np.int64))
+    address = shm_array_create(_shm_name(name), str.encode(dtype.str),
+                               dtype.itemsize, len(shape), shape)
+    if not address:
+        raise OSError("could not create shared array %r" % name)
+    return np.asarray(_SharedMapping(address, shape, dtype))
+
+
+def shared_open(name):
+    """Open an existing shared-memory array, with the dtype and shape it
+    was created with. Writes are seen by every process that has it open."""
+    header = ShmArrayHeader()
+    address = shm_array_open(_shm_name(name), ctp.byref(header))
+    if not address:
+        raise OSError("could not open shared array %r" % name)
+    shape = header.shape[:header.ndim]
+    dtype = np.dtype(header.dtype.decode())
+    return np.asarray(_SharedMapping(address, shape, dtype))
+
+
+def shared_unlink(name):
+    """Remove the name of a shared array. The memory is freed once every
+    process has finished with it."""
+    if shm_array_unlink(_shm_name(name)) != 0:
+        raise OSError("could not unlink shared array %r" % name)
+
+
+# Matrices shared with C
+# ======================
+matrix_create = lib.matrix_create
+matrix_release = lib.matrix_release
+matrix_live = lib.matrix_live
+matrix_data = lib.matrix_data
+matrix_rows = lib.matrix_rows
+matrix_cols = lib.matrix_cols
+matrix_make_ripples = lib.matrix_make_ripples
+matrix_to_dlpack = lib.matrix_to_dlpack
+dlpack_delete = lib.dlpack_delete
+
+matrix_create.restype = ctp.c_void_p
+matrix_create.argtypes = [ctp.c_int64, ctp.c_int64]
+matrix_release.argtypes = [ctp.c_void_p]
+matrix_live.restype = ctp.c_int64
+matrix_live.argtypes = []
+matrix_data.restype = ctp.c_void_p
+matrix_data.argtypes = [ctp.c_void_p]
+matrix_rows.restype = ctp.c_int64
+matrix_rows.argtypes = [ctp.c_void_p]
+matrix_cols.restype = ctp.c_int64
+matrix_cols.argtypes = [ctp.c_void_p]
+matrix_make_ripples.restype = ctp.c_int
+matrix_make_ripples.argtypes = [ctp.c_void_p]
+matrix_to_dlpack.restype = ctp.c_void_p
+matrix_to_dlpack.argtypes = [ctp.c_void_p]
+dlpack_delete.argtypes = [ctp.c_void_p]
+
+# DLPack tensors travel inside PyCapsules named "dltensor". A consumer that
+# takes one renames it "used_dltensor" and calls the deleter itself; if
+# nobody does, the capsule's destructor has to. The destructor gets the
+# capsule as it's being freed, so it must be a plain pointer (a py_object
+# would try to take a new reference to it).
+_capsule_new = ctp.pythonapi.PyCapsule_New
+_capsule_new.restype = ctp.py_object
+_capsule_new.argtypes = [ctp.c_void_p, ctp.c_char_p, ctp.c_void_p]
+_capsule_valid = ctp.pythonapi.PyCapsule_IsValid
+_capsule_valid.restype = ctp.c_int
+_capsule_valid.argtypes = [ctp.c_void_p, ctp.c_char_p]
+_capsule_pointer = ctp.pythonapi.PyCapsule_GetPointer
+_capsule_pointer.restype = ctp.c_void_p
+_capsule_pointer.argtypes = [ctp.c_void_p, ctp.c_char_p]
+
+@ctp.CFUNCTYPE(None, ctp.c_void_p)
+def _dltensor_destructor(capsule):
+    if _capsule_valid(capsule, b"dltensor"):
+        dlpack_delete(_capsule_pointer(capsule, b"dltensor"))
+
+_DLPACK_CPU = 1
+
+
+class Matrix(object):
+    """A matrix of doubles allocated (and filled) by C, which numpy can view
+    without copying:
+
+        >>> m = mypackage.Matrix.ripples(1000, 2000)
+        >>> a = np.asarray(m)          # via __array_interface__
+        >>> b = np.from_dlpack(m)      # via DLPack (torch.from_dlpack etc. too)
+        >>> v = m.memoryview()         # via the buffer protocol
+
+    All of them share the same memory, which stays valid for as long as any
+    of them (or the Matrix) is alive, and is freed once after the last goes.
+    """
+    def __init__(self, rows, cols):
+        handle = matrix_create(rows, cols)
+        if not handle:
+            raise MemoryError("could not allocate a %d x %d matrix" % (rows, cols))
+        self._handle = handle
+        self.shape = (rows, cols)
+        # Our reference to the C matrix; views keep this object alive
+        weakref.finalize(self, matrix_release, handle)
+
+    @classmethod
+    def ripples(cls, rows, cols):
+        """The same concentric ripples as lesson1/fileio.c writes out (made
+        by lesson1/ripples.c, which is built into the library)."""
+        m = cls(rows, cols)
+        if matrix_make_ripples(m._handle) != 0:
+            raise ValueError("lesson1's ripples need fewer than 2**31 rows and columns")
+        return m
+
+    @property
+    def __array_interface__(self):
+        return {
+            'version': 3,
+            'shape': self.shape,
+            'typestr': '<f8',
+            'data': (matrix_data(self._handle), False),
+        }
+
+    def memoryview(self):
+        """A 2D memoryview (format 'd') of the matrix.
+
+        An empty matrix (0 rows or 0 columns) gives an empty view of the
+        same shape, in format '<d': cast() refuses shapes with a 0 in them,
+        so it comes from a ctypes array of arrays instead.
+        """
+        rows, cols = self.shape
+        if rows == 0 or cols == 0:
+            return memoryview(((ctp.c_double * cols) * rows)())
+        buf = (ctp.c_double * (rows * cols)).from_address(matrix_data(self._handle))
+        buf._owner = self     # ctypes doesn't own the memory, so keep us alive
+        return memoryview(buf).cast('B').cast('d', self.shape)
+
+    # Python 3.12+ lets a class export the buffer protocol directly
+    def __buffer__(self, flags):
+        return self.memoryview()
+
+    def __dlpack__(self, stream=None, max_version=None, dl_device=None, copy=None):
+        if stream is not None:
+            raise BufferError("stream must be None for CPU tensors")
+        if copy:
+            raise BufferError("Matrix only exports views")
+        tensor = matrix_to_dlpack(self._handle)   # holds its own reference
+        if not tensor:
+            raise MemoryError("could not export matrix")
+        try:
+            return _capsule_new(tensor, b"dltensor",
+                                ctp.cast(_dltensor_destructor, ctp.c_void_p))
+        except BaseException:
+            dlpack_delete(tensor)
+            raise
+
+    def __dlpack_device__(self):
+        return (_DLPACK_CPU, 0)
+
+
+# Big Fibonacci numbers
+# =====================
+# fib() above is an int, and wrong from fib(47) on. bigfib() works out F(n)
+# exactly, as an array of 64-bit limbs (least significant first) that C
+# allocates and we free, and which int.from_bytes turns into a Python int
+# in one pass. That needs the bytes of each limb least significant first
+# too, as they are on x86 and ARM.
+bigfib = lib.bigfib
+bigfib_decimal = lib.bigfib_decimal
+big_to_decimal = lib.big_to_decimal
+bigfib_set_threads = lib.bigfib_set_threads
+bigfib_free = lib.bigfib_free
+
+bigfib.restype = ctp.c_void_p
+bigfib.argtypes = [ctp.c_long, ctp.POINTER(ctp.c_size_t)]
+bigfib_decimal.restype = ctp.c_void_p
+bigfib_decimal.argtypes = [ctp.c_long, ctp.POINTER(ctp.c_size_t)]
+big_to_decimal.restype = ctp.c_void_p
+big_to_decimal.argtypes = [ctp.c_char_p, ctp.c_size_t, ctp.POINTER(ctp.c_size_t)]
+bigfib_set_threads.argtypes = [ctp.c_int]
+bigfib_free.argtypes = [ctp.c_void_p]
+
+
+def _take(ptr, nbytes):
+    # Copy nbytes out of memory that C allocated for us, and free it. C
+    # hands back NULL (None here) when it ran out of memory on the way.
+    if ptr is None:
+        raise MemoryError("bigfib.c ran out of memory")
+    try:
+        return ctp.string_at(ptr, nbytes)
+    finally:
+        bigfib_free(ptr)
+
+
+def fib_big(n):
+    """The n-th Fibonacci number, exactly, as a Python int."""
+    if n < 0:
+        raise ValueError("n must be >= 0")
+    nlimbs = ctp.c_size_t()
+    ptr = bigfib(n, ctp.byref(nlimbs))
+    return int.from_bytes(_take(ptr, 8 * nlimbs.value), 'little')
+
+
+def fib_big_str(n):
+    """The n-th Fibonacci number in decimal.
+
+    Python's own str() of an int takes time proportional to the square of
+    its length (and refuses past 4300 digits unless told otherwise), so for
+    big n this is much quicker than str(fib_big(n)).
+    """
+    if n < 0:
+        raise ValueError("n must be >= 0")
+    ndigits = ctp.c_size_t()
+    ptr = bigfib_decimal(n, ctp.byref(ndigits))
+    return _take(ptr, ndigits.value).decode('ascii')
+
+
+def decimal_str(x):
+    """str(x) for a non-negative int x of any size, done by bigfib.c."""
+    if x < 0:
+        return '-' + decimal_str(-x)
+    nlimbs = (x.bit_length() + 63) // 64
+    ndigits = ctp.c_size_t()
+    ptr = big_to_decimal(x.to_bytes(8 * nlimbs, 'little'), nlimbs, ctp.byref(ndigits))
+    return _take(ptr, ndigits.value).decode('ascii')
+
+
+# Background jobs
+# ===============
+JOB_PENDING, JOB_RUNNING, JOB_DONE, JOB_CANCELLED, JOB_FAILED = range(5)
+
+job_pool_create = lib.job_pool_create
+job_pool_destroy = lib.job_pool_destroy
+job_pool_fd = lib.job_pool_fd
+job_pool_reap = lib.job_pool_reap
+job_cancel = lib.job_cancel
+job_progress = lib.job_progress
+job_total = lib.job_total
+job_status = lib.job_status
+job_free = lib.job_free
+job_submit_fib_sequence = lib.job_submit_fib_sequence
+
+job_pool_create.restype = ctp.c_void_p
+job_pool_create.argtypes = [ctp.c_int]
+job_pool_destroy.argtypes = [ctp.c_void_p]
+job_pool_fd.restype = ctp.c_int
+job_pool_fd.argtypes = [ctp.c_void_p]
+job_pool_reap.restype = ctp.c_int
+job_pool_reap.argtypes = [ctp.c_void_p, ctp.POINTER(ctp.c_void_p), ctp.c_int]
+job_cancel.argtypes = [ctp.c_void_p]
+job_progress.restype = ctp.c_int64
+job_progress.argtypes = [ctp.c_void_p]
+job_total.restype = ctp.c_int64
+job_total.argtypes = [ctp.c_void_p]
+job_status.restype = ctp.c_int
+job_status.argtypes = [ctp.c_void_p]
+job_free.argtypes = [ctp.c_void_p]
+job_submit_fib_sequence.restype = ctp.c_void_p
+job_submit_fib_sequence.argtypes = [ctp.c_void_p, ctp.c_int,
+                                    ndpointer(np.uint64), ndpointer(np.uint64)]
+
+
+class Job(object):
+    """A handle on a job running in a JobPool. Await it to get its result."""
+    def __init__(self, handle, future, result):
+        self._handle = handle
+        self._future = future
+        self._result = result      # also keeps the job's arrays alive
+
+    @property
+    def progress(self):
+        """(work done, total work), e.g. elements of the sequence so far."""
+        if self._handle is None:
+            return self._final
+        return job_progress(self._handle), job_total(self._handle)
+
+    def cancel(self):
+        if self._handle is not None:
+            job_cancel(self._handle)
+
+    def done(self):
+        return self._future.done()
+
+    def __await__(self):
+        return self._future.__await__()
+
+
+class JobPool(object):
+    """A pool of C threads, whose jobs can be awaited from asyncio.
+
+    The pool's file descriptor is registered with the running event loop, so
+    no Python thread sits waiting on the C code:
+
+        async with JobPool() as pool:
+            seq0, seq1 = await pool.fib_sequence(40)
+    """
+    REAP_BATCH = 64
+
+    def __init__(self, nthreads=0, loop=None):
+        self._pool = job_pool_create(nthreads)
+        if not self._pool:
+            raise OSError("could not start the job pool")
+        self._loop = loop or asyncio.get_event_loop()
+        self._jobs = {}
+        self._loop.add_reader(job_pool_fd(self._pool), self._reap)
+
+    def fib_sequence(self, n):
+        """fib_sequence() in the background. Awaiting the job gives (seq0, seq1)."""
+        seq0 = np.zeros(n, dtype=np.uint64)
+        seq1 = np.zeros(n, dtype=np.uint64)
+        return self._track(job_submit_fib_sequence(self._pool, n, seq0, seq1), (seq0, seq1))
+
+    def _track(self, handle, result):
+        if not handle:
+            raise MemoryError("could not submit job")
+        job = Job(handle, self._loop.create_future(), result)
+        # If whoever is awaiting gets cancelled, stop the C side too
+        job._future.add_done_callback(lambda f: f.cancelled() and job.cancel())
+        self._jobs[handle] = job
+        return job
+
+    def _reap(self):
+        finished = (ctp.c_void_p * self.REAP_BATCH)()
+        while True:
+            n = job_pool_reap(self._pool, finished, self.REAP_BATCH)
+            for handle in finished[:n]:
+                job = self._jobs.pop(handle)
+                status = job_status(handle)
+                job._final = (job_progress(handle), job_total(handle))
+                job._handle = None
+                job_free(handle)
+                if job._future.done():
+                    continue
+                if status == JOB_DONE:
+                    job._future.set_result(job._result)
+                elif status == JOB_CANCELLED:
+                    job._future.cancel()
+                else:
+                    job._future.set_exception(RuntimeError("job failed"))
+            if n < self.REAP_BATCH:
+                break
+
+    def close(self):
+        if self._pool:
+            self._loop.remove_reader(job_pool_fd(self._pool))
+            job_pool_destroy(self._pool)   # cancels and frees anything left
+            self._pool = None
+            for job in self._jobs.values():
+                job._handle = None
+                job._final = (0, 0)
+                if not job._future.done():
+                    job._future.cancel()
+            self._jobs.clear()
+
+    async def __aenter__(self):
+        return self
+
+    async def __aexit__(self, *exc):
+        self.close()
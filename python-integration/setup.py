@@ -4,6 +4,7 @@
 from __future__ import absolute_import
 from __future__ import print_function
 
+import sys
 
 from setuptools import Extension
 from setuptools import find_packages
@@ -21,8 +22,12 @@ setup(
     ext_modules=[
         Extension(
             'mypackage.cfunctions',
-            sources=['cfunctions.c'],
-            extra_compile_args = ['-Ofast']
+            sources=['cfunctions.c', 'shm_array.c', 'jobs.c', 'matrix.c', 'bigfib.c',
+                     '../lesson1/ripples.c'],
+            include_dirs=['../lesson1'],
+            extra_compile_args = ['-Ofast', '-fopenmp'],
+            extra_link_args = ['-fopenmp'],
+            libraries = (['rt'] if sys.platform.startswith('linux') else []) + ['pthread', 'm'],
         )
         
     ],
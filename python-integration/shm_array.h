@@ -0,0 +1,33 @@
+/*
+  shm_array.h -- numpy-compatible arrays in POSIX shared memory
+
+  See shm_array.c.
+ */
+#ifndef SHM_ARRAY_H
+#define SHM_ARRAY_H
+
+#include <stdint.h>
+
+#define SHM_ARRAY_MAGIC    "SHMARR1"
+#define SHM_ARRAY_MAX_DIMS 8
+
+/* Every shared-memory array starts with one of these, so that any process
+   that opens it by name knows what it's looking at. The data itself starts
+   data_offset bytes after the start of the header. */
+struct shm_array_header{
+  char     magic[8];    // SHM_ARRAY_MAGIC, written last when creating
+  char     dtype[8];    // a numpy type string, e.g. "<u8" or "<f4"
+  int64_t  itemsize;    // bytes per element
+  int64_t  ndim;
+  int64_t  shape[SHM_ARRAY_MAX_DIMS];
+  int64_t  nbytes;      // bytes of data (not including the header)
+  int64_t  data_offset;
+};
+
+void *shm_array_create(const char *name, const char *dtype, int64_t itemsize,
+                       int ndim, const int64_t *shape);
+void *shm_array_open(const char *name, struct shm_array_header *header);
+int shm_array_close(void *data);
+int shm_array_unlink(const char *name);
+
+#endif
@@ -0,0 +1,36 @@
+"""
+Checks that simulate_many() and simulate_range() count the whole steps of
+dx in L, even when L/dx comes out a hair under a whole number:
+
+    $ python setup.py build_ext --inplace
+    $ pytest test_simulate.py
+"""
+import numpy as np
+import pytest
+
+import mypackage
+
+
+# (L, dx, N): in double precision, 0.3/0.1 and 0.7/0.1 are just under 3 and 7
+EXACT = [(0.3, 0.1, 3), (0.7, 0.1, 7), (1.0, 0.001, 1000), (1.0, 0.3, 3), (1.0, 0.4, 2)]
+
+
+@pytest.mark.parametrize("L,dx,N", EXACT)
+def test_simulate_many_double(L, dx, N):
+    N_out, L_out = mypackage.simulate_many([L], [dx], double=True)
+    assert N_out[0] == N
+    assert L_out[0] == pytest.approx(N * dx)
+
+
+@pytest.mark.parametrize("L,dx,N", EXACT)
+def test_simulate_range_double(L, dx, N):
+    N_out, L_out = mypackage.simulate_range(L, 0.0, 1, dx, 0.0, 1, double=True)
+    assert N_out[0, 0] == N
+    assert L_out[0, 0] == pytest.approx(N * dx)
+
+
+def test_simulate_many_double_agrees_with_range():
+    N_many, _ = mypackage.simulate_many(np.array([[0.3], [0.7]]), np.array([0.1, 0.2]), double=True)
+    N_range, _ = mypackage.simulate_range(0.3, 0.4, 2, 0.1, 0.1, 2, double=True)
+    assert N_many.tolist() == [[3, 1], [7, 3]]
+    assert N_range.tolist() == N_many.tolist()